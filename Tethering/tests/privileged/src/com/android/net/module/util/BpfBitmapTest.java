@@ -18,10 +18,12 @@ package com.android.networkstack.tethering;
 
 import static com.android.networkstack.tethering.util.TetheringUtils.getTetheringJniLibraryName;
 
+import static org.junit.Assert.assertArrayEquals;
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertFalse;
 import static org.junit.Assert.assertNotNull;
 import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertThrows;
 import static org.junit.Assert.assertTrue;
 import static org.junit.Assert.fail;
 
@@ -100,4 +102,43 @@ public final class BpfBitmapTest {
         mTestBitmap.clear();
         assertTrue(mTestBitmap.isEmpty());
     }
+
+    @Test
+    public void testSetRange() throws Exception {
+        // Spans both words of the test bitmap, with partial words at both ends.
+        mTestBitmap.setRange(60, 100, true);
+        for (int i = 0; i < 128; ++i) assertEquals(i >= 60 && i <= 100, mTestBitmap.get(i));
+
+        mTestBitmap.setRange(61, 99, false);
+        for (int i = 0; i < 128; ++i) assertEquals(i == 60 || i == 100, mTestBitmap.get(i));
+
+        // Whole words, then a single index in the middle of one.
+        mTestBitmap.setRange(0, 127, true);
+        for (int i = 0; i < 128; ++i) assertTrue(mTestBitmap.get(i));
+        mTestBitmap.setRange(5, 5, false);
+        assertFalse(mTestBitmap.get(5));
+        assertTrue(mTestBitmap.get(4));
+        assertTrue(mTestBitmap.get(6));
+    }
+
+    @Test
+    public void testSetRangeRejectsInvalidRange() throws Exception {
+        assertThrows(IllegalArgumentException.class, () -> mTestBitmap.setRange(-1, 5, true));
+        assertThrows(IllegalArgumentException.class, () -> mTestBitmap.setRange(6, 5, true));
+        assertTrue(mTestBitmap.isEmpty());
+    }
+
+    @Test
+    public void testGetSetIndexes() throws Exception {
+        assertArrayEquals(new int[0], mTestBitmap.getSetIndexes());
+        for (int i : mTestData) {
+            mTestBitmap.set(i);
+        }
+        assertArrayEquals(mTestData, mTestBitmap.getSetIndexes());
+        mTestBitmap.setRange(100, 127, true);
+        final int[] indexes = mTestBitmap.getSetIndexes();
+        assertEquals(mTestData.length + 28, indexes.length);
+        assertEquals(100, indexes[mTestData.length]);
+        assertEquals(127, indexes[indexes.length - 1]);
+    }
 }
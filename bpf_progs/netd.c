@@ -83,17 +83,24 @@ static const bool TRACE_OFF = false;
 // only valid indexes are [0..CONFIGURATION_MAP_SIZE-1]
 DEFINE_BPF_MAP_RO_NETD(configuration_map, ARRAY, uint32_t, uint32_t, CONFIGURATION_MAP_SIZE)
 
-// TODO: consider whether we can merge some of these maps
-// for example it might be possible to merge 2 or 3 of:
-//   uid_counterset_map + uid_owner_map + uid_permission_map
+// TODO: consider whether uid_permission_map can also be merged into uid_owner_map,
+// like the per uid counter set was.
 DEFINE_BPF_MAP_RW_NETD(cookie_tag_map, HASH, uint64_t, UidTagValue, COOKIE_UID_MAP_SIZE)
-DEFINE_BPF_MAP_NO_NETD(uid_counterset_map, HASH, uint32_t, uint8_t, UID_COUNTERSET_MAP_SIZE)
 DEFINE_BPF_MAP_NO_NETD(app_uid_stats_map, HASH, uint32_t, StatsValue, APP_STATS_MAP_SIZE)
 DEFINE_BPF_MAP_RO_NETD(stats_map_A, HASH, StatsKey, StatsValue, STATS_MAP_SIZE)
 DEFINE_BPF_MAP_RO_NETD(stats_map_B, HASH, StatsKey, StatsValue, STATS_MAP_SIZE)
+// Indexed by StatsMapType. Lets the stats service drain a filling map before the next poll.
+DEFINE_BPF_MAP_NO_NETD(stats_map_health_map, ARRAY, uint32_t, StatsMapHealthValue,
+                       STATS_MAP_HEALTH_MAP_SIZE)
 DEFINE_BPF_MAP_NO_NETD(iface_stats_map, HASH, uint32_t, StatsValue, IFACE_STATS_MAP_SIZE)
+// Running total over all interfaces, so that reading it needs no map walk. Updated next to
+// iface_stats_map but not atomically with it, and it still counts once iface_stats_map is full,
+// so it need not equal the sum of that map at any given time. Per cpu, since every packet on
+// every cpu updates its single entry: readers sum the copies.
+DEFINE_BPF_MAP_NO_NETD(iface_stats_total_map, PERCPU_ARRAY, uint32_t, StatsValue,
+                       IFACE_STATS_TOTAL_MAP_SIZE)
 DEFINE_BPF_MAP_RO_NETD(uid_owner_map, HASH, uint32_t, UidOwnerValue, UID_OWNER_MAP_SIZE)
-DEFINE_BPF_MAP_RO_NETD(uid_permission_map, HASH, uint32_t, uint8_t, UID_OWNER_MAP_SIZE)
+DEFINE_BPF_MAP_RO_NETD(uid_permission_map, HASH, uint32_t, uint8_t, UID_PERMISSION_MAP_SIZE)
 DEFINE_BPF_MAP_NO_NETD(ingress_discard_map, HASH, IngressDiscardKey, IngressDiscardValue,
                        INGRESS_DISCARD_MAP_SIZE)
 
@@ -172,7 +179,7 @@ DEFINE_BPF_MAP_RO_NETD(data_saver_enabled_map, ARRAY, uint32_t, bool,
  * Especially since the number of packets is important for any future clat offload correction.
  * (which adjusts upward by 20 bytes per packet to account for ipv4 -> ipv6 header conversion)
  */
-#define DEFINE_UPDATE_STATS(the_stats_map, TypeOfKey)                                            \
+#define DEFINE_UPDATE_STATS_EXT(the_stats_map, TypeOfKey, note_insert)                           \
     static __always_inline inline void update_##the_stats_map(const struct __sk_buff* const skb, \
                                                               const TypeOfKey* const key,        \
                                                               const struct egress_bool egress,   \
@@ -180,8 +187,9 @@ DEFINE_BPF_MAP_RO_NETD(data_saver_enabled_map, ARRAY, uint32_t, bool,
         StatsValue* value = bpf_##the_stats_map##_lookup_elem(key);                              \
         if (!value) {                                                                            \
             StatsValue newValue = {};                                                            \
-            bpf_##the_stats_map##_update_elem(key, &newValue, BPF_NOEXIST);                      \
+            const int ret = bpf_##the_stats_map##_update_elem(key, &newValue, BPF_NOEXIST);      \
             value = bpf_##the_stats_map##_lookup_elem(key);                                      \
+            note_insert(ret, value);                                                             \
         }                                                                                        \
         if (value) {                                                                             \
             const int mtu = 1500;                                                                \
@@ -206,10 +214,35 @@ DEFINE_BPF_MAP_RO_NETD(data_saver_enabled_map, ARRAY, uint32_t, bool,
         }                                                                                        \
     }
 
+#define IGNORE_STATS_INSERT(ret, value) (void)(ret)
+#define DEFINE_UPDATE_STATS(the_stats_map, TypeOfKey) \
+    DEFINE_UPDATE_STATS_EXT(the_stats_map, TypeOfKey, IGNORE_STATS_INSERT)
+
+// ret is the result of adding a new entry to the selected stats map, and value is the entry
+// looked up afterwards: if that is missing too, the map was full and the packet goes uncounted.
+static __always_inline inline void note_stats_map_insert(const uint32_t selectedMap, const int ret,
+                                                         const StatsValue* const value) {
+    StatsMapHealthValue* health = bpf_stats_map_health_map_lookup_elem(&selectedMap);
+    if (!health) return;
+    if (!ret) __sync_fetch_and_add(&health->entries, 1);
+    if (!value) __sync_fetch_and_add(&health->insertFailures, 1);
+}
+#define NOTE_STATS_MAP_A_INSERT(ret, value) note_stats_map_insert(SELECT_MAP_A, ret, value)
+#define NOTE_STATS_MAP_B_INSERT(ret, value) note_stats_map_insert(SELECT_MAP_B, ret, value)
+
 DEFINE_UPDATE_STATS(app_uid_stats_map, uint32_t)
 DEFINE_UPDATE_STATS(iface_stats_map, uint32_t)
-DEFINE_UPDATE_STATS(stats_map_A, StatsKey)
-DEFINE_UPDATE_STATS(stats_map_B, StatsKey)
+DEFINE_UPDATE_STATS(iface_stats_total_map, uint32_t)
+DEFINE_UPDATE_STATS_EXT(stats_map_A, StatsKey, NOTE_STATS_MAP_A_INSERT)
+DEFINE_UPDATE_STATS_EXT(stats_map_B, StatsKey, NOTE_STATS_MAP_B_INSERT)
+
+static __always_inline inline void update_iface_stats(const struct __sk_buff* const skb,
+                                                      const struct egress_bool egress) {
+    uint32_t key = skb->ifindex;
+    update_iface_stats_map(skb, &key, egress, KVER_NONE);
+    const uint32_t totalKey = IFACE_STATS_TOTAL_KEY;
+    update_iface_stats_total_map(skb, &totalKey, egress, KVER_NONE);
+}
 
 // both of these return 0 on success or -EFAULT on failure (and zero out the buffer)
 static __always_inline inline int bpf_skb_load_bytes_net(const struct __sk_buff* const skb,
@@ -398,7 +431,9 @@ static __always_inline inline bool ingress_should_discard(struct __sk_buff* skb,
     return true;  // disallowed interface
 }
 
+// uidEntry is uid's uid_owner_map entry, if any, looked up by the caller.
 static __always_inline inline int bpf_owner_match(struct __sk_buff* skb, uint32_t uid,
+                                                  const UidOwnerValue* const uidEntry,
                                                   const struct egress_bool egress,
                                                   const struct kver_uint kver) {
     if (is_system_uid(uid)) return PASS;
@@ -407,7 +442,6 @@ static __always_inline inline int bpf_owner_match(struct __sk_buff* skb, uint32_
 
     BpfConfig enabledRules = getConfig(UID_RULES_CONFIGURATION_KEY);
 
-    UidOwnerValue* uidEntry = bpf_uid_owner_map_lookup_elem(&uid);
     uint32_t uidRules = uidEntry ? uidEntry->rule : 0;
     uint32_t allowed_iif = uidEntry ? uidEntry->iif : 0;
 
@@ -474,7 +508,11 @@ static __always_inline inline int bpf_traffic_account(struct __sk_buff* skb,
     // CLAT daemon receives via an untagged AF_PACKET socket.
     if (egress.egress && uid == AID_CLAT) return PASS;
 
-    int match = bpf_owner_match(skb, sock_uid, egress, kver);
+    // The firewall rules and the counter set share an entry, so in the common case of a socket
+    // that is untagged or tagged with its own uid a single lookup serves both.
+    UidOwnerValue* sockUidEntry = bpf_uid_owner_map_lookup_elem(&sock_uid);
+
+    int match = bpf_owner_match(skb, sock_uid, sockUidEntry, egress, kver);
 
 // Workaround for secureVPN with VpnIsolation enabled, refer to b/159994981 for details.
 // Keep TAG_SYSTEM_DNS in sync with DnsResolver/include/netd_resolv/resolv.h
@@ -492,8 +530,9 @@ static __always_inline inline int bpf_traffic_account(struct __sk_buff* skb,
 
     StatsKey key = {.uid = uid, .tag = tag, .counterSet = 0, .ifaceIndex = skb->ifindex};
 
-    uint8_t* counterSet = bpf_uid_counterset_map_lookup_elem(&uid);
-    if (counterSet) key.counterSet = (uint32_t)*counterSet;
+    UidOwnerValue* uidEntry = (uid == sock_uid) ? sockUidEntry
+                                                : bpf_uid_owner_map_lookup_elem(&uid);
+    if (uidEntry) key.counterSet = (uint32_t)uidEntry->counterSet;
 
     uint32_t mapSettingKey = CURRENT_STATS_MAP_CONFIGURATION_KEY;
     uint32_t* selectedMap = bpf_configuration_map_lookup_elem(&mapSettingKey);
@@ -591,8 +630,7 @@ DEFINE_XTBPF_PROG("skfilter/egress/xtbpf", AID_ROOT, AID_NET_ADMIN, xt_bpf_egres
         if (utag && utag->uid == AID_CLAT) return BPF_NOMATCH;
     }
 
-    uint32_t key = skb->ifindex;
-    update_iface_stats_map(skb, &key, EGRESS, KVER_NONE);
+    update_iface_stats(skb, EGRESS);
     return BPF_MATCH;
 }
 
@@ -604,8 +642,7 @@ DEFINE_XTBPF_PROG("skfilter/ingress/xtbpf", AID_ROOT, AID_NET_ADMIN, xt_bpf_ingr
     // It will be accounted for on the v4-* clat interface instead.
     // Keep that in mind when moving this out of iptables xt_bpf and into tc ingress (or xdp).
 
-    uint32_t key = skb->ifindex;
-    update_iface_stats_map(skb, &key, INGRESS, KVER_NONE);
+    update_iface_stats(skb, INGRESS);
     return BPF_MATCH;
 }
 
@@ -614,8 +651,7 @@ DEFINE_SYS_BPF_PROG("schedact/ingress/account", AID_ROOT, AID_NET_ADMIN,
 (struct __sk_buff* skb) {
     if (is_received_skb(skb)) {
         // Account for ingress traffic before tc drops it.
-        uint32_t key = skb->ifindex;
-        update_iface_stats_map(skb, &key, INGRESS, KVER_NONE);
+        update_iface_stats(skb, INGRESS);
     }
     return TC_ACT_UNSPEC;
 }
@@ -56,6 +56,13 @@ typedef struct {
 } StatsValue;
 STRUCT_SIZE(StatsValue, 4 * 8);  // 32
 
+// Fill level of one of the two stats maps, indexed by StatsMapType in stats_map_health_map.
+typedef struct {
+    uint64_t entries;         // entries added since the map was last drained (an estimate)
+    uint64_t insertFailures;  // entries dropped since then because the map was full
+} StatsMapHealthValue;
+STRUCT_SIZE(StatsMapHealthValue, 2 * 8);  // 16
+
 #ifdef __cplusplus
 static inline StatsValue& operator+=(StatsValue& lhs, const StatsValue& rhs) {
     lhs.rxPackets += rhs.rxPackets;
@@ -99,31 +106,37 @@ STRUCT_SIZE(PacketTrace, 8+4+4 + 4+4 + 2+2 + 1+1+1+1);
 //              elem_size * number_of_CPU
 // And the cost of each map currently used is(assume the device have 8 CPUs):
 // cookie_tag_map:      key:  8 bytes, value:  8 bytes, cost:  822592 bytes    =   823Kbytes
-// uid_counter_set_map: key:  4 bytes, value:  1 bytes, cost:  145216 bytes    =   145Kbytes
 // app_uid_stats_map:   key:  4 bytes, value: 32 bytes, cost: 1062784 bytes    =  1063Kbytes
 // uid_stats_map:       key: 16 bytes, value: 32 bytes, cost: 1142848 bytes    =  1143Kbytes
 // tag_stats_map:       key: 16 bytes, value: 32 bytes, cost: 1142848 bytes    =  1143Kbytes
 // iface_index_name_map:key:  4 bytes, value: 16 bytes, cost:   80896 bytes    =    81Kbytes
 // iface_stats_map:     key:  4 bytes, value: 32 bytes, cost:   97024 bytes    =    97Kbytes
+// iface_stats_total_map:key: 4 bytes, value: 32 bytes, cost:     256 bytes    =     0Kbytes
+// stats_map_health_map:key:  4 bytes, value: 16 bytes, cost:      32 bytes    =     0Kbytes
 // dozable_uid_map:     key:  4 bytes, value:  1 bytes, cost:  145216 bytes    =   145Kbytes
 // standby_uid_map:     key:  4 bytes, value:  1 bytes, cost:  145216 bytes    =   145Kbytes
 // powersave_uid_map:   key:  4 bytes, value:  1 bytes, cost:  145216 bytes    =   145Kbytes
+// uid_owner_map:       key:  4 bytes, value: 12 bytes, cost:  643584 bytes    =   644Kbytes
 // packet_trace_ringbuf:key:  0 bytes, value: 24 bytes, cost:   32768 bytes    =    32Kbytes
-// total:                                                                         4962Kbytes
-// It takes maximum 4.9MB kernel memory space if all maps are full, which requires any devices
-// running this module to have a memlock rlimit to be larger then 5MB. In the old qtaguid module,
+// total:                                                                         5461Kbytes
+// It takes maximum 5.5MB kernel memory space if all maps are full, which requires any devices
+// running this module to have a memlock rlimit to be larger then 6MB. In the old qtaguid module,
 // we don't have a total limit for data entries but only have limitation of tags each uid can have.
 // (default is 1024 in kernel);
 
 // 'static' - otherwise these constants end up in .rodata in the resulting .o post compilation
 static const int COOKIE_UID_MAP_SIZE = 10000;
-static const int UID_COUNTERSET_MAP_SIZE = 4000;
 static const int APP_STATS_MAP_SIZE = 10000;
 static const int STATS_MAP_SIZE = 5000;
 static const int IFACE_INDEX_NAME_MAP_SIZE = 1000;
 static const int IFACE_STATS_MAP_SIZE = 1000;
+static const int IFACE_STATS_TOTAL_MAP_SIZE = 1;
+static const int STATS_MAP_HEALTH_MAP_SIZE = 2;
 static const int CONFIGURATION_MAP_SIZE = 2;
-static const int UID_OWNER_MAP_SIZE = 4000;
+// uid_owner_map holds both the firewall rules and the counter set of a uid, which used to live in
+// two maps of 4000 entries each, so it keeps their combined capacity.
+static const int UID_OWNER_MAP_SIZE = 8000;
+static const int UID_PERMISSION_MAP_SIZE = 4000;
 static const int INGRESS_DISCARD_MAP_SIZE = 100;
 static const int PACKET_TRACE_BUF_SIZE = 32 * 1024;
 static const int DATA_SAVER_ENABLED_MAP_SIZE = 1;
@@ -161,12 +174,13 @@ ASSERT_STRING_EQUAL(XT_BPF_DENYLIST_PROG_PATH,  BPF_NETD_PATH "prog_netd_skfilte
 #define TC_BPF_INGRESS_ACCOUNT_PROG_PATH BPF_NETD_PATH TC_BPF_INGRESS_ACCOUNT_PROG_NAME
 
 #define COOKIE_TAG_MAP_PATH BPF_NETD_PATH "map_netd_cookie_tag_map"
-#define UID_COUNTERSET_MAP_PATH BPF_NETD_PATH "map_netd_uid_counterset_map"
 #define APP_UID_STATS_MAP_PATH BPF_NETD_PATH "map_netd_app_uid_stats_map"
 #define STATS_MAP_A_PATH BPF_NETD_PATH "map_netd_stats_map_A"
 #define STATS_MAP_B_PATH BPF_NETD_PATH "map_netd_stats_map_B"
+#define STATS_MAP_HEALTH_MAP_PATH BPF_NETD_PATH "map_netd_stats_map_health_map"
 #define IFACE_INDEX_NAME_MAP_PATH BPF_NETD_PATH "map_netd_iface_index_name_map"
 #define IFACE_STATS_MAP_PATH BPF_NETD_PATH "map_netd_iface_stats_map"
+#define IFACE_STATS_TOTAL_MAP_PATH BPF_NETD_PATH "map_netd_iface_stats_total_map"
 #define CONFIGURATION_MAP_PATH BPF_NETD_PATH "map_netd_configuration_map"
 #define UID_OWNER_MAP_PATH BPF_NETD_PATH "map_netd_uid_owner_map"
 #define UID_PERMISSION_MAP_PATH BPF_NETD_PATH "map_netd_uid_permission_map"
@@ -218,8 +232,12 @@ typedef struct {
     uint32_t iif;
     // A bitmask of enum values in UidOwnerMatchType.
     uint32_t rule;
+    // The counter set the uid's traffic is accounted to, written by NetworkStatsService. Kept in
+    // the same entry as the firewall rules so that accounting needs a single lookup per packet.
+    uint8_t counterSet;
+    uint8_t pad[3];
 } UidOwnerValue;
-STRUCT_SIZE(UidOwnerValue, 2 * 4);  // 8
+STRUCT_SIZE(UidOwnerValue, 2 * 4 + 1 + 3);  // 12
 
 typedef struct {
     // The destination ip of the incoming packet.  IPv4 uses IPv4-mapped IPv6 address format.
@@ -239,6 +257,8 @@ STRUCT_SIZE(IngressDiscardValue, 2 * 4);  // 8
 #define CURRENT_STATS_MAP_CONFIGURATION_KEY 1
 // Entry in the data saver enabled map that stores whether data saver is enabled or not.
 #define DATA_SAVER_ENABLED_KEY 0
+// Entry in the iface stats total map that stores the sum over all interfaces.
+#define IFACE_STATS_TOTAL_KEY 0
 
 #undef STRUCT_SIZE
 
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This object is not part of the tethering apex. netd_updatable_unit_test ships it as test data
+// and loads it itself, so these programs and maps only exist while that test runs.
+#define THIS_BPF_PROGRAM_IS_FOR_TEST_PURPOSES_ONLY
+
+#include "bpf_helpers.h"
+
+// The uid_owner_map layout before the per uid counter set was folded into uid_owner_map...
+typedef struct {
+    uint32_t iif;
+    uint32_t rule;
+} TestUidOwnerValue;
+DEFINE_BPF_MAP_GRW(uid_owner_split_map, HASH, uint32_t, TestUidOwnerValue, 16, AID_ROOT)
+DEFINE_BPF_MAP_GRW(uid_counterset_split_map, HASH, uint32_t, uint8_t, 16, AID_ROOT)
+
+// ...and the combined one netd.c uses now.
+typedef struct {
+    uint32_t iif;
+    uint32_t rule;
+    uint8_t counterSet;
+    uint8_t pad[3];
+} TestUidOwnerCounterSetValue;
+DEFINE_BPF_MAP_GRW(uid_owner_combined_map, HASH, uint32_t, TestUidOwnerCounterSetValue, 16,
+                   AID_ROOT)
+
+// Both programs take the uid from the first 4 bytes of the packet and return (rule << 8 | set).
+static inline __always_inline uint32_t test_packet_uid(struct __sk_buff* skb) {
+    uint32_t uid = 0;
+    bpf_skb_load_bytes(skb, 0, &uid, sizeof(uid));
+    return uid;
+}
+
+DEFINE_BPF_PROG_KVER("skfilter/uid_owner_split", AID_ROOT, AID_ROOT,
+                     uid_owner_split_test, KVER_4_14)
+(struct __sk_buff* skb) {
+    uint32_t uid = test_packet_uid(skb);
+    TestUidOwnerValue* owner = bpf_uid_owner_split_map_lookup_elem(&uid);
+    uint8_t* counterSet = bpf_uid_counterset_split_map_lookup_elem(&uid);
+    uint32_t rule = owner ? owner->rule : 0;
+    uint32_t set = counterSet ? *counterSet : 0;
+    return (rule << 8) | set;
+}
+
+DEFINE_BPF_PROG_KVER("skfilter/uid_owner_combined", AID_ROOT, AID_ROOT,
+                     uid_owner_combined_test, KVER_4_14)
+(struct __sk_buff* skb) {
+    uint32_t uid = test_packet_uid(skb);
+    TestUidOwnerCounterSetValue* owner = bpf_uid_owner_combined_map_lookup_elem(&uid);
+    uint32_t rule = owner ? owner->rule : 0;
+    uint32_t set = owner ? owner->counterSet : 0;
+    return (rule << 8) | set;
+}
+
+LICENSE("Apache 2.0");
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/prctl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
@@ -42,6 +43,7 @@
 
 #include "clatd.h"
 #include "checksum.h"
+#include "clatd_control.h"
 #include "config.h"
 #include "dump.h"
 #include "logging.h"
@@ -51,6 +53,19 @@ struct clat_config Global_Clatd_Config;
 
 volatile sig_atomic_t running = 1;
 
+/* function: tunnel_removed
+ * called when the tun interface or packet socket goes away. A persistent clatd waits to be
+ * re-armed, any other clatd stops.
+ *   tunnel - tun device data
+ */
+static void tunnel_removed(struct tun_data *tunnel) {
+  if (tunnel->control_fd >= 0) {
+    disarm_tunnel(tunnel);
+  } else {
+    running = 0;
+  }
+}
+
 // reads IPv6 packet from AF_PACKET socket, translates to IPv4, writes to tun
 void process_packet_6_to_4(struct tun_data *tunnel) {
   // ethernet header is 14 bytes, plus 4 for a normal VLAN tag or 8 for Q-in-Q
@@ -81,7 +96,7 @@ void process_packet_6_to_4(struct tun_data *tunnel) {
     return;
   } else if (readlen == 0) {
     logmsg(ANDROID_LOG_WARN, "%s: packet socket removed?", __func__);
-    running = 0;
+    tunnel_removed(tunnel);
     return;
   } else if (readlen >= sizeof(buf)) {
     logmsg(ANDROID_LOG_WARN, "%s: read truncation - ignoring pkt", __func__);
@@ -164,7 +179,7 @@ void process_packet_4_to_6(struct tun_data *tunnel) {
     return;
   } else if (readlen == 0) {
     logmsg(ANDROID_LOG_WARN, "%s: tun interface removed", __func__);
-    running = 0;
+    tunnel_removed(tunnel);
     return;
   } else if (readlen >= sizeof(buf)) {
     logmsg(ANDROID_LOG_WARN, "%s: read truncation - ignoring pkt", __func__);
@@ -282,14 +297,17 @@ void event_loop(struct tun_data *tunnel) {
   // (with the other 16 chosen to guarantee checksum neutrality) this seems like a remote
   // concern...
   // TODO: actually perform true DAD
-  send_dad(tunnel->write_fd6, &Global_Clatd_Config.ipv6_local_subnet);
-
-  struct pollfd wait_fd[] = {
-    { tunnel->read_fd6, POLLIN, 0 },
-    { tunnel->fd4, POLLIN, 0 },
-  };
+  if (tunnel->write_fd6 >= 0) send_dad(tunnel->write_fd6, &Global_Clatd_Config.ipv6_local_subnet);
 
   while (running) {
+    // Rebuilt every time, since a control message may replace the tunnel's fds. poll() ignores
+    // negative fds, ie. the tunnel of a disarmed clatd or the control socket of a one-shot one.
+    struct pollfd wait_fd[] = {
+      { tunnel->read_fd6, POLLIN, 0 },
+      { tunnel->fd4, POLLIN, 0 },
+      { tunnel->control_fd, POLLIN, 0 },
+    };
+
     if (poll(wait_fd, ARRAY_SIZE(wait_fd), -1) == -1) {
       if (errno != EINTR) {
         logmsg(ANDROID_LOG_WARN, "event_loop/poll returned an error: %s", strerror(errno));
@@ -300,8 +318,132 @@ void event_loop(struct tun_data *tunnel) {
       // subsequent poll() will return immediately with POLLERR again,
       // causing this code to spin in a loop. Calling read() will clear the
       // socket error flag instead.
-      if (wait_fd[0].revents) process_packet_6_to_4(tunnel);
-      if (wait_fd[1].revents) process_packet_4_to_6(tunnel);
+      if (wait_fd[0].revents && tunnel->read_fd6 >= 0) process_packet_6_to_4(tunnel);
+      if (wait_fd[1].revents && tunnel->fd4 >= 0) process_packet_4_to_6(tunnel);
+      if (wait_fd[2].revents) handle_control_message(tunnel);
     }
   }
 }
+
+/* function: disarm_tunnel
+ * closes the tun fd and the IPv6 sockets
+ *   tunnel - tun device data
+ */
+void disarm_tunnel(struct tun_data *tunnel) {
+  if (tunnel->fd4 >= 0 || tunnel->read_fd6 >= 0 || tunnel->write_fd6 >= 0) {
+    logmsg(ANDROID_LOG_INFO, "Disarming clat on %s", tunnel->device4);
+  }
+  if (tunnel->fd4 >= 0) close(tunnel->fd4);
+  if (tunnel->read_fd6 >= 0) close(tunnel->read_fd6);
+  if (tunnel->write_fd6 >= 0) close(tunnel->write_fd6);
+  tunnel->fd4 = tunnel->read_fd6 = tunnel->write_fd6 = -1;
+}
+
+/* function: arm_tunnel
+ * switches to the interface, addresses and fds of a CLATD_CONTROL_ARM message
+ *   tunnel - tun device data
+ *   msg    - the message
+ *   fds    - tun fd, read socket and write socket. Owned by the tunnel on success.
+ *   returns: 0 on success, or a positive errno
+ */
+static int arm_tunnel(struct tun_data *tunnel, const struct clatd_control_msg *msg,
+                      const int fds[CLATD_CONTROL_ARM_FDS]) {
+  // Global_Clatd_Config.native_ipv6_interface must outlive the message.
+  static char uplink_interface[IFNAMSIZ];
+
+  if (!memchr(msg->uplink_interface, '\0', sizeof(msg->uplink_interface)) ||
+      !msg->uplink_interface[0]) {
+    return EINVAL;
+  }
+  char device4[IFNAMSIZ];
+  if (snprintf(device4, sizeof(device4), "v4-%s", msg->uplink_interface) >= (int)sizeof(device4)) {
+    return EINVAL;
+  }
+
+  disarm_tunnel(tunnel);
+
+  memcpy(uplink_interface, msg->uplink_interface, sizeof(uplink_interface));
+  memcpy(tunnel->device4, device4, sizeof(tunnel->device4));
+  tunnel->fd4 = fds[0];
+  tunnel->read_fd6 = fds[1];
+  tunnel->write_fd6 = fds[2];
+
+  Global_Clatd_Config.native_ipv6_interface = uplink_interface;
+  Global_Clatd_Config.plat_subnet = msg->plat_subnet;
+  Global_Clatd_Config.ipv4_local_subnet = msg->ipv4_local_subnet;
+  Global_Clatd_Config.ipv6_local_subnet = msg->ipv6_local_subnet;
+
+  char v4_str[INET_ADDRSTRLEN], v6_str[INET6_ADDRSTRLEN];
+  inet_ntop(AF_INET, &msg->ipv4_local_subnet, v4_str, sizeof(v4_str));
+  inet_ntop(AF_INET6, &msg->ipv6_local_subnet, v6_str, sizeof(v6_str));
+  logmsg(ANDROID_LOG_INFO, "Arming clat on %s v4=%s v6=%s", uplink_interface, v4_str, v6_str);
+
+  // See event_loop().
+  send_dad(tunnel->write_fd6, &Global_Clatd_Config.ipv6_local_subnet);
+  return 0;
+}
+
+/* function: handle_control_message
+ * reads one message from the control socket of a persistent clatd, acts on it and replies
+ *   tunnel - tun device data
+ */
+void handle_control_message(struct tun_data *tunnel) {
+  struct clatd_control_msg msg;
+  struct iovec iov = {
+    .iov_base = &msg,
+    .iov_len = sizeof(msg),
+  };
+  union {
+    char buf[CMSG_SPACE(CLATD_CONTROL_ARM_FDS * sizeof(int))];
+    struct cmsghdr align;
+  } cmsg_buf;
+  struct msghdr msgh = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = cmsg_buf.buf,
+    .msg_controllen = sizeof(cmsg_buf.buf),
+  };
+  ssize_t len = recvmsg(tunnel->control_fd, &msgh, MSG_CMSG_CLOEXEC);
+
+  if (len < 0) {
+    if (errno != EAGAIN && errno != EINTR) {
+      logmsg(ANDROID_LOG_WARN, "%s: read error: %s", __func__, strerror(errno));
+    }
+    return;
+  } else if (len == 0) {
+    logmsg(ANDROID_LOG_INFO, "%s: control socket closed", __func__);
+    running = 0;
+    return;
+  }
+
+  int fds[CLATD_CONTROL_ARM_FDS] = { -1, -1, -1 };
+  size_t nfds = 0;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgh); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgh, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      if (nfds > ARRAY_SIZE(fds)) nfds = ARRAY_SIZE(fds);
+      memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+      break;
+    }
+  }
+
+  int32_t err = 0;
+  if (len != sizeof(msg) || (msgh.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+    err = EINVAL;
+  } else if (msg.cmd == CLATD_CONTROL_ARM) {
+    err = (nfds == CLATD_CONTROL_ARM_FDS) ? arm_tunnel(tunnel, &msg, fds) : EBADF;
+  } else if (msg.cmd == CLATD_CONTROL_DISARM) {
+    disarm_tunnel(tunnel);
+  } else {
+    err = EOPNOTSUPP;
+  }
+
+  // Unless arm_tunnel() took them, the fds are ours to close.
+  if (err || msg.cmd != CLATD_CONTROL_ARM) {
+    for (size_t i = 0; i < nfds; i++) close(fds[i]);
+  }
+
+  if (send(tunnel->control_fd, &err, sizeof(err), MSG_NOSIGNAL) != sizeof(err)) {
+    logmsg(ANDROID_LOG_WARN, "%s: reply failed: %s", __func__, strerror(errno));
+  }
+}
@@ -55,6 +55,8 @@ struct tun_data;
 extern volatile sig_atomic_t running;
 
 void event_loop(struct tun_data *tunnel);
+void disarm_tunnel(struct tun_data *tunnel);
+void handle_control_message(struct tun_data *tunnel);
 
 /* function: parse_int
  * parses a string as a decimal/hex/octal signed integer
@@ -21,8 +21,11 @@
 #include <arpa/inet.h>
 #include <linux/if_packet.h>
 #include <netinet/in6.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
 
@@ -32,6 +35,7 @@
 extern "C" {
 #include "checksum.h"
 #include "clatd.h"
+#include "clatd_control.h"
 #include "config.h"
 #include "translate.h"
 }
@@ -833,3 +837,97 @@ TEST_F(ClatdTest, TranslateChecksumNeutral) {
   check_translate_checksum_neutral(udp_ipv4, sizeof(udp_ipv4), sizeof(udp_ipv4) + 20,
                                    "UDP/IPv4 -> UDP/IPv6 checksum neutral");
 }
+
+// Sends a control message to clatd, with nfds fds attached.
+void send_control_msg(int sock, const clatd_control_msg &msg, const int *fds, size_t nfds) {
+  struct iovec iov = {
+    .iov_base = const_cast<clatd_control_msg *>(&msg),
+    .iov_len = sizeof(msg),
+  };
+  union {
+    char buf[CMSG_SPACE(CLATD_CONTROL_ARM_FDS * sizeof(int))];
+    struct cmsghdr align;
+  } cmsg_buf = {};
+  struct msghdr msgh = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+  };
+  if (nfds) {
+    msgh.msg_control = cmsg_buf.buf;
+    msgh.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+  }
+  ASSERT_EQ((ssize_t)sizeof(msg), sendmsg(sock, &msgh, 0));
+}
+
+int32_t read_control_reply(int sock) {
+  int32_t err = -1;
+  EXPECT_EQ((ssize_t)sizeof(err), read(sock, &err, sizeof(err)));
+  return err;
+}
+
+TEST_F(ClatdTest, ControlSocket) {
+  int control[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, control));
+  struct tun_data tunnel = {
+    .read_fd6 = -1,
+    .write_fd6 = -1,
+    .fd4 = -1,
+    .control_fd = control[1],
+  };
+
+  clatd_control_msg msg = { .cmd = CLATD_CONTROL_ARM };
+  strlcpy(msg.uplink_interface, sTun.name().c_str(), sizeof(msg.uplink_interface));
+  inet_pton(AF_INET6, kIPv6PlatSubnet, &msg.plat_subnet);
+  inet_pton(AF_INET, "192.0.0.5", &msg.ipv4_local_subnet);
+  inet_pton(AF_INET6, "2001:db8::5", &msg.ipv6_local_subnet);
+
+  // Arming without fds is refused, and leaves clatd idle.
+  send_control_msg(control[0], msg, nullptr, 0);
+  handle_control_message(&tunnel);
+  EXPECT_EQ(EBADF, read_control_reply(control[0]));
+  EXPECT_EQ(-1, tunnel.fd4);
+
+  // Any fds will do, since nothing is translated.
+  int fds[CLATD_CONTROL_ARM_FDS];
+  for (int &fd : fds) fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+  send_control_msg(control[0], msg, fds, CLATD_CONTROL_ARM_FDS);
+  for (int fd : fds) close(fd);
+  handle_control_message(&tunnel);
+  EXPECT_EQ(0, read_control_reply(control[0]));
+  EXPECT_GE(tunnel.fd4, 0);
+  EXPECT_GE(tunnel.read_fd6, 0);
+  EXPECT_GE(tunnel.write_fd6, 0);
+  EXPECT_EQ("v4-" + sTun.name(), tunnel.device4);
+  EXPECT_EQ(sTun.name(), Global_Clatd_Config.native_ipv6_interface);
+  EXPECT_EQ(inet_addr("192.0.0.5"), Global_Clatd_Config.ipv4_local_subnet.s_addr);
+  expect_ipv6_addr_equal(&msg.ipv6_local_subnet, &Global_Clatd_Config.ipv6_local_subnet);
+
+  // Unknown commands are refused and change nothing.
+  const int fd4 = tunnel.fd4;
+  msg.cmd = 0;
+  send_control_msg(control[0], msg, nullptr, 0);
+  handle_control_message(&tunnel);
+  EXPECT_EQ(EOPNOTSUPP, read_control_reply(control[0]));
+  EXPECT_EQ(fd4, tunnel.fd4);
+
+  msg.cmd = CLATD_CONTROL_DISARM;
+  send_control_msg(control[0], msg, nullptr, 0);
+  handle_control_message(&tunnel);
+  EXPECT_EQ(0, read_control_reply(control[0]));
+  EXPECT_EQ(-1, tunnel.fd4);
+  EXPECT_EQ(-1, tunnel.read_fd6);
+  EXPECT_EQ(-1, tunnel.write_fd6);
+  EXPECT_EQ(-1, fcntl(fd4, F_GETFD));
+
+  // Closing the control socket stops clatd.
+  close(control[0]);
+  handle_control_message(&tunnel);
+  EXPECT_EQ(0, running);
+  running = 1;
+  close(control[1]);
+}
@@ -24,6 +24,8 @@
 struct tun_data {
   char device4[IFNAMSIZ];
   int read_fd6, write_fd6, fd4;
+  // Control socket of a persistent clatd, or -1. See clatd_control.h.
+  int control_fd;
 };
 
 struct clat_config {
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * clatd_control.h - control protocol of a persistent clatd
+ */
+#ifndef __CLATD_CONTROL_H__
+#define __CLATD_CONTROL_H__
+
+#include <linux/if.h>
+#include <netinet/in.h>
+#include <stdint.h>
+
+// A clatd started with -c reads these messages from the given SOCK_SEQPACKET socket, instead of
+// exiting when its interface goes away. This lets the caller move it from one uplink interface to
+// another without spawning a new process.
+//
+// After every message clatd replies with an int32_t: 0 on success, or a positive errno.
+// clatd exits when the control socket is closed.
+
+// Start translating on a new interface. The message carries the tun fd, the packet socket to read
+// from and the raw socket to write to, in that order, as SCM_RIGHTS. Any previous interface is
+// dropped first.
+#define CLATD_CONTROL_ARM 1
+// Close the tun fd and sockets and wait for the next CLATD_CONTROL_ARM.
+#define CLATD_CONTROL_DISARM 2
+
+#define CLATD_CONTROL_ARM_FDS 3
+
+struct clatd_control_msg {
+  uint32_t cmd;
+  // NUL terminated.
+  char uplink_interface[IFNAMSIZ];
+  struct in6_addr plat_subnet;
+  struct in_addr ipv4_local_subnet;
+  struct in6_addr ipv6_local_subnet;
+};
+
+#endif /* __CLATD_CONTROL_H__ */
@@ -51,20 +51,27 @@ void print_help() {
   printf("-t [tun file descriptor number]\n");
   printf("-r [read socket descriptor number]\n");
   printf("-w [write socket descriptor number]\n");
+  printf("-c [control socket descriptor number]\n");
+  printf("   with -c, the other arguments are optional and clatd can be re-armed\n");
 }
 
 /* function: main
  * allocate and setup the tun device, then run the event loop
  */
 int main(int argc, char **argv) {
-  struct tun_data tunnel;
+  struct tun_data tunnel = {
+    .read_fd6 = -1,
+    .write_fd6 = -1,
+    .fd4 = -1,
+    .control_fd = -1,
+  };
   int opt;
   char *uplink_interface = NULL, *plat_prefix = NULL;
   char *v4_addr = NULL, *v6_addr = NULL, *tunfd_str = NULL, *read_sock_str = NULL,
-       *write_sock_str = NULL;
+       *write_sock_str = NULL, *control_sock_str = NULL;
   unsigned len;
 
-  while ((opt = getopt(argc, argv, "i:p:4:6:t:r:w:h")) != -1) {
+  while ((opt = getopt(argc, argv, "i:p:4:6:t:r:w:c:h")) != -1) {
     switch (opt) {
       case 'i':
         uplink_interface = optarg;
@@ -87,6 +94,9 @@ int main(int argc, char **argv) {
       case 'w':
         write_sock_str = optarg;
         break;
+      case 'c':
+        control_sock_str = optarg;
+        break;
       case 'h':
         print_help();
         exit(0);
@@ -96,6 +106,25 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (control_sock_str != NULL &&
+      (!parse_int(control_sock_str, &tunnel.control_fd) || tunnel.control_fd < 0)) {
+    logmsg(ANDROID_LOG_FATAL, "invalid control socket %s", control_sock_str);
+    exit(1);
+  }
+
+  // A persistent clatd may start out idle, and wait to be armed over the control socket.
+  if (tunnel.control_fd >= 0 && uplink_interface == NULL) {
+    logmsg(ANDROID_LOG_INFO, "Starting idle clat version %s", CLATD_VERSION);
+    if (signal(SIGTERM, stop_loop) == SIG_ERR) {
+      logmsg(ANDROID_LOG_FATAL, "sigterm handler failed: %s", strerror(errno));
+      exit(1);
+    }
+    event_loop(&tunnel);
+    disarm_tunnel(&tunnel);
+    logmsg(ANDROID_LOG_INFO, "Shutting down persistent clat");
+    return 0;
+  }
+
   if (uplink_interface == NULL) {
     logmsg(ANDROID_LOG_FATAL, "clatd called without an interface");
     exit(1);
@@ -105,7 +134,7 @@ int main(int argc, char **argv) {
     logmsg(ANDROID_LOG_FATAL, "invalid tunfd %s", tunfd_str);
     exit(1);
   }
-  if (!tunnel.fd4) {
+  if (tunnel.fd4 < 0) {
     logmsg(ANDROID_LOG_FATAL, "no tunfd specified on commandline.");
     exit(1);
   }
@@ -114,7 +143,7 @@ int main(int argc, char **argv) {
     logmsg(ANDROID_LOG_FATAL, "invalid read socket %s", read_sock_str);
     exit(1);
   }
-  if (!tunnel.read_fd6) {
+  if (tunnel.read_fd6 < 0) {
     logmsg(ANDROID_LOG_FATAL, "no read_fd6 specified on commandline.");
     exit(1);
   }
@@ -123,7 +152,7 @@ int main(int argc, char **argv) {
     logmsg(ANDROID_LOG_FATAL, "invalid write socket %s", write_sock_str);
     exit(1);
   }
-  if (!tunnel.write_fd6) {
+  if (tunnel.write_fd6 < 0) {
     logmsg(ANDROID_LOG_FATAL, "no write_fd6 specified on commandline.");
     exit(1);
   }
@@ -190,18 +219,21 @@ int main(int argc, char **argv) {
 
   event_loop(&tunnel);
 
-  logmsg(ANDROID_LOG_INFO, "Shutting down clat on %s", uplink_interface);
+  // A persistent clatd may have been re-armed on another interface since it started.
+  const char *current_uplink = Global_Clatd_Config.native_ipv6_interface;
+  logmsg(ANDROID_LOG_INFO, "Shutting down clat on %s", current_uplink);
 
-  if (running) {
-    logmsg(ANDROID_LOG_INFO, "Clatd on %s waiting for SIGTERM", uplink_interface);
+  // A persistent clatd only gets here on SIGTERM or once its owner has closed the control socket.
+  if (running && tunnel.control_fd < 0) {
+    logmsg(ANDROID_LOG_INFO, "Clatd on %s waiting for SIGTERM", current_uplink);
     // let's give higher level java code 15 seconds to kill us,
     // but eventually terminate anyway, in case system server forgets about us...
     // sleep() should be interrupted by SIGTERM, the handler should clear running
     sleep(15);
-    logmsg(ANDROID_LOG_INFO, "Clatd on %s %s SIGTERM", uplink_interface,
+    logmsg(ANDROID_LOG_INFO, "Clatd on %s %s SIGTERM", current_uplink,
            running ? "timed out waiting for" : "received");
   } else {
-    logmsg(ANDROID_LOG_INFO, "Clatd on %s already received SIGTERM", uplink_interface);
+    logmsg(ANDROID_LOG_INFO, "Clatd on %s already received SIGTERM", current_uplink);
   }
   return 0;
 }
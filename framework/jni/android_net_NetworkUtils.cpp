@@ -22,11 +22,19 @@
 #include <linux/tcp.h>
 #include <netinet/in.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 #include <bpf/BpfClassic.h>
 #include <bpf/KernelUtils.h>
 #include <DnsProxydProtocol.h> // NETID_USE_LOCAL_NAMESERVERS
 #include <nativehelper/JNIPlatformHelp.h>
+#include <nativehelper/ScopedLocalRef.h>
 #include <nativehelper/ScopedPrimitiveArray.h>
 #include <utils/Log.h>
 
@@ -183,6 +191,179 @@ static jobject android_net_utils_resNetworkResult(JNIEnv *env, jclass clazz, job
     return env->NewObject(class_DnsResponse, ctor, answer, rcode);
 }
 
+struct DnsBatchResult {
+    jint index;
+    int rcode;
+    // errno if the query failed, in which case rcode and answer are unused.
+    int error;
+    std::vector<uint8_t> answer;
+};
+
+static int64_t elapsedRealtimeMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// Calls callback.onResults(int[] indices, DnsResponse[] responses, int[] errnos) once for all of
+// results. Returns false if Java threw.
+static bool deliverDnsBatch(JNIEnv* env, jobject callback, jmethodID onResults,
+                            jclass class_DnsResponse, jmethodID responseCtor,
+                            const std::vector<DnsBatchResult>& results) {
+    const jsize n = results.size();
+    ScopedLocalRef<jintArray> indices(env, env->NewIntArray(n));
+    ScopedLocalRef<jintArray> errnos(env, env->NewIntArray(n));
+    ScopedLocalRef<jobjectArray> responses(env,
+            env->NewObjectArray(n, class_DnsResponse, nullptr));
+    if (indices.get() == nullptr || errnos.get() == nullptr || responses.get() == nullptr) {
+        return false;
+    }
+
+    std::vector<jint> indexValues(n), errnoValues(n);
+    for (jsize i = 0; i < n; i++) {
+        const DnsBatchResult& r = results[i];
+        indexValues[i] = r.index;
+        errnoValues[i] = r.error;
+        if (r.error != 0) continue;
+        ScopedLocalRef<jbyteArray> answer(env, env->NewByteArray(r.answer.size()));
+        if (answer.get() == nullptr) return false;
+        env->SetByteArrayRegion(answer.get(), 0, r.answer.size(),
+                                reinterpret_cast<const jbyte*>(r.answer.data()));
+        ScopedLocalRef<jobject> response(env, env->NewObject(class_DnsResponse, responseCtor,
+                                                              answer.get(), r.rcode));
+        if (response.get() == nullptr) return false;
+        env->SetObjectArrayElement(responses.get(), i, response.get());
+    }
+    env->SetIntArrayRegion(indices.get(), 0, n, indexValues.data());
+    env->SetIntArrayRegion(errnos.get(), 0, n, errnoValues.data());
+
+    env->CallVoidMethod(callback, onResults, indices.get(), responses.get(), errnos.get());
+    return !env->ExceptionCheck();
+}
+
+// Issues one query per (dnames[i], nsTypes[i]) and waits for all of them on a single epoll set,
+// calling back once per wakeup with every result that became ready. Queries that could not be
+// sent are reported in a batch of their own before waiting; queries still pending after
+// timeoutMs are cancelled and reported with ETIMEDOUT. Blocks until every query has been
+// reported.
+static void android_net_utils_resNetworkQueryBatch(JNIEnv *env, jclass clazz, jlong netHandle,
+        jobjectArray dnames, jintArray nsTypes, jint ns_class, jint flags, jint timeoutMs,
+        jobject callback) {
+    if (dnames == nullptr || nsTypes == nullptr) {
+        jniThrowNullPointerException(env, dnames == nullptr ? "dnames" : "nsTypes");
+        return;
+    }
+    const jsize count = env->GetArrayLength(dnames);
+    if (env->GetArrayLength(nsTypes) != count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                          "dnames and nsTypes differ in length");
+        return;
+    }
+    // Checked up front so that a bad argument doesn't leave queries behind.
+    for (jsize i = 0; i < count; i++) {
+        ScopedLocalRef<jobject> dname(env, env->GetObjectArrayElement(dnames, i));
+        if (dname.get() == nullptr) {
+            jniThrowExceptionFmt(env, "java/lang/NullPointerException", "dnames[%d] is null", i);
+            return;
+        }
+    }
+    if (callback == nullptr) {
+        jniThrowNullPointerException(env, "callback");
+        return;
+    }
+    ScopedIntArrayRO types(env, nsTypes);
+
+    jclass class_DnsResponse = env->FindClass("android/net/DnsResolver$DnsResponse");
+    jmethodID responseCtor = env->GetMethodID(class_DnsResponse, "<init>", "([BI)V");
+    jclass class_Callback = env->GetObjectClass(callback);
+    jmethodID onResults = env->GetMethodID(class_Callback, "onResults",
+                                           "([I[Landroid/net/DnsResolver$DnsResponse;[I)V");
+    if (responseCtor == nullptr || onResults == nullptr) return;  // NoSuchMethodError pending
+
+    const int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        jniThrowErrnoException(env, "resNetworkQueryBatch", errno);
+        return;
+    }
+
+    // Query fd -> index of the query in dnames.
+    std::unordered_map<int, jint> pending;
+    std::vector<DnsBatchResult> results;
+    for (jsize i = 0; i < count; i++) {
+        ScopedLocalRef<jstring> dname(env,
+                static_cast<jstring>(env->GetObjectArrayElement(dnames, i)));
+        // Same conversion as resNetworkQuery.
+        const jsize javaCharsCount = env->GetStringLength(dname.get());
+        std::vector<char> queryname(env->GetStringUTFLength(dname.get()) + 1, 0);
+        env->GetStringUTFRegion(dname.get(), 0, javaCharsCount, queryname.data());
+
+        const int fd = android_res_nquery(netHandle, queryname.data(), ns_class, types[i], flags);
+        if (fd < 0) {
+            results.push_back({.index = i, .error = -fd});
+            continue;
+        }
+        struct epoll_event ev = {.events = EPOLLIN, .data = {.fd = fd}};
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            results.push_back({.index = i, .error = errno});
+            android_res_cancel(fd);
+            continue;
+        }
+        pending[fd] = i;
+    }
+
+    const int64_t deadline = elapsedRealtimeMs() + timeoutMs;
+    bool ok = true;
+    // Don't hold failures back until the first reply, which may take up to timeoutMs.
+    if (!results.empty()) {
+        ok = deliverDnsBatch(env, callback, onResults, class_DnsResponse, responseCtor, results);
+        results.clear();
+    }
+
+    std::vector<struct epoll_event> events(std::max<size_t>(pending.size(), 1));
+    std::vector<uint8_t> buf(MAXPACKETSIZE);
+    while (ok && !pending.empty()) {
+        const int64_t remaining = deadline - elapsedRealtimeMs();
+        const int n = remaining > 0
+                ? epoll_wait(epfd, events.data(), events.size(), remaining)
+                : 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            jniThrowErrnoException(env, "resNetworkQueryBatch", errno);
+            ok = false;
+            break;
+        }
+        if (n == 0) {
+            for (const auto& [fd, index] : pending) {
+                android_res_cancel(fd);
+                results.push_back({.index = index, .error = ETIMEDOUT});
+            }
+            pending.clear();
+        }
+        for (int i = 0; i < n; i++) {
+            const int fd = events[i].data.fd;
+            const jint index = pending[fd];
+            pending.erase(fd);
+            // android_res_nresult closes the fd, which also removes it from the epoll set.
+            int rcode;
+            const int res = android_res_nresult(fd, &rcode, buf.data(), buf.size());
+            if (res < 0) {
+                results.push_back({.index = index, .error = -res});
+            } else {
+                results.push_back({.index = index, .rcode = rcode,
+                                   .answer = std::vector<uint8_t>(buf.begin(), buf.begin() + res)});
+            }
+        }
+        if (!results.empty()) {
+            ok = deliverDnsBatch(env, callback, onResults, class_DnsResponse, responseCtor,
+                                 results);
+            results.clear();
+        }
+    }
+    // Only left over if Java threw: don't leak the queries.
+    for (const auto& [fd, index] : pending) android_res_cancel(fd);
+    close(epfd);
+}
+
 static void android_net_utils_resNetworkCancel(JNIEnv *env, jclass clazz, jobject javaFd) {
     int fd = AFileDescriptor_getFd(env, javaFd);
     android_res_cancel(fd);
@@ -278,6 +459,7 @@ static const JNINativeMethod gNetworkUtilMethods[] = {
     { "resNetworkQuery", "(JLjava/lang/String;III)Ljava/io/FileDescriptor;", (void*) android_net_utils_resNetworkQuery },
     { "resNetworkResult", "(Ljava/io/FileDescriptor;)Landroid/net/DnsResolver$DnsResponse;", (void*) android_net_utils_resNetworkResult },
     { "resNetworkCancel", "(Ljava/io/FileDescriptor;)V", (void*) android_net_utils_resNetworkCancel },
+    { "resNetworkQueryBatch", "(J[Ljava/lang/String;[IIIILandroid/net/NetworkUtils$DnsBatchCallback;)V", (void*) android_net_utils_resNetworkQueryBatch },
     { "getDnsNetwork", "()Landroid/net/Network;", (void*) android_net_utils_getDnsNetwork },
     { "setsockoptBytes", "(Ljava/io/FileDescriptor;II[B)V",
     (void*) android_net_utils_setsockoptBytes},
@@ -41,10 +41,14 @@ import static android.net.ConnectivityManager.FIREWALL_CHAIN_STANDBY;
 import static android.system.OsConstants.EINVAL;
 
 import android.os.ServiceSpecificException;
+import android.system.ErrnoException;
 import android.util.Pair;
 
 import com.android.modules.utils.build.SdkLevel;
+import com.android.net.module.util.IBpfMap;
+import com.android.net.module.util.Struct.S32;
 
+import java.util.ArrayList;
 import java.util.StringJoiner;
 
 /**
@@ -59,6 +63,54 @@ public class BpfNetMapsUtils {
     // Prevent this class from being accidental instantiated.
     private BpfNetMapsUtils() {}
 
+    /**
+     * Held across every read-modify-write of a uid owner map entry. An entry holds both the
+     * firewall rules, written by BpfNetMaps, and the counter set, written by
+     * NetworkStatsService.
+     */
+    public static final Object sUidOwnerMapLock = new Object();
+
+    /**
+     * Set the counter set of the uid in the uid owner map, keeping its firewall rules.
+     * The entry is deleted once it has neither rules nor a non-default counter set.
+     */
+    public static void setUidCounterSet(final IBpfMap<S32, UidOwnerValue> uidOwnerMap,
+            final int uid, final short counterSet) throws ErrnoException {
+        final S32 key = new S32(uid);
+        synchronized (sUidOwnerMapLock) {
+            final UidOwnerValue oldValue = uidOwnerMap.getValue(key);
+            if (oldValue == null) {
+                if (counterSet == 0) return;
+                uidOwnerMap.updateEntry(key, new UidOwnerValue(0, NO_MATCH, counterSet));
+            } else if (oldValue.rule == NO_MATCH && counterSet == 0) {
+                uidOwnerMap.deleteEntry(key);
+            } else {
+                uidOwnerMap.updateEntry(key,
+                        new UidOwnerValue(oldValue.iif, oldValue.rule, counterSet));
+            }
+        }
+    }
+
+    /**
+     * Drop the firewall rules and allowed interface of every uid in the uid owner map, keeping
+     * the counter sets.
+     */
+    public static void clearUidRules(final IBpfMap<S32, UidOwnerValue> uidOwnerMap)
+            throws ErrnoException {
+        synchronized (sUidOwnerMapLock) {
+            final ArrayList<Pair<S32, UidOwnerValue>> entries = new ArrayList<>();
+            uidOwnerMap.forEach((uid, value) -> entries.add(Pair.create(uid, value)));
+            for (Pair<S32, UidOwnerValue> entry : entries) {
+                if (entry.second.counterSet == 0) {
+                    uidOwnerMap.deleteEntry(entry.first);
+                } else {
+                    uidOwnerMap.updateEntry(entry.first,
+                            new UidOwnerValue(0, NO_MATCH, entry.second.counterSet));
+                }
+            }
+        }
+    }
+
     /**
      * Get corresponding match from firewall chain.
      */
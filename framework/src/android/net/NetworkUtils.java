@@ -145,6 +145,40 @@ public class NetworkUtils {
                 flags);
     }
 
+    /**
+     * Receives the results of {@link #resNetworkQueryBatch}, one call per group of queries that
+     * completed together.
+     */
+    public interface DnsBatchCallback {
+        /**
+         * @param indices the positions, in the batch, of the queries these results are for
+         * @param responses the response for each query, or null if the query failed
+         * @param errnos 0 on success, otherwise the errno the query failed with; ETIMEDOUT if it
+         *               was cancelled because the batch timed out
+         */
+        void onResults(int[] indices, DnsResolver.DnsResponse[] responses, int[] errnos);
+    }
+
+    private static native void resNetworkQueryBatch(long netHandle, String[] dnames,
+            int[] nsTypes, int nsClass, int flags, int timeoutMs, DnsBatchCallback callback)
+            throws ErrnoException;
+
+    /**
+     * DNS resolver series jni method.
+     * Look up the {@code nsClass} {@code nsTypes[i]} RR of every {@code dnames[i]} on the network
+     * designated by {@code netId}. All queries are sent up front and their replies are collected
+     * in native code, so a prefetch of many names costs one blocking call rather than a file
+     * descriptor, a JNI transition and a wakeup per name.
+     * Blocks until every query has been reported to {@code callback} on the calling thread;
+     * queries still pending after {@code timeoutMs} are cancelled.
+     */
+    public static void resNetworkQueryBatch(int netId, String[] dnames, int[] nsTypes,
+            int nsClass, int flags, int timeoutMs, DnsBatchCallback callback)
+            throws ErrnoException {
+        resNetworkQueryBatch(new Network(netId).getNetworkHandle(), dnames, nsTypes, nsClass,
+                flags, timeoutMs, callback);
+    }
+
     /**
      * DNS resolver series jni method.
      * Read a result for the query associated with the {@code fd}.
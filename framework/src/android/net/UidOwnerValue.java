@@ -32,8 +32,17 @@ public class UidOwnerValue extends Struct {
     @Field(order = 1, type = Type.U32)
     public final long rule;
 
+    // The counter set the uid's traffic is accounted to, see NetworkStats#SET_*.
+    @Field(order = 2, type = Type.U8, padding = 3)
+    public final short counterSet;
+
     public UidOwnerValue(final int iif, final long rule) {
+        this(iif, rule, (short) 0);
+    }
+
+    public UidOwnerValue(final int iif, final long rule, final short counterSet) {
         this.iif = iif;
         this.rule = rule;
+        this.counterSet = counterSet;
     }
 }
@@ -22,6 +22,7 @@
 #include <linux/inet_diag.h>
 #include <linux/sock_diag.h>
 #include <net/if.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -31,15 +32,20 @@
 #include <cutils/qtaguid.h>
 #include <processgroup/processgroup.h>
 
+#include <android-base/file.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <netdutils/NetNativeTestBase.h>
 
 #include "bpf/BpfMap.h"
 #include "bpf/BpfUtils.h"
+#include "bpf/KernelUtils.h"
+#include "loader.h"
 #include "netd.h"
 
+using android::base::ErrnoErrorf;
 using android::base::Result;
+using android::base::unique_fd;
 
 namespace android {
 namespace bpf {
@@ -49,6 +55,47 @@ namespace bpf {
 constexpr uid_t TEST_UID = UID_MAX - 1;
 constexpr uint32_t TEST_TAG = 42;
 
+// Test-only object from bpf_progs/uid_owner_layout_test.c comparing the uid_owner_map layouts.
+// It is installed next to the test binary and pinned at the top of the bpf filesystem.
+#define UID_OWNER_LAYOUT_OBJ "uid_owner_layout_test.o"
+#define UID_OWNER_LAYOUT_PATH "/sys/fs/bpf/"
+#define UID_OWNER_SPLIT_PROG_PATH \
+    UID_OWNER_LAYOUT_PATH "prog_uid_owner_layout_test_skfilter_uid_owner_split"
+#define UID_OWNER_COMBINED_PROG_PATH \
+    UID_OWNER_LAYOUT_PATH "prog_uid_owner_layout_test_skfilter_uid_owner_combined"
+#define UID_OWNER_SPLIT_MAP_PATH \
+    UID_OWNER_LAYOUT_PATH "map_uid_owner_layout_test_uid_owner_split_map"
+#define UID_COUNTERSET_SPLIT_MAP_PATH \
+    UID_OWNER_LAYOUT_PATH "map_uid_owner_layout_test_uid_counterset_split_map"
+#define UID_OWNER_COMBINED_MAP_PATH \
+    UID_OWNER_LAYOUT_PATH "map_uid_owner_layout_test_uid_owner_combined_map"
+
+// The uid_owner_map value before the counter set was folded into it.
+typedef struct {
+    uint32_t iif;
+    uint32_t rule;
+} SplitUidOwnerValue;
+
+struct ProgRunResult {
+    uint32_t retval;
+    uint32_t durationNs;  // average over all runs
+};
+
+// Runs a skfilter program `repeat` times over a packet starting with `uid`.
+static Result<ProgRunResult> runUidOwnerProgram(const unique_fd& prog, uint32_t uid,
+                                                uint32_t repeat) {
+    // skb test runs need at least an ethernet header's worth of data.
+    uint8_t packet[64] = {};
+    memcpy(packet, &uid, sizeof(uid));
+    bpf_attr attr = {};
+    attr.test.prog_fd = static_cast<uint32_t>(prog.get());
+    attr.test.data_size_in = sizeof(packet);
+    attr.test.data_in = ptr_to_u64(packet);
+    attr.test.repeat = repeat;
+    if (bpf(BPF_PROG_TEST_RUN, &attr)) return ErrnoErrorf("BPF_PROG_TEST_RUN failed");
+    return ProgRunResult{.retval = attr.test.retval, .durationNs = attr.test.duration};
+}
+
 class BpfBasicTest : public NetNativeTestBase {
   protected:
     BpfBasicTest() {}
@@ -104,5 +151,66 @@ TEST_F(BpfBasicTest, TestCloseSocketWithoutUntag) {
     FAIL() << "socket tag still exist after 5s";
 }
 
+class BpfUidOwnerLayoutTest : public BpfBasicTest {
+  protected:
+    void SetUp() override {
+        if (!isAtLeastKernelVersion(4, 14, 0)) GTEST_SKIP() << "Test programs need 4.14+ kernels";
+
+        const std::string obj = base::GetExecutableDirectory() + "/" UID_OWNER_LAYOUT_OBJ;
+        bool isCritical;
+        ASSERT_EQ(0, loadProg(obj.c_str(), &isCritical)) << "Cannot load " << obj;
+    }
+
+    void TearDown() override {
+        for (const char* pin : {UID_OWNER_SPLIT_PROG_PATH, UID_OWNER_COMBINED_PROG_PATH,
+                                UID_OWNER_SPLIT_MAP_PATH, UID_COUNTERSET_SPLIT_MAP_PATH,
+                                UID_OWNER_COMBINED_MAP_PATH}) {
+            unlink(pin);
+        }
+    }
+};
+
+TEST_F(BpfUidOwnerLayoutTest, TestUidOwnerCombinedLayout) {
+    unique_fd splitProg(retrieveProgram(UID_OWNER_SPLIT_PROG_PATH));
+    ASSERT_LE(0, splitProg.get()) << UID_OWNER_SPLIT_PROG_PATH << ": " << strerror(errno);
+    unique_fd combinedProg(retrieveProgram(UID_OWNER_COMBINED_PROG_PATH));
+    ASSERT_LE(0, combinedProg.get()) << UID_OWNER_COMBINED_PROG_PATH << ": " << strerror(errno);
+
+    BpfMap<uint32_t, SplitUidOwnerValue> splitOwnerMap(UID_OWNER_SPLIT_MAP_PATH);
+    ASSERT_TRUE(splitOwnerMap.isValid());
+    BpfMap<uint32_t, uint8_t> splitCounterSetMap(UID_COUNTERSET_SPLIT_MAP_PATH);
+    ASSERT_TRUE(splitCounterSetMap.isValid());
+    BpfMap<uint32_t, UidOwnerValue> combinedMap(UID_OWNER_COMBINED_MAP_PATH);
+    ASSERT_TRUE(combinedMap.isValid());
+
+    const uint8_t counterSet = 1;
+    ASSERT_RESULT_OK(splitOwnerMap.writeValue(TEST_UID, {.iif = 0, .rule = DOZABLE_MATCH},
+                                              BPF_ANY));
+    ASSERT_RESULT_OK(splitCounterSetMap.writeValue(TEST_UID, counterSet, BPF_ANY));
+    ASSERT_RESULT_OK(combinedMap.writeValue(
+            TEST_UID, {.iif = 0, .rule = DOZABLE_MATCH, .counterSet = counterSet}, BPF_ANY));
+
+    // Both layouts must yield the same rule and counter set, with and without an entry.
+    for (const uint32_t uid : {TEST_UID, TEST_UID - 1}) {
+        auto split = runUidOwnerProgram(splitProg, uid, 1);
+        ASSERT_RESULT_OK(split);
+        auto combined = runUidOwnerProgram(combinedProg, uid, 1);
+        ASSERT_RESULT_OK(combined);
+        EXPECT_EQ(split.value().retval, combined.value().retval) << "uid " << uid;
+    }
+    auto found = runUidOwnerProgram(combinedProg, TEST_UID, 1);
+    ASSERT_RESULT_OK(found);
+    EXPECT_EQ((DOZABLE_MATCH << 8) | counterSet, found.value().retval);
+
+    // Per-run cost of both layouts. Only recorded: test devices are too noisy to assert on.
+    constexpr uint32_t kRepeat = 1000000;
+    auto split = runUidOwnerProgram(splitProg, TEST_UID, kRepeat);
+    ASSERT_RESULT_OK(split);
+    auto combined = runUidOwnerProgram(combinedProg, TEST_UID, kRepeat);
+    ASSERT_RESULT_OK(combined);
+    RecordProperty("split_layout_ns", split.value().durationNs);
+    RecordProperty("combined_layout_ns", combined.value().durationNs);
+}
+
 }
 }
@@ -25,6 +25,7 @@
 #include <android-modules-utils/sdk_level.h>
 #include <bpf/WaitForProgsLoaded.h>
 #include <log/log.h>
+#include <netdutils/LatencyHistogram.h>
 #include <netdutils/UidConstants.h>
 #include <private/android_filesystem_config.h>
 
@@ -195,7 +196,7 @@ bool BpfHandler::hasUpdateDeviceStatsPermission(uid_t uid) {
     return ((appId == AID_ROOT) || (appId == AID_SYSTEM) || (appId == AID_DNS));
 }
 
-int BpfHandler::tagSocket(int sockFd, uint32_t tag, uid_t chargeUid, uid_t realUid) {
+int BpfHandler::checkTagPermission(uid_t chargeUid, uid_t realUid) {
     if (!mCookieTagMap.isValid()) return -EPERM;
 
     if (chargeUid != realUid && !hasUpdateDeviceStatsPermission(realUid)) return -EPERM;
@@ -206,6 +207,15 @@ int BpfHandler::tagSocket(int sockFd, uint32_t tag, uid_t chargeUid, uid_t realU
     // CLAT traffic data usage twice. See packages/modules/Connectivity/service/jni/
     // com_android_server_connectivity_ClatCoordinator.cpp
     if (chargeUid == AID_CLAT) return -EPERM;
+    return 0;
+}
+
+int BpfHandler::tagSocket(int sockFd, uint32_t tag, uid_t chargeUid, uid_t realUid) {
+    NETDUTILS_SCOPED_LATENCY("BpfHandler::tagSocket");
+    if (int ret = checkTagPermission(chargeUid, realUid)) return ret;
+
+    uint64_t sock_cookie = getSocketCookie(sockFd);
+    if (!sock_cookie) return -errno;
 
     // The socket destroy listener only monitors on the group {INET_TCP, INET_UDP, INET6_TCP,
     // INET6_UDP}. Tagging listener unsupported socket causes that the tag can't be removed from
@@ -238,9 +248,23 @@ int BpfHandler::tagSocket(int sockFd, uint32_t tag, uid_t chargeUid, uid_t realU
         return -EPROTONOSUPPORT;
     }
 
+    return writeCookieTag(sock_cookie, tag, chargeUid, realUid);
+}
+
+int BpfHandler::tagSocketCookie(int sockFd, uint64_t cookie, uint32_t tag, uid_t chargeUid,
+                                uid_t realUid) {
+    NETDUTILS_SCOPED_LATENCY("BpfHandler::tagSocketCookie");
+    // A bare cookie may belong to a socket that is already closed, and the socket destroy listener
+    // would then never remove its tag. Only accept the cookie of a socket the caller holds open.
     uint64_t sock_cookie = getSocketCookie(sockFd);
     if (!sock_cookie) return -errno;
+    if (sock_cookie != cookie) return -EINVAL;
+
+    return tagSocket(sockFd, tag, chargeUid, realUid);
+}
 
+int BpfHandler::writeCookieTag(uint64_t sock_cookie, uint32_t tag, uid_t chargeUid,
+                               uid_t realUid) {
     UidTagValue newKey = {.uid = (uint32_t)chargeUid, .tag = tag};
 
     uint32_t totalEntryCount = 0;
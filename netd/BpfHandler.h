@@ -44,6 +44,14 @@ class BpfHandler {
      */
     int tagSocket(int sockFd, uint32_t tag, uid_t chargeUid, uid_t realUid);
 
+    /*
+     * Same as tagSocket, for a caller that already knows the |cookie| of the socket. |sockFd| must
+     * be an open fd of that socket, otherwise returns -EINVAL: a dead cookie would leave behind a
+     * tag the socket destroy listener never removes.
+     */
+    int tagSocketCookie(int sockFd, uint64_t cookie, uint32_t tag, uid_t chargeUid,
+                        uid_t realUid);
+
     /*
      * The untag process is similar to tag socket and both old qtaguid module and
      * new eBPF module have spinlock inside the kernel for concurrent update. No
@@ -57,6 +65,8 @@ class BpfHandler {
 
     netdutils::Status initMaps();
     bool hasUpdateDeviceStatsPermission(uid_t uid);
+    int checkTagPermission(uid_t chargeUid, uid_t realUid);
+    int writeCookieTag(uint64_t cookie, uint32_t tag, uid_t chargeUid, uid_t realUid);
 
     BpfMap<uint64_t, UidTagValue> mCookieTagMap;
     BpfMapRO<StatsKey, StatsValue> mStatsMapA;
@@ -17,12 +17,15 @@
  */
 
 #include <private/android_filesystem_config.h>
+#include <stdio.h>
 #include <sys/socket.h>
 
+#include <android-base/file.h>
 #include <gtest/gtest.h>
 
 #define BPF_MAP_MAKE_VISIBLE_FOR_TESTING
 #include "BpfHandler.h"
+#include "NetdUpdatablePublic.h"
 
 using namespace android::bpf;  // NOLINT(google-build-using-namespace): exempted
 
@@ -253,5 +256,75 @@ TEST_F(BpfHandlerTest, TestTagSocketReachTotalLimitFail) {
     expectTagSocketReachLimit(TEST_TAG, TEST_UID);
 }
 
+TEST_F(BpfHandlerTest, TestTagSocketCookie) {
+    int sock = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_LE(0, sock);
+    uint64_t sockCookie = getSocketCookie(sock);
+    ASSERT_NE(NONEXISTENT_COOKIE, sockCookie);
+
+    EXPECT_EQ(0, mBh.tagSocketCookie(sock, sockCookie, TEST_TAG, TEST_UID, TEST_UID));
+    expectUidTag(sockCookie, TEST_UID, TEST_TAG);
+    EXPECT_EQ(0, mBh.tagSocketCookie(sock, sockCookie, TEST_TAG + 1, TEST_UID, TEST_UID));
+    expectUidTag(sockCookie, TEST_UID, TEST_TAG + 1);
+    EXPECT_EQ(0, mBh.untagSocket(sock));
+    expectMapEmpty(mFakeCookieTagMap);
+    close(sock);
+}
+
+TEST_F(BpfHandlerTest, TestTagSocketCookieWithoutFd) {
+    EXPECT_EQ(-EBADF, mBh.tagSocketCookie(-1, TEST_COOKIE, TEST_TAG, TEST_UID, TEST_UID));
+    expectMapEmpty(mFakeCookieTagMap);
+}
+
+TEST_F(BpfHandlerTest, TestTagSocketCookieOfClosedSocket) {
+    int sock = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_LE(0, sock);
+    uint64_t deadCookie = getSocketCookie(sock);
+    ASSERT_NE(NONEXISTENT_COOKIE, deadCookie);
+    close(sock);
+
+    // Cookies are never reused, so a live socket can't vouch for the closed one.
+    sock = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_LE(0, sock);
+    EXPECT_EQ(-EINVAL, mBh.tagSocketCookie(sock, deadCookie, TEST_TAG, TEST_UID, TEST_UID));
+    expectMapEmpty(mFakeCookieTagMap);
+    close(sock);
+}
+
+TEST_F(BpfHandlerTest, TestTagSocketCookieChecksSocketType) {
+    int packetSocket = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    ASSERT_LE(0, packetSocket);
+    uint64_t sockCookie = getSocketCookie(packetSocket);
+    ASSERT_NE(NONEXISTENT_COOKIE, sockCookie);
+    EXPECT_EQ(-EAFNOSUPPORT,
+              mBh.tagSocketCookie(packetSocket, sockCookie, TEST_TAG, TEST_UID, TEST_UID));
+    expectMapEmpty(mFakeCookieTagMap);
+    close(packetSocket);
+}
+
+TEST_F(BpfHandlerTest, TestTagSocketCookieWithoutPermission) {
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    ASSERT_LE(0, sock);
+    uint64_t sockCookie = getSocketCookie(sock);
+    ASSERT_NE(NONEXISTENT_COOKIE, sockCookie);
+    EXPECT_EQ(-EPERM, mBh.tagSocketCookie(sock, sockCookie, TEST_TAG, TEST_UID, TEST_UID2));
+    EXPECT_EQ(-EPERM, mBh.tagSocketCookie(sock, sockCookie, TEST_TAG, AID_CLAT, AID_CLAT));
+    expectMapEmpty(mFakeCookieTagMap);
+    close(sock);
+}
+
+TEST_F(BpfHandlerTest, TestDumpIncludesTagSocketLatency) {
+    uint64_t sockCookie;
+    setUpSocketAndTag(AF_INET, &sockCookie, TEST_TAG, TEST_UID, TEST_UID);
+
+    std::unique_ptr<FILE, decltype(&fclose)> out(tmpfile(), fclose);
+    ASSERT_NE(nullptr, out);
+    libnetd_updatable_dump(fileno(out.get()));
+    ASSERT_EQ(0, lseek(fileno(out.get()), 0, SEEK_SET));
+    std::string dump;
+    ASSERT_TRUE(base::ReadFdToString(fileno(out.get()), &dump));
+    EXPECT_NE(std::string::npos, dump.find("BpfHandler::tagSocket: count="));
+}
+
 }  // namespace net
 }  // namespace android
@@ -19,6 +19,8 @@
 #include "BpfHandler.h"
 
 #include <android-base/logging.h>
+#include <netdutils/DumpWriter.h>
+#include <netdutils/LatencyHistogram.h>
 #include <netdutils/Status.h>
 
 #include "NetdUpdatablePublic.h"
@@ -41,6 +43,16 @@ int libnetd_updatable_tagSocket(int sockFd, uint32_t tag, uid_t chargeUid, uid_t
     return sBpfHandler.tagSocket(sockFd, tag, chargeUid, realUid);
 }
 
+int libnetd_updatable_tagSocketCookie(int sockFd, uint64_t cookie, uint32_t tag, uid_t chargeUid,
+                                      uid_t realUid) {
+    return sBpfHandler.tagSocketCookie(sockFd, cookie, tag, chargeUid, realUid);
+}
+
 int libnetd_updatable_untagSocket(int sockFd) {
     return sBpfHandler.untagSocket(sockFd);
 }
+
+void libnetd_updatable_dump(int fd) {
+    android::netdutils::DumpWriter dw(fd);
+    android::netdutils::LatencyHistogram::dumpAll(dw);
+}
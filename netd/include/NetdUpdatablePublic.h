@@ -48,6 +48,18 @@ int libnetd_updatable_init(const char* cg2_path);
 int libnetd_updatable_tagSocket(int sockFd, uint32_t tag, uid_t chargeUid,
                                                        uid_t realUid);
 
+/*
+ * Same as libnetd_updatable_tagSocket, for a socket the caller also knows the |cookie| (SO_COOKIE)
+ * of. |sockFd| must be an open file descriptor of that socket. The cookie alone is not enough,
+ * since it may belong to a socket that has already been closed, whose tag would then never be
+ * removed.
+ *
+ * Returns 0 on success, -EINVAL if |sockFd| is not the socket |cookie| identifies, or another
+ * negative POSIX error code (see errno.h) on failure.
+ */
+int libnetd_updatable_tagSocketCookie(int sockFd, uint64_t cookie, uint32_t tag, uid_t chargeUid,
+                                      uid_t realUid);
+
 /*
  * Untag a network socket. Future traffic on this socket will no longer be associated with any
  * previously configured tag and uid.
@@ -58,4 +70,11 @@ int libnetd_updatable_tagSocket(int sockFd, uint32_t tag, uid_t chargeUid,
  */
 int libnetd_updatable_untagSocket(int sockFd);
 
+/*
+ * Write the latencies recorded by the library, such as those of socket tagging, to |fd| in
+ * human-readable form. The library keeps its own copy of the histograms, separate from those of
+ * netd, so netd's dumpsys must call this for them to appear in bugreports.
+ */
+void libnetd_updatable_dump(int fd);
+
 __END_DECLS
\ No newline at end of file
@@ -37,6 +37,7 @@
 #include "netdbpf/BpfNetworkStats.h"
 
 using android::bpf::parseBpfNetworkStatsDetail;
+using android::bpf::parseNetlinkNetworkStatsDev;
 using android::bpf::stats_line;
 
 namespace android {
@@ -188,11 +189,22 @@ static int readNetworkStatsDev(JNIEnv* env, jclass clazz, jobject stats) {
     return statsLinesToNetworkStats(env, clazz, stats, lines);
 }
 
+static int readNetworkStatsDevNetlink(JNIEnv* env, jclass clazz, jobject stats) {
+    std::vector<stats_line> lines;
+
+    if (parseNetlinkNetworkStatsDev(&lines) < 0)
+            return -1;
+
+    return statsLinesToNetworkStats(env, clazz, stats, lines);
+}
+
 static const JNINativeMethod gMethods[] = {
         { "nativeReadNetworkStatsDetail", "(Landroid/net/NetworkStats;)I",
                 (void*) readNetworkStatsDetail },
         { "nativeReadNetworkStatsDev", "(Landroid/net/NetworkStats;)I",
                 (void*) readNetworkStatsDev },
+        { "nativeReadNetworkStatsDevNetlink", "(Landroid/net/NetworkStats;)I",
+                (void*) readNetworkStatsDevNetlink },
 };
 
 int register_android_server_net_NetworkStatsFactory(JNIEnv* env) {
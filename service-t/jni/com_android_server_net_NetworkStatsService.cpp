@@ -16,25 +16,43 @@
 
 #define LOG_TAG "NetworkStatsNative"
 
+#include <android-base/thread_annotations.h>
 #include <cutils/qtaguid.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <jni.h>
+#include <netdutils/DumpWriter.h>
+#include <netdutils/LatencyHistogram.h>
+#include <netjniutils/netjniutils.h>
+#include <nativehelper/JNIHelp.h>
 #include <nativehelper/ScopedUtfChars.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <utils/Log.h>
 #include <utils/misc.h>
 
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "bpf/BpfUtils.h"
 #include "netdbpf/BpfNetworkStats.h"
 #include "netdbpf/NetworkTraceHandler.h"
 
+using android::bpf::bpfGetAllUidStats;
 using android::bpf::bpfGetUidStats;
+using android::bpf::bpfGetUidStatsBulk;
 using android::bpf::bpfGetIfaceStats;
+using android::bpf::bpfGetStatsMapHealth;
 using android::bpf::bpfRegisterIface;
+using android::bpf::bpfStatsMapNeedsDrain;
 using android::bpf::NetworkTraceHandler;
 
 namespace android {
@@ -76,7 +94,56 @@ static jobject statsValueToEntry(JNIEnv* env, StatsValue* stats) {
     return result;
 }
 
-static int parseIfaceStats(const char* iface, StatsValue* stats) {
+// Per-interface totals from QTAGUID_IFACE_STATS.
+struct QtaguidIfaceTable {
+    std::unordered_map<std::string, StatsValue> ifaces;
+    StatsValue total = {};
+};
+
+// Untagged per-uid totals from QTAGUID_UID_STATS.
+struct QtaguidUidTable {
+    std::unordered_map<uint32_t, StatsValue> uids;
+};
+
+// Keeps the last table parsed from a qtaguid stats file. Each file is parsed in a single pass, and
+// the table is served to every read within kMaxAge of that pass, so that a burst of TrafficStats
+// calls (or one bulk call) on the fallback path reads and parses the file once.
+template <class Table>
+class QtaguidTableCache {
+  public:
+    using Parser = int (*)(Table*);
+
+    explicit QtaguidTableCache(Parser parser) : mParser(parser) {}
+
+    std::shared_ptr<const Table> get() {
+        std::lock_guard guard(mMutex);
+        const auto now = std::chrono::steady_clock::now();
+        if (mTable != nullptr && now - mReadAt < kMaxAge) return mTable;
+        auto table = std::make_shared<Table>();
+        if (mParser(table.get()) != 0) return nullptr;
+        mTable = std::move(table);
+        mReadAt = now;
+        return mTable;
+    }
+
+  private:
+    static constexpr auto kMaxAge = std::chrono::milliseconds(500);
+
+    const Parser mParser;
+    std::mutex mMutex;
+    std::shared_ptr<const Table> mTable GUARDED_BY(mMutex);
+    std::chrono::steady_clock::time_point mReadAt GUARDED_BY(mMutex);
+};
+
+static void addStats(StatsValue* stats, uint64_t rxBytes, uint64_t rxPackets, uint64_t txBytes,
+                     uint64_t txPackets) {
+    stats->rxBytes += rxBytes;
+    stats->rxPackets += rxPackets;
+    stats->txBytes += txBytes;
+    stats->txPackets += txPackets;
+}
+
+static int parseIfaceStatsTable(QtaguidIfaceTable* table) {
     FILE *fp = fopen(QTAGUID_IFACE_STATS, "r");
     if (fp == NULL) {
         return -1;
@@ -92,12 +159,8 @@ static int parseIfaceStats(const char* iface, StatsValue* stats) {
                 "%*u %" SCNu64 " %*u %*u %*u %*u", cur_iface, &rxBytes,
                 &rxPackets, &txBytes, &txPackets, &tcpRxPackets, &tcpTxPackets);
         if (matched >= 5) {
-            if (!iface || !strcmp(iface, cur_iface)) {
-                stats->rxBytes += rxBytes;
-                stats->rxPackets += rxPackets;
-                stats->txBytes += txBytes;
-                stats->txPackets += txPackets;
-            }
+            addStats(&table->ifaces[cur_iface], rxBytes, rxPackets, txBytes, txPackets);
+            addStats(&table->total, rxBytes, rxPackets, txBytes, txPackets);
         }
     }
 
@@ -107,7 +170,7 @@ static int parseIfaceStats(const char* iface, StatsValue* stats) {
     return 0;
 }
 
-static int parseUidStats(const uint32_t uid, StatsValue* stats) {
+static int parseUidStatsTable(QtaguidUidTable* table) {
     FILE *fp = fopen(QTAGUID_UID_STATS, "r");
     if (fp == NULL) {
         return -1;
@@ -124,11 +187,8 @@ static int parseUidStats(const uint32_t uid, StatsValue* stats) {
                 " %" SCNu64 " %" SCNu64 "",
                 &idx, iface, &tag, &cur_uid, &set, &rxBytes, &rxPackets,
                 &txBytes, &txPackets) == 9) {
-            if (uid == cur_uid && tag == 0L) {
-                stats->rxBytes += rxBytes;
-                stats->rxPackets += rxPackets;
-                stats->txBytes += txBytes;
-                stats->txPackets += txPackets;
+            if (tag == 0L) {
+                addStats(&table->uids[cur_uid], rxBytes, rxPackets, txBytes, txPackets);
             }
         }
     }
@@ -139,6 +199,33 @@ static int parseUidStats(const uint32_t uid, StatsValue* stats) {
     return 0;
 }
 
+static QtaguidTableCache<QtaguidIfaceTable> sQtaguidIfaceTable(parseIfaceStatsTable);
+static QtaguidTableCache<QtaguidUidTable> sQtaguidUidTable(parseUidStatsTable);
+
+static int parseIfaceStats(const char* iface, StatsValue* stats) {
+    const auto table = sQtaguidIfaceTable.get();
+    if (table == nullptr) {
+        return -1;
+    }
+    if (!iface) {
+        *stats = table->total;
+        return 0;
+    }
+    const auto it = table->ifaces.find(iface);
+    *stats = (it != table->ifaces.end()) ? it->second : StatsValue{};
+    return 0;
+}
+
+static int parseUidStats(const uint32_t uid, StatsValue* stats) {
+    const auto table = sQtaguidUidTable.get();
+    if (table == nullptr) {
+        return -1;
+    }
+    const auto it = table->uids.find(uid);
+    *stats = (it != table->uids.end()) ? it->second : StatsValue{};
+    return 0;
+}
+
 static jobject nativeGetTotalStat(JNIEnv* env, jclass clazz) {
     StatsValue stats = {};
 
@@ -186,10 +273,103 @@ static jobject nativeGetUidStat(JNIEnv* env, jclass clazz, jint uid) {
     }
 }
 
+// Copies stats into the parallel rxBytes/rxPackets/txBytes/txPackets arrays, starting at index 0.
+static void statsValuesToArrays(JNIEnv* env, const std::vector<StatsValue>& stats,
+                                jlongArray rxBytes, jlongArray rxPackets, jlongArray txBytes,
+                                jlongArray txPackets) {
+    const jsize count = stats.size();
+    std::vector<jlong> buf(count);
+    const auto copyField = [&](jlongArray array, uint64_t StatsValue::*field) {
+        for (jsize i = 0; i < count; i++) buf[i] = stats[i].*field;
+        env->SetLongArrayRegion(array, 0, count, buf.data());
+    };
+    copyField(rxBytes, &StatsValue::rxBytes);
+    copyField(rxPackets, &StatsValue::rxPackets);
+    copyField(txBytes, &StatsValue::txBytes);
+    copyField(txPackets, &StatsValue::txPackets);
+}
+
+static bool hasRoomFor(JNIEnv* env, jsize count, jlongArray rxBytes, jlongArray rxPackets,
+                       jlongArray txBytes, jlongArray txPackets) {
+    return env->GetArrayLength(rxBytes) >= count && env->GetArrayLength(rxPackets) >= count &&
+           env->GetArrayLength(txBytes) >= count && env->GetArrayLength(txPackets) >= count;
+}
+
+static jboolean nativeGetUidStatsBulk(JNIEnv* env, jclass clazz, jintArray juids,
+                                      jlongArray rxBytes, jlongArray rxPackets,
+                                      jlongArray txBytes, jlongArray txPackets) {
+    const jsize count = env->GetArrayLength(juids);
+    if (!hasRoomFor(env, count, rxBytes, rxPackets, txBytes, txPackets)) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "Output arrays too short");
+        return false;
+    }
+    std::vector<uint32_t> uids(count);
+    env->GetIntArrayRegion(juids, 0, count, reinterpret_cast<jint*>(uids.data()));
+
+    std::vector<StatsValue> stats(count);
+    if (bpfGetUidStatsBulk(uids.data(), count, stats.data()) != 0) {
+        for (jsize i = 0; i < count; i++) {
+            if (parseUidStats(uids[i], &stats[i]) != 0) return false;
+        }
+    }
+    statsValuesToArrays(env, stats, rxBytes, rxPackets, txBytes, txPackets);
+    return true;
+}
+
+static jint nativeGetAllUidStats(JNIEnv* env, jclass clazz, jintArray juids, jlongArray rxBytes,
+                                 jlongArray rxPackets, jlongArray txBytes,
+                                 jlongArray txPackets) {
+    std::vector<std::pair<uint32_t, StatsValue>> snapshot;
+    if (bpfGetAllUidStats(&snapshot) != 0) return -1;
+
+    const jsize total = snapshot.size();
+    const jsize capacity = env->GetArrayLength(juids);
+    if (!hasRoomFor(env, capacity, rxBytes, rxPackets, txBytes, txPackets)) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "Output arrays too short");
+        return -1;
+    }
+    const jsize count = std::min(total, capacity);
+    std::vector<jint> uids(count);
+    std::vector<StatsValue> stats(count);
+    for (jsize i = 0; i < count; i++) {
+        uids[i] = snapshot[i].first;
+        stats[i] = snapshot[i].second;
+    }
+    env->SetIntArrayRegion(juids, 0, count, uids.data());
+    statsValuesToArrays(env, stats, rxBytes, rxPackets, txBytes, txPackets);
+    return total;
+}
+
+static jboolean nativeShouldDrainStatsMap(JNIEnv* env, jclass clazz) {
+    return bpfStatsMapNeedsDrain() > 0;
+}
+
+static void nativeDumpStatsMapHealth(JNIEnv* env, jclass clazz, jobject javaFd) {
+    netdutils::DumpWriter dw(netjniutils::GetNativeFileDescriptor(env, javaFd));
+    dw.incIndent();
+    for (const auto& [selectedMap, name] : {std::pair(SELECT_MAP_A, "A"),
+                                            std::pair(SELECT_MAP_B, "B")}) {
+        StatsMapHealthValue health;
+        const int ret = bpfGetStatsMapHealth(selectedMap, &health);
+        if (ret) {
+            dw.println("stats_map_%s: unavailable: %s", name, strerror(-ret));
+            continue;
+        }
+        dw.println("stats_map_%s: entries=%" PRIu64 "/%d insertFailures=%" PRIu64, name,
+                   health.entries, STATS_MAP_SIZE, health.insertFailures);
+    }
+}
+
 static void nativeInitNetworkTracing(JNIEnv* env, jclass clazz) {
     NetworkTraceHandler::InitPerfettoTracing();
 }
 
+static void nativeDumpLatencyHistograms(JNIEnv* env, jclass clazz, jobject javaFd) {
+    netdutils::DumpWriter dw(netjniutils::GetNativeFileDescriptor(env, javaFd));
+    dw.incIndent();
+    netdutils::LatencyHistogram::dumpAll(dw);
+}
+
 static const JNINativeMethod gMethods[] = {
         {
             "nativeRegisterIface",
@@ -211,11 +391,36 @@ static const JNINativeMethod gMethods[] = {
             "(I)Landroid/net/NetworkStats$Entry;",
             (void*)nativeGetUidStat
         },
+        {
+            "nativeGetUidStatsBulk",
+            "([I[J[J[J[J)Z",
+            (void*)nativeGetUidStatsBulk
+        },
+        {
+            "nativeGetAllUidStats",
+            "([I[J[J[J[J)I",
+            (void*)nativeGetAllUidStats
+        },
+        {
+            "nativeShouldDrainStatsMap",
+            "()Z",
+            (void*)nativeShouldDrainStatsMap
+        },
+        {
+            "nativeDumpStatsMapHealth",
+            "(Ljava/io/FileDescriptor;)V",
+            (void*)nativeDumpStatsMapHealth
+        },
         {
             "nativeInitNetworkTracing",
             "()V",
             (void*)nativeInitNetworkTracing
         },
+        {
+            "nativeDumpLatencyHistograms",
+            "(Ljava/io/FileDescriptor;)V",
+            (void*)nativeDumpLatencyHistograms
+        },
 };
 
 int register_android_server_net_NetworkStatsService(JNIEnv* env) {
@@ -15,8 +15,13 @@
  */
 
 #include <inttypes.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
 #include <net/if.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <algorithm>
 #include <unordered_set>
 
 #include <utils/Log.h>
@@ -27,6 +32,8 @@
 #include "android-base/unique_fd.h"
 #include "bpf/BpfMap.h"
 #include "netd.h"
+#include "netdutils/LatencyHistogram.h"
+#include "netdutils/Netlink.h"
 #include "netdbpf/BpfNetworkStats.h"
 
 #ifdef LOG_TAG
@@ -50,6 +57,21 @@ const BpfMapRO<uint32_t, StatsValue>& getIfaceStatsMap() {
     return ifaceStatsMap;
 }
 
+const BpfMapRO<uint32_t, StatsValue>& getIfaceStatsTotalMap() {
+    static BpfMapRO<uint32_t, StatsValue> ifaceStatsTotalMap(IFACE_STATS_TOTAL_MAP_PATH);
+    return ifaceStatsTotalMap;
+}
+
+const BpfMapRO<uint32_t, uint32_t>& getConfigurationMap() {
+    static BpfMapRO<uint32_t, uint32_t> configurationMap(CONFIGURATION_MAP_PATH);
+    return configurationMap;
+}
+
+BpfMap<uint32_t, StatsMapHealthValue>& getStatsMapHealthMap() {
+    static BpfMap<uint32_t, StatsMapHealthValue> statsMapHealthMap(STATS_MAP_HEALTH_MAP_PATH);
+    return statsMapHealthMap;
+}
+
 Result<IfaceValue> ifindex2name(const uint32_t ifindex) {
     Result<IfaceValue> v = getIfaceIndexNameMap().readValue(ifindex);
     if (v.ok()) return v;
@@ -80,9 +102,66 @@ int bpfGetUidStatsInternal(uid_t uid, StatsValue* stats,
     return 0;
 }
 
-int bpfGetUidStats(uid_t uid, StatsValue* stats) {
+const BpfMapRO<uint32_t, StatsValue>& getAppUidStatsMap() {
     static BpfMapRO<uint32_t, StatsValue> appUidStatsMap(APP_UID_STATS_MAP_PATH);
-    return bpfGetUidStatsInternal(uid, stats, appUidStatsMap);
+    return appUidStatsMap;
+}
+
+int bpfGetUidStats(uid_t uid, StatsValue* stats) {
+    return bpfGetUidStatsInternal(uid, stats, getAppUidStatsMap());
+}
+
+int bpfGetAllUidStatsInternal(std::vector<std::pair<uint32_t, StatsValue>>* stats,
+                              const BpfMapRO<uint32_t, StatsValue>& appUidStatsMap) {
+    stats->clear();
+    const auto processUidStats =
+            [stats](const uint32_t& key, const StatsValue& value,
+                    const BpfMapRO<uint32_t, StatsValue>&) -> Result<void> {
+        stats->emplace_back(key, value);
+        return Result<void>();
+    };
+    auto res = appUidStatsMap.iterateWithValue(processUidStats);
+    if (!res.ok()) {
+        stats->clear();
+        return -res.error().code();
+    }
+    std::sort(stats->begin(), stats->end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    return 0;
+}
+
+int bpfGetAllUidStats(std::vector<std::pair<uint32_t, StatsValue>>* stats) {
+    return bpfGetAllUidStatsInternal(stats, getAppUidStatsMap());
+}
+
+// Up to this many uids are looked up one by one: walking the whole map costs two syscalls per
+// entry, and it usually holds hundreds of uids.
+static constexpr size_t kMaxDirectUidLookups = 64;
+
+int bpfGetUidStatsBulkInternal(const uint32_t* uids, size_t count, StatsValue* stats,
+                               const BpfMapRO<uint32_t, StatsValue>& appUidStatsMap) {
+    if (count <= kMaxDirectUidLookups) {
+        for (size_t i = 0; i < count; i++) {
+            int ret = bpfGetUidStatsInternal(uids[i], &stats[i], appUidStatsMap);
+            if (ret) return ret;
+        }
+        return 0;
+    }
+
+    std::vector<std::pair<uint32_t, StatsValue>> snapshot;
+    int ret = bpfGetAllUidStatsInternal(&snapshot, appUidStatsMap);
+    if (ret) return ret;
+    for (size_t i = 0; i < count; i++) {
+        const auto it = std::lower_bound(
+                snapshot.begin(), snapshot.end(), uids[i],
+                [](const auto& entry, uint32_t uid) { return entry.first < uid; });
+        stats[i] = (it != snapshot.end() && it->first == uids[i]) ? it->second : StatsValue{};
+    }
+    return 0;
+}
+
+int bpfGetUidStatsBulk(const uint32_t* uids, size_t count, StatsValue* stats) {
+    return bpfGetUidStatsBulkInternal(uids, count, stats, getAppUidStatsMap());
 }
 
 int bpfGetIfaceStatsInternal(const char* iface, StatsValue* stats,
@@ -112,7 +191,41 @@ int bpfGetIfaceStatsInternal(const char* iface, StatsValue* stats,
     return res.ok() ? 0 : -res.error().code();
 }
 
+int getPossibleCpuCount() {
+    // Parsed like libbpf does: a list of ranges such as "0-3,5", counting every cpu in them.
+    static const int count = [] {
+        std::string possible;
+        if (!base::ReadFileToString("/sys/devices/system/cpu/possible", &possible)) return -errno;
+        int n = 0;
+        for (const std::string& range : base::Split(base::Trim(possible), ",")) {
+            int first, last;
+            const int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+            if (fields == 1) last = first;
+            if (fields < 1 || last < first) return -EINVAL;
+            n += last - first + 1;
+        }
+        return n ? n : -EINVAL;
+    }();
+    return count;
+}
+
+int bpfGetTotalStatsInternal(StatsValue* stats,
+                             const BpfMapRO<uint32_t, StatsValue>& ifaceStatsTotalMap) {
+    *stats = {};
+    const int cpus = getPossibleCpuCount();
+    if (cpus < 0) return cpus;
+    // A per cpu map returns one value for each possible cpu.
+    std::vector<StatsValue> perCpu(cpus);
+    const uint32_t key = IFACE_STATS_TOTAL_KEY;
+    if (findMapEntry(ifaceStatsTotalMap.getMap(), &key, perCpu.data())) return -errno;
+    for (const StatsValue& value : perCpu) *stats += value;
+    return 0;
+}
+
 int bpfGetIfaceStats(const char* iface, StatsValue* stats) {
+    // The total is a single lookup. An interface is still matched by name over all of
+    // iface_stats_map, so that a recreated interface keeps the counters of its earlier ifindexes.
+    if (!iface && bpfGetTotalStatsInternal(stats, getIfaceStatsTotalMap()) == 0) return 0;
     return bpfGetIfaceStatsInternal(iface, stats, getIfaceStatsMap(), ifindex2name);
 }
 
@@ -192,7 +305,8 @@ int parseBpfNetworkStatsDetailInternal(std::vector<stats_line>& lines,
 }
 
 int parseBpfNetworkStatsDetail(std::vector<stats_line>* lines) {
-    static BpfMapRO<uint32_t, uint32_t> configurationMap(CONFIGURATION_MAP_PATH);
+    NETDUTILS_SCOPED_LATENCY("BpfNetworkStats::parseBpfNetworkStatsDetail");
+    const BpfMapRO<uint32_t, uint32_t>& configurationMap = getConfigurationMap();
     static BpfMap<StatsKey, StatsValue> statsMapA(STATS_MAP_A_PATH);
     static BpfMap<StatsKey, StatsValue> statsMapB(STATS_MAP_B_PATH);
     if (!configurationMap.isOk()) return -1;
@@ -205,12 +319,15 @@ int parseBpfNetworkStatsDetail(std::vector<stats_line>* lines) {
     // The target map for stats reading should be the inactive map, which is opposite
     // from the config value.
     BpfMap<StatsKey, StatsValue> *inactiveStatsMap;
+    uint32_t inactiveSelection;
     switch (configuration.value()) {
       case SELECT_MAP_A:
         inactiveStatsMap = &statsMapB;
+        inactiveSelection = SELECT_MAP_B;
         break;
       case SELECT_MAP_B:
         inactiveStatsMap = &statsMapA;
+        inactiveSelection = SELECT_MAP_A;
         break;
       default:
         ALOGE("%s unknown configuration value: %d", __func__, configuration.value());
@@ -234,6 +351,51 @@ int parseBpfNetworkStatsDetail(std::vector<stats_line>* lines) {
         return -res.error().code();
     }
 
+    // Not fatal: the stats were read fine, the next drain would just come early.
+    if (getStatsMapHealthMap().isOk()) {
+        resetStatsMapHealthInternal(inactiveSelection, getStatsMapHealthMap());
+    }
+    return 0;
+}
+
+int bpfStatsMapNeedsDrainInternal(const BpfMapRO<uint32_t, uint32_t>& configurationMap,
+                                  const BpfMapRO<uint32_t, StatsMapHealthValue>& healthMap) {
+    auto configuration = configurationMap.readValue(CURRENT_STATS_MAP_CONFIGURATION_KEY);
+    if (!configuration.ok()) return -configuration.error().code();
+    auto health = healthMap.readValue(configuration.value());
+    if (!health.ok()) return -health.error().code();
+    return health.value().entries >= STATS_MAP_DRAIN_THRESHOLD ||
+           health.value().insertFailures > 0;
+}
+
+int bpfStatsMapNeedsDrain() {
+    return bpfStatsMapNeedsDrainInternal(getConfigurationMap(), getStatsMapHealthMap());
+}
+
+int bpfGetStatsMapHealth(uint32_t selectedMap, StatsMapHealthValue* health) {
+    auto value = getStatsMapHealthMap().readValue(selectedMap);
+    if (!value.ok()) return -value.error().code();
+    *health = value.value();
+    return 0;
+}
+
+int resetStatsMapHealthInternal(uint32_t selectedMap,
+                                BpfMap<uint32_t, StatsMapHealthValue>& healthMap) {
+    auto health = healthMap.readValue(selectedMap);
+    if (!health.ok()) {
+        ALOGE("Cannot read stats map health: %s", health.error().message().c_str());
+        return -health.error().code();
+    }
+    if (health.value().insertFailures > 0) {
+        ALOGW("Stats map %u was full, dropped %" PRIu64 " entries since it was last drained",
+              selectedMap, health.value().insertFailures);
+    }
+    // The kernel stopped adding to this map when it was swapped out, so nothing is lost here.
+    Result<void> res = healthMap.writeValue(selectedMap, StatsMapHealthValue{}, BPF_EXIST);
+    if (!res.ok()) {
+        ALOGE("Cannot reset stats map health: %s", res.error().message().c_str());
+        return -res.error().code();
+    }
     return 0;
 }
 
@@ -269,9 +431,105 @@ int parseBpfNetworkStatsDevInternal(std::vector<stats_line>& lines,
 }
 
 int parseBpfNetworkStatsDev(std::vector<stats_line>* lines) {
+    NETDUTILS_SCOPED_LATENCY("BpfNetworkStats::parseBpfNetworkStatsDev");
     return parseBpfNetworkStatsDevInternal(*lines, getIfaceStatsMap(), ifindex2name);
 }
 
+namespace {
+
+// The leading fields of struct rtnl_link_stats64. The struct has grown over time, and declaring
+// all of it would make NetlinkAttributes drop the attribute when an older kernel sends it.
+struct LinkStats64 {
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+};
+
+using LinkStatsAttributes = netdutils::NetlinkAttributes<
+        netdutils::NetlinkAttributeSpec<IFLA_STATS_LINK_64, LinkStats64>>;
+
+// Large enough for a few dozen links per read. The kernel never splits a message.
+constexpr size_t kNetlinkDumpBufferSize = 16 * 1024;
+
+}  // namespace
+
+int parseNetlinkNetworkStatsDevInternal(std::vector<stats_line>& lines, const netdutils::Slice msgs,
+                                        const IfIndexToNameFunc ifindex2name) {
+    int ret = 0;
+    const auto onMsg = [&](const nlmsghdr& hdr, const netdutils::Slice payload) {
+        if (ret != 0) return;
+        if (hdr.nlmsg_type == NLMSG_DONE) {
+            ret = 1;
+            return;
+        }
+        if (hdr.nlmsg_type == NLMSG_ERROR) {
+            nlmsgerr err = {};
+            netdutils::extract(payload, err);
+            ret = (err.error != 0) ? err.error : -EPROTO;
+            return;
+        }
+        if (hdr.nlmsg_type != RTM_NEWSTATS) return;
+
+        if_stats_msg ifsm = {};
+        if (netdutils::extract(payload, ifsm) < sizeof(ifsm)) return;
+        const LinkStatsAttributes attrs(netdutils::drop(payload, NLMSG_ALIGN(sizeof(ifsm))));
+        const auto link = attrs.get<IFLA_STATS_LINK_64>();
+        if (!link) return;
+        Result<IfaceValue> ifname = ifindex2name(ifsm.ifindex);
+        if (!ifname.ok()) return;
+
+        const StatsKey fakeKey = {
+                .uid = (uint32_t)UID_ALL,
+                .tag = (uint32_t)TAG_NONE,
+                .counterSet = (uint32_t)SET_ALL,
+        };
+        const StatsValue value = {
+                .rxPackets = link->rx_packets,
+                .rxBytes = link->rx_bytes,
+                .txPackets = link->tx_packets,
+                .txBytes = link->tx_bytes,
+        };
+        lines.push_back(populateStatsEntry(fakeKey, value, ifname.value()));
+    };
+    netdutils::forEachNetlinkMessage(msgs, onMsg);
+    return ret;
+}
+
+int parseNetlinkNetworkStatsDev(std::vector<stats_line>* lines) {
+    NETDUTILS_SCOPED_LATENCY("BpfNetworkStats::parseNetlinkNetworkStatsDev");
+    const base::unique_fd s(socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_ROUTE));
+    if (!s.ok()) return -errno;
+
+    struct {
+        nlmsghdr nlh;
+        if_stats_msg ifsm;
+    } req = {
+            .nlh = {.nlmsg_len = sizeof(req),
+                    .nlmsg_type = RTM_GETSTATS,
+                    .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+                    .nlmsg_seq = 1},
+            .ifsm = {.family = AF_UNSPEC,
+                     .filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64)},
+    };
+    if (send(s.get(), &req, sizeof(req), 0) != sizeof(req)) return -errno;
+
+    alignas(nlmsghdr) uint8_t buf[kNetlinkDumpBufferSize];
+    while (true) {
+        const ssize_t len = recv(s.get(), buf, sizeof(buf), 0);
+        if (len < 0) return -errno;
+        // The socket was closed before the dump completed.
+        if (len == 0) return -EPROTO;
+        const int ret = parseNetlinkNetworkStatsDevInternal(*lines, netdutils::Slice(buf, len),
+                                                            ifindex2name);
+        if (ret < 0) return ret;
+        if (ret > 0) break;
+    }
+
+    groupNetworkStats(*lines);
+    return 0;
+}
+
 void groupNetworkStats(std::vector<stats_line>& lines) {
     if (lines.size() <= 1) return;
     std::sort(lines.begin(), lines.end());
@@ -21,7 +21,9 @@
 
 #include <fcntl.h>
 #include <inttypes.h>
+#include <linux/if_link.h>
 #include <linux/inet_diag.h>
+#include <linux/rtnetlink.h>
 #include <linux/sock_diag.h>
 #include <net/if.h>
 #include <sys/socket.h>
@@ -236,6 +238,59 @@ TEST_F(BpfNetworkStatsHelperTest, TestGetUidStatsTotal) {
     ASSERT_EQ((unsigned long)3, lines.size());
 }
 
+TEST_F(BpfNetworkStatsHelperTest, TestGetUidStatsBulk) {
+    StatsValue value1 = {
+            .rxPackets = TEST_PACKET0,
+            .rxBytes = TEST_BYTES0,
+            .txPackets = TEST_PACKET1,
+            .txBytes = TEST_BYTES1,
+    };
+    StatsValue value2 = {
+            .rxPackets = TEST_PACKET0 * 2,
+            .rxBytes = TEST_BYTES0 * 2,
+            .txPackets = TEST_PACKET1 * 2,
+            .txBytes = TEST_BYTES1 * 2,
+    };
+    ASSERT_RESULT_OK(mFakeAppUidStatsMap.writeValue(TEST_UID2, value2, BPF_ANY));
+    ASSERT_RESULT_OK(mFakeAppUidStatsMap.writeValue(TEST_UID1, value1, BPF_ANY));
+
+    std::vector<std::pair<uint32_t, StatsValue>> all;
+    ASSERT_EQ(0, bpfGetAllUidStatsInternal(&all, mFakeAppUidStatsMap));
+    ASSERT_EQ((unsigned long)2, all.size());
+    EXPECT_EQ(TEST_UID1, all[0].first);
+    expectStatsEqual(value1, all[0].second);
+    EXPECT_EQ(TEST_UID2, all[1].first);
+    expectStatsEqual(value2, all[1].second);
+
+    // Uids without traffic come back zeroed, in the order they were asked for.
+    const uint32_t uids[] = {TEST_UID2, TEST_UID1 + 1, TEST_UID1};
+    StatsValue results[3];
+    ASSERT_EQ(0, bpfGetUidStatsBulkInternal(uids, 3, results, mFakeAppUidStatsMap));
+    expectStatsEqual(value2, results[0]);
+    expectStatsEqual({}, results[1]);
+    expectStatsEqual(value1, results[2]);
+}
+
+TEST_F(BpfNetworkStatsHelperTest, TestGetUidStatsBulkFromSnapshot) {
+    StatsValue value1 = {
+            .rxPackets = TEST_PACKET0,
+            .rxBytes = TEST_BYTES0,
+            .txPackets = TEST_PACKET1,
+            .txBytes = TEST_BYTES1,
+    };
+    ASSERT_RESULT_OK(mFakeAppUidStatsMap.writeValue(TEST_UID1, value1, BPF_ANY));
+
+    // Enough uids to be served from a walk of the map rather than one lookup each.
+    std::vector<uint32_t> uids(100, TEST_UID1 + 1);
+    uids[42] = TEST_UID1;
+    std::vector<StatsValue> results(uids.size());
+    ASSERT_EQ(0, bpfGetUidStatsBulkInternal(uids.data(), uids.size(), results.data(),
+                                            mFakeAppUidStatsMap));
+    for (size_t i = 0; i < uids.size(); i++) {
+        expectStatsEqual(i == 42 ? value1 : StatsValue{}, results[i]);
+    }
+}
+
 TEST_F(BpfNetworkStatsHelperTest, TestGetIfaceStatsInternal) {
     updateIfaceMap(IFACE_NAME1, IFACE_INDEX1);
     updateIfaceMap(IFACE_NAME2, IFACE_INDEX2);
@@ -292,6 +347,107 @@ TEST_F(BpfNetworkStatsHelperTest, TestGetIfIndexStatsInternal) {
     expectStatsEqual(value, result);
 }
 
+TEST_F(BpfNetworkStatsHelperTest, TestGetTotalStatsInternal) {
+    BpfMap<uint32_t, StatsValue> fakeIfaceStatsTotalMap;
+    fakeIfaceStatsTotalMap.resetMap(BPF_MAP_TYPE_PERCPU_ARRAY, 1);
+    ASSERT_TRUE(fakeIfaceStatsTotalMap.isValid());
+    const int cpus = getPossibleCpuCount();
+    ASSERT_LT(0, cpus);
+
+    // Array entries exist from creation, so an idle device reads back zeroes.
+    StatsValue result = {};
+    ASSERT_EQ(0, bpfGetTotalStatsInternal(&result, fakeIfaceStatsTotalMap));
+    expectStatsEqual({}, result);
+
+    StatsValue value = {
+            .rxPackets = TEST_PACKET0,
+            .rxBytes = TEST_BYTES0,
+            .txPackets = TEST_PACKET1,
+            .txBytes = TEST_BYTES1,
+    };
+    // Every cpu counts separately, and the total is their sum.
+    std::vector<StatsValue> perCpu(cpus, value);
+    const uint32_t key = IFACE_STATS_TOTAL_KEY;
+    ASSERT_EQ(0, writeToMapEntry(fakeIfaceStatsTotalMap.getMap(), &key, perCpu.data(), BPF_ANY));
+    ASSERT_EQ(0, bpfGetTotalStatsInternal(&result, fakeIfaceStatsTotalMap));
+    StatsValue expected = {
+            .rxPackets = TEST_PACKET0 * cpus,
+            .rxBytes = TEST_BYTES0 * cpus,
+            .txPackets = TEST_PACKET1 * cpus,
+            .txBytes = TEST_BYTES1 * cpus,
+    };
+    expectStatsEqual(expected, result);
+}
+
+TEST_F(BpfNetworkStatsHelperTest, TestStatsMapNeedsDrain) {
+    BpfMap<uint32_t, uint32_t> fakeConfigurationMap;
+    fakeConfigurationMap.resetMap(BPF_MAP_TYPE_ARRAY, CONFIGURATION_MAP_SIZE);
+    ASSERT_TRUE(fakeConfigurationMap.isValid());
+    BpfMap<uint32_t, StatsMapHealthValue> fakeHealthMap;
+    fakeHealthMap.resetMap(BPF_MAP_TYPE_ARRAY, STATS_MAP_HEALTH_MAP_SIZE);
+    ASSERT_TRUE(fakeHealthMap.isValid());
+    EXPECT_RESULT_OK(fakeConfigurationMap.writeValue(CURRENT_STATS_MAP_CONFIGURATION_KEY,
+                                                     SELECT_MAP_A, BPF_ANY));
+    EXPECT_EQ(0, bpfStatsMapNeedsDrainInternal(fakeConfigurationMap, fakeHealthMap));
+
+    // Only the active map matters: a full inactive map is about to be drained anyway.
+    StatsMapHealthValue full = {.entries = STATS_MAP_DRAIN_THRESHOLD};
+    EXPECT_RESULT_OK(fakeHealthMap.writeValue(SELECT_MAP_B, full, BPF_ANY));
+    EXPECT_EQ(0, bpfStatsMapNeedsDrainInternal(fakeConfigurationMap, fakeHealthMap));
+    EXPECT_RESULT_OK(fakeConfigurationMap.writeValue(CURRENT_STATS_MAP_CONFIGURATION_KEY,
+                                                     SELECT_MAP_B, BPF_ANY));
+    EXPECT_EQ(1, bpfStatsMapNeedsDrainInternal(fakeConfigurationMap, fakeHealthMap));
+
+    // Draining resets the counters.
+    EXPECT_EQ(0, resetStatsMapHealthInternal(SELECT_MAP_B, fakeHealthMap));
+    EXPECT_EQ(0, bpfStatsMapNeedsDrainInternal(fakeConfigurationMap, fakeHealthMap));
+
+    // Dropped entries trigger a drain however few entries the map thinks it holds.
+    StatsMapHealthValue dropping = {.entries = 1, .insertFailures = 1};
+    EXPECT_RESULT_OK(fakeHealthMap.writeValue(SELECT_MAP_B, dropping, BPF_ANY));
+    EXPECT_EQ(1, bpfStatsMapNeedsDrainInternal(fakeConfigurationMap, fakeHealthMap));
+
+    EXPECT_RESULT_OK(fakeConfigurationMap.writeValue(CURRENT_STATS_MAP_CONFIGURATION_KEY,
+                                                     UINT32_MAX, BPF_ANY));
+    EXPECT_EQ(-ENOENT, bpfStatsMapNeedsDrainInternal(fakeConfigurationMap, fakeHealthMap));
+}
+
+TEST_F(BpfNetworkStatsHelperTest, TestTotalStatsIncludeUnnamedIfaces) {
+    BpfMap<uint32_t, StatsValue> fakeIfaceStatsTotalMap;
+    fakeIfaceStatsTotalMap.resetMap(BPF_MAP_TYPE_PERCPU_ARRAY, 1);
+    ASSERT_TRUE(fakeIfaceStatsTotalMap.isValid());
+    const int cpus = getPossibleCpuCount();
+    ASSERT_LT(0, cpus);
+
+    // IFACE_INDEX2 has no name, for example because it went away before it was registered.
+    updateIfaceMap(IFACE_NAME1, IFACE_INDEX1);
+    StatsValue value = {
+            .rxPackets = TEST_PACKET0,
+            .rxBytes = TEST_BYTES0,
+            .txPackets = TEST_PACKET1,
+            .txBytes = TEST_BYTES1,
+    };
+    EXPECT_RESULT_OK(mFakeIfaceStatsMap.writeValue(IFACE_INDEX1, value, BPF_ANY));
+    EXPECT_RESULT_OK(mFakeIfaceStatsMap.writeValue(IFACE_INDEX2, value, BPF_ANY));
+    // The bpf programs add every packet to the total, whatever its interface.
+    StatsValue total = value;
+    total += value;
+    std::vector<StatsValue> perCpu(cpus);
+    perCpu[0] = total;
+    const uint32_t key = IFACE_STATS_TOTAL_KEY;
+    ASSERT_EQ(0, writeToMapEntry(fakeIfaceStatsTotalMap.getMap(), &key, perCpu.data(), BPF_ANY));
+
+    // The walk over named interfaces skips the unnamed one...
+    StatsValue namedResult = {};
+    ASSERT_EQ(0, bpfGetIfaceStatsInternal(NULL, &namedResult, mFakeIfaceStatsMap, mIfIndex2Name));
+    expectStatsEqual(value, namedResult);
+
+    // ...but the total read by bpfGetIfaceStats(nullptr) includes it.
+    StatsValue totalResult = {};
+    ASSERT_EQ(0, bpfGetTotalStatsInternal(&totalResult, fakeIfaceStatsTotalMap));
+    expectStatsEqual(total, totalResult);
+}
+
 TEST_F(BpfNetworkStatsHelperTest, TestGetStatsDetail) {
     updateIfaceMap(IFACE_NAME1, IFACE_INDEX1);
     updateIfaceMap(IFACE_NAME2, IFACE_INDEX2);
@@ -409,6 +565,80 @@ TEST_F(BpfNetworkStatsHelperTest, TestGetIfaceStatsDetail) {
     expectStatsLineEqual(value2, TRUNCATED_IFACE_NAME, UID_ALL, SET_ALL, TAG_NONE, lines[3]);
 }
 
+// An RTM_NEWSTATS message as the kernel sends it in reply to an IFLA_STATS_LINK_64 dump.
+struct NewStatsMessage {
+    nlmsghdr hdr;
+    if_stats_msg ifsm;
+    nlattr attr;
+    rtnl_link_stats64 stats;
+};
+
+NewStatsMessage makeNewStatsMessage(uint32_t ifindex, const StatsValue& value) {
+    NewStatsMessage msg = {};
+    msg.hdr = {.nlmsg_len = sizeof(msg), .nlmsg_type = RTM_NEWSTATS};
+    msg.ifsm = {.ifindex = ifindex,
+                .filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64)};
+    msg.attr = {.nla_len = NLA_HDRLEN + sizeof(msg.stats), .nla_type = IFLA_STATS_LINK_64};
+    msg.stats.rx_packets = value.rxPackets;
+    msg.stats.rx_bytes = value.rxBytes;
+    msg.stats.tx_packets = value.txPackets;
+    msg.stats.tx_bytes = value.txBytes;
+    return msg;
+}
+
+TEST_F(BpfNetworkStatsHelperTest, TestParseNetlinkStatsDev) {
+    updateIfaceMap(IFACE_NAME1, IFACE_INDEX1);
+    updateIfaceMap(IFACE_NAME2, IFACE_INDEX2);
+    StatsValue value1 = {
+            .rxPackets = TEST_PACKET0,
+            .rxBytes = TEST_BYTES0,
+            .txPackets = TEST_PACKET1,
+            .txBytes = TEST_BYTES1,
+    };
+    StatsValue value2 = {
+            .rxPackets = TEST_PACKET1,
+            .rxBytes = TEST_BYTES1,
+            .txPackets = TEST_PACKET0,
+            .txBytes = TEST_BYTES0,
+    };
+
+    // Links without a known name are skipped, and parsing goes on until the end of the dump.
+    struct {
+        NewStatsMessage link1;
+        NewStatsMessage unknown;
+    } firstRead = {
+            .link1 = makeNewStatsMessage(IFACE_INDEX1, value1),
+            .unknown = makeNewStatsMessage(IFACE_INDEX3, value2),
+    };
+    struct {
+        NewStatsMessage link2;
+        nlmsghdr done;
+    } lastRead = {
+            .link2 = makeNewStatsMessage(IFACE_INDEX2, value2),
+            .done = {.nlmsg_len = sizeof(nlmsghdr), .nlmsg_type = NLMSG_DONE},
+    };
+    std::vector<stats_line> lines;
+    ASSERT_EQ(0, parseNetlinkNetworkStatsDevInternal(lines, netdutils::makeSlice(firstRead),
+                                                     mIfIndex2Name));
+    ASSERT_EQ(1, parseNetlinkNetworkStatsDevInternal(lines, netdutils::makeSlice(lastRead),
+                                                     mIfIndex2Name));
+    ASSERT_EQ((unsigned long)2, lines.size());
+    expectStatsLineEqual(value1, IFACE_NAME1, UID_ALL, SET_ALL, TAG_NONE, lines[0]);
+    expectStatsLineEqual(value2, IFACE_NAME2, UID_ALL, SET_ALL, TAG_NONE, lines[1]);
+
+    struct {
+        nlmsghdr hdr;
+        nlmsgerr err;
+    } error = {
+            .hdr = {.nlmsg_len = sizeof(error), .nlmsg_type = NLMSG_ERROR},
+            .err = {.error = -EOPNOTSUPP},
+    };
+    lines.clear();
+    EXPECT_EQ(-EOPNOTSUPP, parseNetlinkNetworkStatsDevInternal(lines, netdutils::makeSlice(error),
+                                                               mIfIndex2Name));
+    EXPECT_TRUE(lines.empty());
+}
+
 TEST_F(BpfNetworkStatsHelperTest, TestGetStatsSortedAndGrouped) {
     // Create iface indexes with duplicate iface name.
     updateIfaceMap(IFACE_NAME1, IFACE_INDEX1);
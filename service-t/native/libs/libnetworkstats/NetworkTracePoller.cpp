@@ -25,6 +25,7 @@
 #include <perfetto/tracing/platform.h>
 #include <perfetto/tracing/tracing.h>
 
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -34,17 +35,34 @@ namespace android {
 namespace bpf {
 namespace internal {
 using ::android::base::StringPrintf;
+using std::chrono::milliseconds;
+
+// Number of PacketTrace records the ring buffer holds. Each record is preceded
+// by a header and padded to 8 bytes.
+constexpr size_t kRingBufferCapacity =
+    PACKET_TRACE_BUF_SIZE /
+    ((BPF_RINGBUF_HDR_SZ + sizeof(PacketTrace) + 7) & ~size_t{7});
+
+// The poll interval ranges from a quarter of the configured one, when the ring
+// buffer is at least half full, to four times it when there is no traffic.
+constexpr uint32_t kPollIntervalRange = 4;
+constexpr double kRingBufferHighWatermark = 0.5;
 
 void NetworkTracePoller::PollAndSchedule(perfetto::base::TaskRunner* runner,
                                          uint32_t poll_ms) {
-  // Always schedule another run of ourselves to recursively poll periodically.
-  // The task runner is sequential so these can't run on top of each other.
-  runner->PostDelayedTask([=]() { PollAndSchedule(runner, poll_ms); }, poll_ms);
-
   if (mMutex.try_lock()) {
-    ConsumeAllLocked();
+    size_t consumed = 0;
+    if (ConsumeAllLocked(&consumed) && mPollInterval) {
+      const double fill = static_cast<double>(consumed) / kRingBufferCapacity;
+      poll_ms = mPollInterval->next(fill).count();
+      ATRACE_INT("NetworkTracePollMs", poll_ms);
+    }
     mMutex.unlock();
   }
+
+  // Always schedule another run of ourselves to recursively poll periodically.
+  // The task runner is sequential so these can't run on top of each other.
+  runner->PostDelayedTask([=]() { PollAndSchedule(runner, poll_ms); }, poll_ms);
 }
 
 bool NetworkTracePoller::Start(uint32_t pollMs) {
@@ -87,6 +105,11 @@ bool NetworkTracePoller::Start(uint32_t pollMs) {
   // Start a task runner to run ConsumeAll every mPollMs milliseconds.
   mTaskRunner = perfetto::Platform::GetDefaultPlatform()->CreateTaskRunner({});
   mPollMs = pollMs;
+  mPollInterval.emplace(netdutils::AdaptivePollInterval<milliseconds>::Parameters{
+      .minInterval = milliseconds(std::max<uint32_t>(1, pollMs / kPollIntervalRange)),
+      .initialInterval = milliseconds(pollMs),
+      .maxInterval = milliseconds(pollMs) * kPollIntervalRange,
+      .highWatermark = kRingBufferHighWatermark});
   PollAndSchedule(mTaskRunner.get(), mPollMs);
 
   mSessionCount++;
@@ -118,6 +141,7 @@ bool NetworkTracePoller::Stop() {
 
   mTaskRunner.reset();
   mRingBuffer.reset();
+  mPollInterval.reset();
 
   return res.ok();
 }
@@ -149,7 +173,7 @@ bool NetworkTracePoller::ConsumeAll() {
   return ConsumeAllLocked();
 }
 
-bool NetworkTracePoller::ConsumeAllLocked() {
+bool NetworkTracePoller::ConsumeAllLocked(size_t* consumed) {
   if (mRingBuffer == nullptr) {
     ALOGW("Tracing is not active");
     return false;
@@ -164,6 +188,7 @@ bool NetworkTracePoller::ConsumeAllLocked() {
   }
 
   ATRACE_INT("NetworkTracePackets", packets.size());
+  if (consumed != nullptr) *consumed = packets.size();
 
   TraceIfaces(packets);
   mCallback(packets);
@@ -18,6 +18,7 @@
 #define _BPF_NETWORKSTATS_H
 
 #include <bpf/BpfMap.h>
+#include <netdutils/Slice.h>
 #include "netd.h"
 
 namespace android {
@@ -32,6 +33,10 @@ constexpr int SET_ALL = -1;
 constexpr int SET_DEFAULT = 0;
 constexpr int SET_FOREGROUND = 1;
 
+// Once the active stats map holds this many entries it is swapped and drained ahead of the next
+// scheduled poll, leaving headroom for the entries added while that happens.
+constexpr uint64_t STATS_MAP_DRAIN_THRESHOLD = STATS_MAP_SIZE * 3 / 4;
+
 // The limit for stats received by a unknown interface;
 constexpr const int64_t MAX_UNKNOWN_IFACE_BYTES = 100 * 1000;
 
@@ -64,9 +69,20 @@ using IfIndexToNameFunc = std::function<Result<IfaceValue>(const uint32_t)>;
 int bpfGetUidStatsInternal(uid_t uid, StatsValue* stats,
                            const BpfMapRO<uint32_t, StatsValue>& appUidStatsMap);
 // For test only
+int bpfGetAllUidStatsInternal(std::vector<std::pair<uint32_t, StatsValue>>* stats,
+                              const BpfMapRO<uint32_t, StatsValue>& appUidStatsMap);
+// For test only
+int bpfGetUidStatsBulkInternal(const uint32_t* uids, size_t count, StatsValue* stats,
+                               const BpfMapRO<uint32_t, StatsValue>& appUidStatsMap);
+// For test only
 int bpfGetIfaceStatsInternal(const char* iface, StatsValue* stats,
                              const BpfMapRO<uint32_t, StatsValue>& ifaceStatsMap,
                              const IfIndexToNameFunc ifindex2name);
+// Number of possible cpus, i.e. of values per key in a per cpu map, or a negative errno.
+int getPossibleCpuCount();
+// For test only
+int bpfGetTotalStatsInternal(StatsValue* stats,
+                             const BpfMapRO<uint32_t, StatsValue>& ifaceStatsTotalMap);
 // For test only
 int bpfGetIfIndexStatsInternal(uint32_t ifindex, StatsValue* stats,
                                const BpfMapRO<uint32_t, StatsValue>& ifaceStatsMap);
@@ -75,6 +91,12 @@ int parseBpfNetworkStatsDetailInternal(std::vector<stats_line>& lines,
                                        const BpfMapRO<StatsKey, StatsValue>& statsMap,
                                        const IfIndexToNameFunc ifindex2name);
 // For test only
+int bpfStatsMapNeedsDrainInternal(const BpfMapRO<uint32_t, uint32_t>& configurationMap,
+                                  const BpfMapRO<uint32_t, StatsMapHealthValue>& healthMap);
+// For test only
+int resetStatsMapHealthInternal(uint32_t selectedMap,
+                                BpfMap<uint32_t, StatsMapHealthValue>& healthMap);
+// For test only
 int cleanStatsMapInternal(const base::unique_fd& cookieTagMap, const base::unique_fd& tagStatsMap);
 
 template <class Key>
@@ -105,13 +127,33 @@ int parseBpfNetworkStatsDevInternal(std::vector<stats_line>& lines,
                                     const BpfMapRO<uint32_t, StatsValue>& statsMap,
                                     const IfIndexToNameFunc ifindex2name);
 
+// For test only. Appends a line for each RTM_NEWSTATS message in msgs. Returns 1 once the end of
+// the dump was seen, 0 if more messages are expected, or -errno if the kernel reported an error.
+int parseNetlinkNetworkStatsDevInternal(std::vector<stats_line>& lines, const netdutils::Slice msgs,
+                                        const IfIndexToNameFunc ifindex2name);
+
 void bpfRegisterIface(const char* iface);
 int bpfGetUidStats(uid_t uid, StatsValue* stats);
+// Reads app_uid_stats_map once and returns one entry per uid, sorted by uid.
+int bpfGetAllUidStats(std::vector<std::pair<uint32_t, StatsValue>>* stats);
+// Fills stats[i] with the totals of uids[i]. A few uids are looked up directly, larger requests
+// are served from a single read of app_uid_stats_map. Uids without an entry get zeroed stats.
+int bpfGetUidStatsBulk(const uint32_t* uids, size_t count, StatsValue* stats);
+// Sums the counters of every ifindex that had the name iface. With a null iface, returns the total
+// of all interfaces from iface_stats_total_map. That total also counts ifindexes whose name can
+// no longer be resolved, which the per-interface reads skip, so it can exceed their sum.
 int bpfGetIfaceStats(const char* iface, StatsValue* stats);
 int bpfGetIfIndexStats(int ifindex, StatsValue* stats);
 int parseBpfNetworkStatsDetail(std::vector<stats_line>* lines);
+// Returns 1 if the active stats map is close to full, or already dropping entries, and should be
+// drained before the next scheduled poll; 0 if not; -errno on failure.
+int bpfStatsMapNeedsDrain();
+int bpfGetStatsMapHealth(uint32_t selectedMap, StatsMapHealthValue* health);
 
 int parseBpfNetworkStatsDev(std::vector<stats_line>* lines);
+// Same rows as parseBpfNetworkStatsDev, but read from the kernel's own link counters for all
+// interfaces with a single RTM_GETSTATS dump, rather than from what the BPF programs accounted.
+int parseNetlinkNetworkStatsDev(std::vector<stats_line>* lines);
 void groupNetworkStats(std::vector<stats_line>& lines);
 int cleanStatsMap();
 }  // namespace bpf
@@ -19,12 +19,15 @@
 #include <perfetto/base/task_runner.h>
 #include <perfetto/tracing.h>
 
+#include <chrono>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
 #include "android-base/thread_annotations.h"
 #include "bpf/BpfMap.h"
 #include "bpf/BpfRingbuf.h"
+#include "netdutils/AdaptivePollInterval.h"
 
 // For PacketTrace struct definition
 #include "netd.h"
@@ -54,12 +57,16 @@ class NetworkTracePoller {
 
  private:
   // Poll the ring buffer for new data and schedule another run of ourselves
-  // after poll_ms (essentially polling periodically until stopped). This takes
-  // in the runner and poll duration to prevent a hard requirement on the lock
-  // and thus a deadlock while resetting the TaskRunner. The runner pointer is
-  // always valid within tasks run by that runner.
+  // (essentially polling periodically until stopped). The next run is after
+  // mPollInterval adapts to how full the ring buffer was, or after poll_ms if
+  // the lock could not be taken. This takes in the runner and poll duration to
+  // prevent a hard requirement on the lock and thus a deadlock while resetting
+  // the TaskRunner. The runner pointer is always valid within tasks run by
+  // that runner.
   void PollAndSchedule(perfetto::base::TaskRunner* runner, uint32_t poll_ms);
-  bool ConsumeAllLocked() REQUIRES(mMutex);
+
+  // If consumed is not null, it is set to the number of events consumed.
+  bool ConsumeAllLocked(size_t* consumed = nullptr) REQUIRES(mMutex);
 
   // Record sparse iface stats via atrace. This queries the per-iface stats maps
   // for any iface present in the vector of packets. This is inexact, but should
@@ -77,6 +84,11 @@ class NetworkTracePoller {
   // How often to poll the ring buffer, defined by the trace config.
   uint32_t mPollMs GUARDED_BY(mMutex);
 
+  // The actual poll interval, which varies around mPollMs with how much data
+  // each poll finds. Set while tracing is active.
+  std::optional<netdutils::AdaptivePollInterval<std::chrono::milliseconds>>
+      mPollInterval GUARDED_BY(mMutex);
+
   // The function to process PacketTrace, typically a Perfetto sink.
   EventSink mCallback GUARDED_BY(mMutex);
 
@@ -44,6 +44,7 @@ public class NetworkStatsEventLogger {
     static final int POLL_REASON_REG_CALLBACK = 7;
     static final int POLL_REASON_REMOVE_UIDS = 8;
     static final int POLL_REASON_UPSTREAM_CHANGED = 9;
+    static final int POLL_REASON_STATS_MAP_PRESSURE = 10;
 
     @Retention(RetentionPolicy.SOURCE)
     @IntDef(prefix = { "POLL_REASON_" }, value = {
@@ -56,11 +57,12 @@ public class NetworkStatsEventLogger {
             POLL_REASON_RAT_CHANGED,
             POLL_REASON_REMOVE_UIDS,
             POLL_REASON_REG_CALLBACK,
-            POLL_REASON_UPSTREAM_CHANGED
+            POLL_REASON_UPSTREAM_CHANGED,
+            POLL_REASON_STATS_MAP_PRESSURE
     })
     public @interface PollReason {
     }
-    static final int MAX_POLL_REASON = POLL_REASON_UPSTREAM_CHANGED;
+    static final int MAX_POLL_REASON = POLL_REASON_STATS_MAP_PRESSURE;
 
     @VisibleForTesting(visibility = PRIVATE)
     public static final int MAX_EVENTS_LOGS = 50;
@@ -145,6 +147,7 @@ public class NetworkStatsEventLogger {
                 case POLL_REASON_REMOVE_UIDS:               return "REMOVE_UIDS";
                 case POLL_REASON_REG_CALLBACK:              return "REG_CALLBACK";
                 case POLL_REASON_UPSTREAM_CHANGED:          return "UPSTREAM_CHANGED";
+                case POLL_REASON_STATS_MAP_PRESSURE:        return "STATS_MAP_PRESSURE";
                 default:                                    return Integer.toString(reason);
             }
         }
@@ -106,6 +106,21 @@ public class NetworkStatsFactory {
             return stats;
         }
 
+        /**
+         * Read device summary statistics from the kernel's link counters into given
+         * {@link NetworkStats} object, with a single netlink dump. Values are expected to
+         * monotonically increase since each interface was created.
+         */
+        @NonNull
+        public NetworkStats getNetworkStatsDevNetlink() throws IOException {
+            final NetworkStats stats = new NetworkStats(SystemClock.elapsedRealtime(), 6);
+            final int ret = nativeReadNetworkStatsDevNetlink(stats);
+            if (ret != 0) {
+                throw new IOException("Failed to read netlink iface stats");
+            }
+            return stats;
+        }
+
         /** Create a new {@link BpfNetMaps}. */
         public BpfNetMaps createBpfNetMaps(@NonNull Context ctx) {
             return new BpfNetMaps(ctx);
@@ -173,6 +188,16 @@ public class NetworkStatsFactory {
         return mDeps.getNetworkStatsDev();
     }
 
+    /**
+     * Parse and return interface-level summary {@link NetworkStats} as counted by the network
+     * devices themselves. Unlike {@link #readNetworkStatsSummaryXt}, this includes traffic that
+     * never reaches the BPF accounting hooks, such as link-layer overhead and forwarded packets.
+     * Only interfaces that currently exist are included.
+     */
+    public NetworkStats readNetworkStatsSummaryDevNetlink() throws IOException {
+        return mDeps.getNetworkStatsDevNetlink();
+    }
+
     public NetworkStats readNetworkStatsDetail() throws IOException {
         return readNetworkStatsDetail(UID_ALL, INTERFACES_ALL, TAG_ALL);
     }
@@ -302,6 +327,9 @@ public class NetworkStatsFactory {
     @VisibleForTesting
     public static native int nativeReadNetworkStatsDev(NetworkStats stats);
 
+    @VisibleForTesting
+    public static native int nativeReadNetworkStatsDevNetlink(NetworkStats stats);
+
     private static ProtocolException protocolExceptionWithCause(String message, Throwable cause) {
         ProtocolException pe = new ProtocolException(message);
         pe.initCause(cause);
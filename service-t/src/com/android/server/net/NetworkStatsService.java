@@ -75,6 +75,7 @@ import static com.android.server.net.NetworkStatsEventLogger.POLL_REASON_OPEN_SE
 import static com.android.server.net.NetworkStatsEventLogger.POLL_REASON_RAT_CHANGED;
 import static com.android.server.net.NetworkStatsEventLogger.POLL_REASON_REG_CALLBACK;
 import static com.android.server.net.NetworkStatsEventLogger.POLL_REASON_REMOVE_UIDS;
+import static com.android.server.net.NetworkStatsEventLogger.POLL_REASON_STATS_MAP_PRESSURE;
 import static com.android.server.net.NetworkStatsEventLogger.POLL_REASON_UPSTREAM_CHANGED;
 import static com.android.server.net.NetworkStatsEventLogger.PollEvent;
 
@@ -95,6 +96,7 @@ import android.content.pm.ApplicationInfo;
 import android.content.pm.PackageManager;
 import android.content.res.Resources;
 import android.database.ContentObserver;
+import android.net.BpfNetMapsUtils;
 import android.net.DataUsageRequest;
 import android.net.INetd;
 import android.net.INetworkStatsService;
@@ -118,6 +120,7 @@ import android.net.TetherStatsParcel;
 import android.net.TetheringManager;
 import android.net.TrafficStats;
 import android.net.TransportInfo;
+import android.net.UidOwnerValue;
 import android.net.UnderlyingNetworkInfo;
 import android.net.Uri;
 import android.net.netstats.IUsageCallback;
@@ -179,7 +182,6 @@ import com.android.net.module.util.PermissionUtils;
 import com.android.net.module.util.SharedLog;
 import com.android.net.module.util.Struct;
 import com.android.net.module.util.Struct.S32;
-import com.android.net.module.util.Struct.U8;
 import com.android.net.module.util.bpf.CookieTagMapKey;
 import com.android.net.module.util.bpf.CookieTagMapValue;
 import com.android.networkstack.apishim.BroadcastOptionsShimImpl;
@@ -233,6 +235,9 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
     // A message for broadcasting ACTION_NETWORK_STATS_UPDATED in handler thread to prevent
     // deadlock.
     private static final int MSG_BROADCAST_NETWORK_STATS_UPDATED = 4;
+    // Check whether the active stats map is filling up, and drain it early if so.
+    @VisibleForTesting
+    static final int MSG_CHECK_STATS_MAP_PRESSURE = 5;
 
     /** Flags to control detail level of poll event. */
     private static final int FLAG_PERSIST_NETWORK = 0x1;
@@ -248,6 +253,14 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
      */
     private static final int DEFAULT_PERFORM_POLL_DELAY_MS = 1000;
 
+    /**
+     * How often to check the fill level of the active stats map. The regular poll interval can be
+     * long enough for a burst of new uid/tag/iface combinations to fill the map and have further
+     * traffic go uncounted, so it is drained early when close to full. This runs on the uptime
+     * clock, so it does not wake the device up.
+     */
+    private static final long STATS_MAP_PRESSURE_CHECK_INTERVAL_MS = 60 * 1000L;
+
     private static final String TAG_NETSTATS_ERROR = "netstats_error";
 
     /**
@@ -262,8 +275,8 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
     private static final String NETSTATS_COMBINE_SUBTYPE_ENABLED =
             "netstats_combine_subtype_enabled";
 
-    private static final String UID_COUNTERSET_MAP_PATH =
-            "/sys/fs/bpf/netd_shared/map_netd_uid_counterset_map";
+    private static final String UID_OWNER_MAP_PATH =
+            "/sys/fs/bpf/netd_shared/map_netd_uid_owner_map";
     private static final String COOKIE_TAG_MAP_PATH =
             "/sys/fs/bpf/netd_shared/map_netd_cookie_tag_map";
     private static final String APP_UID_STATS_MAP_PATH =
@@ -428,12 +441,14 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
 
     /**
      * Current counter sets for each UID.
-     * TODO: maybe remove mActiveUidCounterSet and read UidCouneterSet value from mUidCounterSetMap
+     * TODO: maybe remove mActiveUidCounterSet and read the counter set from mUidOwnerMap
      * directly ? But if mActiveUidCounterSet would be accessed very frequently, maybe keep
      * mActiveUidCounterSet to avoid accessing kernel too frequently.
      */
     private SparseIntArray mActiveUidCounterSet = new SparseIntArray();
-    private IBpfMap<S32, U8> mUidCounterSetMap = null;
+    // Counter sets live in the uid owner map next to the firewall rules written by BpfNetMaps,
+    // so that the eBPF accounting program needs one lookup per packet for both.
+    private IBpfMap<S32, UidOwnerValue> mUidOwnerMap = null;
     private IBpfMap<CookieTagMapKey, CookieTagMapValue> mCookieTagMap = null;
     private IBpfMap<StatsMapKey, StatsMapValue> mStatsMapA = null;
     private IBpfMap<StatsMapKey, StatsMapValue> mStatsMapB = null;
@@ -554,6 +569,16 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
                     registerGlobalAlert();
                     break;
                 }
+                case MSG_CHECK_STATS_MAP_PRESSURE: {
+                    if (mDeps.shouldDrainStatsMap()) {
+                        performPoll(FLAG_PERSIST_NETWORK,
+                                maybeCreatePollEvent(POLL_REASON_STATS_MAP_PRESSURE));
+                    }
+                    removeMessages(MSG_CHECK_STATS_MAP_PRESSURE);
+                    sendEmptyMessageDelayed(MSG_CHECK_STATS_MAP_PRESSURE,
+                            STATS_MAP_PRESSURE_CHECK_INTERVAL_MS);
+                    break;
+                }
                 case MSG_BROADCAST_NETWORK_STATS_UPDATED: {
                     final Intent updatedIntent = new Intent(ACTION_NETWORK_STATS_UPDATED);
                     updatedIntent.setFlags(Intent.FLAG_RECEIVER_REGISTERED_ONLY);
@@ -630,7 +655,7 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
         mLocationPermissionChecker = mDeps.makeLocationPermissionChecker(mContext);
         mInterfaceMapHelper = mDeps.makeBpfInterfaceMapHelper();
         try {
-            mUidCounterSetMap = mDeps.getUidCounterSetMap();
+            mUidOwnerMap = mDeps.getUidOwnerMap();
             mCookieTagMap = mDeps.getCookieTagMap();
             mStatsMapA = mDeps.getStatsMapA();
             mStatsMapB = mDeps.getStatsMapB();
@@ -807,12 +832,12 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
             return new BpfInterfaceMapHelper();
         }
 
-        /** Get counter sets map for each UID. */
-        public IBpfMap<S32, U8> getUidCounterSetMap() {
+        /** Get the uid owner map, which holds the counter set of each UID. */
+        public IBpfMap<S32, UidOwnerValue> getUidOwnerMap() {
             try {
-                return new BpfMap<>(UID_COUNTERSET_MAP_PATH, S32.class, U8.class);
+                return new BpfMap<>(UID_OWNER_MAP_PATH, S32.class, UidOwnerValue.class);
             } catch (ErrnoException e) {
-                Log.wtf(TAG, "Cannot open uid counter set map: " + e);
+                Log.wtf(TAG, "Cannot open uid owner map: " + e);
                 return null;
             }
         }
@@ -892,6 +917,53 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
             return DeviceConfigUtils.isTetheringFeatureNotChickenedOut(
                     ctx, CONFIG_ENABLE_NETWORK_STATS_EVENT_LOGGER);
         }
+
+        /**
+         * Dump the latency histograms recorded by native code in this process to fd.
+         */
+        public void dumpNativeLatencies(FileDescriptor fd) {
+            nativeDumpLatencyHistograms(fd);
+        }
+
+        /**
+         * Whether the active stats map is close to full and should be drained before the next
+         * scheduled poll.
+         */
+        public boolean shouldDrainStatsMap() {
+            return nativeShouldDrainStatsMap();
+        }
+
+        /**
+         * Dump the fill level of both stats maps to fd.
+         */
+        public void dumpStatsMapHealth(FileDescriptor fd) {
+            nativeDumpStatsMapHealth(fd);
+        }
+
+        /**
+         * Get the uid of the binder caller.
+         */
+        public int getCallingUid() {
+            return Binder.getCallingUid();
+        }
+
+        /**
+         * Read the stats since boot of each uid into the parallel output arrays.
+         * Returns false if the stats could not be read.
+         */
+        public boolean getUidStatsBulk(int[] uids, long[] rxBytes, long[] rxPackets,
+                long[] txBytes, long[] txPackets) {
+            return nativeGetUidStatsBulk(uids, rxBytes, rxPackets, txBytes, txPackets);
+        }
+
+        /**
+         * Read the stats since boot of every uid with traffic into the parallel output arrays.
+         * Returns the number of such uids, or -1 if the stats could not be read.
+         */
+        public int getAllUidStats(int[] uids, long[] rxBytes, long[] rxPackets, long[] txBytes,
+                long[] txPackets) {
+            return nativeGetAllUidStats(uids, rxBytes, rxPackets, txBytes, txPackets);
+        }
     }
 
     /**
@@ -979,6 +1051,9 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
                 .getUriFor(NETSTATS_COMBINE_SUBTYPE_ENABLED)));
 
         registerGlobalAlert();
+
+        mHandler.sendEmptyMessageDelayed(MSG_CHECK_STATS_MAP_PRESSURE,
+                STATS_MAP_PRESSURE_CHECK_INTERVAL_MS);
     }
 
     private NetworkStatsRecorder buildRecorder(
@@ -1841,25 +1916,16 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
     }
 
     private void setKernelCounterSet(int uid, int set) {
-        if (mUidCounterSetMap == null) {
+        if (mUidOwnerMap == null) {
             Log.wtf(TAG, "Fail to set UidCounterSet: Null bpf map");
             return;
         }
 
-        if (set == SET_DEFAULT) {
-            try {
-                mUidCounterSetMap.deleteEntry(new S32(uid));
-            } catch (ErrnoException e) {
-                Log.w(TAG, "UidCounterSetMap.deleteEntry(" + uid + ") failed with errno: " + e);
-            }
-            return;
-        }
-
+        // SET_DEFAULT is 0, which setUidCounterSet() treats as no counter set.
         try {
-            mUidCounterSetMap.updateEntry(new S32(uid), new U8((short) set));
+            BpfNetMapsUtils.setUidCounterSet(mUidOwnerMap, uid, (short) set);
         } catch (ErrnoException e) {
-            Log.w(TAG, "UidCounterSetMap.updateEntry(" + uid + ", " + set
-                    + ") failed with errno: " + e);
+            Log.w(TAG, "setUidCounterSet(" + uid + ", " + set + ") failed with errno: " + e);
         }
     }
 
@@ -1993,6 +2059,59 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
         return getEntryValueForType(nativeGetUidStat(uid), type);
     }
 
+    @Override
+    public void getUidStatsBulk(@NonNull int[] uids, @NonNull long[] rxBytes,
+            @NonNull long[] rxPackets, @NonNull long[] txBytes, @NonNull long[] txPackets) {
+        Objects.requireNonNull(uids);
+        if (rxBytes.length < uids.length || rxPackets.length < uids.length
+                || txBytes.length < uids.length || txPackets.length < uids.length) {
+            throw new IllegalArgumentException("Output arrays too short");
+        }
+
+        // Same restriction as getUidStats: apps only get to see their own usage, so nothing
+        // else is read for them.
+        final int callingUid = mDeps.getCallingUid();
+        if (callingUid == android.os.Process.SYSTEM_UID) {
+            if (!mDeps.getUidStatsBulk(uids, rxBytes, rxPackets, txBytes, txPackets)) {
+                fillUnsupported(uids.length, rxBytes, rxPackets, txBytes, txPackets);
+            }
+            return;
+        }
+
+        fillUnsupported(uids.length, rxBytes, rxPackets, txBytes, txPackets);
+        if (!CollectionUtils.contains(uids, callingUid)) return;
+        final long[] ownRxBytes = new long[1];
+        final long[] ownRxPackets = new long[1];
+        final long[] ownTxBytes = new long[1];
+        final long[] ownTxPackets = new long[1];
+        if (!mDeps.getUidStatsBulk(new int[] {callingUid},
+                ownRxBytes, ownRxPackets, ownTxBytes, ownTxPackets)) {
+            return;
+        }
+        for (int i = 0; i < uids.length; i++) {
+            if (uids[i] != callingUid) continue;
+            rxBytes[i] = ownRxBytes[0];
+            rxPackets[i] = ownRxPackets[0];
+            txBytes[i] = ownTxBytes[0];
+            txPackets[i] = ownTxPackets[0];
+        }
+    }
+
+    private static void fillUnsupported(int count, long[]... arrays) {
+        for (long[] array : arrays) {
+            Arrays.fill(array, 0, count, UNSUPPORTED);
+        }
+    }
+
+    @Override
+    public int getAllUidStats(@NonNull int[] uids, @NonNull long[] rxBytes,
+            @NonNull long[] rxPackets, @NonNull long[] txBytes, @NonNull long[] txPackets) {
+        if (mDeps.getCallingUid() != android.os.Process.SYSTEM_UID) {
+            return UNSUPPORTED;
+        }
+        return mDeps.getAllUidStats(uids, rxBytes, rxPackets, txBytes, txPackets);
+    }
+
     @Override
     public long getIfaceStats(@NonNull String iface, int type) {
         Objects.requireNonNull(iface);
@@ -2613,9 +2732,9 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
         deleteStatsMapTagData(mStatsMapB, uid);
 
         try {
-            mUidCounterSetMap.deleteEntry(new S32(uid));
+            BpfNetMapsUtils.setUidCounterSet(mUidOwnerMap, uid, (short) SET_DEFAULT);
         } catch (ErrnoException e) {
-            logErrorIfNotErrNoent(e, "Failed to delete tag data from uid counter set map");
+            logErrorIfNotErrNoent(e, "Failed to reset counter set in uid owner map");
         }
 
         try {
@@ -2933,6 +3052,18 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
             pw.increaseIndent();
             mSkDestroyListener.dump(pw);
             pw.decreaseIndent();
+
+            pw.println();
+            pw.println("Stats map health:");
+            // Written directly to fd, so everything printed so far must be out first.
+            pw.flush();
+            mDeps.dumpStatsMapHealth(fd);
+
+            pw.println();
+            pw.println("Native latencies:");
+            // Written directly to fd, so everything printed so far must be out first.
+            pw.flush();
+            mDeps.dumpNativeLatencies(fd);
         }
     }
 
@@ -3000,7 +3131,7 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
 
     private void dumpMapStatus(final IndentingPrintWriter pw) {
         BpfDump.dumpMapStatus(mCookieTagMap, pw, "mCookieTagMap", COOKIE_TAG_MAP_PATH);
-        BpfDump.dumpMapStatus(mUidCounterSetMap, pw, "mUidCounterSetMap", UID_COUNTERSET_MAP_PATH);
+        BpfDump.dumpMapStatus(mUidOwnerMap, pw, "mUidOwnerMap", UID_OWNER_MAP_PATH);
         BpfDump.dumpMapStatus(mAppUidStatsMap, pw, "mAppUidStatsMap", APP_UID_STATS_MAP_PATH);
         BpfDump.dumpMapStatus(mStatsMapA, pw, "mStatsMapA", STATS_MAP_A_PATH);
         BpfDump.dumpMapStatus(mStatsMapB, pw, "mStatsMapB", STATS_MAP_B_PATH);
@@ -3021,11 +3152,11 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
 
     @GuardedBy("mStatsLock")
     private void dumpUidCounterSetMapLocked(final IndentingPrintWriter pw) {
-        if (mUidCounterSetMap == null) {
+        if (mUidOwnerMap == null) {
             return;
         }
-        BpfDump.dumpMap(mUidCounterSetMap, pw, "mUidCounterSetMap",
-                (uid, set) -> "uid=" + uid.val + " set=" + set.val);
+        BpfDump.dumpMap(mUidOwnerMap, pw, "mUidOwnerMap counter sets",
+                (uid, value) -> "uid=" + uid.val + " set=" + value.counterSet);
     }
 
     @GuardedBy("mStatsLock")
@@ -3438,7 +3569,17 @@ public class NetworkStatsService extends INetworkStatsService.Stub {
     private static native NetworkStats.Entry nativeGetIfaceStat(String iface);
     @Nullable
     private static native NetworkStats.Entry nativeGetUidStat(int uid);
+    private static native boolean nativeGetUidStatsBulk(int[] uids, long[] rxBytes,
+            long[] rxPackets, long[] txBytes, long[] txPackets);
+    private static native int nativeGetAllUidStats(int[] uids, long[] rxBytes, long[] rxPackets,
+            long[] txBytes, long[] txPackets);
 
     /** Initializes and registers the Perfetto Network Trace data source */
     public static native void nativeInitNetworkTracing();
+
+    private static native boolean nativeShouldDrainStatsMap();
+    private static native void nativeDumpStatsMapHealth(FileDescriptor fd);
+
+    /** Dumps the latency histograms recorded by native code in this process to fd */
+    private static native void nativeDumpLatencyHistograms(FileDescriptor fd);
 }
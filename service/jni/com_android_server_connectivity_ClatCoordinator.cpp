@@ -27,10 +27,13 @@
 #include <net/if.h>
 #include <spawn.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
 #include <sys/xattr.h>
 #include <string>
+#include <thread>
 #include <unistd.h>
 
 #include <android-modules-utils/sdk_level.h>
@@ -39,7 +42,9 @@
 #include <netjniutils/netjniutils.h>
 #include <private/android_filesystem_config.h>
 
+#include "clatd_control.h"
 #include "libclat/clatutils.h"
+#include "nativehelper/scoped_local_ref.h"
 #include "nativehelper/scoped_utf_chars.h"
 
 // Sync from system/netd/server/NetdConstants.h
@@ -225,31 +230,87 @@ jstring com_android_server_connectivity_ClatCoordinator_generateIpv6Address(
     return env->NewStringUTF(addrstr);
 }
 
-static jint com_android_server_connectivity_ClatCoordinator_createTunInterface(JNIEnv* env,
-                                                                               jclass clazz,
-                                                                               jstring tuniface) {
-    ScopedUtfChars v4interface(env, tuniface);
+// The helpers below return a file descriptor, or -errno and the name of the step that failed. They
+// don't touch the JNIEnv, so that prepareClat can run them on other threads.
 
+static int createTunInterface(const char* name, const char** failed) {
     // open the tun device in non blocking mode as required by clatd
-    jint fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
     if (fd == -1) {
-        jniThrowExceptionFmt(env, "java/io/IOException", "open tun device failed (%s)",
-                             strerror(errno));
-        return -1;
+        *failed = "open tun device";
+        return -errno;
     }
 
     struct ifreq ifr = {
             .ifr_flags = static_cast<short>(IFF_TUN | IFF_TUN_EXCL),
     };
-    strlcpy(ifr.ifr_name, v4interface.c_str(), sizeof(ifr.ifr_name));
+    strlcpy(ifr.ifr_name, name, sizeof(ifr.ifr_name));
 
     if (ioctl(fd, TUNSETIFF, &ifr, sizeof(ifr))) {
+        const int err = errno;
         close(fd);
-        jniThrowExceptionFmt(env, "java/io/IOException", "ioctl(TUNSETIFF) failed (%s)",
-                             strerror(errno));
-        return -1;
+        *failed = "ioctl(TUNSETIFF)";
+        return -err;
+    }
+
+    return fd;
+}
+
+static int openPacketSocket(const char** failed) {
+    // Will eventually be bound to htons(ETH_P_IPV6) protocol,
+    // but only after appropriate bpf filter is attached.
+    const int sock = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        *failed = "packet socket failed";
+        return -errno;
+    }
+    const int on = 1;
+    // enable tpacket_auxdata cmsg delivery, which includes L2 header length
+    if (setsockopt(sock, SOL_PACKET, PACKET_AUXDATA, &on, sizeof(on))) {
+        const int err = errno;
+        close(sock);
+        *failed = "packet socket auxdata enablement failed";
+        return -err;
+    }
+    // needed for virtio_net_hdr prepending, which includes checksum metadata
+    if (setsockopt(sock, SOL_PACKET, PACKET_VNET_HDR, &on, sizeof(on))) {
+        const int err = errno;
+        close(sock);
+        *failed = "packet socket vnet_hdr enablement failed";
+        return -err;
     }
+    return sock;
+}
+
+static int openRawSocket6(uint32_t mark, const char** failed) {
+    int sock = socket(AF_INET6, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_RAW);
+    if (sock < 0) {
+        *failed = "raw socket failed";
+        return -errno;
+    }
+
+    // TODO: check the mark validation
+    if (setsockopt(sock, SOL_SOCKET, SO_MARK, &mark, sizeof(mark)) < 0) {
+        const int err = errno;
+        close(sock);
+        *failed = "could not set mark on raw socket";
+        return -err;
+    }
+
+    return sock;
+}
 
+static jint com_android_server_connectivity_ClatCoordinator_createTunInterface(JNIEnv* env,
+                                                                               jclass clazz,
+                                                                               jstring tuniface) {
+    ScopedUtfChars v4interface(env, tuniface);
+
+    const char* failed = nullptr;
+    const int fd = createTunInterface(v4interface.c_str(), &failed);
+    if (fd < 0) {
+        jniThrowExceptionFmt(env, "java/io/IOException", "%s failed (%s)", failed, strerror(-fd));
+        return -1;
+    }
     return fd;
 }
 
@@ -276,24 +337,10 @@ static jint com_android_server_connectivity_ClatCoordinator_detectMtu(JNIEnv* en
 
 static jint com_android_server_connectivity_ClatCoordinator_openPacketSocket(JNIEnv* env,
                                                                               jclass clazz) {
-    // Will eventually be bound to htons(ETH_P_IPV6) protocol,
-    // but only after appropriate bpf filter is attached.
-    const int sock = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    const char* failed = nullptr;
+    const int sock = openPacketSocket(&failed);
     if (sock < 0) {
-        throwIOException(env, "packet socket failed", errno);
-        return -1;
-    }
-    const int on = 1;
-    // enable tpacket_auxdata cmsg delivery, which includes L2 header length
-    if (setsockopt(sock, SOL_PACKET, PACKET_AUXDATA, &on, sizeof(on))) {
-        throwIOException(env, "packet socket auxdata enablement failed", errno);
-        close(sock);
-        return -1;
-    }
-    // needed for virtio_net_hdr prepending, which includes checksum metadata
-    if (setsockopt(sock, SOL_PACKET, PACKET_VNET_HDR, &on, sizeof(on))) {
-        throwIOException(env, "packet socket vnet_hdr enablement failed", errno);
-        close(sock);
+        throwIOException(env, failed, -sock);
         return -1;
     }
     return sock;
@@ -302,20 +349,127 @@ static jint com_android_server_connectivity_ClatCoordinator_openPacketSocket(JNI
 static jint com_android_server_connectivity_ClatCoordinator_openRawSocket6(JNIEnv* env,
                                                                            jclass clazz,
                                                                            jint mark) {
-    int sock = socket(AF_INET6, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_RAW);
+    const char* failed = nullptr;
+    const int sock = openRawSocket6(mark, &failed);
     if (sock < 0) {
-        throwIOException(env, "raw socket failed", errno);
+        throwIOException(env, failed, -sock);
         return -1;
     }
+    return sock;
+}
 
-    // TODO: check the mark validation
-    if (setsockopt(sock, SOL_SOCKET, SO_MARK, &mark, sizeof(mark)) < 0) {
-        throwIOException(env, "could not set mark on raw socket", errno);
-        close(sock);
-        return -1;
+// Runs the steps of bringing up clat that don't depend on each other at the same time: picking the
+// IPv4 and IPv6 addresses, creating the tun interface, detecting the MTU and opening the sockets.
+// On success, fills addrs with {v4, v6} and fds with {tun fd, packet socket, raw socket, mtu}.
+// On failure nothing is left open.
+static void com_android_server_connectivity_ClatCoordinator_prepareClat(
+        JNIEnv* env, jclass clazz, jstring ifaceStr, jstring tunIfaceStr, jstring v4addrStr,
+        jint prefixlen, jstring prefix64Str, jint platSuffix, jint mark, jobjectArray addrs,
+        jintArray fds) {
+    ScopedUtfChars iface(env, ifaceStr);
+    ScopedUtfChars tunIface(env, tunIfaceStr);
+    ScopedUtfChars v4addr(env, v4addrStr);
+    ScopedUtfChars prefix64(env, prefix64Str);
+
+    if (iface.c_str() == nullptr || tunIface.c_str() == nullptr) {
+        jniThrowExceptionFmt(env, "java/io/IOException", "Invalid null interface name");
+        return;
+    }
+    if (env->GetArrayLength(addrs) != 2 || env->GetArrayLength(fds) != 4) {
+        jniThrowExceptionFmt(env, "java/lang/IllegalArgumentException", "Invalid output arrays");
+        return;
     }
 
-    return sock;
+    in_addr ip;
+    if (inet_pton(AF_INET, v4addr.c_str(), &ip) != 1) {
+        throwIOException(env, "invalid address", EINVAL);
+        return;
+    }
+    in6_addr nat64Prefix;
+    if (inet_pton(AF_INET6, prefix64.c_str(), &nat64Prefix) != 1) {
+        jniThrowExceptionFmt(env, "java/io/IOException", "Invalid prefix %s", prefix64.c_str());
+        return;
+    }
+
+    // Each step records its own error, so that they can't race.
+    struct Step {
+        int ret = 0;
+        std::string error;
+        void fail(const char* what, int err) {
+            ret = -err;
+            error = std::string(what) + ": " + strerror(err);
+        }
+    };
+
+    Step tunStep;
+    int tunFd = -1;
+    std::thread tunThread([&] {
+        const char* failed = nullptr;
+        tunFd = createTunInterface(tunIface.c_str(), &failed);
+        if (tunFd < 0) tunStep.fail(failed, -tunFd);
+    });
+
+    Step mtuStep;
+    int mtu = -1;
+    std::thread mtuThread([&] {
+        mtu = net::clat::detect_mtu(&nat64Prefix, platSuffix, mark);
+        if (mtu < 0) mtuStep.fail("detect mtu failed", -mtu);
+    });
+
+    Step sockStep;
+    int readSock = -1;
+    int writeSock = -1;
+    std::thread sockThread([&] {
+        const char* failed = nullptr;
+        readSock = openPacketSocket(&failed);
+        if (readSock < 0) {
+            sockStep.fail(failed, -readSock);
+            return;
+        }
+        writeSock = openRawSocket6(mark, &failed);
+        if (writeSock < 0) sockStep.fail(failed, -writeSock);
+    });
+
+    // Picking the addresses is usually the slowest step, so do it on this thread.
+    Step addrStep;
+    in_addr v4 = {net::clat::selectIpv4Address(ip, prefixlen)};
+    in6_addr v6;
+    if (v4.s_addr == INADDR_NONE) {
+        addrStep.fail("No free IPv4 address", EADDRNOTAVAIL);
+    } else if (int ret = net::clat::generateIpv6Address(iface.c_str(), v4, nat64Prefix, &v6,
+                                                        mark)) {
+        addrStep.fail("Unable to find global source address", -ret);
+    }
+
+    tunThread.join();
+    mtuThread.join();
+    sockThread.join();
+
+    for (const Step* step : {&addrStep, &tunStep, &mtuStep, &sockStep}) {
+        if (step->ret == 0) continue;
+        for (int fd : {tunFd, readSock, writeSock}) {
+            if (fd >= 0) close(fd);
+        }
+        jniThrowExceptionFmt(env, "java/io/IOException", "Prepare clat on %s failed: %s",
+                             iface.c_str(), step->error.c_str());
+        return;
+    }
+
+    char v4str[INET_ADDRSTRLEN];
+    char v6str[INET6_ADDRSTRLEN];
+    inet_ntop(AF_INET, &v4, v4str, sizeof(v4str));
+    inet_ntop(AF_INET6, &v6, v6str, sizeof(v6str));
+    ScopedLocalRef<jstring> v4Java(env, env->NewStringUTF(v4str));
+    ScopedLocalRef<jstring> v6Java(env, env->NewStringUTF(v6str));
+    if (v4Java.get() == nullptr || v6Java.get() == nullptr) {
+        // OutOfMemoryError is pending.
+        for (int fd : {tunFd, readSock, writeSock}) close(fd);
+        return;
+    }
+    env->SetObjectArrayElement(addrs, 0, v4Java.get());
+    env->SetObjectArrayElement(addrs, 1, v6Java.get());
+    const jint out[] = {tunFd, readSock, writeSock, mtu};
+    env->SetIntArrayRegion(fds, 0, 4, out);
 }
 
 static void com_android_server_connectivity_ClatCoordinator_addAnycastSetsockopt(
@@ -368,6 +522,64 @@ static void com_android_server_connectivity_ClatCoordinator_configurePacketSocke
     }
 }
 
+// Spawns clatd with args, passing it the given fds. Returns the pid, or -1 with an exception
+// pending.
+static jint spawnClatd(JNIEnv* env, const char* const args[],
+                       std::initializer_list<std::pair<int, const char*>> inheritedFds) {
+    // Register vfork requirement.
+    posix_spawnattr_t attr;
+    if (int ret = posix_spawnattr_init(&attr)) {
+        throwIOException(env, "posix_spawnattr_init failed", ret);
+        return -1;
+    }
+
+    // TODO: use android::base::ScopeGuard.
+    if (int ret = posix_spawnattr_setflags(&attr, POSIX_SPAWN_USEVFORK
+                                           | POSIX_SPAWN_CLOEXEC_DEFAULT)) {
+        posix_spawnattr_destroy(&attr);
+        throwIOException(env, "posix_spawnattr_setflags failed", ret);
+        return -1;
+    }
+
+    // Register dup2() actions: this is what 'clears' the CLOEXEC flag
+    // on the fds that we want the child clatd process to inherit
+    // (this will happen after the vfork, and before the execve).
+    // Note that even though dup2(2) is a no-op if fd == new_fd but O_CLOEXEC flag will be removed.
+    // See implementation of bionic's posix_spawn_file_actions_adddup2().
+    posix_spawn_file_actions_t fa;
+    if (int ret = posix_spawn_file_actions_init(&fa)) {
+        posix_spawnattr_destroy(&attr);
+        throwIOException(env, "posix_spawn_file_actions_init failed", ret);
+        return -1;
+    }
+
+    for (const auto& [fd, name] : inheritedFds) {
+        if (int ret = posix_spawn_file_actions_adddup2(&fa, fd, fd)) {
+            posix_spawnattr_destroy(&attr);
+            posix_spawn_file_actions_destroy(&fa);
+            const std::string msg = std::string("posix_spawn_file_actions_adddup2 for ") + name +
+                                    " failed";
+            throwIOException(env, msg.c_str(), ret);
+            return -1;
+        }
+    }
+
+    // Actually perform vfork/dup2/execve.
+    pid_t pid;
+    if (int ret = posix_spawn(&pid, kClatdBin, &fa, &attr, const_cast<char* const*>(args),
+                              nullptr)) {
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&fa);
+        throwIOException(env, "posix_spawn failed", ret);
+        return -1;
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+
+    return pid;
+}
+
 static jint com_android_server_connectivity_ClatCoordinator_startClatd(
         JNIEnv* env, jclass clazz, jobject tunJavaFd, jobject readSockJavaFd,
         jobject writeSockJavaFd, jstring iface, jstring pfx96, jstring v4, jstring v6) {
@@ -418,65 +630,142 @@ static jint com_android_server_connectivity_ClatCoordinator_startClatd(
                           nullptr};
     // clang-format on
 
-    // 3. register vfork requirement
-    posix_spawnattr_t attr;
-    if (int ret = posix_spawnattr_init(&attr)) {
-        throwIOException(env, "posix_spawnattr_init failed", ret);
-        return -1;
+    return spawnClatd(env, args, {{tunFd, "tun fd"}, {readSock, "read socket"},
+                                  {writeSock, "write socket"}});
+}
+
+// How long sendClatdControlMessage() waits for clatd to reply. Callers stop a clatd that does not
+// reply in time, so a late reply can't be mistaken for that of a later message.
+static constexpr timeval CLATD_CONTROL_REPLY_TIMEOUT = {.tv_sec = 2, .tv_usec = 0};
+
+// Starts an idle clatd that is armed and disarmed over a control socket, see clatd_control.h.
+// Fills out with {pid, control socket}.
+//
+// The fds of each CLATD_CONTROL_ARM are passed to clatd as SCM_RIGHTS, which sepolicy must allow:
+// system_server needs to use the seqpacket socket, and clatd needs to use the tun fd and the
+// packet and raw sockets it receives from system_server.
+static void com_android_server_connectivity_ClatCoordinator_startPersistentClatd(
+        JNIEnv* env, jclass clazz, jintArray out) {
+    if (env->GetArrayLength(out) != 2) {
+        jniThrowExceptionFmt(env, "java/lang/IllegalArgumentException", "Invalid output array");
+        return;
     }
 
-    // TODO: use android::base::ScopeGuard.
-    if (int ret = posix_spawnattr_setflags(&attr, POSIX_SPAWN_USEVFORK
-                                           | POSIX_SPAWN_CLOEXEC_DEFAULT)) {
-        posix_spawnattr_destroy(&attr);
-        throwIOException(env, "posix_spawnattr_setflags failed", ret);
-        return -1;
+    int control[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, control)) {
+        throwIOException(env, "control socketpair failed", errno);
+        return;
+    }
+    if (setsockopt(control[0], SOL_SOCKET, SO_RCVTIMEO, &CLATD_CONTROL_REPLY_TIMEOUT,
+                   sizeof(CLATD_CONTROL_REPLY_TIMEOUT))) {
+        throwIOException(env, "setsockopt(SO_RCVTIMEO) on control socket failed", errno);
+        close(control[0]);
+        close(control[1]);
+        return;
     }
 
-    // 4. register dup2() action: this is what 'clears' the CLOEXEC flag
-    // on the tun fd that we want the child clatd process to inherit
-    // (this will happen after the vfork, and before the execve).
-    // Note that even though dup2(2) is a no-op if fd == new_fd but O_CLOEXEC flag will be removed.
-    // See implementation of bionic's posix_spawn_file_actions_adddup2().
-    posix_spawn_file_actions_t fa;
-    if (int ret = posix_spawn_file_actions_init(&fa)) {
-        posix_spawnattr_destroy(&attr);
-        throwIOException(env, "posix_spawn_file_actions_init failed", ret);
-        return -1;
+    char controlStr[INT32_STRLEN];
+    snprintf(controlStr, sizeof(controlStr), "%d", control[1]);
+    const char* args[] = {"clatd-persistent", "-c", controlStr, nullptr};
+    const jint pid = spawnClatd(env, args, {{control[1], "control socket"}});
+    close(control[1]);
+    if (pid < 0) {
+        close(control[0]);
+        return;
     }
 
-    if (int ret = posix_spawn_file_actions_adddup2(&fa, tunFd, tunFd)) {
-        posix_spawnattr_destroy(&attr);
-        posix_spawn_file_actions_destroy(&fa);
-        throwIOException(env, "posix_spawn_file_actions_adddup2 for tun fd failed", ret);
-        return -1;
+    const jint result[] = {pid, control[0]};
+    env->SetIntArrayRegion(out, 0, 2, result);
+}
+
+// Sends msg to a persistent clatd, with fds attached, and waits for its reply for at most
+// CLATD_CONTROL_REPLY_TIMEOUT.
+static void sendClatdControlMessage(JNIEnv* env, int control, const clatd_control_msg& msg,
+                                    const int* fds, size_t nfds) {
+    iovec iov = {.iov_base = const_cast<clatd_control_msg*>(&msg), .iov_len = sizeof(msg)};
+    union {
+        char buf[CMSG_SPACE(CLATD_CONTROL_ARM_FDS * sizeof(int))];
+        cmsghdr align;
+    } cmsgBuf = {};
+    msghdr msgh = {.msg_iov = &iov, .msg_iovlen = 1};
+    if (nfds > 0) {
+        msgh.msg_control = cmsgBuf.buf;
+        msgh.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msgh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+
+    if (sendmsg(control, &msgh, MSG_NOSIGNAL) != sizeof(msg)) {
+        throwIOException(env, "send to clatd failed", errno);
+        return;
     }
-    if (int ret = posix_spawn_file_actions_adddup2(&fa, readSock, readSock)) {
-        posix_spawnattr_destroy(&attr);
-        posix_spawn_file_actions_destroy(&fa);
-        throwIOException(env, "posix_spawn_file_actions_adddup2 for read socket failed", ret);
-        return -1;
+
+    // clatd replies once it has acted on the message, so a later message on another socket
+    // can't overtake it.
+    int32_t err;
+    const ssize_t len = TEMP_FAILURE_RETRY(recv(control, &err, sizeof(err), 0));
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        throwIOException(env, "clatd did not reply", ETIMEDOUT);
+    } else if (len < 0) {
+        throwIOException(env, "receive from clatd failed", errno);
+    } else if (len != sizeof(err)) {
+        throwIOException(env, "clatd closed the control socket", EPIPE);
+    } else if (err != 0) {
+        throwIOException(env, "clatd refused the control message", err);
     }
-    if (int ret = posix_spawn_file_actions_adddup2(&fa, writeSock, writeSock)) {
-        posix_spawnattr_destroy(&attr);
-        posix_spawn_file_actions_destroy(&fa);
-        throwIOException(env, "posix_spawn_file_actions_adddup2 for write socket failed", ret);
-        return -1;
+}
+
+static void com_android_server_connectivity_ClatCoordinator_armClatd(
+        JNIEnv* env, jclass clazz, jobject controlJavaFd, jobject tunJavaFd,
+        jobject readSockJavaFd, jobject writeSockJavaFd, jstring iface, jstring pfx96, jstring v4,
+        jstring v6) {
+    ScopedUtfChars ifaceStr(env, iface);
+    ScopedUtfChars pfx96Str(env, pfx96);
+    ScopedUtfChars v4Str(env, v4);
+    ScopedUtfChars v6Str(env, v6);
+
+    const int control = netjniutils::GetNativeFileDescriptor(env, controlJavaFd);
+    const int fds[CLATD_CONTROL_ARM_FDS] = {
+            netjniutils::GetNativeFileDescriptor(env, tunJavaFd),
+            netjniutils::GetNativeFileDescriptor(env, readSockJavaFd),
+            netjniutils::GetNativeFileDescriptor(env, writeSockJavaFd),
+    };
+    if (control < 0 || fds[0] < 0 || fds[1] < 0 || fds[2] < 0) {
+        jniThrowExceptionFmt(env, "java/io/IOException", "Invalid file descriptor");
+        return;
     }
 
-    // 5. actually perform vfork/dup2/execve
-    pid_t pid;
-    if (int ret = posix_spawn(&pid, kClatdBin, &fa, &attr, (char* const*)args, nullptr)) {
-        posix_spawnattr_destroy(&attr);
-        posix_spawn_file_actions_destroy(&fa);
-        throwIOException(env, "posix_spawn failed", ret);
-        return -1;
+    clatd_control_msg msg = {.cmd = CLATD_CONTROL_ARM};
+    if (strlcpy(msg.uplink_interface, ifaceStr.c_str(), sizeof(msg.uplink_interface)) >=
+        sizeof(msg.uplink_interface)) {
+        jniThrowExceptionFmt(env, "java/io/IOException", "Interface name too long %s",
+                             ifaceStr.c_str());
+        return;
+    }
+    if (inet_pton(AF_INET6, pfx96Str.c_str(), &msg.plat_subnet) != 1 ||
+        inet_pton(AF_INET, v4Str.c_str(), &msg.ipv4_local_subnet) != 1 ||
+        inet_pton(AF_INET6, v6Str.c_str(), &msg.ipv6_local_subnet) != 1) {
+        throwIOException(env, "invalid address", EINVAL);
+        return;
     }
 
-    posix_spawnattr_destroy(&attr);
-    posix_spawn_file_actions_destroy(&fa);
+    sendClatdControlMessage(env, control, msg, fds, CLATD_CONTROL_ARM_FDS);
+}
 
-    return pid;
+static void com_android_server_connectivity_ClatCoordinator_disarmClatd(JNIEnv* env,
+                                                                        jclass clazz,
+                                                                        jobject controlJavaFd) {
+    const int control = netjniutils::GetNativeFileDescriptor(env, controlJavaFd);
+    if (control < 0) {
+        jniThrowExceptionFmt(env, "java/io/IOException", "Invalid file descriptor");
+        return;
+    }
+
+    const clatd_control_msg msg = {.cmd = CLATD_CONTROL_DISARM};
+    sendClatdControlMessage(env, control, msg, nullptr, 0);
 }
 
 // Stop clatd process. SIGTERM with timeout first, if fail, SIGKILL.
@@ -568,6 +857,19 @@ static const JNINativeMethod gMethods[] = {
          (void*)com_android_server_connectivity_ClatCoordinator_startClatd},
         {"native_stopClatd", "(I)V",
          (void*)com_android_server_connectivity_ClatCoordinator_stopClatd},
+        {"native_prepareClat",
+         "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ILjava/lang/String;II"
+         "[Ljava/lang/String;[I)V",
+         (void*)com_android_server_connectivity_ClatCoordinator_prepareClat},
+        {"native_startPersistentClatd", "([I)V",
+         (void*)com_android_server_connectivity_ClatCoordinator_startPersistentClatd},
+        {"native_armClatd",
+         "(Ljava/io/FileDescriptor;Ljava/io/FileDescriptor;Ljava/io/FileDescriptor;"
+         "Ljava/io/FileDescriptor;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;"
+         "Ljava/lang/String;)V",
+         (void*)com_android_server_connectivity_ClatCoordinator_armClatd},
+        {"native_disarmClatd", "(Ljava/io/FileDescriptor;)V",
+         (void*)com_android_server_connectivity_ClatCoordinator_disarmClatd},
         {"native_getSocketCookie", "(Ljava/io/FileDescriptor;)J",
          (void*)com_android_server_connectivity_ClatCoordinator_getSocketCookie},
 };
@@ -25,6 +25,9 @@
 #ifndef __ANDROID_API_U__
 #define __ANDROID_API_U__ 34
 #endif
+#ifndef __ANDROID_API_V__
+#define __ANDROID_API_V__ 35
+#endif
 
 __BEGIN_DECLS
 
@@ -81,6 +84,59 @@ int AConnectivityNative_unblockAllPortsForBind() __INTRODUCED_IN(__ANDROID_API_U
 int AConnectivityNative_getPortsBlockedForBind(in_port_t* _Nonnull ports, size_t* _Nonnull count)
     __INTRODUCED_IN(__ANDROID_API_U__);
 
+/**
+ * Blocks several ports from being assigned during bind() in a single call. See
+ * AConnectivityNative_blockPortForBind.
+ *
+ * Returns 0 on success, or a POSIX error code (see errno.h) on failure:
+ *  - EINVAL for invalid port number, in which case no port is blocked
+ *  - EPERM if the UID of the client doesn't have network stack permission
+ *  - Other errors as per https://man7.org/linux/man-pages/man2/bpf.2.html
+ *
+ * @param ports Array of port numbers to block.
+ * @param count Number of ports in the array.
+ */
+int AConnectivityNative_blockPortsForBind(const in_port_t* _Nonnull ports, size_t count)
+    __INTRODUCED_IN(__ANDROID_API_V__);
+
+/**
+ * Unblocks several ports that have previously been blocked in a single call. See
+ * AConnectivityNative_unblockPortForBind.
+ *
+ * Returns 0 on success, or a POSIX error code (see errno.h) on failure:
+ *  - EINVAL for invalid port number, in which case no port is unblocked
+ *  - EPERM if the UID of the client doesn't have network stack permission
+ *  - Other errors as per https://man7.org/linux/man-pages/man2/bpf.2.html
+ *
+ * @param ports Array of port numbers to unblock.
+ * @param count Number of ports in the array.
+ */
+int AConnectivityNative_unblockPortsForBind(const in_port_t* _Nonnull ports, size_t count)
+    __INTRODUCED_IN(__ANDROID_API_V__);
+
+/**
+ * Blocks all ports from |first| to |last| inclusive from being assigned during bind(). See
+ * AConnectivityNative_blockPortForBind.
+ *
+ * Returns 0 on success, or a POSIX error code (see errno.h) on failure:
+ *  - EINVAL if |first| is greater than |last|
+ *  - EPERM if the UID of the client doesn't have network stack permission
+ *  - Other errors as per https://man7.org/linux/man-pages/man2/bpf.2.html
+ */
+int AConnectivityNative_blockPortRangeForBind(in_port_t first, in_port_t last)
+    __INTRODUCED_IN(__ANDROID_API_V__);
+
+/**
+ * Unblocks all ports from |first| to |last| inclusive. See AConnectivityNative_unblockPortForBind.
+ *
+ * Returns 0 on success, or a POSIX error code (see errno.h) on failure:
+ *  - EINVAL if |first| is greater than |last|
+ *  - EPERM if the UID of the client doesn't have network stack permission
+ *  - Other errors as per https://man7.org/linux/man-pages/man2/bpf.2.html
+ */
+int AConnectivityNative_unblockPortRangeForBind(in_port_t first, in_port_t last)
+    __INTRODUCED_IN(__ANDROID_API_V__);
+
 __END_DECLS
 
 
@@ -16,13 +16,14 @@
 
 #include "connectivity_native.h"
 
+#include <vector>
+
 #include <android/binder_manager.h>
 #include <android-modules-utils/sdk_level.h>
 #include <aidl/android/net/connectivity/aidl/ConnectivityNative.h>
 
 using aidl::android::net::connectivity::aidl::IConnectivityNative;
 
-
 static std::shared_ptr<IConnectivityNative> getBinder() {
     ndk::SpAIBinder sBinder = ndk::SpAIBinder(reinterpret_cast<AIBinder*>(
         AServiceManager_checkService("connectivity_native")));
@@ -71,6 +72,48 @@ int AConnectivityNative_unblockAllPortsForBind() {
     return getErrno(c->unblockAllPortsForBind());
 }
 
+static int setPortRangesBlocked(const std::vector<int32_t>& ranges, bool blocked) {
+    if (!android::modules::sdklevel::IsAtLeastU()) return ENOSYS;
+    std::shared_ptr<IConnectivityNative> c = getBinder();
+    if (!c) {
+        return EAGAIN;
+    }
+    return getErrno(blocked ? c->blockPortRangesForBind(ranges)
+                            : c->unblockPortRangesForBind(ranges));
+}
+
+// Turns ports into [first, last] pairs, merging runs of consecutive ports.
+static std::vector<int32_t> toPortRanges(const in_port_t* ports, size_t count) {
+    std::vector<int32_t> ranges;
+    for (size_t i = 0; i < count; i++) {
+        if (!ranges.empty() && ranges.back() + 1 == ports[i]) {
+            ranges.back() = ports[i];
+        } else {
+            ranges.push_back(ports[i]);
+            ranges.push_back(ports[i]);
+        }
+    }
+    return ranges;
+}
+
+int AConnectivityNative_blockPortsForBind(const in_port_t* ports, size_t count) {
+    return setPortRangesBlocked(toPortRanges(ports, count), true /* blocked */);
+}
+
+int AConnectivityNative_unblockPortsForBind(const in_port_t* ports, size_t count) {
+    return setPortRangesBlocked(toPortRanges(ports, count), false /* blocked */);
+}
+
+int AConnectivityNative_blockPortRangeForBind(in_port_t first, in_port_t last) {
+    if (first > last) return EINVAL;
+    return setPortRangesBlocked({first, last}, true /* blocked */);
+}
+
+int AConnectivityNative_unblockPortRangeForBind(in_port_t first, in_port_t last) {
+    if (first > last) return EINVAL;
+    return setPortRangesBlocked({first, last}, false /* blocked */);
+}
+
 int AConnectivityNative_getPortsBlockedForBind(in_port_t *ports, size_t *count) {
     if (!android::modules::sdklevel::IsAtLeastU()) return ENOSYS;
     std::shared_ptr<IConnectivityNative> c = getBinder();
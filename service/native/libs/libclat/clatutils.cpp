@@ -20,11 +20,16 @@
 #include <linux/filter.h>
 #include <linux/if_packet.h>
 #include <linux/if_tun.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #include <log/log.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
+#include <vector>
+
 #include <bpf/BpfClassic.h>
 
 extern "C" {
@@ -61,7 +66,91 @@ bool isIpv4AddressFree(const in_addr_t addr) {
 //   prefixlen - the length of the prefix from which addresses may be selected.
 //   returns: the IPv4 address, or INADDR_NONE if no addresses were available
 in_addr_t selectIpv4Address(const in_addr ip, const int16_t prefixlen) {
-    return selectIpv4AddressInternal(ip, prefixlen, isIpv4AddressFree);
+    // Dumping the assigned addresses costs a handful of system calls, whereas probing costs three
+    // per address and may have to go through the whole prefix. Only probe if the dump fails.
+    std::vector<in_addr_t> assigned;
+    const int ret = getLocalIpv4Addresses(&assigned);
+    if (ret != 0) {
+        ALOGW("Failed to dump IPv4 addresses, probing one by one: %s", strerror(-ret));
+        return selectIpv4AddressInternal(ip, prefixlen, isIpv4AddressFree);
+    }
+    return selectIpv4AddressInternal(ip, prefixlen, isIpv4AddressFree, assigned);
+}
+
+// Fetches all IPv4 addresses assigned to any interface with a single RTM_GETADDR dump.
+//   addrs - receives the addresses, in network byte order
+//   returns: 0 on success, -errno on failure
+int getLocalIpv4Addresses(std::vector<in_addr_t>* const addrs) {
+    const int s = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (s == -1) return -errno;
+
+    struct {
+        nlmsghdr nlh;
+        ifaddrmsg ifa;
+    } req = {
+            .nlh = {.nlmsg_len = sizeof(req),
+                    .nlmsg_type = RTM_GETADDR,
+                    .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+                    .nlmsg_seq = 1},
+            .ifa = {.ifa_family = AF_INET},
+    };
+    if (send(s, &req, sizeof(req), 0) != sizeof(req)) {
+        const int err = errno;
+        close(s);
+        return -err;
+    }
+
+    addrs->clear();
+    // Large enough for a few dozen addresses per read. The kernel never splits a message.
+    alignas(nlmsghdr) char buf[8192];
+    while (true) {
+        const ssize_t len = recv(s, buf, sizeof(buf), 0);
+        if (len < 0) {
+            const int err = errno;
+            close(s);
+            return -err;
+        }
+        if (len == 0) break;
+
+        int remaining = len;
+        for (const nlmsghdr* nlh = reinterpret_cast<const nlmsghdr*>(buf);
+             NLMSG_OK(nlh, remaining); nlh = NLMSG_NEXT(nlh, remaining)) {
+            if (nlh->nlmsg_seq != req.nlh.nlmsg_seq) continue;
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                close(s);
+                return 0;
+            }
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                const nlmsgerr* err = reinterpret_cast<const nlmsgerr*>(NLMSG_DATA(nlh));
+                close(s);
+                return (err->error != 0) ? err->error : -EPROTO;
+            }
+            if (nlh->nlmsg_type != RTM_NEWADDR) continue;
+
+            const ifaddrmsg* ifa = reinterpret_cast<const ifaddrmsg*>(NLMSG_DATA(nlh));
+            if (ifa->ifa_family != AF_INET) continue;
+            // IFA_LOCAL is the address itself. IFA_ADDRESS is the peer on point-to-point links,
+            // and only the address itself otherwise.
+            const rtattr* local = nullptr;
+            const rtattr* address = nullptr;
+            int attrlen = IFA_PAYLOAD(nlh);
+            for (const rtattr* rta = IFA_RTA(ifa); RTA_OK(rta, attrlen);
+                 rta = RTA_NEXT(rta, attrlen)) {
+                if (RTA_PAYLOAD(rta) != sizeof(in_addr_t)) continue;
+                if (rta->rta_type == IFA_LOCAL) local = rta;
+                if (rta->rta_type == IFA_ADDRESS) address = rta;
+            }
+            const rtattr* rta = (local != nullptr) ? local : address;
+            if (rta == nullptr) continue;
+            in_addr_t addr;
+            memcpy(&addr, RTA_DATA(rta), sizeof(addr));
+            addrs->push_back(addr);
+        }
+    }
+
+    // The socket was closed before the dump completed.
+    close(s);
+    return -EPROTO;
 }
 
 // Only allow testing to use this function directly. Otherwise call selectIpv4Address(ip, pfxlen)
@@ -90,6 +179,36 @@ in_addr_t selectIpv4AddressInternal(const in_addr ip, const int16_t prefixlen,
     return INADDR_NONE;
 }
 
+// Like selectIpv4AddressInternal(ip, prefixlen, fn), but skips addresses known to be assigned
+// without probing them. Candidates that are not assigned are still confirmed with
+// isIpv4AddressFreeFunc, which also catches addresses that are local only through a route.
+in_addr_t selectIpv4AddressInternal(const in_addr ip, const int16_t prefixlen,
+                                    const isIpv4AddrFreeFn isIpv4AddressFreeFunc,
+                                    const std::vector<in_addr_t>& assigned) {
+    if (isIpv4AddressFreeFunc == nullptr) return INADDR_NONE;
+    if (prefixlen < 16 || prefixlen > 32) return INADDR_NONE;
+
+    // All these are in host byte order.
+    const uint32_t mask = 0xffffffff >> (32 - prefixlen) << (32 - prefixlen);
+    uint32_t ipv4 = ntohl(ip.s_addr);
+    const uint32_t first_ipv4 = ipv4;
+    const uint32_t prefix = ipv4 & mask;
+
+    // One bit per address in the prefix, at most 8 KiB for a /16.
+    std::vector<bool> inUse(~mask + uint64_t{1});
+    for (const in_addr_t addr : assigned) {
+        const uint32_t a = ntohl(addr);
+        if ((a & mask) == prefix) inUse[a & ~mask] = true;
+    }
+
+    do {
+        if (!inUse[ipv4 & ~mask] && isIpv4AddressFreeFunc(htonl(ipv4))) return htonl(ipv4);
+        ipv4 = prefix | ((ipv4 + 1) & ~mask);
+    } while (ipv4 != first_ipv4);
+
+    return INADDR_NONE;
+}
+
 // Alters the bits in the IPv6 address to make them checksum neutral with v4 and nat64Prefix.
 void makeChecksumNeutral(in6_addr* const v6, const in_addr v4, const in6_addr& nat64Prefix) {
     // Fill last 8 bytes of IPv6 address with random bits.
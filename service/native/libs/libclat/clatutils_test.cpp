@@ -20,6 +20,10 @@
 #include <linux/if_packet.h>
 #include <linux/if_tun.h>
 #include <netinet/in.h>
+
+#include <algorithm>
+#include <vector>
+
 #include "tun_interface.h"
 
 extern "C" {
@@ -104,6 +108,50 @@ TEST_F(ClatUtils, SelectIpv4Address) {
     EXPECT_EQ(inet_addr("127.0.0.2"), selectIpv4Address(addr, 29));
 }
 
+// Counts calls, to check that assigned addresses are not probed.
+int sProbeCount;
+bool countingAlwaysFree(in_addr_t /* addr */) {
+    sProbeCount++;
+    return 1;
+}
+
+TEST_F(ClatUtils, SelectIpv4AddressSkipsAssigned) {
+    struct in_addr addr;
+    inet_pton(AF_INET, kIPv4LocalAddr, &addr);
+    const std::vector<in_addr_t> assigned = {inet_addr("192.0.0.4"), inet_addr("192.0.0.5"),
+                                             inet_addr("192.0.0.7"), inet_addr("10.0.0.6")};
+
+    // Assigned addresses are skipped without being probed.
+    sProbeCount = 0;
+    EXPECT_EQ(inet_addr("192.0.0.6"),
+              selectIpv4AddressInternal(addr, 29, countingAlwaysFree, assigned));
+    EXPECT_EQ(1, sProbeCount);
+
+    // Addresses that are not assigned must still pass the probe.
+    EXPECT_EQ(INADDR_NONE, selectIpv4AddressInternal(addr, 29, neverFree, assigned));
+    EXPECT_EQ(inet_addr("192.0.0.2"), selectIpv4AddressInternal(addr, 29, only2Free, assigned));
+
+    // Wrap around past assigned addresses at the end of the prefix.
+    EXPECT_EQ(inet_addr("192.0.0.0"), selectIpv4AddressInternal(addr, 30, alwaysFree, assigned));
+    const std::vector<in_addr_t> all = {inet_addr("192.0.0.4"), inet_addr("192.0.0.5"),
+                                        inet_addr("192.0.0.6"), inet_addr("192.0.0.7")};
+    EXPECT_EQ(INADDR_NONE, selectIpv4AddressInternal(addr, 30, alwaysFree, all));
+
+    // Same prefix length limits as probing one by one.
+    EXPECT_EQ(INADDR_NONE, selectIpv4AddressInternal(addr, 15, alwaysFree, assigned));
+    EXPECT_EQ(INADDR_NONE, selectIpv4AddressInternal(addr, 33, alwaysFree, assigned));
+    EXPECT_EQ(INADDR_NONE, selectIpv4AddressInternal(addr, 32, alwaysFree, assigned));
+    EXPECT_EQ(inet_addr(kIPv4LocalAddr), selectIpv4AddressInternal(addr, 16, alwaysFree, {}));
+}
+
+TEST_F(ClatUtils, GetLocalIpv4Addresses) {
+    // Assume that the machine running the test has the address 127.0.0.1, but not 8.8.8.8.
+    std::vector<in_addr_t> addrs;
+    ASSERT_EQ(0, getLocalIpv4Addresses(&addrs));
+    EXPECT_NE(addrs.end(), std::find(addrs.begin(), addrs.end(), inet_addr("127.0.0.1")));
+    EXPECT_EQ(addrs.end(), std::find(addrs.begin(), addrs.end(), inet_addr("8.8.8.8")));
+}
+
 TEST_F(ClatUtils, MakeChecksumNeutral) {
     // We can't test generateIPv6Address here since it requires manipulating routing, which we can't
     // do without talking to the real netd on the system.
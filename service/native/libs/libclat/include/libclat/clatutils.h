@@ -16,12 +16,15 @@
 #include <netinet/in.h>
 #include <netinet/in6.h>
 
+#include <vector>
+
 namespace android {
 namespace net {
 namespace clat {
 
 bool isIpv4AddressFree(const in_addr_t addr);
 in_addr_t selectIpv4Address(const in_addr ip, const int16_t prefixlen);
+int getLocalIpv4Addresses(std::vector<in_addr_t>* const addrs);
 void makeChecksumNeutral(in6_addr* const v6, const in_addr v4, const in6_addr& nat64Prefix);
 int generateIpv6Address(const char* const iface, const in_addr v4, const in6_addr& nat64Prefix,
                         in6_addr* const v6, const uint32_t mark);
@@ -33,6 +36,9 @@ int configure_packet_socket(const int sock, const in6_addr* const addr, const in
 typedef bool (*isIpv4AddrFreeFn)(const in_addr_t);
 in_addr_t selectIpv4AddressInternal(const in_addr ip, const int16_t prefixlen,
                                     const isIpv4AddrFreeFn fn);
+in_addr_t selectIpv4AddressInternal(const in_addr ip, const int16_t prefixlen,
+                                    const isIpv4AddrFreeFn fn,
+                                    const std::vector<in_addr_t>& assigned);
 
 }  // namespace clat
 }  // namespace net
@@ -31,9 +31,11 @@ import static android.net.BpfNetMapsConstants.PENALTY_BOX_MATCH;
 import static android.net.BpfNetMapsConstants.UID_OWNER_MAP_PATH;
 import static android.net.BpfNetMapsConstants.UID_PERMISSION_MAP_PATH;
 import static android.net.BpfNetMapsConstants.UID_RULES_CONFIGURATION_KEY;
+import static android.net.BpfNetMapsUtils.clearUidRules;
 import static android.net.BpfNetMapsUtils.getMatchByFirewallChain;
 import static android.net.BpfNetMapsUtils.isFirewallAllowList;
 import static android.net.BpfNetMapsUtils.matchToString;
+import static android.net.BpfNetMapsUtils.sUidOwnerMapLock;
 import static android.net.ConnectivityManager.FIREWALL_RULE_ALLOW;
 import static android.net.ConnectivityManager.FIREWALL_RULE_DENY;
 import static android.net.INetd.PERMISSION_INTERNET;
@@ -265,8 +267,10 @@ public class BpfNetMaps {
         if (sUidOwnerMap == null) {
             sUidOwnerMap = getUidOwnerMap();
         }
+        // The counter sets in this map belong to NetworkStatsService, which may have written them
+        // already; only the rules are reset.
         try {
-            sUidOwnerMap.clear();
+            clearUidRules(sUidOwnerMap);
         } catch (ErrnoException e) {
             throw new IllegalStateException("Failed to initialize uid owner map", e);
         }
@@ -392,7 +396,7 @@ public class BpfNetMaps {
         if (sUidOwnerMap == null) return;
 
         try {
-            synchronized (sUidOwnerMap) {
+            synchronized (sUidOwnerMapLock) {
                 final UidOwnerValue oldMatch = sUidOwnerMap.getValue(new S32(uid));
 
                 if (oldMatch == null) {
@@ -402,10 +406,13 @@ public class BpfNetMaps {
 
                 final UidOwnerValue newMatch = new UidOwnerValue(
                         (match == IIF_MATCH) ? 0 : oldMatch.iif,
-                        oldMatch.rule & ~match
+                        oldMatch.rule & ~match,
+                        oldMatch.counterSet
                 );
 
-                if (newMatch.rule == 0) {
+                // The entry also holds the uid's counter set, see
+                // BpfNetMapsUtils#setUidCounterSet.
+                if (newMatch.rule == 0 && newMatch.counterSet == 0) {
                     sUidOwnerMap.deleteEntry(new S32(uid));
                 } else {
                     sUidOwnerMap.updateEntry(new S32(uid), newMatch);
@@ -426,14 +433,15 @@ public class BpfNetMaps {
         }
 
         try {
-            synchronized (sUidOwnerMap) {
+            synchronized (sUidOwnerMapLock) {
                 final UidOwnerValue oldMatch = sUidOwnerMap.getValue(new S32(uid));
 
                 final UidOwnerValue newMatch;
                 if (oldMatch != null) {
                     newMatch = new UidOwnerValue(
                             (match == IIF_MATCH) ? iif : oldMatch.iif,
-                            oldMatch.rule | match
+                            oldMatch.rule | match,
+                            oldMatch.counterSet
                     );
                 } else {
                     newMatch = new UidOwnerValue(
@@ -589,7 +597,7 @@ public class BpfNetMaps {
         final Set<Integer> uidSet = asSet(uids);
         final Set<Integer> uidSetToRemoveRule = new ArraySet<>();
         try {
-            synchronized (sUidOwnerMap) {
+            synchronized (sUidOwnerMapLock) {
                 sUidOwnerMap.forEach((uid, config) -> {
                     // config could be null if there is a concurrent entry deletion.
                     // http://b/220084230. But sUidOwnerMap update must be done while holding a
@@ -661,7 +669,7 @@ public class BpfNetMaps {
 
         if (sUidOwnerMap == null) return uids;
 
-        synchronized (sUidOwnerMap) {
+        synchronized (sUidOwnerMapLock) {
             sUidOwnerMap.forEach((uid, val) -> {
                 if (val == null) {
                     Log.wtf(TAG, "sUidOwnerMap entry was deleted while holding a lock");
@@ -31,9 +31,11 @@ import android.net.InetAddresses;
 import android.net.InterfaceConfigurationParcel;
 import android.net.IpPrefix;
 import android.os.Build;
+import android.os.Handler;
 import android.os.ParcelFileDescriptor;
 import android.os.RemoteException;
 import android.os.ServiceSpecificException;
+import android.provider.DeviceConfig;
 import android.system.ErrnoException;
 import android.util.Log;
 
@@ -41,7 +43,9 @@ import androidx.annotation.RequiresApi;
 
 import com.android.internal.annotations.VisibleForTesting;
 import com.android.internal.util.IndentingPrintWriter;
+import com.android.modules.utils.BackgroundThread;
 import com.android.net.module.util.BpfMap;
+import com.android.net.module.util.DeviceConfigUtils;
 import com.android.net.module.util.IBpfMap;
 import com.android.net.module.util.InterfaceParams;
 import com.android.net.module.util.TcUtils;
@@ -58,6 +62,7 @@ import java.net.Inet4Address;
 import java.net.Inet6Address;
 import java.net.InetAddress;
 import java.nio.ByteBuffer;
+import java.util.ArrayDeque;
 import java.util.Objects;
 
 /**
@@ -93,6 +98,21 @@ public class ClatCoordinator {
 
     private static final int INVALID_IFINDEX = 0;
 
+    // Tethering namespace DeviceConfig flags. The first runs the steps of clatStart that don't
+    // depend on each other at the same time, the second keeps clatd processes around to be
+    // re-armed on the next network instead of spawning a new one.
+    @VisibleForTesting
+    static final String CLAT_PREPARE_CONCURRENTLY = "clat_prepare_concurrently";
+    @VisibleForTesting
+    static final String CLAT_PERSISTENT_CLATD = "clat_persistent_clatd";
+
+    // Disarmed persistent clatd processes, shared by all coordinators since each network has its
+    // own. One is enough to cover a handover from one network to another, and one left idle for
+    // longer than that is stopped.
+    private static final int MAX_IDLE_CLATDS = 1;
+    private static final long IDLE_CLATD_TIMEOUT_MS = 60_000;
+    private static final ArrayDeque<PersistentClatd> sIdleClatds = new ArrayDeque<>();
+
     // For better code clarity when used for 'bool ingress' parameter.
     @VisibleForTesting
     static final boolean EGRESS = false;
@@ -136,6 +156,9 @@ public class ClatCoordinator {
     private final IBpfMap<CookieTagMapKey, CookieTagMapValue> mCookieTagMap;
     @Nullable
     private ClatdTracker mClatdTracker = null;
+    // The persistent clatd armed for mClatdTracker, if any.
+    @Nullable
+    private PersistentClatd mPersistentClatd = null;
 
     /**
      * Dependencies of ClatCoordinator which makes ConnectivityService injection
@@ -244,6 +267,116 @@ public class ClatCoordinator {
             native_stopClatd(pid);
         }
 
+        /**
+         * Whether to pick the addresses, create the tun interface, detect the MTU and open the
+         * sockets concurrently with {@link #prepareClat}.
+         */
+        public boolean isClatPrepareEnabled() {
+            return DeviceConfigUtils.getDeviceConfigPropertyBoolean(
+                    DeviceConfig.NAMESPACE_TETHERING, CLAT_PREPARE_CONCURRENTLY,
+                    false /* defaultValue */);
+        }
+
+        /**
+         * Whether to run clatd as a {@link PersistentClatd}.
+         */
+        public boolean isPersistentClatdEnabled() {
+            return DeviceConfigUtils.getDeviceConfigPropertyBoolean(
+                    DeviceConfig.NAMESPACE_TETHERING, CLAT_PERSISTENT_CLATD,
+                    false /* defaultValue */);
+        }
+
+        /**
+         * Run the steps of starting clat that don't depend on each other or on netd concurrently.
+         */
+        @NonNull
+        public ClatPreparation prepareClat(@NonNull String iface, @NonNull String tunIface,
+                @NonNull String v4addr, int prefixlen, @NonNull String prefix64, int platSuffix,
+                int mark) throws IOException {
+            final String[] addrs = new String[2];
+            final int[] fds = new int[4];
+            native_prepareClat(iface, tunIface, v4addr, prefixlen, prefix64, platSuffix, mark,
+                    addrs, fds);
+            return new ClatPreparation(addrs[0], addrs[1], adoptFd(fds[0]), adoptFd(fds[1]),
+                    adoptFd(fds[2]), fds[3] /* detectedMtu */);
+        }
+
+        /**
+         * Start an idle persistent clatd.
+         */
+        @NonNull
+        public PersistentClatd startPersistentClatd() throws IOException {
+            final int[] pidAndControl = new int[2];
+            native_startPersistentClatd(pidAndControl);
+            return new PersistentClatd(pidAndControl[0], adoptFd(pidAndControl[1]));
+        }
+
+        /**
+         * Make a persistent clatd translate on the given interface.
+         */
+        public void armClatd(@NonNull FileDescriptor control, @NonNull FileDescriptor tunfd,
+                @NonNull FileDescriptor readsock6, @NonNull FileDescriptor writesock6,
+                @NonNull String iface, @NonNull String pfx96, @NonNull String v4,
+                @NonNull String v6) throws IOException {
+            native_armClatd(control, tunfd, readsock6, writesock6, iface, pfx96, v4, v6);
+        }
+
+        /**
+         * Make a persistent clatd close its interface and sockets.
+         */
+        public void disarmClatd(@NonNull FileDescriptor control) throws IOException {
+            native_disarmClatd(control);
+        }
+
+        /**
+         * Take a disarmed persistent clatd left behind by any coordinator, or null if none.
+         */
+        @Nullable
+        public PersistentClatd takeIdleClatd() {
+            final PersistentClatd clatd;
+            synchronized (sIdleClatds) {
+                clatd = sIdleClatds.poll();
+            }
+            if (clatd != null) getIdleClatdHandler().removeCallbacksAndMessages(clatd);
+            return clatd;
+        }
+
+        /**
+         * Keep a disarmed persistent clatd for the next network. Returns false if there are
+         * enough already, in which case the caller should stop it. Otherwise reap runs on
+         * {@link #getIdleClatdHandler} if the clatd is still idle after
+         * {@link #getIdleClatdTimeoutMs}.
+         */
+        public boolean offerIdleClatd(@NonNull PersistentClatd clatd, @NonNull Runnable reap) {
+            synchronized (sIdleClatds) {
+                if (sIdleClatds.size() >= MAX_IDLE_CLATDS) return false;
+                sIdleClatds.add(clatd);
+            }
+            getIdleClatdHandler().postDelayed(() -> {
+                final boolean stillIdle;
+                synchronized (sIdleClatds) {
+                    stillIdle = sIdleClatds.remove(clatd);
+                }
+                if (stillIdle) reap.run();
+            }, clatd /* token */, getIdleClatdTimeoutMs());
+            return true;
+        }
+
+        /**
+         * The handler that stops persistent clatds left idle.
+         */
+        @NonNull
+        public Handler getIdleClatdHandler() {
+            return BackgroundThread.getHandler();
+        }
+
+        /**
+         * How long a disarmed persistent clatd is kept for the next network.
+         */
+        public long getIdleClatdTimeoutMs() {
+            return IDLE_CLATD_TIMEOUT_MS;
+        }
+
         /**
          * Get socket cookie.
          */
@@ -370,6 +503,51 @@ public class ClatCoordinator {
         }
     };
 
+    /**
+     * Result of {@link Dependencies#prepareClat}. The caller owns the file descriptors.
+     */
+    @VisibleForTesting
+    static class ClatPreparation {
+        @NonNull
+        public final String v4;
+        @NonNull
+        public final String v6;
+        @NonNull
+        public final ParcelFileDescriptor tunFd;
+        @NonNull
+        public final ParcelFileDescriptor readSock6;
+        @NonNull
+        public final ParcelFileDescriptor writeSock6;
+        public final int detectedMtu;
+
+        ClatPreparation(@NonNull String v4, @NonNull String v6,
+                @NonNull ParcelFileDescriptor tunFd, @NonNull ParcelFileDescriptor readSock6,
+                @NonNull ParcelFileDescriptor writeSock6, int detectedMtu) {
+            this.v4 = v4;
+            this.v6 = v6;
+            this.tunFd = tunFd;
+            this.readSock6 = readSock6;
+            this.writeSock6 = writeSock6;
+            this.detectedMtu = detectedMtu;
+        }
+    }
+
+    /**
+     * A clatd process that is moved from one interface to another over a control socket instead
+     * of being stopped and spawned again. See clatd_control.h.
+     */
+    @VisibleForTesting
+    static class PersistentClatd {
+        public final int pid;
+        @NonNull
+        public final ParcelFileDescriptor control;
+
+        PersistentClatd(int pid, @NonNull ParcelFileDescriptor control) {
+            this.pid = pid;
+            this.control = control;
+        }
+    }
+
     @VisibleForTesting
     static int getFwmark(int netId) {
         // See union Fwmark in system/netd/include/Fwmark.h
@@ -599,6 +777,9 @@ public class ClatCoordinator {
         if (nat64Prefix.getPrefixLength() != 96) {
             throw new IOException("Prefix must be 96 bits long: " + nat64Prefix);
         }
+        if (mDeps.isClatPrepareEnabled()) {
+            return clatStartPrepared(iface, netId, nat64Prefix);
+        }
 
         // [1] Pick an IPv4 address from 192.0.0.4, 192.0.0.5, 192.0.0.6 ..
         final String v4Str;
@@ -677,23 +858,10 @@ public class ClatCoordinator {
 
         // Config tun interface mtu, address and bring up.
         try {
-            mNetd.interfaceSetMtu(tunIface, mtu);
-        } catch (RemoteException | ServiceSpecificException e) {
-            maybeCleanUp(tunFd, readSock6, writeSock6);
-            throw new IOException("Set MTU " + mtu + " on " + tunIface + " failed: " + e);
-        }
-        final InterfaceConfigurationParcel ifConfig = new InterfaceConfigurationParcel();
-        ifConfig.ifName = tunIface;
-        ifConfig.ipv4Addr = v4Str;
-        ifConfig.prefixLength = 32;
-        ifConfig.hwAddr = "";
-        ifConfig.flags = new String[] {IF_STATE_UP};
-        try {
-            mNetd.interfaceSetCfg(ifConfig);
-        } catch (RemoteException | ServiceSpecificException e) {
+            bringUpTunInterface(tunIface, mtu, v4Str);
+        } catch (IOException e) {
             maybeCleanUp(tunFd, readSock6, writeSock6);
-            throw new IOException("Setting IPv4 address to " + ifConfig.ipv4Addr + "/"
-                    + ifConfig.prefixLength + " failed on " + ifConfig.ifName + ": " + e);
+            throw e;
         }
 
         // [4] Open and configure local 464xlat read/write sockets.
@@ -719,6 +887,17 @@ public class ClatCoordinator {
             throw new IOException("Open raw socket failed: " + e);
         }
 
+        return finishClatStart(iface, fwmark, pfx96Str, pfx96, v4Str, v4, v6Str, v6, tunIface,
+                tunIfIndex, tunFd, readSock6, writeSock6);
+    }
+
+    // The steps of clatStart that come after the tun interface is up and the sockets are open.
+    // Takes ownership of the file descriptors.
+    private String finishClatStart(final String iface, final int fwmark, final String pfx96Str,
+            final Inet6Address pfx96, final String v4Str, final Inet4Address v4,
+            final String v6Str, final Inet6Address v6, final String tunIface, final int tunIfIndex,
+            final ParcelFileDescriptor tunFd, final ParcelFileDescriptor readSock6,
+            final ParcelFileDescriptor writeSock6) throws IOException {
         final int ifIndex = mDeps.getInterfaceIndex(iface);
         if (ifIndex == INVALID_IFINDEX) {
             maybeCleanUp(tunFd, readSock6, writeSock6);
@@ -759,7 +938,7 @@ public class ClatCoordinator {
         // [5] Start clatd.
         final int pid;
         try {
-            pid = mDeps.startClatd(tunFd.getFileDescriptor(), readSock6.getFileDescriptor(),
+            pid = startClatdProcess(tunFd.getFileDescriptor(), readSock6.getFileDescriptor(),
                     writeSock6.getFileDescriptor(), iface, pfx96Str, v4Str, v6Str);
         } catch (IOException e) {
             try {
@@ -769,8 +948,9 @@ public class ClatCoordinator {
             }
             throw new IOException("Error start clatd on " + iface + ": " + e);
         } finally {
-            // The file descriptors have been duplicated (dup2) to clatd in native_startClatd().
-            // Close these file descriptor stubs which are unused anymore.
+            // The file descriptors have been duplicated to clatd, either by dup2 in
+            // native_startClatd() or as SCM_RIGHTS in native_armClatd(). Close these file
+            // descriptor stubs which are unused anymore.
             maybeCleanUp(tunFd, readSock6, writeSock6);
         }
 
@@ -784,6 +964,136 @@ public class ClatCoordinator {
         return v6Str;
     }
 
+    // Like clatStart, but with the steps that don't depend on each other or on netd run
+    // concurrently by Dependencies#prepareClat.
+    private String clatStartPrepared(final String iface, final int netId,
+            @NonNull final IpPrefix nat64Prefix) throws IOException {
+        final int fwmark = getFwmark(netId);
+        final String pfx96Str = nat64Prefix.getAddress().getHostAddress();
+        final Inet6Address pfx96 = (Inet6Address) nat64Prefix.getAddress();
+        final String tunIface = CLAT_PREFIX + iface;
+
+        final ClatPreparation prep = mDeps.prepareClat(iface, tunIface, INIT_V4ADDR_STRING,
+                INIT_V4ADDR_PREFIX_LEN, pfx96Str,
+                ByteBuffer.wrap(GOOGLE_DNS_4.getAddress()).getInt(), fwmark);
+
+        final Inet4Address v4;
+        final Inet6Address v6;
+        try {
+            v4 = (Inet4Address) InetAddresses.parseNumericAddress(prep.v4);
+            v6 = (Inet6Address) InetAddresses.parseNumericAddress(prep.v6);
+        } catch (ClassCastException | IllegalArgumentException | NullPointerException e) {
+            maybeCleanUp(prep.tunFd, prep.readSock6, prep.writeSock6);
+            throw new IOException("Invalid clat address " + prep.v4 + " or " + prep.v6);
+        }
+
+        final int tunIfIndex = mDeps.getInterfaceIndex(tunIface);
+        if (tunIfIndex == INVALID_IFINDEX) {
+            maybeCleanUp(prep.tunFd, prep.readSock6, prep.writeSock6);
+            throw new IOException("Fail to get interface index for interface " + tunIface);
+        }
+
+        // disable IPv6 on it - failing to do so is not a critical error
+        try {
+            mNetd.interfaceSetEnableIPv6(tunIface, false /* enabled */);
+        } catch (RemoteException | ServiceSpecificException e) {
+            Log.e(TAG, "Disable IPv6 on " + tunIface + " failed: " + e);
+        }
+
+        final int mtu = adjustMtu(prep.detectedMtu);
+        Log.i(TAG, "detected ipv4 mtu of " + prep.detectedMtu + " adjusted to " + mtu);
+        try {
+            bringUpTunInterface(tunIface, mtu, prep.v4);
+        } catch (IOException e) {
+            maybeCleanUp(prep.tunFd, prep.readSock6, prep.writeSock6);
+            throw e;
+        }
+
+        return finishClatStart(iface, fwmark, pfx96Str, pfx96, prep.v4, v4, prep.v6, v6,
+                tunIface, tunIfIndex, prep.tunFd, prep.readSock6, prep.writeSock6);
+    }
+
+    private void bringUpTunInterface(final String tunIface, final int mtu, final String v4Str)
+            throws IOException {
+        try {
+            mNetd.interfaceSetMtu(tunIface, mtu);
+        } catch (RemoteException | ServiceSpecificException e) {
+            throw new IOException("Set MTU " + mtu + " on " + tunIface + " failed: " + e);
+        }
+        final InterfaceConfigurationParcel ifConfig = new InterfaceConfigurationParcel();
+        ifConfig.ifName = tunIface;
+        ifConfig.ipv4Addr = v4Str;
+        ifConfig.prefixLength = 32;
+        ifConfig.hwAddr = "";
+        ifConfig.flags = new String[] {IF_STATE_UP};
+        try {
+            mNetd.interfaceSetCfg(ifConfig);
+        } catch (RemoteException | ServiceSpecificException e) {
+            throw new IOException("Setting IPv4 address to " + ifConfig.ipv4Addr + "/"
+                    + ifConfig.prefixLength + " failed on " + ifConfig.ifName + ": " + e);
+        }
+    }
+
+    // Starts clatd, or arms a persistent one, and returns its pid.
+    private int startClatdProcess(@NonNull FileDescriptor tunfd,
+            @NonNull FileDescriptor readsock6, @NonNull FileDescriptor writesock6,
+            @NonNull String iface, @NonNull String pfx96, @NonNull String v4, @NonNull String v6)
+            throws IOException {
+        if (!mDeps.isPersistentClatdEnabled()) {
+            return mDeps.startClatd(tunfd, readsock6, writesock6, iface, pfx96, v4, v6);
+        }
+
+        PersistentClatd clatd = mDeps.takeIdleClatd();
+        if (clatd != null) {
+            try {
+                mDeps.armClatd(clatd.control.getFileDescriptor(), tunfd, readsock6, writesock6,
+                        iface, pfx96, v4, v6);
+                mPersistentClatd = clatd;
+                return clatd.pid;
+            } catch (IOException e) {
+                // It may have died while idle. Start a fresh one.
+                Log.w(TAG, "Re-arming clatd pid=" + clatd.pid + " failed: " + e);
+                stopPersistentClatd(clatd);
+            }
+        }
+
+        clatd = mDeps.startPersistentClatd();
+        try {
+            mDeps.armClatd(clatd.control.getFileDescriptor(), tunfd, readsock6, writesock6,
+                    iface, pfx96, v4, v6);
+        } catch (IOException e) {
+            stopPersistentClatd(clatd);
+            throw e;
+        }
+        mPersistentClatd = clatd;
+        return clatd.pid;
+    }
+
+    // Disarms a persistent clatd and keeps it for the next network, or stops it.
+    private void releasePersistentClatd(@NonNull PersistentClatd clatd) {
+        try {
+            mDeps.disarmClatd(clatd.control.getFileDescriptor());
+            if (mDeps.offerIdleClatd(clatd, () -> stopPersistentClatd(clatd))) return;
+        } catch (IOException e) {
+            Log.e(TAG, "Disarming clatd pid=" + clatd.pid + " failed: " + e);
+        }
+        stopPersistentClatd(clatd);
+    }
+
+    private void stopPersistentClatd(@NonNull PersistentClatd clatd) {
+        // Closing the control socket makes clatd exit by itself, stopClatd then reaps it.
+        try {
+            clatd.control.close();
+        } catch (IOException e) {
+            Log.e(TAG, "Fail to close clatd control socket " + e);
+        }
+        try {
+            mDeps.stopClatd(clatd.pid);
+        } catch (IOException e) {
+            Log.e(TAG, "Stopping clatd pid=" + clatd.pid + " failed: " + e);
+        }
+    }
+
     private void maybeStopBpf(final ClatdTracker tracker) {
         if (mIngressMap == null || mEgressMap == null) return;
 
@@ -830,7 +1140,12 @@ public class ClatCoordinator {
         Log.i(TAG, "Stopping clatd pid=" + mClatdTracker.pid + " on " + mClatdTracker.iface);
 
         maybeStopBpf(mClatdTracker);
-        mDeps.stopClatd(mClatdTracker.pid);
+        if (mPersistentClatd != null) {
+            releasePersistentClatd(mPersistentClatd);
+            mPersistentClatd = null;
+        } else {
+            mDeps.stopClatd(mClatdTracker.pid);
+        }
         untagSocket(mClatdTracker.cookie);
 
         Log.i(TAG, "clatd on " + mClatdTracker.iface + " stopped");
@@ -930,5 +1245,14 @@ public class ClatCoordinator {
             FileDescriptor writesock6, String iface, String pfx96, String v4, String v6)
             throws IOException;
     private static native void native_stopClatd(int pid) throws IOException;
+    private static native void native_prepareClat(String iface, String tunIface, String v4addr,
+            int prefixlen, String prefix64, int platSuffix, int mark, String[] addrs, int[] fds)
+            throws IOException;
+    private static native void native_startPersistentClatd(int[] pidAndControl)
+            throws IOException;
+    private static native void native_armClatd(FileDescriptor control, FileDescriptor tunfd,
+            FileDescriptor readsock6, FileDescriptor writesock6, String iface, String pfx96,
+            String v4, String v6) throws IOException;
+    private static native void native_disarmClatd(FileDescriptor control) throws IOException;
     private static native long native_getSocketCookie(FileDescriptor sock) throws IOException;
 }
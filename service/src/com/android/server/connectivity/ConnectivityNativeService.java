@@ -28,11 +28,8 @@ import android.util.Log;
 
 import com.android.internal.annotations.VisibleForTesting;
 import com.android.net.module.util.BpfBitmap;
-import com.android.net.module.util.CollectionUtils;
 import com.android.net.module.util.PermissionUtils;
 
-import java.util.ArrayList;
-
 /**
  * @hide
  */
@@ -78,6 +75,32 @@ public class ConnectivityNativeService extends ConnectivityNative.Stub {
         }
     }
 
+    private void ensureValidPortRanges(int[] ranges) {
+        if (ranges == null || ranges.length % 2 != 0) {
+            throw new IllegalArgumentException("Port ranges must be [first, last] pairs");
+        }
+        for (int i = 0; i < ranges.length; i += 2) {
+            ensureValidPortNumber(ranges[i]);
+            ensureValidPortNumber(ranges[i + 1]);
+            if (ranges[i] > ranges[i + 1]) {
+                throw new IllegalArgumentException(
+                        "Invalid port range " + ranges[i] + "-" + ranges[i + 1]);
+            }
+        }
+    }
+
+    private void setPortRangesBlocked(int[] ranges, boolean blocked) {
+        for (int i = 0; i < ranges.length; i += 2) {
+            try {
+                mBpfBlockedPortsMap.setRange(ranges[i], ranges[i + 1], blocked);
+            } catch (ErrnoException e) {
+                throw new ServiceSpecificException(e.errno, "Could not "
+                        + (blocked ? "set" : "unset") + " bitmap range (ports: " + ranges[i] + "-"
+                        + ranges[i + 1] + "): " + e);
+            }
+        }
+    }
+
     public ConnectivityNativeService(final Context context) {
         this(context, new Dependencies());
     }
@@ -125,15 +148,26 @@ public class ConnectivityNativeService extends ConnectivityNative.Stub {
     public int[] getPortsBlockedForBind() {
         enforceBlockPortPermission();
 
-        ArrayList<Integer> portMap = new ArrayList<Integer>();
-        for (int i = 0; i <= 65535; i++) {
-            try {
-                if (mBpfBlockedPortsMap.get(i)) portMap.add(i);
-            } catch (ErrnoException e) {
-                Log.e(TAG, "Failed to get index " + i, e);
-            }
+        try {
+            return mBpfBlockedPortsMap.getSetIndexes();
+        } catch (ErrnoException e) {
+            Log.e(TAG, "Failed to read blocked ports", e);
+            throw new ServiceSpecificException(e.errno, "Could not read bitmap: " + e);
         }
-        return CollectionUtils.toIntArray(portMap);
+    }
+
+    @Override
+    public void blockPortRangesForBind(int[] ranges) {
+        enforceBlockPortPermission();
+        ensureValidPortRanges(ranges);
+        setPortRangesBlocked(ranges, true /* blocked */);
+    }
+
+    @Override
+    public void unblockPortRangesForBind(int[] ranges) {
+        enforceBlockPortPermission();
+        ensureValidPortRanges(ranges);
+        setPortRangesBlocked(ranges, false /* blocked */);
     }
 
     @Override
@@ -22,6 +22,9 @@ import android.system.ErrnoException;
 import androidx.annotation.NonNull;
 import androidx.annotation.RequiresApi;
 
+import java.util.ArrayList;
+import java.util.Arrays;
+
  /**
  *
  * Generic bitmap class for use with BPF programs. Corresponds to a BpfMap
@@ -101,6 +104,49 @@ public class BpfBitmap {
         mBpfMap.updateEntry(key, new Struct.S64(val));
     }
 
+    /**
+     * Change every index in [first, last] to set value. Each word of the map covering the range is
+     * read and written at most once, rather than once per index.
+     *
+     * @param first First position of the range in bitmap.
+     * @param last Last position of the range in bitmap, inclusive.
+     * @param set Boolean indicating to set or unset the range.
+     */
+    public void setRange(int first, int last, boolean set) throws ErrnoException {
+        if (first < 0 || first > last) throw new IllegalArgumentException("Invalid range.");
+
+        for (int word = first >> 6; word <= last >> 6; word++) {
+            final int lo = Math.max(first, word << 6) & 63;
+            final int hi = Math.min(last, (word << 6) + 63) & 63;
+            final long mask = (-1L >>> (63 - hi + lo)) << lo;
+            Struct.S32 key = new Struct.S32(word);
+            final long val = getBpfMapValue(key);
+            final long newVal = set ? (val | mask) : (val & ~mask);
+            if (newVal != val) mBpfMap.updateEntry(key, new Struct.S64(newVal));
+        }
+    }
+
+    /**
+     * Returns the positions of all set bits in ascending order, reading each word of the map once.
+     */
+    public int[] getSetIndexes() throws ErrnoException {
+        final ArrayList<Integer> indexes = new ArrayList<>();
+        Struct.S32 key = mBpfMap.getFirstKey();
+        while (key != null) {
+            long val = getBpfMapValue(key);
+            while (val != 0) {
+                indexes.add((key.val << 6) + Long.numberOfTrailingZeros(val));
+                val &= val - 1;
+            }
+            key = mBpfMap.getNextKey(key);
+        }
+        final int[] result = new int[indexes.size()];
+        for (int i = 0; i < result.length; i++) result[i] = indexes.get(i);
+        // Keys come in map order, which is only ascending for array maps.
+        Arrays.sort(result);
+        return result;
+    }
+
     /**
      * Clears the map. The map may already be empty.
      *
@@ -20,6 +20,7 @@
 
 #include "logging.h"
 #include "bpf/KernelUtils.h"
+#include "netdutils/NetlinkMessageBuilder.h"
 #include "scopeguard.h"
 
 #include <arpa/inet.h>
@@ -36,8 +37,10 @@
 #include <net/if.h>
 #include <stdio.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <utility>
+#include <vector>
 
 #define BPF_FD_JUST_USE_INT
 #include <BpfSyscallWrappers.h>
@@ -368,7 +371,16 @@ public:
 const sockaddr_nl KERNEL_NLADDR = {AF_NETLINK, 0, 0, 0};
 const uint16_t NETLINK_REQUEST_FLAGS = NLM_F_REQUEST | NLM_F_ACK;
 
-int sendAndProcessNetlinkResponse(const void *req, int len) {
+int sendAndProcessNetlinkResponse(const std::vector<iovec> &iov) {
+  if (iov.empty()) {
+    ALOGE("empty netlink request");
+    return -ENOBUFS;
+  }
+  size_t len = 0;
+  for (const iovec &v : iov) {
+    len += v.iov_len;
+  }
+
   // TODO: use unique_fd instead of ScopeGuard
   int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
   if (fd == -1) {
@@ -408,17 +420,21 @@ int sendAndProcessNetlinkResponse(const void *req, int len) {
     return -error;
   }
 
-  int rv = send(fd, req, len, 0);
+  const msghdr msg = {
+      .msg_iov = const_cast<iovec *>(iov.data()),
+      .msg_iovlen = iov.size(),
+  };
+  int rv = sendmsg(fd, &msg, 0);
 
   if (rv == -1) {
     int error = errno;
-    ALOGE("send(fd, req, len, 0) failed: %d", error);
+    ALOGE("sendmsg(fd, msg, 0) failed: %d", error);
     return -error;
   }
 
-  if (rv != len) {
-    ALOGE("send(fd, req, len = %d, 0) returned invalid message size %d", len,
-             rv);
+  if (rv != (int)len) {
+    ALOGE("sendmsg(fd, msg len = %zu, 0) returned invalid message size %d",
+          len, rv);
     return -EMSGSIZE;
   }
 
@@ -459,6 +475,11 @@ int sendAndProcessNetlinkResponse(const void *req, int len) {
   return resp.e.error; // returns 0 on success
 }
 
+int sendAndProcessNetlinkResponse(const void *req, int len) {
+  return sendAndProcessNetlinkResponse(
+      {{.iov_base = const_cast<void *>(req), .iov_len = (size_t)len}});
+}
+
 int hardwareAddressType(const char *interface) {
   int fd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
   if (fd < 0)
@@ -583,100 +604,32 @@ int tcAddBpfFilter(int ifIndex, bool ingress, uint16_t prio, uint16_t proto,
   }
   auto scopeGuard = base::make_scope_guard([bpfFd] { close(bpfFd); });
 
-  struct {
-    nlmsghdr n;
-    tcmsg t;
-    struct {
-      nlattr attr;
-      // The maximum classifier name length is defined in
-      // tcf_proto_ops in include/net/sch_generic.h.
-      char str[NLMSG_ALIGN(sizeof(CLS_BPF_KIND_NAME))];
-    } kind;
-    struct {
-      nlattr attr;
-      struct {
-        nlattr attr;
-        __u32 u32;
-      } fd;
-      struct {
-        nlattr attr;
-        char str[NLMSG_ALIGN(CLS_BPF_NAME_LEN)];
-      } name;
-      struct {
-        nlattr attr;
-        __u32 u32;
-      } flags;
-    } options;
-  } req = {
-      .n =
-          {
-              .nlmsg_len = sizeof(req),
-              .nlmsg_type = RTM_NEWTFILTER,
-              .nlmsg_flags = NETLINK_REQUEST_FLAGS | NLM_F_EXCL | NLM_F_CREATE,
-          },
-      .t =
-          {
-              .tcm_family = AF_UNSPEC,
-              .tcm_ifindex = ifIndex,
-              .tcm_handle = TC_H_UNSPEC,
-              .tcm_parent = TC_H_MAKE(TC_H_CLSACT, ingress ? TC_H_MIN_INGRESS
-                                                           : TC_H_MIN_EGRESS),
-              .tcm_info =
-                  static_cast<__u32>((static_cast<uint16_t>(prio) << 16) |
+  // Visible via 'tc filter show'.
+  char name[CLS_BPF_NAME_LEN];
+  snprintf(name, sizeof(name), "%s:[*fsobj]", basename(bpfProgPath));
+
+  // Large enough for everything but the name, which is sent in place.
+  alignas(nlmsghdr) uint8_t arena[128];
+  netdutils::NetlinkMessageBuilder req(
+      RTM_NEWTFILTER, NETLINK_REQUEST_FLAGS | NLM_F_EXCL | NLM_F_CREATE,
+      netdutils::Slice(arena, sizeof(arena)));
+  req.append(tcmsg{
+      .tcm_family = AF_UNSPEC,
+      .tcm_ifindex = ifIndex,
+      .tcm_handle = TC_H_UNSPEC,
+      .tcm_parent = TC_H_MAKE(TC_H_CLSACT,
+                              ingress ? TC_H_MIN_INGRESS : TC_H_MIN_EGRESS),
+      .tcm_info = static_cast<__u32>((static_cast<uint16_t>(prio) << 16) |
                                      htons(static_cast<uint16_t>(proto))),
-          },
-      .kind =
-          {
-              .attr =
-                  {
-                      .nla_len = sizeof(req.kind),
-                      .nla_type = TCA_KIND,
-                  },
-              .str = CLS_BPF_KIND_NAME,
-          },
-      .options =
-          {
-              .attr =
-                  {
-                      .nla_len = sizeof(req.options),
-                      .nla_type = NLA_F_NESTED | TCA_OPTIONS,
-                  },
-              .fd =
-                  {
-                      .attr =
-                          {
-                              .nla_len = sizeof(req.options.fd),
-                              .nla_type = TCA_BPF_FD,
-                          },
-                      .u32 = static_cast<__u32>(bpfFd),
-                  },
-              .name =
-                  {
-                      .attr =
-                          {
-                              .nla_len = sizeof(req.options.name),
-                              .nla_type = TCA_BPF_NAME,
-                          },
-                      // Visible via 'tc filter show', but
-                      // is overwritten by strncpy below
-                      .str = "placeholder",
-                  },
-              .flags =
-                  {
-                      .attr =
-                          {
-                              .nla_len = sizeof(req.options.flags),
-                              .nla_type = TCA_BPF_FLAGS,
-                          },
-                      .u32 = TCA_BPF_FLAG_ACT_DIRECT,
-                  },
-          },
-  };
-
-  snprintf(req.options.name.str, sizeof(req.options.name.str), "%s:[*fsobj]",
-           basename(bpfProgPath));
-
-  int error = sendAndProcessNetlinkResponse(&req, sizeof(req));
+  });
+  req.addAttrString(TCA_KIND, CLS_BPF_KIND_NAME);
+  const auto options = req.beginNested(TCA_OPTIONS);
+  req.addAttr(TCA_BPF_FD, static_cast<__u32>(bpfFd));
+  req.addAttrString(TCA_BPF_NAME, name);
+  req.addAttr(TCA_BPF_FLAGS, static_cast<__u32>(TCA_BPF_FLAG_ACT_DIRECT));
+  req.endNested(options);
+
+  int error = sendAndProcessNetlinkResponse(req.finish());
   return error;
 }
 
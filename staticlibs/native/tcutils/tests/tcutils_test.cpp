@@ -110,6 +110,30 @@ TEST(LibTcUtilsTest, AddAndDeleteBpfFilter) {
   EXPECT_EQ(-EINVAL, tcDeleteFilter(LOOPBACK_IFINDEX, ingress, prio, proto));
 }
 
+TEST(LibTcUtilsTest, AddAndDeleteEgressBpfFilter) {
+  static constexpr char bpfProgPath[] =
+      "/sys/fs/bpf/tethering/prog_offload_schedcls_tether_downstream6_ether";
+  static constexpr char missingProgPath[] =
+      "/sys/fs/bpf/tethering/prog_offload_schedcls_does_not_exist";
+
+  // static test values
+  static constexpr bool ingress = false;
+  static constexpr uint16_t prio = 17;
+  static constexpr uint16_t proto = ETH_P_ALL;
+
+  // a missing program fails before any request is built
+  EXPECT_EQ(-ENOENT, tcAddBpfFilter(LOOPBACK_IFINDEX, ingress, prio, proto,
+                                    missingProgPath));
+  EXPECT_EQ(0, tcAddQdiscClsact(LOOPBACK_IFINDEX));
+  EXPECT_EQ(-ENOENT, tcAddBpfFilter(LOOPBACK_IFINDEX, ingress, prio, proto,
+                                    missingProgPath));
+  // the egress hook takes the same request with a different parent
+  EXPECT_EQ(
+      0, tcAddBpfFilter(LOOPBACK_IFINDEX, ingress, prio, proto, bpfProgPath));
+  EXPECT_EQ(0, tcDeleteFilter(LOOPBACK_IFINDEX, ingress, prio, proto));
+  EXPECT_EQ(0, tcDeleteQdiscClsact(LOOPBACK_IFINDEX));
+}
+
 TEST(LibTcUtilsTest, AddAndDeleteIngressPoliceFilter) {
   // TODO: this should likely be in the tethering module, where using netd.h would be ok
   static constexpr char bpfProgPath[] =
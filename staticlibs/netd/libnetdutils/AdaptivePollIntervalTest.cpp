@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "netdutils/AdaptivePollInterval.h"
+
+namespace android {
+namespace netdutils {
+
+using std::chrono::milliseconds;
+
+namespace {
+
+AdaptivePollInterval<milliseconds> makeInterval() {
+    return AdaptivePollInterval<milliseconds>({.minInterval = milliseconds(250),
+                                               .initialInterval = milliseconds(1000),
+                                               .maxInterval = milliseconds(4000),
+                                               .highWatermark = 0.5});
+}
+
+}  // namespace
+
+TEST(AdaptivePollIntervalTest, emptyPollsBackOff) {
+    auto interval = makeInterval();
+    EXPECT_EQ(milliseconds(1000), interval.interval());
+    EXPECT_EQ(milliseconds(2000), interval.next(0));
+    EXPECT_EQ(milliseconds(4000), interval.next(0));
+    // Maxes out, and stays there.
+    EXPECT_EQ(milliseconds(4000), interval.next(0));
+    EXPECT_EQ(milliseconds(4000), interval.next(0));
+}
+
+TEST(AdaptivePollIntervalTest, fullPollsSpeedUp) {
+    auto interval = makeInterval();
+    EXPECT_EQ(milliseconds(500), interval.next(0.5));
+    EXPECT_EQ(milliseconds(250), interval.next(1.0));
+    // Bottoms out, and stays there.
+    EXPECT_EQ(milliseconds(250), interval.next(0.9));
+}
+
+TEST(AdaptivePollIntervalTest, moderatePollsHold) {
+    auto interval = makeInterval();
+    EXPECT_EQ(milliseconds(2000), interval.next(0));
+    EXPECT_EQ(milliseconds(2000), interval.next(0.1));
+    EXPECT_EQ(milliseconds(2000), interval.next(0.49));
+
+    // Backing off starts again from the current interval.
+    EXPECT_EQ(milliseconds(4000), interval.next(0));
+    EXPECT_EQ(milliseconds(2000), interval.next(0.6));
+    EXPECT_EQ(milliseconds(4000), interval.next(0));
+}
+
+TEST(AdaptivePollIntervalTest, reset) {
+    auto interval = makeInterval();
+    interval.next(1.0);
+    interval.next(1.0);
+    EXPECT_EQ(milliseconds(250), interval.interval());
+    interval.reset();
+    EXPECT_EQ(milliseconds(1000), interval.interval());
+    EXPECT_EQ(milliseconds(2000), interval.next(0));
+}
+
+}  // namespace netdutils
+}  // namespace android
@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DatagramReceiver"
+
+#include <algorithm>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "netdutils/DatagramReceiver.h"
+#include "netdutils/IoUring.h"
+#include "netdutils/Syscalls.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+// Largest number of entries the kernel accepts for a provided buffer ring.
+constexpr unsigned int kMaxBufRingEntries = 32768;
+
+constexpr uint16_t kBufferGroup = 0;
+constexpr uint64_t kRecvUserData = 1;
+constexpr uint64_t kProbeUserData = 2;
+
+size_t roundUpToPageSize(size_t size) {
+    const size_t pageSize = getpagesize();
+    return (std::max<size_t>(size, 1) + pageSize - 1) / pageSize * pageSize;
+}
+
+unsigned int roundUpToPowerOfTwo(unsigned int n) {
+    unsigned int p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+// Anonymous, page-aligned mapping.
+class MappedBuffer {
+  public:
+    MappedBuffer() = default;
+    MappedBuffer(MappedBuffer&& other) { *this = std::move(other); }
+    MappedBuffer& operator=(MappedBuffer&& other) {
+        std::swap(mBase, other.mBase);
+        std::swap(mSize, other.mSize);
+        return *this;
+    }
+    ~MappedBuffer() {
+        if (mBase != nullptr) munmap(mBase, mSize);
+    }
+
+    static StatusOr<MappedBuffer> create(size_t size) {
+        MappedBuffer buffer;
+        buffer.mSize = roundUpToPageSize(size);
+        void* base = mmap(nullptr, buffer.mSize, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            return statusFromErrno(errno, "mmap() failed");
+        }
+        buffer.mBase = static_cast<uint8_t*>(base);
+        return buffer;
+    }
+
+    uint8_t* base() const { return mBase; }
+
+  private:
+    uint8_t* mBase = nullptr;
+    size_t mSize = 0;
+};
+
+class RecvmmsgDatagramReceiver : public DatagramReceiver {
+  public:
+    RecvmmsgDatagramReceiver(Fd sock, MappedBuffer buffers, size_t bufferSize,
+                             unsigned int bufferCount)
+        : mSock(sock), mBuffers(std::move(buffers)), mIovs(bufferCount), mMsgs(bufferCount) {
+        for (unsigned int i = 0; i < bufferCount; ++i) {
+            mIovs[i] = {.iov_base = mBuffers.base() + i * bufferSize, .iov_len = bufferSize};
+            mMsgs[i].msg_hdr.msg_iov = &mIovs[i];
+            mMsgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    Fd pollFd() const override { return mSock; }
+
+    StatusOr<size_t> drain(const OnDatagram& onDatagram) override {
+        const auto& sys = sSyscalls.get();
+        // MSG_DONTWAIT returns whatever is queued rather than blocking until
+        // every buffer is filled.
+        auto rx = sys.recvmmsg(mSock, mMsgs.data(), mMsgs.size(), MSG_DONTWAIT);
+        if (equalToErrno(rx, EAGAIN)) {
+            return 0;
+        }
+        RETURN_IF_NOT_OK(rx);
+        size_t delivered = 0;
+        for (unsigned int i = 0; i < rx.value(); ++i) {
+            const mmsghdr& msg = mMsgs[i];
+            if (msg.msg_hdr.msg_flags & MSG_TRUNC) {
+                ALOGE("Dropped datagram larger than %zu bytes on fd %d",
+                      msg.msg_hdr.msg_iov->iov_len, mSock.get());
+                continue;
+            }
+            onDatagram(Slice(msg.msg_hdr.msg_iov->iov_base, msg.msg_len));
+            delivered++;
+        }
+        return delivered;
+    }
+
+    bool isIoUring() const override { return false; }
+
+  private:
+    const Fd mSock;
+    const MappedBuffer mBuffers;
+    std::vector<iovec> mIovs;
+    std::vector<mmsghdr> mMsgs;
+};
+
+class IoUringDatagramReceiver : public DatagramReceiver {
+  public:
+    IoUringDatagramReceiver(Fd sock, std::unique_ptr<IoUring> ring, MappedBuffer bufRing,
+                            MappedBuffer buffers, size_t bufferSize, unsigned int bufferCount)
+        : mSock(sock),
+          mRing(std::move(ring)),
+          mBufRingMem(std::move(bufRing)),
+          mBuffers(std::move(buffers)),
+          mBufferSize(bufferSize),
+          mBufferCount(bufferCount),
+          mBufRing(reinterpret_cast<io_uring_buf_ring*>(mBufRingMem.base())) {}
+
+    Status init() {
+        RETURN_IF_NOT_OK(mRing->registerBufRing(mBufRing, mBufferCount, kBufferGroup));
+        for (unsigned int bid = 0; bid < mBufferCount; ++bid) {
+            recycle(bid);
+        }
+        publishBuffers();
+        RETURN_IF_NOT_OK(probe());
+        return arm();
+    }
+
+    Fd pollFd() const override { return mRing->fd(); }
+
+    StatusOr<size_t> drain(const OnDatagram& onDatagram) override {
+        size_t delivered = 0;
+        unsigned int consumed = 0;
+        bool rearm = false;
+        int err = 0;
+        mRing->forEachCqe([&](const io_uring_cqe& cqe) {
+            if (cqe.user_data != kRecvUserData) return;
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                rearm = true;
+            }
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                const uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                // With MSG_TRUNC, res is the full datagram length even if
+                // only mBufferSize bytes of it were copied.
+                if (static_cast<size_t>(cqe.res) > mBufferSize) {
+                    ALOGE("Dropped datagram larger than %zu bytes on fd %d", mBufferSize,
+                          mSock.get());
+                } else {
+                    onDatagram(Slice(mBuffers.base() + bid * mBufferSize, cqe.res));
+                    delivered++;
+                }
+                recycle(bid);
+                consumed++;
+                return;
+            }
+            // The multishot recv also ends with ENOBUFS when it runs out of
+            // provided buffers. Buffers are only returned at the end of
+            // drain(), so that happened iff every buffer was consumed since.
+            // No data is lost in that case; it stays queued on the socket.
+            if (cqe.res == -ENOBUFS && consumed >= mBufferCount) return;
+            if (cqe.res < 0 && err == 0) {
+                err = -cqe.res;
+            }
+        });
+        publishBuffers();
+        if (rearm) {
+            RETURN_IF_NOT_OK(arm());
+        }
+        if (err != 0) {
+            return statusFromErrno(err, "multishot recv failed");
+        }
+        return delivered;
+    }
+
+    bool isIoUring() const override { return true; }
+
+  private:
+    // Queue buffer bid for reuse by the kernel. Takes effect on publishBuffers().
+    void recycle(uint16_t bid) {
+        io_uring_buf& buf = mBufRing->bufs[mBufTail & (mBufferCount - 1)];
+        buf.addr = reinterpret_cast<uintptr_t>(mBuffers.base() + bid * mBufferSize);
+        buf.len = mBufferSize;
+        buf.bid = bid;
+        mBufTail++;
+    }
+
+    void publishBuffers() { __atomic_store_n(&mBufRing->tail, mBufTail, __ATOMIC_RELEASE); }
+
+    // Some kernels accept IORING_REGISTER_PBUF_RING but never select
+    // buffers from the ring. Read an eventfd through the ring before
+    // trusting it with the socket, so that callers fall back to recvmmsg().
+    Status probe() {
+        const auto& sys = sSyscalls.get();
+        ASSIGN_OR_RETURN(auto efd, sys.eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK));
+        io_uring_sqe* sqe = mRing->getSqe();
+        if (sqe == nullptr) {
+            return statusFromErrno(EBUSY, "io_uring submission queue full");
+        }
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = Fd(efd).get();
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufferGroup;
+        sqe->user_data = kProbeUserData;
+        RETURN_IF_NOT_OK(mRing->submit(1));
+
+        bool selected = false;
+        mRing->forEachCqe([&](const io_uring_cqe& cqe) {
+            if (cqe.user_data != kProbeUserData || !(cqe.flags & IORING_CQE_F_BUFFER)) return;
+            recycle(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            selected = true;
+        });
+        publishBuffers();
+        if (!selected) {
+            return statusFromErrno(EOPNOTSUPP, "io_uring provided buffer ring not functional");
+        }
+        return status::ok;
+    }
+
+    Status arm() {
+        io_uring_sqe* sqe = mRing->getSqe();
+        if (sqe == nullptr) {
+            return statusFromErrno(EBUSY, "io_uring submission queue full");
+        }
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = mSock.get();
+        // Complete with the real length of datagrams that do not fit in a
+        // buffer, so drain() can drop them instead of delivering a prefix.
+        sqe->msg_flags = MSG_TRUNC;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = kBufferGroup;
+        sqe->user_data = kRecvUserData;
+        return mRing->submit().status();
+    }
+
+    const Fd mSock;
+    const std::unique_ptr<IoUring> mRing;
+    const MappedBuffer mBufRingMem;
+    const MappedBuffer mBuffers;
+    const size_t mBufferSize;
+    const unsigned int mBufferCount;
+    io_uring_buf_ring* const mBufRing;
+    uint16_t mBufTail = 0;
+};
+
+}  // namespace
+
+StatusOr<std::unique_ptr<DatagramReceiver>> makeIoUringDatagramReceiver(
+        Fd sock, size_t bufferSize, unsigned int bufferCount) {
+    bufferSize = roundUpToPageSize(bufferSize);
+    bufferCount = roundUpToPowerOfTwo(std::clamp(bufferCount, 1U, kMaxBufRingEntries));
+
+    // Multishot recv and IORING_SETUP_SINGLE_ISSUER both appeared in Linux 6.0,
+    // so creating the ring doubles as a feature probe. The completion queue
+    // holds one completion per buffer plus the one ending the multishot recv.
+    ASSIGN_OR_RETURN(auto ring,
+                     IoUring::create(1, bufferCount + 1, IORING_SETUP_SINGLE_ISSUER));
+    ASSIGN_OR_RETURN(auto bufRing, MappedBuffer::create(bufferCount * sizeof(io_uring_buf)));
+    ASSIGN_OR_RETURN(auto buffers, MappedBuffer::create(bufferCount * bufferSize));
+    auto receiver = std::make_unique<IoUringDatagramReceiver>(
+            sock, std::move(ring), std::move(bufRing), std::move(buffers), bufferSize,
+            bufferCount);
+    RETURN_IF_NOT_OK(receiver->init());
+    return std::unique_ptr<DatagramReceiver>(std::move(receiver));
+}
+
+StatusOr<std::unique_ptr<DatagramReceiver>> makeRecvmmsgDatagramReceiver(
+        Fd sock, size_t bufferSize, unsigned int bufferCount) {
+    bufferSize = roundUpToPageSize(bufferSize);
+    bufferCount = std::max(bufferCount, 1U);
+    ASSIGN_OR_RETURN(auto buffers, MappedBuffer::create(bufferCount * bufferSize));
+    return std::unique_ptr<DatagramReceiver>(std::make_unique<RecvmmsgDatagramReceiver>(
+            sock, std::move(buffers), bufferSize, bufferCount));
+}
+
+}  // namespace netdutils
+}  // namespace android
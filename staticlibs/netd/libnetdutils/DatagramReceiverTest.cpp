@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <gtest/gtest.h>
+
+#include "netdutils/DatagramReceiver.h"
+#include "netdutils/Syscalls.h"
+
+namespace android {
+namespace netdutils {
+
+class DatagramReceiverTest : public testing::TestWithParam<bool> {
+  protected:
+    void SetUp() override {
+        int fds[2];
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds));
+        mReader.reset(fds[0]);
+        mWriter.reset(fds[1]);
+    }
+
+    std::unique_ptr<DatagramReceiver> makeReceiver(unsigned int bufferCount) {
+        auto receiver = GetParam()
+                                ? makeIoUringDatagramReceiver(mReader, 4096, bufferCount)
+                                : makeRecvmmsgDatagramReceiver(mReader, 4096, bufferCount);
+        if (!isOk(receiver)) return nullptr;
+        return std::move(receiver.value());
+    }
+
+    void send(const std::string& payload) {
+        ASSERT_EQ(static_cast<ssize_t>(payload.size()),
+                  ::send(Fd(mWriter).get(), payload.data(), payload.size(), 0));
+    }
+
+    // Drain until count datagrams have been received or the receiver goes idle.
+    std::vector<std::string> receive(DatagramReceiver& receiver, size_t count) {
+        std::vector<std::string> received;
+        while (received.size() < count) {
+            pollfd pfd = {.fd = receiver.pollFd().get(), .events = POLLIN};
+            if (poll(&pfd, 1, 1000) != 1) break;
+            auto drained = receiver.drain([&received](const Slice buf) {
+                received.emplace_back(reinterpret_cast<const char*>(buf.base()), buf.size());
+            });
+            if (!isOk(drained)) {
+                ADD_FAILURE() << "drain failed: " << drained.status();
+                break;
+            }
+        }
+        return received;
+    }
+
+    UniqueFd mReader;
+    UniqueFd mWriter;
+};
+
+INSTANTIATE_TEST_SUITE_P(DatagramReceiverTest, DatagramReceiverTest, testing::Bool(),
+                         [](const testing::TestParamInfo<bool>& info) {
+                             return info.param ? "IoUring" : "Recvmmsg";
+                         });
+
+TEST_P(DatagramReceiverTest, receivesInOrder) {
+    auto receiver = makeReceiver(8);
+    if (receiver == nullptr) GTEST_SKIP() << "io_uring multishot recv not available";
+    EXPECT_EQ(GetParam(), receiver->isIoUring());
+
+    const std::vector<std::string> expected = {"one", "two", "three", "four"};
+    for (const auto& payload : expected) send(payload);
+    EXPECT_EQ(expected, receive(*receiver, expected.size()));
+}
+
+TEST_P(DatagramReceiverTest, moreDatagramsThanBuffers) {
+    auto receiver = makeReceiver(4);
+    if (receiver == nullptr) GTEST_SKIP() << "io_uring multishot recv not available";
+
+    std::vector<std::string> expected;
+    for (int i = 0; i < 50; ++i) {
+        expected.push_back("datagram " + std::to_string(i));
+        send(expected.back());
+    }
+    EXPECT_EQ(expected, receive(*receiver, expected.size()));
+}
+
+TEST_P(DatagramReceiverTest, dropsTruncatedDatagrams) {
+    auto receiver = makeReceiver(4);
+    if (receiver == nullptr) GTEST_SKIP() << "io_uring multishot recv not available";
+
+    send(std::string(4097, 'x'));
+    send("fits");
+    EXPECT_EQ(std::vector<std::string>{"fits"}, receive(*receiver, 1));
+}
+
+TEST_P(DatagramReceiverTest, drainWithoutDataIsEmpty) {
+    auto receiver = makeReceiver(4);
+    if (receiver == nullptr) GTEST_SKIP() << "io_uring multishot recv not available";
+
+    auto drained = receiver->drain([](const Slice) { FAIL() << "unexpected datagram"; });
+    ASSERT_OK(drained);
+    EXPECT_EQ(0U, drained.value());
+}
+
+TEST(DatagramReceiverTest, syscallsFallsBackToRecvmmsg) {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds));
+    UniqueFd reader(fds[0]);
+    UniqueFd writer(fds[1]);
+
+    auto receiver = sSyscalls.get().datagramReceiver(reader, 4096, 4, false);
+    ASSERT_OK(receiver);
+    EXPECT_FALSE(receiver.value()->isIoUring());
+    EXPECT_EQ(Fd(reader), receiver.value()->pollFd());
+
+    // Requesting io_uring always yields a usable receiver.
+    receiver = sSyscalls.get().datagramReceiver(reader, 4096, 4, true);
+    ASSERT_OK(receiver);
+}
+
+}  // namespace netdutils
+}  // namespace android
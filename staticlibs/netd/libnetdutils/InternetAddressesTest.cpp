@@ -14,10 +14,15 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <limits>
+#include <random>
+#include <set>
 #include <sstream>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include <android-base/macros.h>
@@ -723,6 +728,251 @@ TEST(CompatIPDataTest, ConversionsClearUnneededValues) {
     EXPECT_EQ(IPV6_ADDR_BITS, IPPrefix(linkLocalPrefix.ip()).length());
 }
 
+TEST(IPAddressTest, Hash) {
+    const std::vector<IPAddress> addresses = {
+            IPAddress(),
+            IPAddress(IPV4_ANY),
+            IPAddress(IPV4_LOOPBACK),
+            IPAddress(IPV6_ANY),
+            IPAddress(IPV6_LOOPBACK),
+            IPAddress(FE80_1),
+            IPAddress(FE80_1, 1),
+            IPAddress(FE80_1, 2),
+    };
+    std::unordered_set<IPAddress> set(addresses.begin(), addresses.end());
+    EXPECT_EQ(addresses.size(), set.size());
+    for (const auto& ip : addresses) {
+        EXPECT_EQ(1U, set.count(ip)) << ip;
+        EXPECT_EQ(std::hash<IPAddress>()(ip), std::hash<IPAddress>()(IPAddress(ip))) << ip;
+    }
+    EXPECT_EQ(0U, set.count(IPAddress(FE80_2)));
+
+    // IPv4 addresses do not depend on bytes beyond the 32 bits in use.
+    in6_addr dirty = IPV6_ONES;
+    memcpy(&dirty, &IPV4_LOOPBACK, sizeof(IPV4_LOOPBACK));
+    const IPAddress v4a(IPV4_LOOPBACK);
+    const IPAddress v4b(*reinterpret_cast<const in_addr*>(&dirty));
+    EXPECT_EQ(v4a, v4b);
+    EXPECT_EQ(std::hash<IPAddress>()(v4a), std::hash<IPAddress>()(v4b));
+
+    const std::unordered_set<IPPrefix> prefixes = {
+            IPPrefix(IPAddress(FE80_1), 64),
+            IPPrefix(IPAddress(FE80_2), 64),
+            IPPrefix(IPAddress(FE80_1), 128),
+    };
+    EXPECT_EQ(2U, prefixes.size());
+
+    const std::unordered_set<IPSockAddr> sockaddrs = {
+            IPSockAddr(IPAddress(IPV6_LOOPBACK), 53),
+            IPSockAddr(IPAddress(IPV6_LOOPBACK), 853),
+            IPSockAddr(IPAddress(IPV6_LOOPBACK), 53),
+    };
+    EXPECT_EQ(2U, sockaddrs.size());
+}
+
+TEST(IPAddressTest, IPv6OrderingMatchesBytes) {
+    std::mt19937 rng(42);
+    for (int i = 0; i < 1000; i++) {
+        in6_addr a, b;
+        for (int j = 0; j < IPV6_ADDR_LEN; j++) {
+            a.s6_addr[j] = rng();
+            // Share a random number of leading bytes.
+            b.s6_addr[j] = (j < i % IPV6_ADDR_LEN) ? a.s6_addr[j] : rng();
+        }
+        const int cmp = memcmp(&a, &b, sizeof(a));
+        EXPECT_EQ(cmp < 0, IPAddress(a) < IPAddress(b));
+        EXPECT_EQ(cmp == 0, IPAddress(a) == IPAddress(b));
+    }
+}
+
+TEST(IPPrefixMapTest, InsertFindErase) {
+    IPPrefixMap<int> map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_TRUE(map.insert(IPPrefix::forString("10.0.0.0/8"), 1));
+    EXPECT_TRUE(map.insert(IPPrefix::forString("10.1.0.0/16"), 2));
+    EXPECT_TRUE(map.insert(IPPrefix::forString("10.2.0.0/16"), 3));
+    EXPECT_TRUE(map.insert(IPPrefix::forString("2001:db8::/32"), 4));
+    EXPECT_TRUE(map.insert(IPPrefix::forString("::/0"), 5));
+    EXPECT_FALSE(map.insert(IPPrefix::forString("10.1.0.0/16"), 6));
+    EXPECT_FALSE(map.insert(IPPrefix(), 7));
+    EXPECT_EQ(5U, map.size());
+
+    ASSERT_NE(nullptr, map.find(IPPrefix::forString("10.1.0.0/16")));
+    EXPECT_EQ(6, *map.find(IPPrefix::forString("10.1.0.0/16")));
+    // The branch point at 10.0.0.0/14 is not a stored prefix.
+    EXPECT_EQ(nullptr, map.find(IPPrefix::forString("10.0.0.0/14")));
+    EXPECT_EQ(nullptr, map.find(IPPrefix::forString("10.1.0.0/24")));
+    EXPECT_EQ(nullptr, map.find(IPPrefix::forString("0.0.0.0/0")));
+
+    EXPECT_TRUE(map.erase(IPPrefix::forString("10.1.0.0/16")));
+    EXPECT_FALSE(map.erase(IPPrefix::forString("10.1.0.0/16")));
+    EXPECT_EQ(nullptr, map.find(IPPrefix::forString("10.1.0.0/16")));
+    EXPECT_TRUE(map.erase(IPPrefix::forString("10.0.0.0/8")));
+    EXPECT_EQ(3, *map.find(IPPrefix::forString("10.2.0.0/16")));
+    EXPECT_EQ(3U, map.size());
+
+    std::set<IPPrefix> remaining;
+    map.forEach([&remaining](const IPPrefix& prefix, const int&) { remaining.insert(prefix); });
+    EXPECT_EQ((std::set<IPPrefix>{IPPrefix::forString("10.2.0.0/16"),
+                                  IPPrefix::forString("2001:db8::/32"),
+                                  IPPrefix::forString("::/0")}),
+              remaining);
+
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(nullptr, map.find(IPPrefix::forString("10.2.0.0/16")));
+}
+
+TEST(IPPrefixMapTest, LongestMatch) {
+    IPPrefixMap<std::string> map;
+    map.insert(IPPrefix::forString("0.0.0.0/0"), "default4");
+    map.insert(IPPrefix::forString("192.0.2.0/24"), "net");
+    map.insert(IPPrefix::forString("192.0.2.128/25"), "subnet");
+    map.insert(IPPrefix::forString("192.0.2.1/32"), "host");
+    map.insert(IPPrefix::forString("2001:db8::/32"), "doc");
+    map.insert(IPPrefix::forString("2001:db8:1::/48"), "site");
+
+    const struct {
+        const char* address;
+        const char* expected;
+        const char* prefix;
+    } expectations[] = {
+            {"8.8.8.8", "default4", "0.0.0.0/0"},
+            {"192.0.2.1", "host", "192.0.2.1/32"},
+            {"192.0.2.2", "net", "192.0.2.0/24"},
+            {"192.0.2.200", "subnet", "192.0.2.128/25"},
+            {"2001:db8:1::1", "site", "2001:db8:1::/48"},
+            {"2001:db8:2::1", "doc", "2001:db8::/32"},
+            {"2001:db9::1", nullptr, nullptr},
+            {"::ffff:192.0.2.1", nullptr, nullptr},
+    };
+    for (const auto& e : expectations) {
+        SCOPED_TRACE(e.address);
+        IPPrefix matched;
+        const std::string* value = map.longestMatch(IPAddress::forString(e.address), &matched);
+        if (e.expected == nullptr) {
+            EXPECT_EQ(nullptr, value);
+            continue;
+        }
+        ASSERT_NE(nullptr, value);
+        EXPECT_EQ(e.expected, *value);
+        EXPECT_EQ(IPPrefix::forString(e.prefix), matched);
+    }
+}
+
+TEST(IPPrefixSetTest, Covers) {
+    IPPrefixSet set;
+    set.insert(IPPrefix::forString("fe80::/64"));
+    set.insert(IPPrefix::forString("100.64.0.0/10"));
+    EXPECT_TRUE(set.contains(IPPrefix::forString("fe80::/64")));
+    EXPECT_FALSE(set.contains(IPPrefix::forString("fe80::/10")));
+
+    const std::vector<IPAddress> addresses = {
+            IPAddress::forString("fe80::1"),
+            IPAddress::forString("fe81::1"),
+            IPAddress::forString("100.100.1.1"),
+            IPAddress::forString("100.128.1.1"),
+            IPAddress(),
+    };
+    EXPECT_EQ((std::vector<bool>{true, false, true, false, false}), set.covers(addresses));
+
+    IPPrefix matched;
+    EXPECT_TRUE(set.longestMatch(IPAddress::forString("100.64.0.1"), &matched));
+    EXPECT_EQ(IPPrefix::forString("100.64.0.0/10"), matched);
+}
+
+IPPrefix randomPrefix(std::mt19937& rng, bool ipv6) {
+    if (!ipv6) {
+        const in_addr v4 = {.s_addr = static_cast<in_addr_t>(rng())};
+        return IPPrefix(IPAddress(v4), rng() % (IPV4_ADDR_BITS + 1));
+    }
+    // Cluster addresses under a few /16s so that prefixes nest.
+    in6_addr v6;
+    for (int i = 0; i < IPV6_ADDR_LEN; i++) v6.s6_addr[i] = rng();
+    v6.s6_addr[0] = 0x20;
+    v6.s6_addr[1] = rng() % 4;
+    return IPPrefix(IPAddress(v6), 16 + rng() % (IPV6_ADDR_BITS - 16 + 1));
+}
+
+IPAddress randomAddressNear(std::mt19937& rng, const IPPrefix& prefix) {
+    if (prefix.family() == AF_INET) {
+        const uint32_t host = rng() & ~(prefix.length() ? ~0U << (32 - prefix.length()) : 0U);
+        const in_addr v4 = {.s_addr = prefix.addr4().s_addr | htonl(host & (rng() % 2 ? ~0U : 0xffU))};
+        return IPAddress(v4);
+    }
+    in6_addr v6 = prefix.addr6();
+    v6.s6_addr[IPV6_ADDR_LEN - 1 - rng() % 4] ^= rng();
+    return IPAddress(v6);
+}
+
+// Longest prefix match by linear scan, as done by the code IPPrefixMap replaces.
+const IPPrefix* linearLongestMatch(const std::vector<IPPrefix>& prefixes, const IPAddress& ip) {
+    const IPPrefix* best = nullptr;
+    for (const auto& prefix : prefixes) {
+        if (prefix.family() != ip.family()) continue;
+        if (IPPrefix(ip, prefix.length()).ip() != prefix.ip()) continue;
+        if (best == nullptr || prefix.length() > best->length()) best = &prefix;
+    }
+    return best;
+}
+
+// Checks IPPrefixMap against a linear scan on random data.
+TEST(IPPrefixMapTest, LongestMatchAgreesWithLinearScan) {
+    constexpr int kPrefixes = 2000;
+    constexpr int kLookups = 20000;
+    std::mt19937 rng(1234);
+
+    std::vector<IPPrefix> prefixes;
+    IPPrefixMap<IPPrefix> map;
+    for (int i = 0; i < kPrefixes; i++) {
+        const IPPrefix prefix = randomPrefix(rng, i % 2);
+        if (map.insert(prefix, prefix)) prefixes.push_back(prefix);
+    }
+    ASSERT_EQ(prefixes.size(), map.size());
+
+    std::vector<IPAddress> addresses;
+    for (int i = 0; i < kLookups; i++) {
+        addresses.push_back(randomAddressNear(rng, prefixes[rng() % prefixes.size()]));
+    }
+
+    std::vector<const IPPrefix*> linear;
+    for (const auto& ip : addresses) linear.push_back(linearLongestMatch(prefixes, ip));
+    std::vector<const IPPrefix*> trie;
+    for (const auto& ip : addresses) trie.push_back(map.longestMatch(ip));
+
+    int matched = 0;
+    for (int i = 0; i < kLookups; i++) {
+        ASSERT_EQ(linear[i] == nullptr, trie[i] == nullptr) << addresses[i];
+        if (linear[i] == nullptr) continue;
+        EXPECT_EQ(*linear[i], *trie[i]) << addresses[i];
+        matched++;
+    }
+    EXPECT_LT(kLookups / 2, matched);
+
+    // Erasing everything leaves no nodes reachable.
+    for (const auto& prefix : prefixes) EXPECT_TRUE(map.erase(prefix)) << prefix;
+    EXPECT_TRUE(map.empty());
+    for (const auto& ip : addresses) EXPECT_EQ(nullptr, map.longestMatch(ip));
+}
+
+// Hashing and ordering agree on which of many similar addresses are distinct.
+TEST(IPAddressTest, HashAndCompareAgree) {
+    constexpr int kAddresses = 100000;
+    std::mt19937 rng(5678);
+    std::vector<IPAddress> addresses;
+    for (int i = 0; i < kAddresses; i++) {
+        in6_addr v6;
+        for (int j = 0; j < IPV6_ADDR_LEN; j++) v6.s6_addr[j] = (j < 12) ? 0x20 : rng();
+        addresses.emplace_back(v6);
+    }
+
+    std::unordered_set<IPAddress> set(addresses.begin(), addresses.end());
+    std::sort(addresses.begin(), addresses.end());
+
+    EXPECT_TRUE(std::is_sorted(addresses.begin(), addresses.end()));
+    EXPECT_EQ(std::set<IPAddress>(addresses.begin(), addresses.end()).size(), set.size());
+}
+
 }  // namespace
 }  // namespace netdutils
 }  // namespace android
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "netdutils/IoUring.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+int ioUringSetup(unsigned int entries, io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int ioUringEnter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags) {
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+int ioUringRegister(int fd, unsigned int opcode, void* arg, unsigned int nrArgs) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+template <typename T>
+T* atOffset(void* base, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<IoUring>> IoUring::create(unsigned int sqEntries,
+                                                   unsigned int cqEntries, uint32_t flags) {
+    io_uring_params params = {};
+    params.flags = flags;
+    if (cqEntries > sqEntries) {
+        params.flags |= IORING_SETUP_CQSIZE;
+        params.cq_entries = cqEntries;
+    }
+    const int fd = ioUringSetup(sqEntries, &params);
+    if (fd == -1) {
+        return statusFromErrno(errno, "io_uring_setup() failed");
+    }
+    std::unique_ptr<IoUring> ring(new IoUring());
+    ring->mFd.reset(Fd(fd));
+    RETURN_IF_NOT_OK(ring->map(params));
+    return ring;
+}
+
+IoUring::~IoUring() {
+    if (mSqes != nullptr) munmap(mSqes, mSqesSize);
+    if (mCqRing != nullptr && mCqRing != mSqRing) munmap(mCqRing, mCqRingSize);
+    if (mSqRing != nullptr) munmap(mSqRing, mSqRingSize);
+}
+
+Status IoUring::map(const io_uring_params& params) {
+    const int ringFd = fd().get();
+    mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        mSqRingSize = mCqRingSize = std::max(mSqRingSize, mCqRingSize);
+    }
+
+    void* sqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        return statusFromErrno(errno, "mmap(IORING_OFF_SQ_RING) failed");
+    }
+    mSqRing = sqRing;
+
+    if (singleMmap) {
+        mCqRing = mSqRing;
+    } else {
+        void* cqRing = mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            return statusFromErrno(errno, "mmap(IORING_OFF_CQ_RING) failed");
+        }
+        mCqRing = cqRing;
+    }
+
+    mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return statusFromErrno(errno, "mmap(IORING_OFF_SQES) failed");
+    }
+    mSqes = static_cast<io_uring_sqe*>(sqes);
+
+    mSqHead = atOffset<unsigned int>(mSqRing, params.sq_off.head);
+    mSqTail = atOffset<unsigned int>(mSqRing, params.sq_off.tail);
+    mSqArray = atOffset<unsigned int>(mSqRing, params.sq_off.array);
+    mSqMask = *atOffset<unsigned int>(mSqRing, params.sq_off.ring_mask);
+    mSqEntries = params.sq_entries;
+    mSqeTail = mSqeHead = *mSqTail;
+
+    mCqHead = atOffset<unsigned int>(mCqRing, params.cq_off.head);
+    mCqTail = atOffset<unsigned int>(mCqRing, params.cq_off.tail);
+    mCqes = atOffset<io_uring_cqe>(mCqRing, params.cq_off.cqes);
+    mCqMask = *atOffset<unsigned int>(mCqRing, params.cq_off.ring_mask);
+    return status::ok;
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    const unsigned int head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+    if (mSqeTail - head >= mSqEntries) {
+        return nullptr;
+    }
+    io_uring_sqe* sqe = &mSqes[mSqeTail & mSqMask];
+    mSqeTail++;
+    *sqe = {};
+    return sqe;
+}
+
+StatusOr<unsigned int> IoUring::submit(unsigned int waitNr) {
+    unsigned int tail = *mSqTail;
+    for (; mSqeHead != mSqeTail; ++mSqeHead, ++tail) {
+        mSqArray[tail & mSqMask] = mSqeHead & mSqMask;
+    }
+    __atomic_store_n(mSqTail, tail, __ATOMIC_RELEASE);
+
+    const unsigned int flags = (waitNr > 0) ? IORING_ENTER_GETEVENTS : 0;
+    int rv;
+    do {
+        // Includes entries an earlier short submission left behind.
+        const unsigned int toSubmit = tail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+        rv = ioUringEnter(fd().get(), toSubmit, waitNr, flags);
+    } while (rv == -1 && errno == EINTR);
+    if (rv == -1) {
+        return statusFromErrno(errno, "io_uring_enter() failed");
+    }
+    return static_cast<unsigned int>(rv);
+}
+
+Status IoUring::wait(unsigned int waitNr) {
+    int rv;
+    do {
+        rv = ioUringEnter(fd().get(), 0, waitNr, IORING_ENTER_GETEVENTS);
+    } while (rv == -1 && errno == EINTR);
+    if (rv == -1) {
+        return statusFromErrno(errno, "io_uring_enter() failed");
+    }
+    return status::ok;
+}
+
+unsigned int IoUring::forEachCqe(const std::function<void(const io_uring_cqe&)>& fn) {
+    const unsigned int head = *mCqHead;
+    const unsigned int tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+    for (unsigned int i = head; i != tail; ++i) {
+        fn(mCqes[i & mCqMask]);
+    }
+    __atomic_store_n(mCqHead, tail, __ATOMIC_RELEASE);
+    return tail - head;
+}
+
+Status IoUring::registerBufRing(io_uring_buf_ring* ring, unsigned int entries, uint16_t bgid) {
+    io_uring_buf_reg reg = {};
+    reg.ring_addr = reinterpret_cast<uintptr_t>(ring);
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+    if (ioUringRegister(fd().get(), IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        return statusFromErrno(errno, "io_uring_register(IORING_REGISTER_PBUF_RING) failed");
+    }
+    return status::ok;
+}
+
+bool IoUring::isSupported(uint8_t opcode) {
+    if (!mProbed) {
+        mProbed = true;
+        // io_uring_probe ends in a flexible array of one entry per opcode.
+        const size_t nrOps = mSupportedOps.size();
+        std::vector<uint8_t> buf(sizeof(io_uring_probe) + nrOps * sizeof(io_uring_probe_op));
+        auto* probe = reinterpret_cast<io_uring_probe*>(buf.data());
+        // Fails on kernels older than 5.6, which predate most opcodes anyway.
+        if (ioUringRegister(fd().get(), IORING_REGISTER_PROBE, probe, nrOps) == 0) {
+            for (size_t i = 0; i < std::min<size_t>(probe->ops_len, nrOps); ++i) {
+                const io_uring_probe_op& op = probe->ops[i];
+                if ((op.flags & IO_URING_OP_SUPPORTED) && op.op < nrOps) {
+                    mSupportedOps.set(op.op);
+                }
+            }
+        }
+    }
+    return opcode < mSupportedOps.size() && mSupportedOps.test(opcode);
+}
+
+}  // namespace netdutils
+}  // namespace android
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+#include "netdutils/LatencyHistogram.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+constexpr uint64_t kSubBuckets = uint64_t{1} << LatencyHistogram::kSubBucketBits;
+// Values below this are counted exactly, one per bucket.
+constexpr uint64_t kLinearLimit = kSubBuckets * 2;
+
+constexpr size_t bucketOfImpl(uint64_t v) {
+    if (v < kLinearLimit) return v;
+    const int msb = 63 - __builtin_clzll(v);
+    const int shift = msb - LatencyHistogram::kSubBucketBits;
+    return shift * kSubBuckets + (v >> shift);
+}
+
+constexpr size_t kNumBuckets = bucketOfImpl(LatencyHistogram::kMaxValueUs) + 1;
+
+// Threads are spread over shards in the order they first record anything.
+size_t threadSlot() {
+    static std::atomic<size_t> sNextSlot{0};
+    thread_local const size_t slot = sNextSlot.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+struct Registry {
+    std::mutex lock;
+    std::map<std::string, LatencyHistogram*> histograms;
+};
+
+Registry& registry() {
+    // Leaked, so that histograms outlive static destructors that might
+    // still record into them.
+    static Registry* sRegistry = new Registry();
+    return *sRegistry;
+}
+
+}  // namespace
+
+struct alignas(64) LatencyHistogram::Shard {
+    std::atomic<uint64_t> counts[kNumBuckets] = {};
+    std::atomic<uint64_t> sumUs{0};
+    std::atomic<uint64_t> maxUs{0};
+};
+
+LatencyHistogram::LatencyHistogram(std::string name) : mName(std::move(name)) {}
+
+LatencyHistogram::~LatencyHistogram() {
+    for (auto& shard : mShards) {
+        delete shard.load(std::memory_order_acquire);
+    }
+}
+
+size_t LatencyHistogram::bucketOf(int64_t us) {
+    return bucketOfImpl(std::clamp<int64_t>(us, 0, kMaxValueUs));
+}
+
+uint64_t LatencyHistogram::bucketLowUs(size_t bucket) {
+    if (bucket < kLinearLimit) return bucket;
+    const int shift = bucket / kSubBuckets - 1;
+    return (bucket % kSubBuckets + kSubBuckets) << shift;
+}
+
+uint64_t LatencyHistogram::bucketHighUs(size_t bucket) {
+    if (bucket < kLinearLimit) return bucket;
+    const int shift = bucket / kSubBuckets - 1;
+    return bucketLowUs(bucket) + (uint64_t{1} << shift) - 1;
+}
+
+size_t LatencyHistogram::numBuckets() {
+    return kNumBuckets;
+}
+
+LatencyHistogram::Shard& LatencyHistogram::shardForThisThread() {
+    std::atomic<Shard*>& slot = mShards[threadSlot() % kMaxShards];
+    Shard* shard = slot.load(std::memory_order_acquire);
+    if (shard != nullptr) return *shard;
+
+    // Another thread mapped to the same slot may get there first, in which
+    // case use its shard.
+    auto* fresh = new Shard();
+    if (slot.compare_exchange_strong(shard, fresh, std::memory_order_acq_rel)) {
+        return *fresh;
+    }
+    delete fresh;
+    return *shard;
+}
+
+void LatencyHistogram::record(int64_t us) {
+    const uint64_t value = std::clamp<int64_t>(us, 0, kMaxValueUs);
+    Shard& shard = shardForThisThread();
+    shard.counts[bucketOfImpl(value)].fetch_add(1, std::memory_order_relaxed);
+    shard.sumUs.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = shard.maxUs.load(std::memory_order_relaxed);
+    while (value > max &&
+           !shard.maxUs.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    // Counters are read individually, so a snapshot taken while other
+    // threads record may be off by the values recorded meanwhile.
+    Snapshot s;
+    s.buckets.resize(kNumBuckets);
+    for (const auto& slot : mShards) {
+        const Shard* shard = slot.load(std::memory_order_acquire);
+        if (shard == nullptr) continue;
+        for (size_t i = 0; i < kNumBuckets; ++i) {
+            const uint64_t count = shard->counts[i].load(std::memory_order_relaxed);
+            s.buckets[i] += count;
+            s.count += count;
+        }
+        s.sumUs += shard->sumUs.load(std::memory_order_relaxed);
+        s.maxUs = std::max(s.maxUs, shard->maxUs.load(std::memory_order_relaxed));
+    }
+    return s;
+}
+
+uint64_t LatencyHistogram::Snapshot::percentileUs(double fraction) const {
+    if (count == 0) return 0;
+    const uint64_t rank = std::clamp<uint64_t>(std::ceil(fraction * count), 1, count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) return std::min(bucketHighUs(i), maxUs);
+    }
+    return maxUs;
+}
+
+void LatencyHistogram::dump(DumpWriter& dw) const {
+    const Snapshot s = snapshot();
+    const uint64_t meanUs = (s.count > 0) ? s.sumUs / s.count : 0;
+    dw.println("%s: count=%" PRIu64 " mean=%" PRIu64 "us p50=%" PRIu64 "us p99=%" PRIu64
+               "us p999=%" PRIu64 "us max=%" PRIu64 "us",
+               mName.c_str(), s.count, meanUs, s.percentileUs(0.5), s.percentileUs(0.99),
+               s.percentileUs(0.999), s.maxUs);
+}
+
+LatencyHistogram& LatencyHistogram::named(const std::string& name) {
+    Registry& r = registry();
+    std::lock_guard guard(r.lock);
+    auto& histogram = r.histograms[name];
+    if (histogram == nullptr) {
+        histogram = new LatencyHistogram(name);
+    }
+    return *histogram;
+}
+
+void LatencyHistogram::dumpAll(DumpWriter& dw) {
+    Registry& r = registry();
+    std::lock_guard guard(r.lock);
+    for (const auto& [name, histogram] : r.histograms) {
+        histogram->dump(dw);
+    }
+}
+
+}  // namespace netdutils
+}  // namespace android
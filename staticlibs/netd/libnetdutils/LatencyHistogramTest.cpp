@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "netdutils/LatencyHistogram.h"
+
+namespace android {
+namespace netdutils {
+
+TEST(LatencyHistogramTest, buckets) {
+    // Exact below 32us.
+    for (int64_t us = 0; us < 32; ++us) {
+        EXPECT_EQ(static_cast<size_t>(us), LatencyHistogram::bucketOf(us));
+    }
+    size_t previous = LatencyHistogram::bucketOf(31);
+    for (int64_t us = 32; us < 1 << 20; ++us) {
+        const size_t bucket = LatencyHistogram::bucketOf(us);
+        ASSERT_LE(LatencyHistogram::bucketLowUs(bucket), static_cast<uint64_t>(us));
+        ASSERT_GE(LatencyHistogram::bucketHighUs(bucket), static_cast<uint64_t>(us));
+        // Buckets are contiguous and no wider than 1/16 of their values.
+        ASSERT_LE(bucket, previous + 1);
+        ASSERT_LE(LatencyHistogram::bucketHighUs(bucket) - LatencyHistogram::bucketLowUs(bucket),
+                  LatencyHistogram::bucketLowUs(bucket) / 16);
+        previous = bucket;
+    }
+    EXPECT_EQ(0U, LatencyHistogram::bucketOf(-5));
+    EXPECT_EQ(LatencyHistogram::numBuckets() - 1,
+              LatencyHistogram::bucketOf(LatencyHistogram::kMaxValueUs));
+    EXPECT_EQ(LatencyHistogram::numBuckets() - 1, LatencyHistogram::bucketOf(INT64_MAX));
+}
+
+TEST(LatencyHistogramTest, percentiles) {
+    LatencyHistogram histogram("test");
+    EXPECT_EQ(0U, histogram.snapshot().percentileUs(0.5));
+
+    // 1..1000us, once each.
+    for (int64_t us = 1; us <= 1000; ++us) histogram.record(us);
+    const auto s = histogram.snapshot();
+    EXPECT_EQ(1000U, s.count);
+    EXPECT_EQ(500500U, s.sumUs);
+    EXPECT_EQ(1000U, s.maxUs);
+    EXPECT_EQ(1U, s.percentileUs(0));
+    EXPECT_NEAR(500, s.percentileUs(0.5), 500 / 16);
+    EXPECT_NEAR(990, s.percentileUs(0.99), 990 / 16);
+    EXPECT_EQ(1000U, s.percentileUs(0.999));
+    EXPECT_EQ(1000U, s.percentileUs(1));
+}
+
+TEST(LatencyHistogramTest, concurrentRecords) {
+    LatencyHistogram histogram("test");
+    constexpr int kThreads = 20;
+    constexpr int kRecords = 10000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&histogram, t] {
+            for (int i = 0; i < kRecords; ++i) histogram.record(t);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    const auto s = histogram.snapshot();
+    EXPECT_EQ(static_cast<uint64_t>(kThreads * kRecords), s.count);
+    EXPECT_EQ(static_cast<uint64_t>(kThreads - 1), s.maxUs);
+    for (int t = 0; t < kThreads; ++t) {
+        EXPECT_EQ(static_cast<uint64_t>(kRecords), s.buckets[t]) << t;
+    }
+}
+
+TEST(LatencyHistogramTest, scopedTimerAndDump) {
+    {
+        NETDUTILS_SCOPED_LATENCY("LatencyHistogramTest.scopedTimerAndDump");
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    auto& histogram = LatencyHistogram::named("LatencyHistogramTest.scopedTimerAndDump");
+    EXPECT_EQ(&histogram, &LatencyHistogram::named("LatencyHistogramTest.scopedTimerAndDump"));
+    const auto s = histogram.snapshot();
+    EXPECT_EQ(1U, s.count);
+    EXPECT_LE(2000U, s.maxUs);
+
+    TemporaryFile file;
+    DumpWriter dw(file.fd);
+    LatencyHistogram::dumpAll(dw);
+    std::string dump;
+    ASSERT_TRUE(base::ReadFileToString(file.path, &dump));
+    EXPECT_NE(std::string::npos, dump.find("LatencyHistogramTest.scopedTimerAndDump: count=1 "))
+            << dump;
+}
+
+}  // namespace netdutils
+}  // namespace android
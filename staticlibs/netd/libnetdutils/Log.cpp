@@ -17,35 +17,42 @@
 #include "netdutils/Log.h"
 #include "netdutils/Slice.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <ctime>
 #include <iomanip>
-#include <mutex>
 #include <sstream>
 
-#include <android-base/strings.h>
 #include <log/log.h>
 
-using ::android::base::Join;
-using ::android::base::StringPrintf;
-
 namespace android {
 namespace netdutils {
 
+using ::std::chrono::system_clock;
+
+struct Log::Slot {
+    // Odd while the entry with ticket (seq - 1) / 2 is being written, then
+    // 2 * (ticket + 1) once it is complete. Zero while unused.
+    std::atomic<uint64_t> seq{0};
+    std::atomic<system_clock::rep> when{0};
+    std::atomic<uint32_t> len{0};
+    char text[MAX_ENTRY_LENGTH];
+};
+
 namespace {
 
-std::string makeTimestampedEntry(const std::string& entry) {
+std::string makeTimestampedEntry(system_clock::time_point when, const char* text, size_t len) {
     using ::std::chrono::duration_cast;
     using ::std::chrono::milliseconds;
-    using ::std::chrono::system_clock;
 
     std::stringstream tsEntry;
-    const auto now = system_clock::now();
-    const auto time_sec = system_clock::to_time_t(now);
+    const auto time_sec = system_clock::to_time_t(when);
     tsEntry << std::put_time(std::localtime(&time_sec), "%m-%d %H:%M:%S.") << std::setw(3)
             << std::setfill('0')
-            << duration_cast<milliseconds>(now - system_clock::from_time_t(time_sec)).count() << " "
-            << entry;
+            << duration_cast<milliseconds>(when - system_clock::from_time_t(time_sec)).count()
+            << " ";
+    tsEntry.write(text, len);
 
     return tsEntry.str();
 }
@@ -53,33 +60,24 @@ std::string makeTimestampedEntry(const std::string& entry) {
 }  // namespace
 
 std::string LogEntry::toString() const {
-    std::vector<std::string> text;
-
-    if (!mMsg.empty()) text.push_back(mMsg);
-    if (!mFunc.empty()) {
-        text.push_back(StringPrintf("%s(%s)", mFunc.c_str(), Join(mArgs, ", ").c_str()));
-    }
-    if (!mReturns.empty()) {
-        text.push_back("->");
-        text.push_back(StringPrintf("(%s)", Join(mReturns, ", ").c_str()));
-    }
-    if (!mUid.empty()) text.push_back(mUid);
-    if (!mDuration.empty()) text.push_back(StringPrintf("(%s)", mDuration.c_str()));
-
-    return Join(text, " ");
+    InlineString<256> text;
+    appendTo(text);
+    return std::string(text.view());
 }
 
-LogEntry& LogEntry::message(const std::string& message) {
-    mMsg = message;
+LogEntry& LogEntry::message(std::string_view message) {
+    mMsg.clear();
+    mMsg.append(message);
     return *this;
 }
 
-LogEntry& LogEntry::function(const std::string& function_name) {
-    mFunc = function_name;
+LogEntry& LogEntry::function(std::string_view function_name) {
+    mFunc.clear();
+    mFunc.append(function_name);
     return *this;
 }
 
-LogEntry& LogEntry::prettyFunction(const std::string& pretty_function) {
+LogEntry& LogEntry::prettyFunction(std::string_view pretty_function) {
     // __PRETTY_FUNCTION__ generally seems to be of the form:
     //
     //     qualifed::returnType qualified::function(args...)
@@ -97,10 +95,10 @@ LogEntry& LogEntry::prettyFunction(const std::string& pretty_function) {
     // name boundary is not obvious.
     const size_t endFuncName = pretty_function.rfind('(');
     const size_t precedingSpace = pretty_function.rfind(' ', endFuncName);
-    size_t substrStart = (precedingSpace != std::string::npos) ? precedingSpace + 1 : 0;
+    size_t substrStart = (precedingSpace != std::string_view::npos) ? precedingSpace + 1 : 0;
 
     const size_t beginFuncName = pretty_function.rfind("::", endFuncName);
-    if (beginFuncName != std::string::npos && substrStart < beginFuncName) {
+    if (beginFuncName != std::string_view::npos && substrStart < beginFuncName) {
         const size_t previousNameBoundary = pretty_function.rfind("::", beginFuncName - 1);
         if (previousNameBoundary < beginFuncName && substrStart < previousNameBoundary) {
             substrStart = previousNameBoundary + 2;
@@ -109,53 +107,68 @@ LogEntry& LogEntry::prettyFunction(const std::string& pretty_function) {
         }
     }
 
-    mFunc = pretty_function.substr(substrStart, endFuncName - substrStart);
-    return *this;
+    return function(pretty_function.substr(substrStart, endFuncName - substrStart));
 }
 
-LogEntry& LogEntry::arg(const std::string& val) {
-    mArgs.push_back(val.empty() ? "\"\"" : val);
+LogEntry& LogEntry::arg(std::string_view val) {
+    nextArg().append(val.empty() ? "\"\"" : val);
     return *this;
 }
 
 template <>
 LogEntry& LogEntry::arg<>(bool val) {
-    mArgs.push_back(val ? "true" : "false");
+    nextArg().append(val ? "true" : "false");
     return *this;
 }
 
 LogEntry& LogEntry::arg(const std::vector<int32_t>& val) {
-    mArgs.push_back(StringPrintf("[%s]", Join(val, ", ").c_str()));
+    auto& out = nextArg();
+    out.append("[");
+    for (size_t i = 0; i < val.size(); i++) {
+        if (i > 0) out.append(", ");
+        out.appendNumber(val[i]);
+    }
+    out.append("]");
     return *this;
 }
 
 LogEntry& LogEntry::arg(const std::vector<uint8_t>& val) {
-    mArgs.push_back('{' + toHex(makeSlice(val)) + '}');
+    auto& out = nextArg();
+    out.append("{");
+    out.append(toHex(makeSlice(val)));
+    out.append("}");
     return *this;
 }
 
 LogEntry& LogEntry::arg(const std::vector<std::string>& val) {
-    mArgs.push_back(StringPrintf("[%s]", Join(val, ", ").c_str()));
+    auto& out = nextArg();
+    out.append("[");
+    for (size_t i = 0; i < val.size(); i++) {
+        if (i > 0) out.append(", ");
+        out.append(val[i]);
+    }
+    out.append("]");
     return *this;
 }
 
-LogEntry& LogEntry::returns(const std::string& rval) {
-    mReturns.push_back(rval);
+LogEntry& LogEntry::returns(std::string_view rval) {
+    nextReturn().append(rval);
     return *this;
 }
 
 LogEntry& LogEntry::returns(bool rval) {
-    mReturns.push_back(rval ? "true" : "false");
+    nextReturn().append(rval ? "true" : "false");
     return *this;
 }
 
 LogEntry& LogEntry::returns(const Status& status) {
-    mReturns.push_back(status.msg());
+    nextReturn().append(status.msg());
     return *this;
 }
 
 LogEntry& LogEntry::withUid(uid_t uid) {
-    mUid = StringPrintf("(uid=%d)", uid);
+    mHasUid = true;
+    mUid = uid;
     return *this;
 }
 
@@ -163,53 +176,114 @@ LogEntry& LogEntry::withAutomaticDuration() {
     using ms = std::chrono::duration<float, std::ratio<1, 1000>>;
 
     const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-    std::stringstream duration;
-    duration << std::setprecision(1) << std::chrono::duration_cast<ms>(end - mStart).count()
-             << "ms";
-    mDuration = duration.str();
-    return *this;
+    // Same as streaming with std::setprecision(1).
+    char duration[32];
+    const int len = snprintf(duration, sizeof(duration), "%.1gms",
+                             std::chrono::duration_cast<ms>(end - mStart).count());
+    return withDuration(std::string_view(duration, std::clamp<int>(len, 0, sizeof(duration) - 1)));
 }
 
-LogEntry& LogEntry::withDuration(const std::string& duration) {
-    mDuration = duration;
+LogEntry& LogEntry::withDuration(std::string_view duration) {
+    mDuration.clear();
+    mDuration.append(duration);
     return *this;
 }
 
+Log::Log(const std::string& tag, size_t maxEntries)
+    : mTag(tag),
+      mMaxEntries(std::max<size_t>(maxEntries, 1)),
+      // Not make_unique, which would also zero every slot's text.
+      mSlots(new Slot[mMaxEntries]) {}
+
 Log::~Log() {
     // TODO: dump the last N entries to the android log for possible posterity.
     info(LogEntry().function(__FUNCTION__));
 }
 
 void Log::forEachEntry(const std::function<void(const std::string&)>& perEntryFn) const {
-    // We make a (potentially expensive) copy of the log buffer (including
-    // all strings), in case the |perEntryFn| takes its sweet time.
-    std::deque<std::string> entries;
-    {
-        std::shared_lock<std::shared_mutex> guard(mLock);
-        entries.assign(mEntries.cbegin(), mEntries.cend());
+    const uint64_t end = mNextTicket.load(std::memory_order_acquire);
+    const uint64_t begin = (end > mMaxEntries) ? end - mMaxEntries : 0;
+
+    char text[MAX_ENTRY_LENGTH];
+    for (uint64_t ticket = begin; ticket < end; ticket++) {
+        const Slot& slot = mSlots[ticket % mMaxEntries];
+        const uint64_t complete = 2 * (ticket + 1);
+        // Skip entries that are still being written or have already been
+        // overwritten by a newer one.
+        if (slot.seq.load(std::memory_order_acquire) != complete) continue;
+        const system_clock::time_point when(
+                system_clock::duration(slot.when.load(std::memory_order_relaxed)));
+        const size_t len = std::min<size_t>(slot.len.load(std::memory_order_relaxed), sizeof(text));
+        memcpy(text, slot.text, len);
+        // A writer a full lap ahead may have started on the slot meanwhile,
+        // in which case the copy may be torn and the entry is gone anyway.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != complete) continue;
+        perEntryFn(makeTimestampedEntry(when, text, len));
     }
-
-    for (const std::string& entry : entries) perEntryFn(entry);
 }
 
 void Log::record(Log::Level lvl, const std::string& entry) {
+    commit(lvl, entry.c_str(), entry.size());
+}
+
+void Log::record(Log::Level lvl, const LogEntry& entry) {
+    InlineString<INLINE_ENTRY_LENGTH> text;
+    entry.appendTo(text);
+    const std::string_view view = text.view();
+    commit(lvl, view.data(), view.size());
+}
+
+void Log::recordv(Log::Level lvl, const char* fmt, va_list ap) {
+    char text[INLINE_ENTRY_LENGTH];
+    va_list copy;
+    va_copy(copy, ap);
+    const int len = vsnprintf(text, sizeof(text), fmt, copy);
+    va_end(copy);
+    if (len < 0) return;
+    if (static_cast<size_t>(len) < sizeof(text)) {
+        commit(lvl, text, len);
+        return;
+    }
+    std::string longText(len, '\0');
+    vsnprintf(longText.data(), longText.size() + 1, fmt, ap);
+    commit(lvl, longText.data(), longText.size());
+}
+
+void Log::commit(Log::Level lvl, const char* text, size_t len) {
     switch (lvl) {
         case Level::LOG:
             break;
         case Level::INFO:
-            ALOG(LOG_INFO, mTag.c_str(), "%s", entry.c_str());
+            ALOG(LOG_INFO, mTag.c_str(), "%.*s", static_cast<int>(len), text);
             break;
         case Level::WARN:
-            ALOG(LOG_WARN, mTag.c_str(), "%s", entry.c_str());
+            ALOG(LOG_WARN, mTag.c_str(), "%.*s", static_cast<int>(len), text);
             break;
         case Level::ERROR:
-            ALOG(LOG_ERROR, mTag.c_str(), "%s", entry.c_str());
+            ALOG(LOG_ERROR, mTag.c_str(), "%.*s", static_cast<int>(len), text);
             break;
     }
 
-    std::lock_guard guard(mLock);
-    mEntries.push_back(makeTimestampedEntry(entry));
-    while (mEntries.size() > mMaxEntries) mEntries.pop_front();
+    const auto now = system_clock::now();
+    const uint64_t ticket = mNextTicket.fetch_add(1, std::memory_order_acq_rel);
+    Slot& slot = mSlots[ticket % mMaxEntries];
+
+    const uint64_t writing = 2 * ticket + 1;
+    uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+    do {
+        // Either a writer a full lap ahead got here first and its entry is
+        // the newer one, or one a full lap behind is still writing. Rather
+        // than wait for it, drop this entry: the log is best effort.
+        if (seq > writing || (seq & 1)) return;
+    } while (!slot.seq.compare_exchange_weak(seq, writing, std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+
+    len = std::min(len, sizeof(slot.text));
+    slot.when.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+    slot.len.store(static_cast<uint32_t>(len), std::memory_order_relaxed);
+    memcpy(slot.text, text, len);
+    slot.seq.store(writing + 1, std::memory_order_release);
 }
 
 }  // namespace netdutils
@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include "netdutils/Log.h"
@@ -139,5 +143,93 @@ TEST(LogEntryTest, PrintArgumentPack) {
     EXPECT_EQ("testFunc(hello, 42, false)", entry.toString());
 }
 
+TEST(LogEntryTest, PrintReturnsUidAndDuration) {
+    const LogEntry entry = LogEntry()
+            .function("testFunc")
+            .arg(std::vector<int32_t>{1, 2})
+            .arg(std::vector<std::string>{"a", "b"})
+            .returns("")
+            .returns(7)
+            .withUid(1000)
+            .withDuration("1ms");
+    EXPECT_EQ("testFunc([1, 2], [a, b]) -> (, 7) (uid=1000) (1ms)", entry.toString());
+}
+
+TEST(LogEntryTest, PrintMessageOnly) {
+    EXPECT_EQ("hello world", LogEntry().message("hello world").toString());
+}
+
+TEST(LogEntryTest, LongArgumentsSpillToHeap) {
+    const std::string longArg(1000, 'x');
+    const LogEntry entry = LogEntry().function("testFunc").arg(longArg).arg(longArg);
+    const LogEntry copy = entry;
+    EXPECT_EQ("testFunc(" + longArg + ", " + longArg + ")", copy.toString());
+}
+
+namespace {
+
+std::vector<std::string> dump(const Log& log) {
+    std::vector<std::string> entries;
+    log.forEachEntry([&entries](const std::string& entry) {
+        // Strip the "MM-DD HH:MM:SS.mmm " timestamp.
+        entries.push_back(entry.substr(entry.find(' ', entry.find(' ') + 1) + 1));
+    });
+    return entries;
+}
+
+}  // namespace
+
+TEST(LogTest, KeepsMostRecentEntries) {
+    Log log("LogTest", 3);
+    for (int i = 0; i < 5; i++) log.log("entry %d", i);
+    EXPECT_EQ((std::vector<std::string>{"entry 2", "entry 3", "entry 4"}), dump(log));
+}
+
+TEST(LogTest, MixedEntryTypes) {
+    Log log("LogTest", 10);
+    log.log(std::string("string"));
+    log.log("printf %s", "format");
+    log.log(LogEntry().function("testFunc").arg(1));
+    EXPECT_EQ((std::vector<std::string>{"string", "printf format", "testFunc(1)"}), dump(log));
+}
+
+TEST(LogTest, TruncatesLongEntries) {
+    Log log("LogTest", 3);
+    const std::string longText(2000, 'x');
+    log.log(longText);
+    log.log("%s", longText.c_str());
+    LogEntry entry;
+    for (int i = 0; i < 200; i++) entry.arg(i);
+    log.log(entry);
+    const auto entries = dump(log);
+    ASSERT_EQ(3U, entries.size());
+    EXPECT_EQ(std::string(256, 'x'), entries[0]);
+    EXPECT_EQ(std::string(256, 'x'), entries[1]);
+    EXPECT_EQ(entry.toString().substr(0, 256), entries[2]);
+}
+
+TEST(LogTest, ConcurrentWriters) {
+    constexpr int kThreads = 8;
+    constexpr int kEntriesPerThread = 1000;
+    Log log("LogTest", 100);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&log, t] {
+            for (int i = 0; i < kEntriesPerThread; i++) log.log("thread %d entry %d", t, i);
+        });
+    }
+    // Dumping concurrently with writers only ever returns complete entries.
+    for (int i = 0; i < 100; i++) {
+        for (const auto& entry : dump(log)) EXPECT_EQ(0U, entry.rfind("thread ", 0));
+    }
+    for (auto& thread : threads) thread.join();
+
+    // A writer may drop its entry if the slot is still being written by one
+    // a full lap behind, so only count entries written without contention.
+    for (int i = 0; i < 100; i++) log.log("entry %d", i);
+    EXPECT_EQ(100U, dump(log).size());
+}
+
 }  // namespace netdutils
 }  // namespace android
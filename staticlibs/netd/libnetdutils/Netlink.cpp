@@ -17,7 +17,6 @@
 #include <ios>
 #include <linux/netlink.h>
 
-#include "netdutils/Math.h"
 #include "netdutils/Netlink.h"
 
 namespace android {
@@ -25,26 +24,12 @@ namespace netdutils {
 
 void forEachNetlinkMessage(const Slice buf,
                            const std::function<void(const nlmsghdr&, const Slice)>& onMsg) {
-    Slice tail = buf;
-    while (tail.size() >= sizeof(nlmsghdr)) {
-        nlmsghdr hdr = {};
-        extract(tail, hdr);
-        const auto len = std::max<size_t>(hdr.nlmsg_len, sizeof(hdr));
-        onMsg(hdr, drop(take(tail, len), sizeof(hdr)));
-        tail = drop(tail, align(len, 2));
-    }
+    visitNetlinkMessages(buf, onMsg);
 }
 
 void forEachNetlinkAttribute(const Slice buf,
                              const std::function<void(const nlattr&, const Slice)>& onAttr) {
-    Slice tail = buf;
-    while (tail.size() >= sizeof(nlattr)) {
-        nlattr hdr = {};
-        extract(tail, hdr);
-        const auto len = std::max<size_t>(hdr.nla_len, sizeof(hdr));
-        onAttr(hdr, drop(take(tail, len), sizeof(hdr)));
-        tail = drop(tail, align(len, 2));
-    }
+    visitNetlinkAttributes(buf, onAttr);
 }
 
 }  // namespace netdutils
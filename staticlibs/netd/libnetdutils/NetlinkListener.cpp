@@ -22,7 +22,6 @@
 #include <linux/netfilter/nfnetlink.h>
 
 #include <log/log.h>
-#include <netdutils/Misc.h>
 #include <netdutils/NetlinkListener.h>
 #include <netdutils/Syscalls.h>
 
@@ -33,8 +32,7 @@ using netdutils::Fd;
 using netdutils::Slice;
 using netdutils::Status;
 using netdutils::UniqueFd;
-using netdutils::findWithDefault;
-using netdutils::forEachNetlinkMessage;
+using netdutils::visitNetlinkMessages;
 using netdutils::makeSlice;
 using netdutils::sSyscalls;
 using netdutils::status::ok;
@@ -48,6 +46,12 @@ constexpr sockaddr_nl kKernelAddr = {
     .nl_family = AF_NETLINK, .nl_pad = 0, .nl_pid = 0, .nl_groups = 0,
 };
 
+// 32KiB holds the largest datagram the kernel builds for a netlink dump,
+// and 16 of them drain a burst of several hundred sock_diag or rtnetlink
+// events per wakeup.
+constexpr size_t kHighThroughputRxBufferSize = 32 * 1024;
+constexpr unsigned int kHighThroughputRxBatchSize = 16;
+
 const NetlinkListener::DispatchFn kDefaultDispatchFn = [](const nlmsghdr& nlmsg, const Slice) {
     std::stringstream ss;
     ss << nlmsg;
@@ -56,8 +60,43 @@ const NetlinkListener::DispatchFn kDefaultDispatchFn = [](const nlmsghdr& nlmsg,
 
 }  // namespace
 
+// Immutable snapshot of mDispatchMap, indexed by nlmsg_type.
+struct NetlinkListener::DispatchTable {
+    explicit DispatchTable(const std::map<uint16_t, DispatchFn>& map) : fns(map) {
+        if (!fns.empty()) {
+            byType.resize(fns.rbegin()->first + 1, nullptr);
+        }
+        for (const auto& [type, fn] : fns) {
+            byType[type] = &fn;
+        }
+    }
+
+    const DispatchFn& lookup(uint16_t type) const {
+        return (type < byType.size() && byType[type] != nullptr) ? *byType[type]
+                                                                 : kDefaultDispatchFn;
+    }
+
+    const std::map<uint16_t, DispatchFn> fns;
+    std::vector<const DispatchFn*> byType;
+};
+
+NetlinkListener::Options NetlinkListener::highThroughputOptions() {
+    Options options;
+    options.rxBufferSize = kHighThroughputRxBufferSize;
+    options.rxBatchSize = kHighThroughputRxBatchSize;
+    return options;
+}
+
 NetlinkListener::NetlinkListener(UniqueFd event, UniqueFd sock, const std::string& name)
-    : mEvent(std::move(event)), mSock(std::move(sock)), mThreadName(name) {
+    : NetlinkListener(std::move(event), std::move(sock), name, Options()) {}
+
+NetlinkListener::NetlinkListener(UniqueFd event, UniqueFd sock, const std::string& name,
+                                 const Options& options)
+    : mEvent(std::move(event)),
+      mSock(std::move(sock)),
+      mThreadName(name),
+      mOptions(options),
+      mDispatchLatency(LatencyHistogram::named("NetlinkListener(" + name + ")::dispatch")) {
     const auto rxErrorHandler = [](const nlmsghdr& nlmsg, const Slice msg) {
         std::stringstream ss;
         ss << nlmsg << " " << msg << " " << netdutils::toHex(msg, 32);
@@ -69,6 +108,11 @@ NetlinkListener::NetlinkListener(UniqueFd event, UniqueFd sock, const std::strin
         ALOGE("Error on NetlinkListener(%s) fd=%d: %s", name.c_str(), fd, strerror(err));
     };
 
+    if (mOptions.noEnobufs) {
+        const int on = 1;
+        expectOk(sSyscalls.get().setsockopt(mSock, SOL_NETLINK, NETLINK_NO_ENOBUFS, on));
+    }
+
     // Start the thread
     mWorker = std::thread([this]() { run().ignoreError(); });
 }
@@ -93,12 +137,14 @@ Status NetlinkListener::send(const Slice msg) {
 Status NetlinkListener::subscribe(uint16_t type, const DispatchFn& fn) {
     std::lock_guard guard(mMutex);
     mDispatchMap[type] = fn;
+    publishDispatchTableLocked();
     return ok;
 }
 
 Status NetlinkListener::unsubscribe(uint16_t type) {
     std::lock_guard guard(mMutex);
     mDispatchMap.erase(type);
+    publishDispatchTableLocked();
     return ok;
 }
 
@@ -106,15 +152,54 @@ void NetlinkListener::registerSkErrorHandler(const SkErrorHandler& handler) {
     mErrorHandler = handler;
 }
 
-Status NetlinkListener::run() {
-    std::vector<char> rxbuf(4096);
+void NetlinkListener::registerResyncHandler(const ResyncHandler& handler) {
+    mResyncHandler = handler;
+}
+
+void NetlinkListener::publishDispatchTableLocked() {
+    auto table = std::make_unique<const DispatchTable>(mDispatchMap);
+    mDispatchSnapshot.store(table.get());
+
+    // If the service thread is inside dispatch() it may still be using the
+    // previous table. Wait for it to leave; any later dispatch() observes the
+    // new snapshot. This also guarantees that an unsubscribed DispatchFn is
+    // never invoked after unsubscribe() returns.
+    const uint64_t seq = mDispatchSeq.load();
+    if (seq & 1) {
+        while (mDispatchSeq.load() == seq) {
+            std::this_thread::yield();
+        }
+    }
+    mDispatchTable = std::move(table);
+}
 
-    const auto rxHandler = [this](const nlmsghdr& nlmsg, const Slice& buf) {
-        std::lock_guard guard(mMutex);
-        const auto& fn = findWithDefault(mDispatchMap, nlmsg.nlmsg_type, kDefaultDispatchFn);
-        fn(nlmsg, buf);
+void NetlinkListener::receive(DatagramReceiver& receiver) {
+    // Read-side critical section, see publishDispatchTableLocked().
+    mDispatchSeq.fetch_add(1);
+    const DispatchTable* table = mDispatchSnapshot.load();
+    const auto rxHandler = [table](const nlmsghdr& nlmsg, const Slice& buf) {
+        table->lookup(nlmsg.nlmsg_type)(nlmsg, buf);
     };
+    auto rx = receiver.drain([this, &rxHandler](const Slice buf) {
+        const ScopedLatencyTimer timer(mDispatchLatency);
+        visitNetlinkMessages(buf, rxHandler);
+    });
+    mDispatchSeq.fetch_add(1, std::memory_order_release);
+
+    const int err = rx.status().code();
+    if (err) {
+        // Ignore errors. The only error we expect to see here is ENOBUFS,
+        // meaning the kernel dropped messages because the socket receive
+        // buffer was full. The failed receive will already have cleared the
+        // error indication and ensured we won't get EPOLLERR again.
+        mErrorHandler(((Fd) mSock).get(), err);
+        if (err == ENOBUFS && mResyncHandler) {
+            mResyncHandler();
+        }
+    }
+}
 
+Status NetlinkListener::run() {
     if (mThreadName.length() > 0) {
         int ret = pthread_setname_np(pthread_self(), mThreadName.c_str());
         if (ret) {
@@ -122,7 +207,14 @@ Status NetlinkListener::run() {
         }
     }
     const auto& sys = sSyscalls.get();
-    const std::array<Fd, 2> fds{{{mEvent}, {mSock}}};
+    auto receiver = sys.datagramReceiver(mSock, mOptions.rxBufferSize, mOptions.rxBatchSize,
+                                         mOptions.ioUring);
+    if (!isOk(receiver)) {
+        ALOGE("NetlinkListener(%s) cannot receive: %s", mThreadName.c_str(),
+              toString(receiver.status()).c_str());
+        return receiver.status();
+    }
+    const std::array<Fd, 2> fds{{{mEvent}, {receiver.value()->pollFd()}}};
     const int events = POLLIN;
     const double timeout = 3600;
     while (true) {
@@ -132,17 +224,7 @@ Status NetlinkListener::run() {
             break;
         }
         if (revents[1] & (POLLIN|POLLERR)) {
-            auto rx = sys.recvfrom(mSock, makeSlice(rxbuf), 0);
-            int err = rx.status().code();
-            if (err) {
-                // Ignore errors. The only error we expect to see here is ENOBUFS, and there's
-                // nothing we can do about that. The recvfrom above will already have cleared the
-                // error indication and ensured we won't get EPOLLERR again.
-                // TODO: Consider using NETLINK_NO_ENOBUFS.
-                mErrorHandler(((Fd) mSock).get(), err);
-                continue;
-            }
-            forEachNetlinkMessage(rx.value(), rxHandler);
+            receive(*receiver.value());
         }
     }
     return ok;
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+
+#include <linux/rtnetlink.h>
+
+#include <gtest/gtest.h>
+
+#include "netdutils/NetlinkListener.h"
+#include "netdutils/Syscalls.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+constexpr auto kDumpTimeout = std::chrono::seconds(5);
+
+struct LinkDumpRequest {
+    nlmsghdr hdr;
+    ifinfomsg ifi;
+};
+
+std::unique_ptr<NetlinkListener> makeRouteListener(const NetlinkListener::Options& options) {
+    auto& sys = sSyscalls.get();
+    auto event = sys.eventfd(0, EFD_CLOEXEC);
+    auto sock = sys.socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (!isOk(event) || !isOk(sock)) return nullptr;
+    return std::make_unique<NetlinkListener>(std::move(event.value()), std::move(sock.value()),
+                                             "NlListenerTest", options);
+}
+
+// Dump all links and return the number of RTM_NEWLINK messages seen before NLMSG_DONE.
+int dumpLinks(NetlinkListener& listener) {
+    std::atomic<int> links{0};
+    std::promise<void> done;
+    EXPECT_OK(listener.subscribe(RTM_NEWLINK, [&links](const nlmsghdr&, const Slice) {
+        links++;
+    }));
+    EXPECT_OK(listener.subscribe(NLMSG_DONE, [&done](const nlmsghdr&, const Slice) {
+        done.set_value();
+    }));
+
+    LinkDumpRequest req = {
+            .hdr = {.nlmsg_len = sizeof(req),
+                    .nlmsg_type = RTM_GETLINK,
+                    .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP},
+            .ifi = {.ifi_family = AF_UNSPEC},
+    };
+    EXPECT_OK(listener.send(makeSlice(req)));
+    EXPECT_EQ(std::future_status::ready, done.get_future().wait_for(kDumpTimeout));
+
+    // unsubscribe() waits for in-flight dispatch, so the locals captured above
+    // can safely go out of scope afterwards.
+    EXPECT_OK(listener.unsubscribe(RTM_NEWLINK));
+    EXPECT_OK(listener.unsubscribe(NLMSG_DONE));
+    return links;
+}
+
+}  // namespace
+
+TEST(NetlinkListenerTest, dumpLinks) {
+    auto listener = makeRouteListener(NetlinkListener::Options());
+    ASSERT_NE(nullptr, listener);
+    // There is always at least a loopback interface.
+    EXPECT_LE(1, dumpLinks(*listener));
+}
+
+TEST(NetlinkListenerTest, dumpLinksHighThroughput) {
+    auto listener = makeRouteListener(NetlinkListener::highThroughputOptions());
+    ASSERT_NE(nullptr, listener);
+    const int expected = dumpLinks(*makeRouteListener(NetlinkListener::Options()));
+    EXPECT_EQ(expected, dumpLinks(*listener));
+}
+
+TEST(NetlinkListenerTest, noEnobufs) {
+    NetlinkListener::Options options = NetlinkListener::highThroughputOptions();
+    options.noEnobufs = true;
+    auto listener = makeRouteListener(options);
+    ASSERT_NE(nullptr, listener);
+    EXPECT_LE(1, dumpLinks(*listener));
+}
+
+TEST(NetlinkListenerTest, dumpLinksIoUring) {
+    NetlinkListener::Options options = NetlinkListener::highThroughputOptions();
+    options.ioUring = true;
+    auto listener = makeRouteListener(options);
+    ASSERT_NE(nullptr, listener);
+    // Falls back to recvmmsg() where io_uring is not available.
+    EXPECT_LE(1, dumpLinks(*listener));
+}
+
+}  // namespace netdutils
+}  // namespace android
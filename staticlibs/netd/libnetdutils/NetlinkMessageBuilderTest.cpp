@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+
+#include <gtest/gtest.h>
+
+#include "netdutils/Netlink.h"
+#include "netdutils/NetlinkMessageBuilder.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+std::vector<uint8_t> flatten(const std::vector<iovec>& iov) {
+    std::vector<uint8_t> out;
+    for (const auto& v : iov) {
+        const uint8_t* base = static_cast<const uint8_t*>(v.iov_base);
+        out.insert(out.end(), base, base + v.iov_len);
+    }
+    return out;
+}
+
+}  // namespace
+
+TEST(NetlinkMessageBuilderTest, headerOnly) {
+    NetlinkMessageBuilder builder(RTM_GETLINK, NLM_F_REQUEST | NLM_F_DUMP);
+    builder.append(ifinfomsg{.ifi_family = AF_UNSPEC});
+    auto msg = flatten(builder.finish());
+    ASSERT_EQ(NLMSG_SPACE(sizeof(ifinfomsg)), msg.size());
+
+    int messages = 0;
+    forEachNetlinkMessage(makeSlice(msg), [&messages](const nlmsghdr& hdr, const Slice payload) {
+        EXPECT_EQ(RTM_GETLINK, hdr.nlmsg_type);
+        EXPECT_EQ(NLM_F_REQUEST | NLM_F_DUMP, hdr.nlmsg_flags);
+        EXPECT_EQ(sizeof(ifinfomsg), payload.size());
+        messages++;
+    });
+    EXPECT_EQ(1, messages);
+}
+
+TEST(NetlinkMessageBuilderTest, nestedAttributes) {
+    const std::string name = "odd length";
+    NetlinkMessageBuilder builder(RTM_NEWTFILTER, NLM_F_REQUEST);
+    builder.append(tcmsg{.tcm_ifindex = 7});
+    builder.addAttrString(TCA_KIND, "bpf");
+    const auto nest = builder.beginNested(TCA_OPTIONS);
+    builder.addAttr(1, uint32_t{42});
+    builder.addAttrString(2, name.c_str());
+    builder.endNested(nest);
+    builder.addAttr(3, uint8_t{1});
+
+    const auto& iov = builder.finish();
+    // Copied values share storage, so only referenced payloads and their
+    // padding add iovecs.
+    EXPECT_GT(8U, iov.size());
+    auto msg = flatten(iov);
+    ASSERT_EQ(builder.size(), msg.size());
+
+    std::vector<uint16_t> types;
+    forEachNetlinkMessage(makeSlice(msg), [&](const nlmsghdr& hdr, const Slice payload) {
+        EXPECT_EQ(msg.size(), hdr.nlmsg_len);
+        tcmsg t = {};
+        extract(payload, t);
+        EXPECT_EQ(7, t.tcm_ifindex);
+        forEachNetlinkAttribute(drop(payload, NLMSG_ALIGN(sizeof(t))),
+                                [&](const nlattr& attr, const Slice value) {
+            types.push_back(attr.nla_type);
+            if (attr.nla_type == TCA_KIND) {
+                EXPECT_EQ(std::string("bpf", 4), toString(value));
+            }
+            if (attr.nla_type != (NLA_F_NESTED | TCA_OPTIONS)) return;
+            // Includes the padding of the last nested attribute.
+            const size_t expectedLen = NLA_HDRLEN + NLA_ALIGN(NLA_HDRLEN + sizeof(uint32_t)) +
+                                       NLA_ALIGN(NLA_HDRLEN + name.size() + 1);
+            EXPECT_EQ(expectedLen, attr.nla_len);
+            forEachNetlinkAttribute(value, [&](const nlattr& inner, const Slice innerValue) {
+                types.push_back(inner.nla_type);
+                if (inner.nla_type == 2) {
+                    EXPECT_EQ(name + '\0', toString(innerValue));
+                }
+            });
+        });
+    });
+    EXPECT_EQ((std::vector<uint16_t>{TCA_KIND, NLA_F_NESTED | TCA_OPTIONS, 1, 2, 3}), types);
+}
+
+TEST(NetlinkMessageBuilderTest, arenaStorage) {
+    uint8_t arena[NLMSG_HDRLEN + NLA_HDRLEN + 4];
+    NetlinkMessageBuilder builder(RTM_NEWLINK, NLM_F_REQUEST, Slice(arena, sizeof(arena)));
+    builder.addAttr(IFLA_MTU, uint32_t{1280});
+    const auto& iov = builder.finish();
+    ASSERT_EQ(1U, iov.size());
+    EXPECT_EQ(arena, iov[0].iov_base);
+    EXPECT_EQ(sizeof(arena), iov[0].iov_len);
+}
+
+TEST(NetlinkMessageBuilderTest, arenaExhausted) {
+    uint8_t arena[NLMSG_HDRLEN];
+    NetlinkMessageBuilder builder(RTM_NEWLINK, NLM_F_REQUEST, Slice(arena, sizeof(arena)));
+    builder.addAttr(IFLA_MTU, uint32_t{1280});
+    EXPECT_TRUE(builder.finish().empty());
+}
+
+TEST(NetlinkMessageBuilderTest, heapStorageGrows) {
+    NetlinkMessageBuilder builder(RTM_NEWLINK, NLM_F_REQUEST);
+    for (uint16_t i = 0; i < 200; i++) builder.addAttr(i, uint32_t{i});
+    auto msg = flatten(builder.finish());
+    ASSERT_EQ(NLMSG_HDRLEN + 200 * (NLA_HDRLEN + 4), msg.size());
+
+    uint32_t expected = 0;
+    forEachNetlinkMessage(makeSlice(msg), [&](const nlmsghdr&, const Slice payload) {
+        forEachNetlinkAttribute(payload, [&](const nlattr& attr, const Slice value) {
+            uint32_t v = 0;
+            extract(value, v);
+            EXPECT_EQ(expected, attr.nla_type);
+            EXPECT_EQ(expected, v);
+            expected++;
+        });
+    });
+    EXPECT_EQ(200U, expected);
+}
+
+}  // namespace netdutils
+}  // namespace android
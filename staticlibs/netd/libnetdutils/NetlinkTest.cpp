@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <linux/rtnetlink.h>
+
+#include <gtest/gtest.h>
+
+#include "netdutils/Netlink.h"
+#include "netdutils/NetlinkMessageBuilder.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+using LinkAttributes = NetlinkAttributes<NetlinkAttributeSpec<IFLA_IFNAME, Slice>,
+                                         NetlinkAttributeSpec<IFLA_MTU, uint32_t>,
+                                         NetlinkAttributeSpec<IFLA_LINKINFO, Slice>>;
+
+// Build an RTM_NEWLINK message holding only attributes, and return them.
+std::vector<uint8_t> linkAttributes(const std::function<void(NetlinkMessageBuilder&)>& fill) {
+    NetlinkMessageBuilder builder(RTM_NEWLINK, 0);
+    fill(builder);
+    std::vector<uint8_t> out;
+    for (const auto& v : builder.finish()) {
+        const uint8_t* base = static_cast<const uint8_t*>(v.iov_base);
+        out.insert(out.end(), base, base + v.iov_len);
+    }
+    out.erase(out.begin(), out.begin() + NLMSG_HDRLEN);
+    return out;
+}
+
+}  // namespace
+
+TEST(NetlinkTest, visitMessagesMatchesForEach) {
+    std::vector<uint8_t> buf;
+    for (const uint16_t type : std::vector<uint16_t>{RTM_NEWLINK, RTM_DELLINK, NLMSG_DONE}) {
+        NetlinkMessageBuilder builder(type, 0);
+        builder.addAttr(IFLA_MTU, uint32_t{type});
+        for (const auto& v : builder.finish()) {
+            const uint8_t* base = static_cast<const uint8_t*>(v.iov_base);
+            buf.insert(buf.end(), base, base + v.iov_len);
+        }
+    }
+
+    std::vector<uint16_t> expected;
+    forEachNetlinkMessage(makeSlice(buf), [&expected](const nlmsghdr& hdr, const Slice) {
+        expected.push_back(hdr.nlmsg_type);
+    });
+    std::vector<uint16_t> visited;
+    visitNetlinkMessages(makeSlice(buf), [&visited](const nlmsghdr& hdr, const Slice) {
+        visited.push_back(hdr.nlmsg_type);
+    });
+    EXPECT_EQ((std::vector<uint16_t>{RTM_NEWLINK, RTM_DELLINK, NLMSG_DONE}), visited);
+    EXPECT_EQ(expected, visited);
+}
+
+TEST(NetlinkTest, attributesIndexed) {
+    const auto buf = linkAttributes([](NetlinkMessageBuilder& b) {
+        b.addAttrString(IFLA_IFNAME, "wlan0");
+        b.addAttr(IFLA_MTU, uint32_t{1500});
+        // Not in the table.
+        b.addAttr(IFLA_TXQLEN, uint32_t{1000});
+        const auto nest = b.beginNested(IFLA_LINKINFO);
+        b.addAttrString(IFLA_INFO_KIND, "veth");
+        b.endNested(nest);
+    });
+    const LinkAttributes attrs(makeSlice(buf));
+
+    ASSERT_TRUE(attrs.has<IFLA_IFNAME>());
+    EXPECT_EQ(std::string("wlan0", 6), toString(*attrs.get<IFLA_IFNAME>()));
+    EXPECT_EQ(1500U, attrs.get<IFLA_MTU>().value_or(0));
+
+    // Nested attribute flags are masked off, and the payload can be parsed
+    // in turn.
+    ASSERT_TRUE(attrs.has<IFLA_LINKINFO>());
+    const NetlinkAttributes<NetlinkAttributeSpec<IFLA_INFO_KIND, Slice>> info(
+            attrs.raw<IFLA_LINKINFO>());
+    EXPECT_EQ(std::string("veth", 5), toString(*info.get<IFLA_INFO_KIND>()));
+}
+
+TEST(NetlinkTest, attributesMissingShortAndRepeated) {
+    const auto buf = linkAttributes([](NetlinkMessageBuilder& b) {
+        // Too short for the uint32_t declared in the spec.
+        b.addAttr(IFLA_MTU, uint16_t{1500});
+        b.addAttrString(IFLA_IFNAME, "first");
+        b.addAttrString(IFLA_IFNAME, "second");
+    });
+    const LinkAttributes attrs(makeSlice(buf));
+
+    EXPECT_FALSE(attrs.has<IFLA_MTU>());
+    EXPECT_FALSE(attrs.get<IFLA_MTU>().has_value());
+    EXPECT_FALSE(attrs.has<IFLA_LINKINFO>());
+    EXPECT_TRUE(attrs.raw<IFLA_LINKINFO>().empty());
+    EXPECT_EQ(std::string("second", 7), toString(*attrs.get<IFLA_IFNAME>()));
+}
+
+TEST(NetlinkTest, attributesTruncatedBuffer) {
+    auto buf = linkAttributes([](NetlinkMessageBuilder& b) {
+        b.addAttr(IFLA_MTU, uint32_t{1500});
+        b.addAttrString(IFLA_IFNAME, "wlan0");
+    });
+    // Cut into the middle of IFLA_IFNAME.
+    buf.resize(NLA_HDRLEN + sizeof(uint32_t) + NLA_HDRLEN + 2);
+    const LinkAttributes attrs(makeSlice(buf));
+
+    EXPECT_EQ(1500U, attrs.get<IFLA_MTU>().value_or(0));
+    ASSERT_TRUE(attrs.has<IFLA_IFNAME>());
+    EXPECT_EQ(2U, attrs.raw<IFLA_IFNAME>().size());
+}
+
+}  // namespace netdutils
+}  // namespace android
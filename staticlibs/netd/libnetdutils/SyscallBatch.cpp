@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SyscallBatch"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <errno.h>
+
+#include <log/log.h>
+
+#include "netdutils/IoUring.h"
+#include "netdutils/SyscallBatch.h"
+#include "netdutils/Syscalls.h"
+
+namespace android {
+namespace netdutils {
+namespace {
+
+using Op = SyscallBatch::Op;
+using Type = SyscallBatch::Type;
+
+// Larger batches are submitted in chunks of this many operations.
+constexpr unsigned int kRingEntries = 64;
+
+// Set once creating a ring failed for a reason that will not go away: the
+// kernel has no io_uring (ENOSYS), policy does not allow it (EPERM), or it
+// does not support the ring parameters (EINVAL). Other failures, such as
+// ENOMEM or EMFILE, only make that batch fall back to plain system calls.
+std::atomic<bool> sUnavailable = false;
+
+// At most one idle ring is kept for the whole process. Threads submitting
+// concurrently create rings of their own, destroyed when they are done.
+std::mutex sIdleRingLock;
+std::unique_ptr<IoUring> sIdleRing;
+
+StatusOr<std::unique_ptr<IoUring>> takeRing() {
+    {
+        std::lock_guard guard(sIdleRingLock);
+        if (sIdleRing != nullptr) return std::move(sIdleRing);
+    }
+    if (sUnavailable) {
+        return statusFromErrno(EOPNOTSUPP, "io_uring not available");
+    }
+    auto ring = IoUring::create(kRingEntries, kRingEntries);
+    if (!isOk(ring)) {
+        const int code = ring.status().code();
+        if (code == ENOSYS || code == EPERM || code == EINVAL) sUnavailable = true;
+    }
+    return ring;
+}
+
+void returnRing(std::unique_ptr<IoUring> ring) {
+    std::lock_guard guard(sIdleRingLock);
+    if (sIdleRing == nullptr) sIdleRing = std::move(ring);
+}
+
+const char* opName(Type type) {
+    switch (type) {
+        case Type::WRITE:
+            return "write()";
+        case Type::WRITEV:
+            return "writev()";
+        case Type::READ:
+            return "read()";
+        case Type::SENDTO:
+            return "sendto()";
+        case Type::RECVFROM:
+            return "recvfrom()";
+        case Type::SETSOCKOPT:
+            return "setsockopt()";
+    }
+    return "unknown()";
+}
+
+uint8_t opcodeOf(Type type) {
+    switch (type) {
+        case Type::WRITE:
+            return IORING_OP_WRITE;
+        case Type::WRITEV:
+            return IORING_OP_WRITEV;
+        case Type::READ:
+            return IORING_OP_READ;
+        case Type::SENDTO:
+            return IORING_OP_SENDMSG;
+        case Type::RECVFROM:
+            return IORING_OP_RECVMSG;
+        case Type::SETSOCKOPT:
+            // Needs IORING_OP_URING_CMD with SOCKET_URING_OP_SETSOCKOPT,
+            // which is too recent to rely on.
+            break;
+    }
+    return IORING_OP_NOP;
+}
+
+// Fill in an sqe for op, or return false if op must run as a plain system
+// call. msg and iov must remain valid until op completes.
+bool prepare(IoUring& ring, const Op& op, uint64_t userData, msghdr& msg, iovec& iov) {
+    const uint8_t opcode = opcodeOf(op.type);
+    if (opcode == IORING_OP_NOP || !ring.isSupported(opcode)) return false;
+    io_uring_sqe* sqe = ring.getSqe();
+    if (sqe == nullptr) return false;
+
+    sqe->opcode = opcode;
+    sqe->fd = op.fd.get();
+    sqe->user_data = userData;
+    switch (op.type) {
+        case Type::WRITE:
+        case Type::READ:
+            sqe->addr = reinterpret_cast<uintptr_t>(op.buf.base());
+            sqe->len = op.buf.size();
+            // Use and advance the file position, like write() and read().
+            sqe->off = -1;
+            break;
+        case Type::WRITEV:
+            sqe->addr = reinterpret_cast<uintptr_t>(op.iov);
+            sqe->len = op.iovcnt;
+            sqe->off = -1;
+            break;
+        case Type::SENDTO:
+            iov = {.iov_base = op.buf.base(), .iov_len = op.buf.size()};
+            msg = {.msg_name = const_cast<sockaddr*>(op.dst),
+                   .msg_namelen = op.dstlen,
+                   .msg_iov = &iov,
+                   .msg_iovlen = 1};
+            sqe->addr = reinterpret_cast<uintptr_t>(&msg);
+            sqe->len = 1;
+            sqe->msg_flags = op.flags;
+            break;
+        case Type::RECVFROM:
+            iov = {.iov_base = op.buf.base(), .iov_len = op.buf.size()};
+            msg = {.msg_name = op.src,
+                   .msg_namelen = (op.srclen != nullptr) ? *op.srclen : 0,
+                   .msg_iov = &iov,
+                   .msg_iovlen = 1};
+            sqe->addr = reinterpret_cast<uintptr_t>(&msg);
+            sqe->len = 1;
+            sqe->msg_flags = op.flags;
+            break;
+        case Type::SETSOCKOPT:
+            break;
+    }
+    return true;
+}
+
+StatusOr<size_t> complete(const Op& op, int res, const msghdr& msg) {
+    if (res < 0) {
+        return statusFromErrno(-res, std::string(opName(op.type)) + " failed");
+    }
+    if (op.type == Type::RECVFROM) {
+        if (op.srclen != nullptr) *op.srclen = msg.msg_namelen;
+        if (res == 0) return status::eof;
+    }
+    return static_cast<size_t>(res);
+}
+
+}  // namespace
+
+StatusOr<std::vector<StatusOr<size_t>>> submitIoUringBatch(const SyscallBatch& batch,
+                                                           const Syscalls& fallback) {
+    auto taken = takeRing();
+    if (!isOk(taken)) {
+        return taken.status();
+    }
+    std::unique_ptr<IoUring> owned = std::move(taken.value());
+    IoUring& ring = *owned;
+
+    const auto& ops = batch.ops();
+    std::vector<StatusOr<size_t>> results(ops.size());
+    const size_t chunkSize = std::min<size_t>(ops.size(), kRingEntries);
+    std::vector<msghdr> msgs(chunkSize);
+    std::vector<iovec> iovs(chunkSize);
+    std::vector<bool> done(chunkSize);
+
+    for (size_t begin = 0; begin < ops.size(); begin += kRingEntries) {
+        const size_t end = std::min(ops.size(), begin + kRingEntries);
+        unsigned int queued = 0;
+        for (size_t i = begin; i < end; ++i) {
+            done[i - begin] = false;
+            if (prepare(ring, ops[i], i, msgs[i - begin], iovs[i - begin])) {
+                queued++;
+                continue;
+            }
+            results[i] = fallback.submitOne(ops[i]);
+            done[i - begin] = true;
+        }
+
+        unsigned int submitted = 0;
+        unsigned int completed = 0;
+        const auto reap = [&]() {
+            completed += ring.forEachCqe([&](const io_uring_cqe& cqe) {
+                const size_t i = cqe.user_data;
+                results[i] = complete(ops[i], cqe.res, msgs[i - begin]);
+                done[i - begin] = true;
+            });
+        };
+        Status error = status::ok;
+        while (completed < queued) {
+            if (submitted < queued) {
+                // The kernel may take only some of the entries, for instance
+                // when short of memory, and the rest are offered again.
+                const auto rv = ring.submit(1);
+                if (isOk(rv) && rv.value() == 0) {
+                    error = statusFromErrno(EAGAIN, "io_uring_enter() submitted nothing");
+                } else if (!isOk(rv)) {
+                    error = rv.status();
+                } else {
+                    submitted += rv.value();
+                }
+            } else {
+                error = ring.wait(1);
+            }
+            if (!isOk(error)) break;
+            reap();
+        }
+        if (isOk(error)) continue;
+
+        // Operations the kernel has taken still reference msgs, iovs and
+        // the caller's buffers, so they must finish before returning.
+        while (completed < submitted) {
+            const Status waited = ring.wait(submitted - completed);
+            LOG_ALWAYS_FATAL_IF(!isOk(waited), "Cannot wait for io_uring operations: %s",
+                                toString(waited).c_str());
+            reap();
+        }
+        for (size_t i = begin; i < end; ++i) {
+            if (!done[i - begin]) results[i] = error;
+        }
+        // Entries the kernel has not taken are still queued. Destroy the
+        // ring rather than have them submitted along with a later batch.
+        return results;
+    }
+    returnRing(std::move(owned));
+    return results;
+}
+
+}  // namespace netdutils
+}  // namespace android
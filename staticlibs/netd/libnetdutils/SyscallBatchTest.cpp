@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <gtest/gtest.h>
+
+#include "netdutils/MockSyscalls.h"
+#include "netdutils/SyscallBatch.h"
+#include "netdutils/Syscalls.h"
+
+using testing::_;
+using testing::Invoke;
+using testing::Return;
+using testing::StrictMock;
+
+namespace android {
+namespace netdutils {
+
+class SyscallBatchTest : public testing::TestWithParam<bool> {
+  protected:
+    void SetUp() override {
+        int fds[2];
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds));
+        mReader.reset(fds[0]);
+        mWriter.reset(fds[1]);
+    }
+
+    // Run batch through the backend under test, or return nothing if it is
+    // not available.
+    std::vector<StatusOr<size_t>> submit(const SyscallBatch& batch) {
+        const auto& sys = sSyscalls.get();
+        if (!GetParam()) return sys.submitSequentially(batch);
+        auto results = submitIoUringBatch(batch, sys);
+        if (!isOk(results)) return {};
+        return std::move(results.value());
+    }
+
+    UniqueFd mReader;
+    UniqueFd mWriter;
+};
+
+INSTANTIATE_TEST_SUITE_P(SyscallBatchTest, SyscallBatchTest, testing::Bool(),
+                         [](const testing::TestParamInfo<bool>& info) {
+                             return info.param ? "IoUring" : "Sequential";
+                         });
+
+TEST_P(SyscallBatchTest, writeThenRead) {
+    const std::vector<std::string> payloads = {"one", "two", "three"};
+    std::string header = "four: ";
+    std::string body = "header and body";
+    const std::vector<iovec> iov = {{header.data(), header.size()}, {body.data(), body.size()}};
+
+    SyscallBatch writes;
+    for (const auto& payload : payloads) writes.write(mWriter, makeSlice(payload));
+    EXPECT_EQ(3U, writes.writev(mWriter, iov));
+    const auto written = submit(writes);
+    if (GetParam() && written.empty()) GTEST_SKIP() << "io_uring not available";
+    ASSERT_EQ(4U, written.size());
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        ASSERT_OK(written[i]);
+        EXPECT_EQ(payloads[i].size(), written[i].value());
+    }
+    ASSERT_OK(written[3]);
+    EXPECT_EQ(header.size() + body.size(), written[3].value());
+
+    // Datagrams are read in order, as each read consumes one.
+    std::vector<std::string> bufs(4, std::string(64, '\0'));
+    SyscallBatch reads;
+    for (auto& buf : bufs) reads.read(mReader, makeSlice(buf));
+    const auto read = submit(reads);
+    ASSERT_EQ(4U, read.size());
+    std::vector<std::string> received;
+    for (size_t i = 0; i < read.size(); ++i) {
+        ASSERT_OK(read[i]);
+        received.push_back(bufs[i].substr(0, read[i].value()));
+    }
+    std::sort(received.begin(), received.end());
+    EXPECT_EQ((std::vector<std::string>{"four: header and body", "one", "three", "two"}),
+              received);
+}
+
+TEST_P(SyscallBatchTest, errorsAreReportedPerOperation) {
+    const int rcvbuf = 65536;
+    const std::string payload = "payload";
+    sockaddr_un nowhere = {.sun_family = AF_UNIX, .sun_path = "\0nowhere"};
+
+    SyscallBatch batch;
+    batch.setsockopt(mReader, SOL_SOCKET, SO_RCVBUF, rcvbuf);
+    batch.write(Fd(-1), makeSlice(payload));
+    // Already connected, so an explicit destination is refused.
+    batch.sendto(mWriter, makeSlice(payload), 0, nowhere);
+    batch.setsockopt(mReader, SOL_SOCKET, -1, rcvbuf);
+    batch.write(mWriter, makeSlice(payload));
+    const auto results = submit(batch);
+    if (GetParam() && results.empty()) GTEST_SKIP() << "io_uring not available";
+    ASSERT_EQ(5U, results.size());
+
+    ASSERT_OK(results[0]);
+    EXPECT_EQ(0U, results[0].value());
+    EXPECT_EQ(EBADF, results[1].status().code());
+    EXPECT_FALSE(isOk(results[2]));
+    EXPECT_EQ(ENOPROTOOPT, results[3].status().code());
+    ASSERT_OK(results[4]);
+    EXPECT_EQ(payload.size(), results[4].value());
+}
+
+TEST_P(SyscallBatchTest, recvfromReportsSource) {
+    // Unconnected sockets bound to abstract addresses.
+    const auto& sys = sSyscalls.get();
+    auto a = sys.socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    auto b = sys.socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    ASSERT_OK(a);
+    ASSERT_OK(b);
+    sockaddr_un addrA = {.sun_family = AF_UNIX};
+    sockaddr_un addrB = {.sun_family = AF_UNIX};
+    // Autobind assigns each socket a unique abstract address.
+    ASSERT_OK(sys.bind(a.value(), asSockaddrPtr(&addrA), sizeof(sa_family_t)));
+    ASSERT_OK(sys.bind(b.value(), asSockaddrPtr(&addrB), sizeof(sa_family_t)));
+    socklen_t lenA = sizeof(addrA);
+    ASSERT_OK(sys.getsockname(a.value(), asSockaddrPtr(&addrA), &lenA));
+    socklen_t lenB = sizeof(addrB);
+    ASSERT_OK(sys.getsockname(b.value(), asSockaddrPtr(&addrB), &lenB));
+
+    const std::string payload = "hello";
+    SyscallBatch send;
+    send.sendto(a.value(), makeSlice(payload), 0, asSockaddrPtr(&addrB), lenB);
+    const auto sent = submit(send);
+    if (GetParam() && sent.empty()) GTEST_SKIP() << "io_uring not available";
+    ASSERT_EQ(1U, sent.size());
+    ASSERT_OK(sent[0]);
+
+    std::string buf(64, '\0');
+    sockaddr_un src = {};
+    socklen_t srclen = sizeof(src);
+    SyscallBatch recv;
+    recv.recvfrom(b.value(), makeSlice(buf), 0, asSockaddrPtr(&src), &srclen);
+    const auto received = submit(recv);
+    ASSERT_EQ(1U, received.size());
+    ASSERT_OK(received[0]);
+    EXPECT_EQ(payload, buf.substr(0, received[0].value()));
+    ASSERT_EQ(lenA, srclen);
+    EXPECT_EQ(0, memcmp(&addrA, &src, srclen));
+}
+
+TEST_P(SyscallBatchTest, largerThanRing) {
+    // Stays under the default socket buffer size so that writes don't block.
+    constexpr size_t kOps = 150;
+    const std::string payload = "x";
+    SyscallBatch batch;
+    for (size_t i = 0; i < kOps; ++i) batch.write(mWriter, makeSlice(payload));
+    const auto results = submit(batch);
+    if (GetParam() && results.empty()) GTEST_SKIP() << "io_uring not available";
+    ASSERT_EQ(kOps, results.size());
+    for (const auto& result : results) {
+        ASSERT_OK(result);
+        EXPECT_EQ(1U, result.value());
+    }
+}
+
+TEST_P(SyscallBatchTest, concurrentBatches) {
+    // More threads than the one ring kept between batches.
+    constexpr size_t kThreads = 4;
+    constexpr size_t kOps = 8;
+    const std::string payload = "x";
+    std::vector<std::vector<StatusOr<size_t>>> results(kThreads);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            SyscallBatch batch;
+            for (size_t i = 0; i < kOps; ++i) batch.write(mWriter, makeSlice(payload));
+            results[t] = submit(batch);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    if (GetParam() && results[0].empty()) GTEST_SKIP() << "io_uring not available";
+    for (const auto& perThread : results) {
+        ASSERT_EQ(kOps, perThread.size());
+        for (const auto& result : perThread) {
+            ASSERT_OK(result);
+            EXPECT_EQ(1U, result.value());
+        }
+    }
+}
+
+TEST(SyscallBatchTest, emptyBatch) {
+    EXPECT_TRUE(sSyscalls.get().submit(SyscallBatch()).empty());
+}
+
+TEST(SyscallBatchTest, mockRoutesToIndividualCalls) {
+    StrictMock<ScopedMockSyscalls> mock;
+    constexpr Fd kFd(40);
+    const int kValue = 1;
+    const std::string payload = "abc";
+    const Status kError = statusFromErrno(EAGAIN, "test");
+
+    EXPECT_CALL(mock, submit(_))
+            .WillOnce(Invoke(&mock, &MockSyscalls::submitSequentially));
+    EXPECT_CALL(mock, setsockopt(kFd, SOL_SOCKET, SO_MARK, &kValue, sizeof(kValue)))
+            .WillOnce(Return(status::ok));
+    EXPECT_CALL(mock, sendto(kFd, _, 0, nullptr, 0))
+            .WillOnce(Return(payload.size()))
+            .WillOnce(Return(kError));
+
+    SyscallBatch batch;
+    batch.setsockopt(kFd, SOL_SOCKET, SO_MARK, kValue);
+    batch.sendto(kFd, makeSlice(payload), 0, nullptr, 0);
+    batch.sendto(kFd, makeSlice(payload), 0, nullptr, 0);
+    const auto results = sSyscalls.get().submit(batch);
+    ASSERT_EQ(3U, results.size());
+    EXPECT_OK(results[0]);
+    ASSERT_OK(results[1]);
+    EXPECT_EQ(payload.size(), results[1].value());
+    EXPECT_EQ(kError, results[2].status());
+}
+
+}  // namespace netdutils
+}  // namespace android
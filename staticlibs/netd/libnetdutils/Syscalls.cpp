@@ -171,6 +171,41 @@ class RealSyscalls final : public Syscalls {
         return take(dst, rv);
     }
 
+    StatusOr<unsigned int> recvmmsg(Fd sock, mmsghdr* msgs, unsigned int vlen,
+                                    int flags) const override {
+        auto rv = syscallRetry(::recvmmsg, sock.get(), msgs, vlen, flags, nullptr);
+        if (rv == -1) {
+            return statusFromErrno(errno, "recvmmsg() failed");
+        }
+        return static_cast<unsigned int>(rv);
+    }
+
+    StatusOr<std::unique_ptr<DatagramReceiver>> datagramReceiver(
+            Fd sock, size_t bufferSize, unsigned int bufferCount,
+            bool preferIoUring) const override {
+        if (preferIoUring) {
+            auto receiver = makeIoUringDatagramReceiver(sock, bufferSize, bufferCount);
+            if (isOk(receiver)) {
+                return receiver;
+            }
+            // Expected on kernels older than 6.0 and for SELinux domains
+            // that are not allowed to use io_uring.
+        }
+        return makeRecvmmsgDatagramReceiver(sock, bufferSize, bufferCount);
+    }
+
+    std::vector<StatusOr<size_t>> submit(const SyscallBatch& batch) const override {
+        if (batch.empty()) {
+            return {};
+        }
+        auto results = submitIoUringBatch(batch, *this);
+        if (isOk(results)) {
+            return std::move(results.value());
+        }
+        // Expected for SELinux domains that are not allowed to use io_uring.
+        return submitSequentially(batch);
+    }
+
     Status shutdown(Fd fd, int how) const override {
         auto rv = ::shutdown(fd.get(), how);
         if (rv == -1) {
@@ -228,6 +263,38 @@ class RealSyscalls final : public Syscalls {
     }
 };
 
+StatusOr<size_t> Syscalls::submitOne(const SyscallBatch::Op& op) const {
+    switch (op.type) {
+        case SyscallBatch::Type::WRITE:
+            return write(op.fd, op.buf);
+        case SyscallBatch::Type::WRITEV:
+            return writev(op.fd, std::vector<iovec>(op.iov, op.iov + op.iovcnt));
+        case SyscallBatch::Type::READ: {
+            ASSIGN_OR_RETURN(auto used, read(op.fd, op.buf));
+            return used.size();
+        }
+        case SyscallBatch::Type::SENDTO:
+            return sendto(op.fd, op.buf, op.flags, op.dst, op.dstlen);
+        case SyscallBatch::Type::RECVFROM: {
+            ASSIGN_OR_RETURN(auto used, recvfrom(op.fd, op.buf, op.flags, op.src, op.srclen));
+            return used.size();
+        }
+        case SyscallBatch::Type::SETSOCKOPT:
+            RETURN_IF_NOT_OK(setsockopt(op.fd, op.level, op.optname, op.optval, op.optlen));
+            return 0U;
+    }
+    return statusFromErrno(EINVAL, "unknown batched operation");
+}
+
+std::vector<StatusOr<size_t>> Syscalls::submitSequentially(const SyscallBatch& batch) const {
+    std::vector<StatusOr<size_t>> results;
+    results.reserve(batch.size());
+    for (const auto& op : batch.ops()) {
+        results.push_back(submitOne(op));
+    }
+    return results;
+}
+
 SyscallsHolder::~SyscallsHolder() {
     delete &get();
 }
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETDUTILS_ADAPTIVE_POLL_INTERVAL_H
+#define NETDUTILS_ADAPTIVE_POLL_INTERVAL_H
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+
+#include "netdutils/BackoffSequence.h"
+
+namespace android {
+namespace netdutils {
+
+// Chooses the interval between polls of a source that fills up between
+// polls, such as a BPF ring buffer or map, from how full each poll found it.
+//
+// Polls that find the source empty lengthen the interval following a
+// BackoffSequence, up to maxInterval. Polls that find it at least
+// highWatermark full halve the interval, down to minInterval, so that the
+// source is drained before it overflows. Anything in between keeps the
+// current interval.
+//
+// Not threadsafe.
+template <typename time_type = std::chrono::milliseconds>
+class AdaptivePollInterval {
+  public:
+    struct Parameters {
+        time_type minInterval;
+        time_type initialInterval;
+        time_type maxInterval;
+        // Fraction of the source's capacity, in (0, 1].
+        double highWatermark = 0.5;
+    };
+
+    explicit AdaptivePollInterval(const Parameters& params)
+        : mParams(params),
+          mInterval(std::clamp(params.initialInterval, params.minInterval, params.maxInterval)) {}
+
+    // Report that a poll found the source fill full, as a fraction of its
+    // capacity, and return the interval until the next poll.
+    time_type next(double fill) {
+        if (fill <= 0) {
+            if (!mIdleBackoff) {
+                mIdleBackoff.emplace(
+                        typename BackoffSequence<time_type>::Builder()
+                                .withInitialRetransmissionTime(
+                                        std::min(2 * mInterval, mParams.maxInterval))
+                                .withMaximumRetransmissionTime(mParams.maxInterval)
+                                .build());
+            }
+            mInterval = std::max(mInterval, mIdleBackoff->getNextTimeout());
+            return mInterval;
+        }
+
+        mIdleBackoff.reset();
+        if (fill >= mParams.highWatermark) {
+            mInterval = std::max(mInterval / 2, mParams.minInterval);
+        }
+        return mInterval;
+    }
+
+    time_type interval() const { return mInterval; }
+
+    // Return to the initial interval, e.g. when the source is restarted.
+    void reset() {
+        mIdleBackoff.reset();
+        mInterval = std::clamp(mParams.initialInterval, mParams.minInterval, mParams.maxInterval);
+    }
+
+  private:
+    const Parameters mParams;
+    time_type mInterval;
+    std::optional<BackoffSequence<time_type>> mIdleBackoff;
+};
+
+}  // namespace netdutils
+}  // namespace android
+
+#endif /* NETDUTILS_ADAPTIVE_POLL_INTERVAL_H */
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETUTILS_DATAGRAM_RECEIVER_H
+#define NETUTILS_DATAGRAM_RECEIVER_H
+
+#include <functional>
+#include <memory>
+
+#include "netdutils/Fd.h"
+#include "netdutils/Slice.h"
+#include "netdutils/StatusOr.h"
+
+namespace android {
+namespace netdutils {
+
+// Drains datagrams queued on a socket into page-aligned buffers owned by
+// the receiver, several datagrams per wakeup.
+//
+// Obtain instances through Syscalls::datagramReceiver(). The io_uring
+// backend arms a multishot recv that the kernel completes directly into
+// a provided buffer ring, so a burst of datagrams costs no system call
+// per datagram. The fallback backend drains with recvmmsg().
+//
+// Not threadsafe. An instance must be created and drained on the same
+// thread.
+class DatagramReceiver {
+  public:
+    using OnDatagram = std::function<void(const Slice)>;
+
+    virtual ~DatagramReceiver() = default;
+
+    // File descriptor that polls readable while drain() has work to do.
+    virtual Fd pollFd() const = 0;
+
+    // Without blocking, invoke onDatagram for each queued datagram, up to
+    // the number of buffers of this receiver. Slices are only valid for the
+    // duration of the callback. Return the number of datagrams delivered or
+    // the first receive error, after delivering the datagrams preceding it.
+    virtual StatusOr<size_t> drain(const OnDatagram& onDatagram) = 0;
+
+    // True if this receiver is backed by io_uring.
+    virtual bool isIoUring() const = 0;
+};
+
+// Backends for Syscalls::datagramReceiver(). Most code should call that
+// instead so tests can substitute MockSyscalls.
+StatusOr<std::unique_ptr<DatagramReceiver>> makeIoUringDatagramReceiver(
+        Fd sock, size_t bufferSize, unsigned int bufferCount);
+
+StatusOr<std::unique_ptr<DatagramReceiver>> makeRecvmmsgDatagramReceiver(
+        Fd sock, size_t bufferSize, unsigned int bufferCount);
+
+}  // namespace netdutils
+}  // namespace android
+
+#endif /* NETUTILS_DATAGRAM_RECEIVER_H */
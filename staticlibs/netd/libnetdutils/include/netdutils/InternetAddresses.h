@@ -16,13 +16,16 @@
 
 #pragma once
 
+#include <endian.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <stdint.h>
 #include <cstring>
+#include <functional>
 #include <limits>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "netdutils/NetworkConstants.h"
 
@@ -31,6 +34,52 @@ namespace netdutils {
 
 namespace internal_ {
 
+// An IPv6 address as two host-order words, or an IPv4 address in the top
+// 32 bits of hi. Lets addresses be compared and masked a word at a time
+// rather than byte by byte.
+struct ip_words {
+    uint64_t hi;
+    uint64_t lo;
+
+    static ip_words of(const in_addr& v4) {
+        return {static_cast<uint64_t>(ntohl(v4.s_addr)) << 32, 0U};
+    }
+    static ip_words of(const in6_addr& v6) {
+        uint64_t hi, lo;
+        memcpy(&hi, v6.s6_addr, sizeof(hi));
+        memcpy(&lo, v6.s6_addr + sizeof(hi), sizeof(lo));
+        return {be64toh(hi), be64toh(lo)};
+    }
+
+    // The leading len bits set, for len in [0, 128].
+    static ip_words mask(int len) {
+        const auto leading = [](int n) -> uint64_t { return (n <= 0) ? 0U : (~0ULL) << (64 - n); };
+        return {len >= 64 ? ~0ULL : leading(len), len >= 128 ? ~0ULL : leading(len - 64)};
+    }
+
+    // Bit i, counting from the most significant bit of hi.
+    int bit(int i) const { return (i < 64) ? (hi >> (63 - i)) & 1 : (lo >> (127 - i)) & 1; }
+
+    // Number of leading bits that a and b have in common.
+    friend int commonPrefixLength(const ip_words& a, const ip_words& b) {
+        if (a.hi != b.hi) return __builtin_clzll(a.hi ^ b.hi);
+        if (a.lo != b.lo) return 64 + __builtin_clzll(a.lo ^ b.lo);
+        return 128;
+    }
+
+    // True if a and b agree on the bits set in mask.
+    friend bool matches(const ip_words& a, const ip_words& b, const ip_words& mask) {
+        return (((a.hi ^ b.hi) & mask.hi) | ((a.lo ^ b.lo) & mask.lo)) == 0;
+    }
+
+    friend bool operator==(const ip_words& a, const ip_words& b) {
+        return ((a.hi ^ b.hi) | (a.lo ^ b.lo)) == 0;
+    }
+    friend bool operator<(const ip_words& a, const ip_words& b) {
+        return (a.hi != b.hi) ? (a.hi < b.hi) : (a.lo < b.lo);
+    }
+};
+
 // A structure to hold data for dealing with Internet addresses (IPAddress) and
 // related types such as IPSockAddr and IPPrefix.
 struct compact_ipdata {
@@ -60,11 +109,8 @@ struct compact_ipdata {
                 const in_addr v4b = b.ip.v4;
                 return (v4a.s_addr == v4b.s_addr);
             }
-            case AF_INET6: {
-                const in6_addr v6a = a.ip.v6;
-                const in6_addr v6b = b.ip.v6;
-                return IN6_ARE_ADDR_EQUAL(&v6a, &v6b);
-            }
+            case AF_INET6:
+                return ip_words::of(a.ip.v6) == ip_words::of(b.ip.v6);
         }
         return false;
     }
@@ -85,10 +131,9 @@ struct compact_ipdata {
                 break;
             }
             case AF_INET6: {
-                const in6_addr v6a = a.ip.v6;
-                const in6_addr v6b = b.ip.v6;
-                const int cmp = std::memcmp(v6a.s6_addr, v6b.s6_addr, IPV6_ADDR_LEN);
-                if (cmp != 0) return cmp < 0;
+                const ip_words v6a = ip_words::of(a.ip.v6);
+                const ip_words v6b = ip_words::of(b.ip.v6);
+                if (!(v6a == v6b)) return v6a < v6b;
                 break;
             }
         }
@@ -96,6 +141,30 @@ struct compact_ipdata {
         if (a.port != b.port) return (a.port < b.port);
         return (a.scope_id < b.scope_id);
     }
+
+    // Consistent with operator==, under the same conditions.
+    friend size_t hashValue(const compact_ipdata& d) {
+        // The splitmix64 finalizer, a cheap mix with good avalanche.
+        const auto mix = [](uint64_t x) {
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+            return x ^ (x >> 31);
+        };
+        ip_words words{0U, 0U};
+        switch (d.family) {
+            case AF_INET:
+                words = ip_words::of(d.ip.v4);
+                break;
+            case AF_INET6:
+                words = ip_words::of(d.ip.v6);
+                break;
+        }
+        const uint64_t meta = static_cast<uint64_t>(d.family) |
+                              (static_cast<uint64_t>(d.cidrlen) << 8) |
+                              (static_cast<uint64_t>(d.port) << 16) |
+                              (static_cast<uint64_t>(d.scope_id) << 32);
+        return static_cast<size_t>(mix(words.hi ^ mix(words.lo ^ mix(meta))));
+    }
 };
 
 static_assert(AF_UNSPEC <= std::numeric_limits<uint8_t>::max(), "AF_UNSPEC value too large");
@@ -168,6 +237,7 @@ class IPAddress {
     friend bool operator>(const IPAddress& a, const IPAddress& b) { return (b.mData < a.mData); }
     friend bool operator<=(const IPAddress& a, const IPAddress& b) { return (a < b) || (a == b); }
     friend bool operator>=(const IPAddress& a, const IPAddress& b) { return (b < a) || (a == b); }
+    friend size_t hashValue(const IPAddress& ip) { return hashValue(ip.mData); }
 
   private:
     friend class IPPrefix;
@@ -242,6 +312,7 @@ class IPPrefix {
     friend bool operator>(const IPPrefix& a, const IPPrefix& b) { return (b.mData < a.mData); }
     friend bool operator<=(const IPPrefix& a, const IPPrefix& b) { return (a < b) || (a == b); }
     friend bool operator>=(const IPPrefix& a, const IPPrefix& b) { return (b < a) || (a == b); }
+    friend size_t hashValue(const IPPrefix& prefix) { return hashValue(prefix.mData); }
 
   private:
     internal_::compact_ipdata mData{};
@@ -323,10 +394,325 @@ class IPSockAddr {
     friend bool operator>(const IPSockAddr& a, const IPSockAddr& b) { return (b.mData < a.mData); }
     friend bool operator<=(const IPSockAddr& a, const IPSockAddr& b) { return (a < b) || (a == b); }
     friend bool operator>=(const IPSockAddr& a, const IPSockAddr& b) { return (b < a) || (a == b); }
+    friend size_t hashValue(const IPSockAddr& sa) { return hashValue(sa.mData); }
 
   private:
     internal_::compact_ipdata mData{};
 };
 
+// Map from IP prefixes to values, supporting longest prefix match.
+//
+// Implemented as a path-compressed binary trie per address family, with
+// nodes stored contiguously and linked by index. Lookups take time
+// proportional to the number of stored prefixes along the path, never
+// the total number of prefixes. Scope IDs are not part of the key.
+//
+// T must be default constructible. No thread-safety guarantees whatsoever.
+template <typename T>
+class IPPrefixMap {
+  public:
+    // Insert or replace the value for prefix. Return true if prefix was not
+    // already present. Prefixes of families other than AF_INET and
+    // AF_INET6 are not stored.
+    bool insert(const IPPrefix& prefix, T value);
+
+    // Remove prefix. Return true if it was present.
+    bool erase(const IPPrefix& prefix);
+
+    // Value for exactly prefix, or nullptr.
+    const T* find(const IPPrefix& prefix) const;
+
+    // Value for the longest stored prefix containing address, or nullptr.
+    // If matched is not null, it is set to that prefix.
+    const T* longestMatch(const IPAddress& address, IPPrefix* matched = nullptr) const;
+
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+    void clear() { *this = IPPrefixMap(); }
+
+    // Invoke fn on each prefix and its value, in no particular order.
+    void forEach(const std::function<void(const IPPrefix&, const T&)>& fn) const;
+
+  private:
+    using Words = internal_::ip_words;
+    static constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+    struct Node {
+        Words key;  // bits beyond len are zero
+        uint8_t len;
+        bool hasValue;
+        uint32_t child[2];
+        T value;
+    };
+
+    // Index of the address family's root in mRoot, or -1 if unsupported.
+    static int familyIndex(sa_family_t family) {
+        return (family == AF_INET) ? 0 : (family == AF_INET6) ? 1 : -1;
+    }
+
+    static Words wordsOf(const IPPrefix& prefix) {
+        return (prefix.family() == AF_INET) ? Words::of(prefix.addr4()) : Words::of(prefix.addr6());
+    }
+
+    static IPPrefix prefixOf(int familyIndex, const Words& key, int len) {
+        if (familyIndex == 0) {
+            const in_addr v4 = {.s_addr = htonl(static_cast<uint32_t>(key.hi >> 32))};
+            return IPPrefix(IPAddress(v4), len);
+        }
+        in6_addr v6;
+        const uint64_t hi = htobe64(key.hi);
+        const uint64_t lo = htobe64(key.lo);
+        memcpy(v6.s6_addr, &hi, sizeof(hi));
+        memcpy(v6.s6_addr + sizeof(hi), &lo, sizeof(lo));
+        return IPPrefix(IPAddress(v6), len);
+    }
+
+    // The link from parent to its child in direction dir, or from nothing
+    // to the root of family dir if parent is kNone. Invalidated by
+    // newNode().
+    uint32_t& link(uint32_t parent, int dir) {
+        return (parent == kNone) ? mRoot[dir] : mNodes[parent].child[dir];
+    }
+
+    uint32_t newNode(const Words& key, int len) {
+        Node node = {.key = key, .len = static_cast<uint8_t>(len), .hasValue = false,
+                     .child = {kNone, kNone}, .value = T()};
+        if (!mFree.empty()) {
+            const uint32_t index = mFree.back();
+            mFree.pop_back();
+            mNodes[index] = std::move(node);
+            return index;
+        }
+        mNodes.push_back(std::move(node));
+        return mNodes.size() - 1;
+    }
+
+    void freeNode(uint32_t index) {
+        mNodes[index].value = T();
+        mFree.push_back(index);
+    }
+
+    // Index of the node holding exactly prefix, with or without a value, or
+    // kNone. Optionally return the link leading to it.
+    uint32_t findNode(const IPPrefix& prefix, uint32_t* parent, int* dir) const;
+
+    std::vector<Node> mNodes;
+    std::vector<uint32_t> mFree;
+    uint32_t mRoot[2] = {kNone, kNone};
+    size_t mSize = 0;
+};
+
+template <typename T>
+bool IPPrefixMap<T>::insert(const IPPrefix& prefix, T value) {
+    const int family = familyIndex(prefix.family());
+    if (family < 0) return false;
+    const Words key = wordsOf(prefix);
+    const int len = prefix.length();
+
+    uint32_t parent = kNone;
+    int dir = family;
+    while (true) {
+        const uint32_t cur = link(parent, dir);
+        if (cur == kNone) {
+            const uint32_t leaf = newNode(key, len);
+            mNodes[leaf].hasValue = true;
+            mNodes[leaf].value = std::move(value);
+            link(parent, dir) = leaf;
+            break;
+        }
+
+        const Node& node = mNodes[cur];
+        const int common = std::min({commonPrefixLength(node.key, key), int{node.len}, len});
+        if (common == node.len && node.len == len) {
+            // Exact match.
+            Node& existing = mNodes[cur];
+            existing.value = std::move(value);
+            if (existing.hasValue) return false;
+            existing.hasValue = true;
+            break;
+        }
+        if (common == node.len) {
+            // The node is a strict prefix of the new key; descend.
+            parent = cur;
+            dir = key.bit(node.len);
+            continue;
+        }
+
+        // Split the link: the new key either sits above the node, or
+        // diverges from it at bit common.
+        const Words nodeKey = node.key;
+        const Words mask = Words::mask(common);
+        const uint32_t split = newNode({key.hi & mask.hi, key.lo & mask.lo}, common);
+        mNodes[split].child[nodeKey.bit(common)] = cur;
+        if (common == len) {
+            mNodes[split].hasValue = true;
+            mNodes[split].value = std::move(value);
+        } else {
+            const uint32_t leaf = newNode(key, len);
+            mNodes[leaf].hasValue = true;
+            mNodes[leaf].value = std::move(value);
+            mNodes[split].child[key.bit(common)] = leaf;
+        }
+        link(parent, dir) = split;
+        break;
+    }
+    mSize++;
+    return true;
+}
+
+template <typename T>
+uint32_t IPPrefixMap<T>::findNode(const IPPrefix& prefix, uint32_t* parentOut,
+                                  int* dirOut) const {
+    const int family = familyIndex(prefix.family());
+    if (family < 0) return kNone;
+    const Words key = wordsOf(prefix);
+    const int len = prefix.length();
+
+    uint32_t parent = kNone;
+    int dir = family;
+    uint32_t cur = mRoot[family];
+    while (cur != kNone) {
+        const Node& node = mNodes[cur];
+        if (node.len > len || !matches(node.key, key, Words::mask(node.len))) return kNone;
+        if (node.len == len) break;
+        parent = cur;
+        dir = key.bit(node.len);
+        cur = node.child[dir];
+    }
+    if (parentOut != nullptr) *parentOut = parent;
+    if (dirOut != nullptr) *dirOut = dir;
+    return cur;
+}
+
+template <typename T>
+const T* IPPrefixMap<T>::find(const IPPrefix& prefix) const {
+    const uint32_t index = findNode(prefix, nullptr, nullptr);
+    if (index == kNone || !mNodes[index].hasValue) return nullptr;
+    return &mNodes[index].value;
+}
+
+template <typename T>
+bool IPPrefixMap<T>::erase(const IPPrefix& prefix) {
+    uint32_t parent;
+    int dir;
+    const uint32_t index = findNode(prefix, &parent, &dir);
+    if (index == kNone || !mNodes[index].hasValue) return false;
+
+    Node& node = mNodes[index];
+    node.hasValue = false;
+    node.value = T();
+    mSize--;
+
+    // Unlink the node unless it still branches. If it was a leaf, its
+    // parent may be left as a valueless node with a single child, which is
+    // unlinked in turn.
+    if (node.child[0] != kNone && node.child[1] != kNone) return true;
+    const uint32_t only = (node.child[0] != kNone) ? node.child[0] : node.child[1];
+    link(parent, dir) = only;
+    freeNode(index);
+    if (only != kNone || parent == kNone) return true;
+
+    const Node& up = mNodes[parent];
+    if (up.hasValue) return true;
+    const uint32_t remaining = (up.child[0] != kNone) ? up.child[0] : up.child[1];
+    uint32_t grandparent;
+    int upDir;
+    findNode(prefixOf(familyIndex(prefix.family()), up.key, up.len), &grandparent, &upDir);
+    link(grandparent, upDir) = remaining;
+    freeNode(parent);
+    return true;
+}
+
+template <typename T>
+const T* IPPrefixMap<T>::longestMatch(const IPAddress& address, IPPrefix* matched) const {
+    const IPPrefix full(address);
+    const int family = familyIndex(full.family());
+    if (family < 0) return nullptr;
+    const Words key = wordsOf(full);
+
+    const Node* best = nullptr;
+    uint32_t cur = mRoot[family];
+    while (cur != kNone) {
+        const Node& node = mNodes[cur];
+        if (!matches(node.key, key, Words::mask(node.len))) break;
+        if (node.hasValue) best = &node;
+        if (node.len == full.length()) break;
+        cur = node.child[key.bit(node.len)];
+    }
+    if (best == nullptr) return nullptr;
+    if (matched != nullptr) *matched = prefixOf(family, best->key, best->len);
+    return &best->value;
+}
+
+template <typename T>
+void IPPrefixMap<T>::forEach(const std::function<void(const IPPrefix&, const T&)>& fn) const {
+    for (int family = 0; family < 2; family++) {
+        std::vector<uint32_t> stack;
+        if (mRoot[family] != kNone) stack.push_back(mRoot[family]);
+        while (!stack.empty()) {
+            const Node& node = mNodes[stack.back()];
+            stack.pop_back();
+            if (node.hasValue) fn(prefixOf(family, node.key, node.len), node.value);
+            for (const uint32_t child : node.child) {
+                if (child != kNone) stack.push_back(child);
+            }
+        }
+    }
+}
+
+// Set of IP prefixes, supporting longest prefix match and checking many
+// addresses at once.
+class IPPrefixSet {
+  public:
+    bool insert(const IPPrefix& prefix) { return mMap.insert(prefix, true); }
+    bool erase(const IPPrefix& prefix) { return mMap.erase(prefix); }
+    bool contains(const IPPrefix& prefix) const { return mMap.find(prefix) != nullptr; }
+
+    // True if any prefix in the set contains address.
+    bool covers(const IPAddress& address) const {
+        return mMap.longestMatch(address) != nullptr;
+    }
+
+    // For each address, whether any prefix in the set contains it.
+    std::vector<bool> covers(const std::vector<IPAddress>& addresses) const {
+        std::vector<bool> result(addresses.size());
+        for (size_t i = 0; i < addresses.size(); i++) result[i] = covers(addresses[i]);
+        return result;
+    }
+
+    // Longest prefix in the set containing address, if any.
+    bool longestMatch(const IPAddress& address, IPPrefix* matched) const {
+        return mMap.longestMatch(address, matched) != nullptr;
+    }
+
+    size_t size() const { return mMap.size(); }
+    bool empty() const { return mMap.empty(); }
+    void clear() { mMap.clear(); }
+
+    void forEach(const std::function<void(const IPPrefix&)>& fn) const {
+        mMap.forEach([&fn](const IPPrefix& prefix, const bool&) { fn(prefix); });
+    }
+
+  private:
+    IPPrefixMap<bool> mMap;
+};
+
 }  // namespace netdutils
 }  // namespace android
+
+template <>
+struct std::hash<android::netdutils::IPAddress> {
+    size_t operator()(const android::netdutils::IPAddress& ip) const { return hashValue(ip); }
+};
+
+template <>
+struct std::hash<android::netdutils::IPPrefix> {
+    size_t operator()(const android::netdutils::IPPrefix& prefix) const {
+        return hashValue(prefix);
+    }
+};
+
+template <>
+struct std::hash<android::netdutils::IPSockAddr> {
+    size_t operator()(const android::netdutils::IPSockAddr& sa) const { return hashValue(sa); }
+};
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETUTILS_IOURING_H
+#define NETUTILS_IOURING_H
+
+#include <bitset>
+#include <functional>
+#include <memory>
+
+#include <linux/io_uring.h>
+
+#include "netdutils/Fd.h"
+#include "netdutils/Status.h"
+#include "netdutils/StatusOr.h"
+#include "netdutils/UniqueFd.h"
+
+namespace android {
+namespace netdutils {
+
+// Minimal io_uring instance written directly against the kernel ABI.
+//
+// io_uring is only permitted to a few SELinux domains on Android and
+// older kernels lack features callers rely on, so a failing create()
+// is routine and callers must be prepared to fall back to plain system
+// calls.
+//
+// Not threadsafe.
+class IoUring {
+  public:
+    // Create a ring with at least sqEntries submission queue and cqEntries
+    // completion queue slots. flags is a combination of IORING_SETUP_*.
+    static StatusOr<std::unique_ptr<IoUring>> create(unsigned int sqEntries,
+                                                     unsigned int cqEntries, uint32_t flags = 0);
+
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // The ring file descriptor. Polls readable while completions are pending.
+    Fd fd() const { return mFd; }
+
+    // Return a zeroed submission queue entry, or nullptr if the submission
+    // queue is full. The entry is handed to the kernel by the next submit().
+    io_uring_sqe* getSqe();
+
+    // Submit all entries obtained from getSqe() that the kernel has not
+    // consumed yet and wait for at least waitNr completions. The kernel may
+    // consume only some of them, in which case it does not wait; the rest
+    // are offered again by the next call. Return the number consumed.
+    StatusOr<unsigned int> submit(unsigned int waitNr = 0);
+
+    // Wait for at least waitNr completions without submitting anything.
+    Status wait(unsigned int waitNr);
+
+    // Invoke fn on every pending completion in order, then release them to
+    // the kernel. Return the number of completions processed.
+    unsigned int forEachCqe(const std::function<void(const io_uring_cqe&)>& fn);
+
+    // Register ring as provided buffer group bgid. ring must be page aligned
+    // and hold entries io_uring_buf slots, entries being a power of two.
+    Status registerBufRing(io_uring_buf_ring* ring, unsigned int entries, uint16_t bgid);
+
+    // True if the kernel implements opcode, an IORING_OP_* value. The kernel
+    // is asked once, on the first call.
+    bool isSupported(uint8_t opcode);
+
+  private:
+    IoUring() = default;
+
+    Status map(const io_uring_params& params);
+
+    UniqueFd mFd;
+
+    void* mSqRing = nullptr;
+    size_t mSqRingSize = 0;
+    void* mCqRing = nullptr;
+    size_t mCqRingSize = 0;
+    io_uring_sqe* mSqes = nullptr;
+    size_t mSqesSize = 0;
+
+    unsigned int* mSqHead = nullptr;
+    unsigned int* mSqTail = nullptr;
+    unsigned int* mSqArray = nullptr;
+    unsigned int mSqMask = 0;
+    unsigned int mSqEntries = 0;
+    // Entries handed out by getSqe(), and those already published to mSqTail.
+    unsigned int mSqeTail = 0;
+    unsigned int mSqeHead = 0;
+
+    unsigned int* mCqHead = nullptr;
+    unsigned int* mCqTail = nullptr;
+    io_uring_cqe* mCqes = nullptr;
+    unsigned int mCqMask = 0;
+
+    bool mProbed = false;
+    std::bitset<IORING_OP_LAST> mSupportedOps;
+};
+
+}  // namespace netdutils
+}  // namespace android
+
+#endif /* NETUTILS_IOURING_H */
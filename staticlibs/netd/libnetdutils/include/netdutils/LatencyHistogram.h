@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETDUTILS_LATENCY_HISTOGRAM_H
+#define NETDUTILS_LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/cdefs.h>
+
+#include "netdutils/DumpWriter.h"
+#include "netdutils/Stopwatch.h"
+
+namespace android {
+namespace netdutils {
+
+// High dynamic range histogram of latencies in microseconds.
+//
+// Buckets are exact up to 32us and then 16 per power of two, so any
+// recorded value is reported to within 1/16 (6.25%) of itself, up to
+// kMaxValueUs. Larger values are counted as kMaxValueUs.
+//
+// record() is lock-free and wait-free. Counters are sharded so that
+// threads recording into the same histogram usually touch different cache
+// lines. Shards are allocated on first use by a thread.
+//
+// Threadsafe.
+class LatencyHistogram {
+  public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int64_t kMaxValueUs = (int64_t{1} << 32) - 1;
+
+    // Merged view of all shards at one point in time.
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t sumUs = 0;
+        uint64_t maxUs = 0;
+        std::vector<uint64_t> buckets;
+
+        // Smallest value such that at least fraction (in [0, 1]) of the
+        // recorded values are at or below it, rounded up to the top of its
+        // bucket. 0 if nothing was recorded.
+        uint64_t percentileUs(double fraction) const;
+    };
+
+    explicit LatencyHistogram(std::string name);
+    ~LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    const std::string& name() const { return mName; }
+
+    void record(int64_t us);
+
+    Snapshot snapshot() const;
+
+    // Print count, mean, p50, p99, p999 and max on one line.
+    void dump(DumpWriter& dw) const;
+
+    // Return the process-wide histogram called name, creating it if needed.
+    // Histograms are never destroyed, so the reference can be cached.
+    static LatencyHistogram& named(const std::string& name);
+
+    // Dump every histogram created by named(), sorted by name.
+    static void dumpAll(DumpWriter& dw);
+
+    // Bucket helpers, exposed for testing.
+    static size_t bucketOf(int64_t us);
+    static uint64_t bucketLowUs(size_t bucket);
+    static uint64_t bucketHighUs(size_t bucket);
+    static size_t numBuckets();
+
+  private:
+    static constexpr size_t kMaxShards = 16;
+    struct Shard;
+
+    Shard& shardForThisThread();
+
+    const std::string mName;
+    std::array<std::atomic<Shard*>, kMaxShards> mShards{};
+};
+
+// Records the lifetime of the object into a LatencyHistogram.
+class ScopedLatencyTimer {
+  public:
+    explicit ScopedLatencyTimer(LatencyHistogram& histogram) : mHistogram(histogram) {}
+    ~ScopedLatencyTimer() { mHistogram.record(mStopwatch.timeTakenUs()); }
+
+    ScopedLatencyTimer(const ScopedLatencyTimer&) = delete;
+    ScopedLatencyTimer& operator=(const ScopedLatencyTimer&) = delete;
+
+  private:
+    LatencyHistogram& mHistogram;
+    const Stopwatch mStopwatch;
+};
+
+// Record the time until the end of the enclosing scope into the
+// process-wide histogram called name. The histogram is looked up once per
+// call site.
+//
+// Example usage:
+// int BpfHandler::tagSocket(...) {
+//     NETDUTILS_SCOPED_LATENCY("BpfHandler::tagSocket");
+//     ...
+// }
+#define NETDUTILS_SCOPED_LATENCY(name) \
+    NETDUTILS_SCOPED_LATENCY_IMPL(name, __CONCAT(_latency_histogram_, __LINE__), \
+                                  __CONCAT(_latency_timer_, __LINE__))
+
+#define NETDUTILS_SCOPED_LATENCY_IMPL(name, histogram, timer)                         \
+    static ::android::netdutils::LatencyHistogram& histogram =                        \
+            ::android::netdutils::LatencyHistogram::named(name);                      \
+    const ::android::netdutils::ScopedLatencyTimer timer(histogram)
+
+}  // namespace netdutils
+}  // namespace android
+
+#endif /* NETDUTILS_LATENCY_HISTOGRAM_H */
@@ -17,11 +17,18 @@
 #ifndef NETUTILS_LOG_H
 #define NETUTILS_LOG_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
 #include <chrono>
-#include <deque>
+#include <cstdarg>
+#include <cstring>
 #include <functional>
-#include <shared_mutex>
+#include <limits>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
@@ -33,6 +40,57 @@
 namespace android {
 namespace netdutils {
 
+// Character buffer that stores up to N bytes inline and only spills to the
+// heap beyond that. Copyable, so LogEntry instances stay value types.
+template <size_t N>
+class InlineString {
+  public:
+    void append(std::string_view text) {
+        if (mOverflow.empty() && mSize + text.size() <= N) {
+            memcpy(mInline.data() + mSize, text.data(), text.size());
+            mSize += text.size();
+            return;
+        }
+        if (mOverflow.empty()) mOverflow.assign(mInline.data(), mSize);
+        mOverflow.append(text);
+    }
+
+    // Appends the decimal representation of an integer, floating point or
+    // enum value, matching std::to_string().
+    template <typename T>
+    void appendNumber(T val) {
+        if constexpr (std::is_enum_v<T>) {
+            appendNumber(static_cast<std::underlying_type_t<T>>(val));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            char buf[std::numeric_limits<T>::max_exponent10 + 20];
+            const int len = snprintf(buf, sizeof(buf), "%f", static_cast<double>(val));
+            append(std::string_view(buf, std::min<size_t>(std::max(len, 0), sizeof(buf) - 1)));
+        } else {
+            static_assert(std::is_integral_v<T>, "not a number");
+            // Digits, sign, and one more since digits10 rounds down.
+            char buf[std::numeric_limits<T>::digits10 + 2];
+            const auto result = std::to_chars(buf, buf + sizeof(buf), val);
+            append(std::string_view(buf, result.ptr - buf));
+        }
+    }
+
+    void clear() {
+        mSize = 0;
+        mOverflow.clear();
+    }
+
+    bool empty() const { return mSize == 0 && mOverflow.empty(); }
+
+    std::string_view view() const {
+        return mOverflow.empty() ? std::string_view(mInline.data(), mSize) : mOverflow;
+    }
+
+  private:
+    std::array<char, N> mInline;
+    size_t mSize = 0;
+    std::string mOverflow;
+};
+
 class LogEntry {
   public:
     LogEntry() = default;
@@ -44,26 +102,31 @@ class LogEntry {
 
     std::string toString() const;
 
+    // Append the same text as toString() to out.
+    template <size_t N>
+    void appendTo(InlineString<N>& out) const;
+
     ///
     // Helper methods that make it easy to build up a LogEntry message.
-    // If performance becomes a factor the implementations could be inlined.
+    // Each piece is serialized as it is added into a buffer held inline in
+    // the entry, so typical entries are built without heap allocations.
     ///
-    LogEntry& message(const std::string& message);
+    LogEntry& message(std::string_view message);
 
     // For calling with __FUNCTION__.
-    LogEntry& function(const std::string& function_name);
+    LogEntry& function(std::string_view function_name);
     // For calling with __PRETTY_FUNCTION__.
-    LogEntry& prettyFunction(const std::string& pretty_function);
+    LogEntry& prettyFunction(std::string_view pretty_function);
 
     // Convenience methods for each of the common types of function arguments.
-    LogEntry& arg(const std::string& val);
+    LogEntry& arg(std::string_view val);
     // Intended for binary buffers, formats as hex
     LogEntry& arg(const std::vector<uint8_t>& val);
     LogEntry& arg(const std::vector<int32_t>& val);
     LogEntry& arg(const std::vector<std::string>& val);
     template <typename IntT, typename = std::enable_if_t<std::is_arithmetic_v<IntT>>>
     LogEntry& arg(IntT val) {
-        mArgs.push_back(std::to_string(val));
+        nextArg().appendNumber(val);
         return *this;
     }
     // Not using a plain overload here to avoid the implicit conversion from
@@ -73,20 +136,20 @@ class LogEntry {
 
     template <typename... Args>
     LogEntry& args(const Args&... a) {
-        // Cleverness ahead: we throw away the initializer_list filled with
-        // zeroes, all we care about is calling arg() for each argument.
-        (void) std::initializer_list<int>{(arg(a), 0)...};
+        (arg(a), ...);
         return *this;
     }
 
     // Some things can return more than one value, or have multiple output
-    // parameters, so each of these adds to the mReturns vector.
-    LogEntry& returns(const std::string& rval);
+    // parameters, so each of these adds to the list of return values.
+    LogEntry& returns(std::string_view rval);
+    // Keeps string literals from converting to bool.
+    LogEntry& returns(const char* rval) { return returns(std::string_view(rval)); }
     LogEntry& returns(const Status& status);
     LogEntry& returns(bool rval);
-    template <class T>
+    template <class T, typename = std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>>>
     LogEntry& returns(T val) {
-        mReturns.push_back(std::to_string(val));
+        nextReturn().appendNumber(val);
         return *this;
     }
 
@@ -95,23 +158,70 @@ class LogEntry {
     // Append the duration computed since the creation of this instance.
     LogEntry& withAutomaticDuration();
     // Append the string-ified duration computed by some other means.
-    LogEntry& withDuration(const std::string& duration);
+    LogEntry& withDuration(std::string_view duration);
 
   private:
+    // Start a new comma separated element of mArgs or mReturns.
+    InlineString<128>& nextArg() {
+        if (mNumArgs++ > 0) mArgs.append(", ");
+        return mArgs;
+    }
+    InlineString<64>& nextReturn() {
+        if (mNumReturns++ > 0) mReturns.append(", ");
+        return mReturns;
+    }
+
     std::chrono::steady_clock::time_point mStart = std::chrono::steady_clock::now();
-    std::string mMsg{};
-    std::string mFunc{};
-    std::vector<std::string> mArgs{};
-    std::vector<std::string> mReturns{};
-    std::string mUid{};
-    std::string mDuration{};
+    InlineString<64> mMsg;
+    InlineString<64> mFunc;
+    InlineString<128> mArgs;
+    InlineString<64> mReturns;
+    InlineString<16> mDuration;
+    size_t mNumArgs = 0;
+    size_t mNumReturns = 0;
+    bool mHasUid = false;
+    uid_t mUid = 0;
 };
 
+template <size_t N>
+void LogEntry::appendTo(InlineString<N>& out) const {
+    bool first = true;
+    auto separate = [&out, &first]() -> InlineString<N>& {
+        if (!first) out.append(" ");
+        first = false;
+        return out;
+    };
+
+    if (!mMsg.empty()) separate().append(mMsg.view());
+    if (!mFunc.empty()) {
+        separate().append(mFunc.view());
+        out.append("(");
+        out.append(mArgs.view());
+        out.append(")");
+    }
+    if (mNumReturns > 0) {
+        separate().append("->");
+        separate().append("(");
+        out.append(mReturns.view());
+        out.append(")");
+    }
+    if (mHasUid) {
+        separate().append("(uid=");
+        out.appendNumber(mUid);
+        out.append(")");
+    }
+    if (!mDuration.empty()) {
+        separate().append("(");
+        out.append(mDuration.view());
+        out.append(")");
+    }
+}
+
 class Log {
   public:
     Log() = delete;
     Log(const std::string& tag) : Log(tag, MAX_ENTRIES) {}
-    Log(const std::string& tag, size_t maxEntries) : mTag(tag), mMaxEntries(maxEntries) {}
+    Log(const std::string& tag, size_t maxEntries);
     Log(const Log&) = delete;
     Log(Log&&) = delete;
     ~Log();
@@ -124,69 +234,63 @@ class Log {
     void log(const std::string& entry) { record(Level::LOG, entry); }
     template <size_t n>
     void log(const char entry[n]) { log(std::string(entry)); }
-    void log(const LogEntry& entry) { log(entry.toString()); }
+    void log(const LogEntry& entry) { record(Level::LOG, entry); }
     void log(const char* fmt, ...) __attribute__((__format__(__printf__, 2, 3))) {
-        using ::android::base::StringAppendV;
-        std::string result;
         va_list ap;
         va_start(ap, fmt);
-        StringAppendV(&result, fmt, ap);
+        recordv(Level::LOG, fmt, ap);
         va_end(ap);
-        log(result);
     }
 
     // Record a log entry in internal storage and to ALOGI as well.
     void info(const std::string& entry) { record(Level::INFO, entry); }
     template <size_t n>
     void info(const char entry[n]) { info(std::string(entry)); }
-    void info(const LogEntry& entry) { info(entry.toString()); }
+    void info(const LogEntry& entry) { record(Level::INFO, entry); }
     void info(const char* fmt, ...) __attribute__((__format__(__printf__, 2, 3))) {
-        using ::android::base::StringAppendV;
-        std::string result;
         va_list ap;
         va_start(ap, fmt);
-        StringAppendV(&result, fmt, ap);
+        recordv(Level::INFO, fmt, ap);
         va_end(ap);
-        info(result);
     }
 
     // Record a log entry in internal storage and to ALOGW as well.
     void warn(const std::string& entry) { record(Level::WARN, entry); }
     template <size_t n>
     void warn(const char entry[n]) { warn(std::string(entry)); }
-    void warn(const LogEntry& entry) { warn(entry.toString()); }
+    void warn(const LogEntry& entry) { record(Level::WARN, entry); }
     void warn(const char* fmt, ...) __attribute__((__format__(__printf__, 2, 3))) {
-        using ::android::base::StringAppendV;
-        std::string result;
         va_list ap;
         va_start(ap, fmt);
-        StringAppendV(&result, fmt, ap);
+        recordv(Level::WARN, fmt, ap);
         va_end(ap);
-        warn(result);
     }
 
     // Record a log entry in internal storage and to ALOGE as well.
     void error(const std::string& entry) { record(Level::ERROR, entry); }
     template <size_t n>
     void error(const char entry[n]) { error(std::string(entry)); }
-    void error(const LogEntry& entry) { error(entry.toString()); }
+    void error(const LogEntry& entry) { record(Level::ERROR, entry); }
     void error(const char* fmt, ...) __attribute__((__format__(__printf__, 2, 3))) {
-        using ::android::base::StringAppendV;
-        std::string result;
         va_list ap;
         va_start(ap, fmt);
-        StringAppendV(&result, fmt, ap);
+        recordv(Level::ERROR, fmt, ap);
         va_end(ap);
-        error(result);
     }
 
-    // Iterates over every entry in the log in chronological order. Operates
-    // on a copy of the log entries, and so perEntryFn may itself call one of
-    // the logging functions if needed.
+    // Iterates over every entry in the log in chronological order. Entries
+    // are timestamped and copied out one at a time, so perEntryFn may itself
+    // call one of the logging functions if needed. Entries written while the
+    // dump is in progress may or may not be included.
     void forEachEntry(const std::function<void(const std::string&)>& perEntryFn) const;
 
   private:
     static constexpr const size_t MAX_ENTRIES = 750U;
+    // Entries up to this length are formatted on the stack. Longer ones are
+    // formatted on the heap, so that the system log gets them in full.
+    static constexpr const size_t INLINE_ENTRY_LENGTH = 512U;
+    // Entries are kept in internal storage truncated to this length.
+    static constexpr const size_t MAX_ENTRY_LENGTH = 256U;
     const std::string mTag;
     const size_t mMaxEntries;
 
@@ -200,10 +304,22 @@ class Log {
         ERROR,
     };
 
+    // Storage for one entry. Defined in Log.cpp.
+    struct Slot;
+
     void record(Level lvl, const std::string& entry);
+    void record(Level lvl, const LogEntry& entry);
+    void recordv(Level lvl, const char* fmt, va_list ap)
+            __attribute__((__format__(__printf__, 3, 0)));
+    void commit(Level lvl, const char* text, size_t len);
 
-    mutable std::shared_mutex mLock;
-    std::deque<const std::string> mEntries;  // GUARDED_BY(mLock), when supported
+    // Entries live in a ring of mMaxEntries fixed size slots. Writers claim
+    // the next slot by incrementing mNextTicket and publish the entry with a
+    // per-slot sequence number, so neither writers nor dumps ever block or
+    // allocate. A dump discards entries that change while it copies them.
+    // Timestamps are only rendered when dumping.
+    const std::unique_ptr<Slot[]> mSlots;
+    std::atomic<uint64_t> mNextTicket{0};
 };
 
 }  // namespace netdutils
@@ -57,6 +57,16 @@ class MockSyscalls : public Syscalls {
                                                 const sockaddr* dst, socklen_t dstlen));
     MOCK_CONST_METHOD5(recvfrom, StatusOr<Slice>(Fd sock, const Slice dst, int flags, sockaddr* src,
                                                  socklen_t* srclen));
+    MOCK_CONST_METHOD4(recvmmsg, StatusOr<unsigned int>(Fd sock, mmsghdr* msgs, unsigned int vlen,
+                                                        int flags));
+    // Use Return(ByMove(...)) to deal with movable return types.
+    MOCK_CONST_METHOD4(datagramReceiver,
+                       StatusOr<std::unique_ptr<DatagramReceiver>>(
+                               Fd sock, size_t bufferSize, unsigned int bufferCount,
+                               bool preferIoUring));
+    // Use Invoke(&mock, &MockSyscalls::submitSequentially) to route batched
+    // operations to the mocks of the individual system calls.
+    MOCK_CONST_METHOD1(submit, std::vector<StatusOr<size_t>>(const SyscallBatch& batch));
     MOCK_CONST_METHOD2(shutdown, Status(Fd fd, int how));
     MOCK_CONST_METHOD1(close, Status(Fd fd));
 
@@ -17,10 +17,16 @@
 #ifndef NETUTILS_NETLINK_H
 #define NETUTILS_NETLINK_H
 
+#include <algorithm>
+#include <array>
+#include <bitset>
 #include <functional>
+#include <optional>
 #include <ostream>
+#include <type_traits>
 #include <linux/netlink.h>
 
+#include "netdutils/Math.h"
 #include "netdutils/Slice.h"
 
 namespace android {
@@ -42,6 +48,133 @@ void forEachNetlinkMessage(const Slice buf,
 void forEachNetlinkAttribute(const Slice buf,
                              const std::function<void(const nlattr&, const Slice)>& onAttr);
 
+// Same as forEachNetlinkMessage(), but onMsg is invoked directly rather
+// than through a std::function, so it can be inlined into the loop.
+template <typename OnMsg>
+inline void visitNetlinkMessages(const Slice buf, OnMsg&& onMsg) {
+    Slice tail = buf;
+    while (tail.size() >= sizeof(nlmsghdr)) {
+        nlmsghdr hdr = {};
+        extract(tail, hdr);
+        const auto len = std::max<size_t>(hdr.nlmsg_len, sizeof(hdr));
+        onMsg(hdr, drop(take(tail, len), sizeof(hdr)));
+        tail = drop(tail, align(len, 2));
+    }
+}
+
+// Same as forEachNetlinkAttribute(), but onAttr is invoked directly rather
+// than through a std::function, so it can be inlined into the loop.
+template <typename OnAttr>
+inline void visitNetlinkAttributes(const Slice buf, OnAttr&& onAttr) {
+    Slice tail = buf;
+    while (tail.size() >= sizeof(nlattr)) {
+        nlattr hdr = {};
+        extract(tail, hdr);
+        const auto len = std::max<size_t>(hdr.nla_len, sizeof(hdr));
+        onAttr(hdr, drop(take(tail, len), sizeof(hdr)));
+        tail = drop(tail, align(len, 2));
+    }
+}
+
+// Declares that attributes of type Type carry a T. Use Slice for variable
+// length payloads such as strings and nested attributes.
+template <uint16_t Type, typename T>
+struct NetlinkAttributeSpec {
+    static constexpr uint16_t type = Type;
+    using value_type = T;
+    static_assert(std::is_same_v<T, Slice> || std::is_trivially_copyable_v<T>,
+                  "value_type must be Slice or trivially copyable");
+    // Shortest valid payload.
+    static constexpr size_t minLength = std::is_same_v<T, Slice> ? 0 : sizeof(T);
+};
+
+// Indexed view of a buffer of netlink attributes, built in a single pass
+// according to a compile-time table of NetlinkAttributeSpecs. For example:
+//
+//     using LinkAttributes = NetlinkAttributes<
+//             NetlinkAttributeSpec<IFLA_IFNAME, Slice>,
+//             NetlinkAttributeSpec<IFLA_MTU, uint32_t>>;
+//     const LinkAttributes attrs(drop(payload, NLMSG_ALIGN(sizeof(ifinfomsg))));
+//     if (auto mtu = attrs.get<IFLA_MTU>()) ...
+//
+// Attributes not in the table and attributes shorter than their spec
+// requires are ignored. If a type occurs more than once, the last one
+// wins, as in the kernel's nla_parse(). Lookups are O(1) and the view
+// refers to, rather than copies, the underlying buffer.
+template <typename... Specs>
+class NetlinkAttributes {
+  public:
+    static_assert(sizeof...(Specs) > 0, "empty attribute table");
+    static constexpr uint16_t kMaxType = std::max({Specs::type...});
+
+    explicit NetlinkAttributes(const Slice buf) {
+        visitNetlinkAttributes(buf, [this](const nlattr& attr, const Slice payload) {
+            const uint16_t type = attr.nla_type & NLA_TYPE_MASK;
+            if (type > kMaxType || !kKnown[type] || payload.size() < kMinLength[type]) return;
+            mPresent.set(type);
+            mPayloads[type] = payload;
+        });
+    }
+
+    template <uint16_t Type>
+    bool has() const {
+        static_assert(isKnown(Type), "attribute type not in table");
+        return mPresent.test(Type);
+    }
+
+    // Raw payload of the attribute, or an empty Slice if absent.
+    template <uint16_t Type>
+    Slice raw() const {
+        static_assert(isKnown(Type), "attribute type not in table");
+        return mPayloads[Type];
+    }
+
+    // Value of the attribute as declared in its spec, or std::nullopt if
+    // absent. Fixed-size values are copied out, so unaligned attributes
+    // are safe to read.
+    template <uint16_t Type>
+    auto get() const {
+        using T = typename SpecFor<Type, Specs...>::value_type;
+        if (!has<Type>()) return std::optional<T>();
+        if constexpr (std::is_same_v<T, Slice>) {
+            return std::optional<T>(mPayloads[Type]);
+        } else {
+            T value;
+            extract(mPayloads[Type], value);
+            return std::optional<T>(value);
+        }
+    }
+
+  private:
+    template <uint16_t Type, typename Head, typename... Tail>
+    struct SpecFor {
+        using value_type = typename std::conditional_t<Head::type == Type, Head,
+                                                       SpecFor<Type, Tail...>>::value_type;
+    };
+    template <uint16_t Type, typename Head>
+    struct SpecFor<Type, Head> {
+        static_assert(Head::type == Type, "attribute type not in table");
+        using value_type = typename Head::value_type;
+    };
+
+    static constexpr bool isKnown(uint16_t type) { return ((Specs::type == type) || ...); }
+
+    static constexpr std::array<bool, kMaxType + 1> kKnown = [] {
+        std::array<bool, kMaxType + 1> known{};
+        ((known[Specs::type] = true), ...);
+        return known;
+    }();
+
+    static constexpr std::array<size_t, kMaxType + 1> kMinLength = [] {
+        std::array<size_t, kMaxType + 1> minLength{};
+        ((minLength[Specs::type] = Specs::minLength), ...);
+        return minLength;
+    }();
+
+    std::bitset<kMaxType + 1> mPresent;
+    std::array<Slice, kMaxType + 1> mPayloads;
+};
+
 }  // namespace netdutils
 }  // namespace android
 
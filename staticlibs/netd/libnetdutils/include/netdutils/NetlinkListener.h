@@ -17,12 +17,16 @@
 #ifndef NETLINK_LISTENER_H
 #define NETLINK_LISTENER_H
 
+#include <atomic>
 #include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <thread>
 
 #include <android-base/thread_annotations.h>
+#include <netdutils/DatagramReceiver.h>
+#include <netdutils/LatencyHistogram.h>
 #include <netdutils/Netlink.h>
 #include <netdutils/Slice.h>
 #include <netdutils/Status.h>
@@ -65,18 +69,57 @@ class NetlinkListenerInterface {
 // no drops) they may share a single listener by calling subscribe()
 // with multiple types.
 //
-// This class is suitable for moderate performance message
-// processing. In particular it avoids extra copies of received
-// message data and allows client code to control which message
-// attributes are processed.
+// With the default Options this class is suitable for moderate
+// performance message processing. In particular it avoids extra copies
+// of received message data and allows client code to control which
+// message attributes are processed.
 //
 // Note that NetlinkListener is capable of processing multiple batched
 // netlink messages in a single system call. This is useful to
 // netfilter extensions that allow batching of events like NFLOG.
+//
+// Subscribers that see bursts of thousands of messages (sock_diag
+// destroy events, route changes) should construct the listener with
+// highThroughputOptions(), which drains several large receive buffers
+// per wakeup.
+//
+// Message dispatch never takes a lock: the service thread reads an
+// immutable per-type dispatch table that subscribe() and unsubscribe()
+// replace RCU-style, waiting for in-flight dispatch to finish before
+// freeing the old table.
 class NetlinkListener : public NetlinkListenerInterface {
   public:
+    struct Options {
+        // Size of each receive buffer. Rounded up to a multiple of the page size.
+        size_t rxBufferSize = 4096;
+
+        // Maximum number of datagrams received per wakeup.
+        unsigned int rxBatchSize = 1;
+
+        // Receive through an io_uring multishot recv into a ring of
+        // rxBatchSize buffers, so event storms cost no system call per
+        // datagram. Falls back to recvmmsg() where io_uring is unavailable.
+        bool ioUring = false;
+
+        // Set NETLINK_NO_ENOBUFS on the socket. The kernel then drops messages
+        // on receive buffer overrun without reporting ENOBUFS, so neither the
+        // SkErrorHandler nor the ResyncHandler is invoked for lost messages.
+        bool noEnobufs = false;
+    };
+
+    // Invoked on the service thread after the kernel reported that messages
+    // were dropped (ENOBUFS). Subscribers mirroring kernel state should
+    // re-dump it, since any number of events may have been lost.
+    using ResyncHandler = std::function<void()>;
+
+    // Options for listeners expected to handle event storms.
+    static Options highThroughputOptions();
+
     NetlinkListener(netdutils::UniqueFd event, netdutils::UniqueFd sock, const std::string& name);
 
+    NetlinkListener(netdutils::UniqueFd event, netdutils::UniqueFd sock, const std::string& name,
+                    const Options& options);
+
     ~NetlinkListener() override;
 
     netdutils::Status send(const netdutils::Slice msg) override;
@@ -87,16 +130,36 @@ class NetlinkListener : public NetlinkListenerInterface {
 
     void registerSkErrorHandler(const SkErrorHandler& handler) override;
 
+    void registerResyncHandler(const ResyncHandler& handler);
+
   private:
+    struct DispatchTable;
+
     netdutils::Status run();
 
+    // Drain one batch of datagrams from receiver and dispatch them.
+    void receive(netdutils::DatagramReceiver& receiver);
+
+    // Publish a new snapshot of mDispatchMap to the service thread.
+    void publishDispatchTableLocked() REQUIRES(mMutex);
+
     const netdutils::UniqueFd mEvent;
     const netdutils::UniqueFd mSock;
     const std::string mThreadName;
+    const Options mOptions;
     std::mutex mMutex;
     std::map<uint16_t, DispatchFn> mDispatchMap GUARDED_BY(mMutex);
+    // Owns the table currently published through mDispatchSnapshot.
+    std::unique_ptr<const DispatchTable> mDispatchTable GUARDED_BY(mMutex);
+    std::atomic<const DispatchTable*> mDispatchSnapshot{nullptr};
+    // Incremented on entry to and exit from dispatch(), so it is odd while
+    // the service thread may hold a pointer obtained from mDispatchSnapshot.
+    std::atomic<uint64_t> mDispatchSeq{0};
+    // Time taken to dispatch the messages of each datagram.
+    netdutils::LatencyHistogram& mDispatchLatency;
     std::thread mWorker;
     SkErrorHandler mErrorHandler;
+    ResyncHandler mResyncHandler;
 };
 
 }  // namespace netdutils
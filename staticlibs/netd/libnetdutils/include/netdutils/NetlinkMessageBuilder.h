@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETUTILS_NETLINK_MESSAGE_BUILDER_H
+#define NETUTILS_NETLINK_MESSAGE_BUILDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include <linux/netlink.h>
+#include <sys/uio.h>
+
+#include "netdutils/MemBlock.h"
+#include "netdutils/Slice.h"
+
+namespace android {
+namespace netdutils {
+
+// Assembles a single netlink message as a list of iovecs suitable for
+// writev() or sendmsg(), without first copying it into one contiguous
+// buffer.
+//
+// Headers and small values are copied into storage owned by the builder.
+// Payloads added through the *Ref() methods are referenced in place and
+// must outlive the returned iovecs. Attribute padding is inserted as
+// needed, and the length of the message and of nested attributes is
+// patched in once their contents are known.
+//
+// By default, storage is allocated from the heap in chunks. Alternatively,
+// the builder can carve storage out of a caller-provided arena, such as a
+// stack buffer. If the arena is too small, the builder fails and finish()
+// returns no iovecs.
+//
+// Header-only, so that it can be used by modules that cannot link against
+// libnetdutils.
+//
+// No thread-safety guarantees whatsoever.
+class NetlinkMessageBuilder {
+  public:
+    // Handle to a nested attribute, to be passed to endNested().
+    struct Nest {
+        nlattr* attr;
+        size_t start;
+    };
+
+    NetlinkMessageBuilder(uint16_t type, uint16_t flags)
+        : NetlinkMessageBuilder(type, flags, Slice(), true) {}
+
+    NetlinkMessageBuilder(uint16_t type, uint16_t flags, Slice arena)
+        : NetlinkMessageBuilder(type, flags, arena, false) {}
+
+    NetlinkMessageBuilder(const NetlinkMessageBuilder&) = delete;
+    NetlinkMessageBuilder& operator=(const NetlinkMessageBuilder&) = delete;
+
+    // Append a copy of a fixed-size header, such as tcmsg or ifaddrmsg.
+    template <typename T>
+    NetlinkMessageBuilder& append(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "value must be trivially copyable");
+        const Slice dst = allocate(sizeof(value));
+        memcpy(dst.base(), &value, std::min(dst.size(), sizeof(value)));
+        return *this;
+    }
+
+    // Append bytes by reference, padded to netlink alignment.
+    NetlinkMessageBuilder& appendRef(const Slice payload) {
+        reference(payload);
+        pad(payload.size());
+        return *this;
+    }
+
+    // Add an attribute holding a copy of value.
+    template <typename T>
+    NetlinkMessageBuilder& addAttr(uint16_t type, const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>, "value must be trivially copyable");
+        static_assert(sizeof(value) <= UINT16_MAX - NLA_HDRLEN, "value too large");
+        const Slice dst = allocate(NLA_HDRLEN + sizeof(value));
+        if (dst.empty()) return *this;
+        const nlattr hdr = {.nla_len = static_cast<uint16_t>(NLA_HDRLEN + sizeof(value)),
+                            .nla_type = type};
+        memcpy(dst.base(), &hdr, sizeof(hdr));
+        memcpy(dst.base() + NLA_HDRLEN, &value, sizeof(value));
+        return *this;
+    }
+
+    // Add an attribute referencing payload in place.
+    NetlinkMessageBuilder& addAttrRef(uint16_t type, const Slice payload) {
+        if (payload.size() > UINT16_MAX - NLA_HDRLEN) {
+            mFailed = true;
+            return *this;
+        }
+        const Slice dst = allocate(NLA_HDRLEN);
+        if (dst.empty()) return *this;
+        const nlattr hdr = {.nla_len = static_cast<uint16_t>(NLA_HDRLEN + payload.size()),
+                            .nla_type = type};
+        memcpy(dst.base(), &hdr, sizeof(hdr));
+        return appendRef(payload);
+    }
+
+    // Add a NUL-terminated string attribute referencing str in place.
+    NetlinkMessageBuilder& addAttrString(uint16_t type, const char* str) {
+        return addAttrRef(type, Slice(const_cast<char*>(str), strlen(str) + 1));
+    }
+
+    // Open a nested attribute. Attributes added until the matching
+    // endNested() call are contained in it.
+    Nest beginNested(uint16_t type) {
+        const size_t start = mLength;
+        const Slice dst = allocate(NLA_HDRLEN);
+        if (dst.empty()) return {nullptr, start};
+        nlattr* attr = reinterpret_cast<nlattr*>(dst.base());
+        attr->nla_type = NLA_F_NESTED | type;
+        return {attr, start};
+    }
+
+    void endNested(const Nest& nest) {
+        if (nest.attr == nullptr) return;
+        const size_t len = mLength - nest.start;
+        if (len > UINT16_MAX) {
+            mFailed = true;
+            return;
+        }
+        nest.attr->nla_len = len;
+    }
+
+    // Total length of the message so far, including padding.
+    size_t size() const { return mLength; }
+
+    // Patch the message length and return the iovecs making up the
+    // message, or an empty vector if the message could not be built.
+    // The iovecs remain valid until the builder is destroyed.
+    const std::vector<iovec>& finish() {
+        if (mFailed || mLength > UINT32_MAX) {
+            mIov.clear();
+            mFailed = true;
+            return mIov;
+        }
+        mHeader->nlmsg_len = mLength;
+        return mIov;
+    }
+
+  private:
+    // Storage chunks are sized so that typical requests fit in one.
+    static constexpr size_t kChunkSize = 256;
+
+    NetlinkMessageBuilder(uint16_t type, uint16_t flags, Slice arena, bool ownsStorage)
+        : mOwnsStorage(ownsStorage), mFree(arena) {
+        const Slice dst = allocate(sizeof(nlmsghdr));
+        if (dst.empty()) return;
+        mHeader = reinterpret_cast<nlmsghdr*>(dst.base());
+        mHeader->nlmsg_type = type;
+        mHeader->nlmsg_flags = flags;
+    }
+
+    // Return size bytes of zeroed storage at the end of the message,
+    // extended to netlink alignment. Return an empty Slice on failure.
+    Slice allocate(size_t size) {
+        size = NLMSG_ALIGN(size);
+        if (mFailed) return {};
+        if (mFree.size() < size) {
+            if (!mOwnsStorage) {
+                mFailed = true;
+                return {};
+            }
+            mChunks.emplace_back(std::max(size, kChunkSize));
+            mFree = mChunks.back().get();
+        }
+        const Slice dst = take(mFree, size);
+        mFree = drop(mFree, size);
+        memset(dst.base(), 0, dst.size());
+        reference(dst);
+        return dst;
+    }
+
+    void reference(const Slice payload) {
+        if (mFailed || payload.empty()) return;
+        mLength += payload.size();
+        // Coalesce with the previous iovec if the memory is contiguous,
+        // which is the common case for consecutive copied values.
+        if (!mIov.empty()) {
+            iovec& last = mIov.back();
+            if (static_cast<uint8_t*>(last.iov_base) + last.iov_len == payload.base()) {
+                last.iov_len += payload.size();
+                return;
+            }
+        }
+        mIov.push_back({.iov_base = payload.base(), .iov_len = payload.size()});
+    }
+
+    void pad(size_t size) {
+        static const uint8_t kPadding[NLA_ALIGNTO] = {};
+        const size_t padding = NLA_ALIGN(size) - size;
+        if (padding > 0) reference(Slice(const_cast<uint8_t*>(kPadding), padding));
+    }
+
+    nlmsghdr* mHeader = nullptr;
+    std::vector<iovec> mIov;
+    size_t mLength = 0;
+    bool mFailed = false;
+
+    const bool mOwnsStorage;
+    // Unused part of the current chunk or of the arena.
+    Slice mFree;
+    std::vector<MemBlock> mChunks;
+};
+
+}  // namespace netdutils
+}  // namespace android
+
+#endif /* NETUTILS_NETLINK_MESSAGE_BUILDER_H */
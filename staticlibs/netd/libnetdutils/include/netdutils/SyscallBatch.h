@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETUTILS_SYSCALL_BATCH_H
+#define NETUTILS_SYSCALL_BATCH_H
+
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "netdutils/Fd.h"
+#include "netdutils/Slice.h"
+#include "netdutils/Socket.h"
+#include "netdutils/StatusOr.h"
+
+namespace android {
+namespace netdutils {
+
+class Syscalls;
+
+// A list of independent system calls to be run together by
+// Syscalls::submit(), which returns one result per operation in the order
+// they were queued.
+//
+// Buffers, iovecs, addresses and option values are referenced, not copied,
+// and must remain valid until submit() returns. Operations may run in any
+// order and concurrently with each other, so a batch must not contain
+// operations that depend on one another, such as a setsockopt() that must
+// take effect before a sendto() on the same socket.
+//
+// No thread-safety guarantees whatsoever.
+class SyscallBatch {
+  public:
+    enum class Type {
+        WRITE,
+        WRITEV,
+        READ,
+        SENDTO,
+        RECVFROM,
+        SETSOCKOPT,
+    };
+
+    // Arguments of one queued operation. Only the fields used by type are set.
+    struct Op {
+        Type type;
+        Fd fd;
+        Slice buf;
+        const iovec* iov = nullptr;
+        size_t iovcnt = 0;
+        int flags = 0;
+        const sockaddr* dst = nullptr;
+        socklen_t dstlen = 0;
+        sockaddr* src = nullptr;
+        socklen_t* srclen = nullptr;
+        int level = 0;
+        int optname = 0;
+        const void* optval = nullptr;
+        socklen_t optlen = 0;
+    };
+
+    // Each method queues an operation and returns its index in the results.
+    // Results are the number of bytes transferred, or 0 for setsockopt().
+
+    size_t write(Fd fd, const Slice buf) {
+        return queue({.type = Type::WRITE, .fd = fd, .buf = buf});
+    }
+
+    size_t writev(Fd fd, const std::vector<iovec>& iov) {
+        return queue({.type = Type::WRITEV, .fd = fd, .iov = iov.data(), .iovcnt = iov.size()});
+    }
+
+    size_t read(Fd fd, const Slice buf) {
+        return queue({.type = Type::READ, .fd = fd, .buf = buf});
+    }
+
+    size_t sendto(Fd sock, const Slice buf, int flags, const sockaddr* dst, socklen_t dstlen) {
+        return queue({.type = Type::SENDTO,
+                      .fd = sock,
+                      .buf = buf,
+                      .flags = flags,
+                      .dst = dst,
+                      .dstlen = dstlen});
+    }
+
+    // Like Syscalls::recvfrom(), an orderly shutdown by the peer is
+    // reported as status::eof.
+    size_t recvfrom(Fd sock, const Slice dst, int flags, sockaddr* src, socklen_t* srclen) {
+        return queue({.type = Type::RECVFROM,
+                      .fd = sock,
+                      .buf = dst,
+                      .flags = flags,
+                      .src = src,
+                      .srclen = srclen});
+    }
+
+    size_t setsockopt(Fd sock, int level, int optname, const void* optval, socklen_t optlen) {
+        return queue({.type = Type::SETSOCKOPT,
+                      .fd = sock,
+                      .level = level,
+                      .optname = optname,
+                      .optval = optval,
+                      .optlen = optlen});
+    }
+
+    // Templated helpers that forward directly to methods declared above
+    template <typename SockaddrT>
+    size_t sendto(Fd sock, const Slice buf, int flags, const SockaddrT& dst) {
+        return sendto(sock, buf, flags, asSockaddrPtr(&dst), sizeof(dst));
+    }
+
+    template <typename SockoptT>
+    size_t setsockopt(Fd sock, int level, int optname, const SockoptT& opt) {
+        return setsockopt(sock, level, optname, &opt, sizeof(opt));
+    }
+
+    const std::vector<Op>& ops() const { return mOps; }
+    size_t size() const { return mOps.size(); }
+    bool empty() const { return mOps.empty(); }
+    void clear() { mOps.clear(); }
+
+  private:
+    size_t queue(const Op& op) {
+        mOps.push_back(op);
+        return mOps.size() - 1;
+    }
+
+    std::vector<Op> mOps;
+};
+
+// io_uring backend for Syscalls::submit(). The process keeps one ring
+// between batches; concurrent callers get temporary rings. Operations the kernel cannot run through io_uring go
+// through fallback one at a time. Fails without running anything if
+// io_uring is not available. Most code should call Syscalls::submit()
+// instead so tests can substitute MockSyscalls.
+StatusOr<std::vector<StatusOr<size_t>>> submitIoUringBatch(const SyscallBatch& batch,
+                                                           const Syscalls& fallback);
+
+}  // namespace netdutils
+}  // namespace android
+
+#endif /* NETUTILS_SYSCALL_BATCH_H */
@@ -18,6 +18,7 @@
 #define NETDUTILS_SYSCALLS_H
 
 #include <memory>
+#include <vector>
 
 #include <net/if.h>
 #include <poll.h>
@@ -27,11 +28,13 @@
 #include <sys/uio.h>
 #include <unistd.h>
 
+#include "netdutils/DatagramReceiver.h"
 #include "netdutils/Fd.h"
 #include "netdutils/Slice.h"
 #include "netdutils/Socket.h"
 #include "netdutils/Status.h"
 #include "netdutils/StatusOr.h"
+#include "netdutils/SyscallBatch.h"
 #include "netdutils/UniqueFd.h"
 #include "netdutils/UniqueFile.h"
 
@@ -77,6 +80,25 @@ class Syscalls {
     virtual StatusOr<Slice> recvfrom(Fd sock, const Slice dst, int flags, sockaddr* src,
                                      socklen_t* srclen) const = 0;
 
+    // Receive up to vlen datagrams in a single system call. Returns the
+    // number of entries of msgs that were filled in.
+    virtual StatusOr<unsigned int> recvmmsg(Fd sock, mmsghdr* msgs, unsigned int vlen,
+                                            int flags) const = 0;
+
+    // Return a receiver that drains datagrams from sock into bufferCount
+    // buffers of at least bufferSize bytes. If preferIoUring is set and the
+    // kernel and SELinux policy allow it, datagrams are received through an
+    // io_uring multishot recv. Otherwise, or if that fails, via recvmmsg().
+    virtual StatusOr<std::unique_ptr<DatagramReceiver>> datagramReceiver(
+            Fd sock, size_t bufferSize, unsigned int bufferCount, bool preferIoUring) const = 0;
+
+    // Run every operation queued in batch and return one result per
+    // operation, in the order they were queued. If the kernel and SELinux
+    // policy allow it, operations are handed to the kernel together through
+    // io_uring, so a batch costs one or a few system calls. Otherwise they
+    // run one at a time as in submitSequentially().
+    virtual std::vector<StatusOr<size_t>> submit(const SyscallBatch& batch) const = 0;
+
     virtual Status shutdown(Fd fd, int how) const = 0;
 
     virtual Status close(Fd fd) const = 0;
@@ -112,6 +134,14 @@ class Syscalls {
         return result;
     }
 
+    // Run one batched operation through the matching method above.
+    StatusOr<size_t> submitOne(const SyscallBatch::Op& op) const;
+
+    // Run batch one operation at a time through submitOne(). Tests using
+    // MockSyscalls can have submit() invoke this, so that batched operations
+    // reach the expectations set on individual system calls.
+    std::vector<StatusOr<size_t>> submitSequentially(const SyscallBatch& batch) const;
+
     // Templated helpers that forward directly to methods declared above
     template <typename SockaddrT>
     StatusOr<SockaddrT> getsockname(Fd sock) const {
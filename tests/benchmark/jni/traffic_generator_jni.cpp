@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DataPathBenchmark"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <jni.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <initializer_list>
+#include <vector>
+
+#include <android/log.h>
+
+#define LOGE(fmt, ...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, fmt, ##__VA_ARGS__)
+
+namespace {
+
+constexpr int64_t kNsPerSec = 1000000000LL;
+// Number of datagrams fetched per recvmmsg() call.
+constexpr int kReceiveBatch = 64;
+// Larger than any packet the benchmark generates; MSG_TRUNC reports the real size anyway.
+constexpr size_t kReceiveBufferSize = 2048;
+
+int64_t nowNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * kNsPerSec + ts.tv_nsec;
+}
+
+void throwIOException(JNIEnv* env, const char* what, int err) {
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s: %s", what, strerror(err));
+    env->ThrowNew(env->FindClass("java/io/IOException"), msg);
+}
+
+jlongArray toLongArray(JNIEnv* env, std::initializer_list<jlong> values) {
+    jlongArray array = env->NewLongArray(values.size());
+    if (array == nullptr) return nullptr;
+    env->SetLongArrayRegion(array, 0, values.size(), values.begin());
+    return array;
+}
+
+}  // namespace
+
+// Writes packet to the tun fd count times, paced to ratePps packets per second (as fast as
+// possible if ratePps <= 0). Pacing uses absolute deadlines, so a late start catches up with a
+// burst instead of drifting. Writes the tun queue refuses are counted as dropped.
+// Returns {written, dropped, elapsedNs, threadCpuNs}.
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_android_net_datapath_benchmarktests_TrafficGenerator_nativeInject(
+        JNIEnv* env, jclass /* clazz */, jint fd, jbyteArray jpacket, jlong count, jint ratePps) {
+    const jsize len = env->GetArrayLength(jpacket);
+    std::vector<uint8_t> packet(len);
+    env->GetByteArrayRegion(jpacket, 0, len, reinterpret_cast<jbyte*>(packet.data()));
+
+    const int64_t intervalNs = ratePps > 0 ? kNsPerSec / ratePps : 0;
+    jlong written = 0;
+    jlong dropped = 0;
+    const int64_t cpuStart = nowNs(CLOCK_THREAD_CPUTIME_ID);
+    const int64_t start = nowNs(CLOCK_MONOTONIC);
+    for (jlong i = 0; i < count; i++) {
+        if (intervalNs > 0) {
+            const int64_t deadline = start + i * intervalNs;
+            if (nowNs(CLOCK_MONOTONIC) < deadline) {
+                const struct timespec ts = {
+                        .tv_sec = static_cast<time_t>(deadline / kNsPerSec),
+                        .tv_nsec = static_cast<long>(deadline % kNsPerSec),
+                };
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+            }
+        }
+        const ssize_t n = write(fd, packet.data(), packet.size());
+        if (n == static_cast<ssize_t>(packet.size())) {
+            written++;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+            dropped++;
+        } else {
+            throwIOException(env, "write", n < 0 ? errno : EIO);
+            return nullptr;
+        }
+    }
+    const int64_t elapsed = nowNs(CLOCK_MONOTONIC) - start;
+    const int64_t cpu = nowNs(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+    return toLongArray(env, {written, dropped, elapsed, cpu});
+}
+
+// Receives datagrams from a socket until expected of them have arrived or none arrived for
+// idleTimeoutMs. Returns {packets, bytes, elapsedNs between the first and the last packet,
+// threadCpuNs}.
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_android_net_datapath_benchmarktests_TrafficGenerator_nativeReceive(
+        JNIEnv* env, jclass /* clazz */, jint fd, jlong expected, jint idleTimeoutMs) {
+    std::vector<uint8_t> buffers(kReceiveBatch * kReceiveBufferSize);
+    struct iovec iovs[kReceiveBatch];
+    struct mmsghdr msgs[kReceiveBatch];
+    for (int i = 0; i < kReceiveBatch; i++) {
+        iovs[i] = {buffers.data() + i * kReceiveBufferSize, kReceiveBufferSize};
+        msgs[i] = {};
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    jlong packets = 0;
+    jlong bytes = 0;
+    int64_t first = 0;
+    int64_t last = 0;
+    const int64_t cpuStart = nowNs(CLOCK_THREAD_CPUTIME_ID);
+    while (packets < expected) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        const int ready = poll(&pfd, 1, idleTimeoutMs);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            throwIOException(env, "poll", errno);
+            return nullptr;
+        }
+        if (ready == 0) break;
+
+        const int n = recvmmsg(fd, msgs, kReceiveBatch, MSG_DONTWAIT | MSG_TRUNC, nullptr);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+            throwIOException(env, "recvmmsg", errno);
+            return nullptr;
+        }
+        last = nowNs(CLOCK_MONOTONIC);
+        if (packets == 0) first = last;
+        packets += n;
+        for (int i = 0; i < n; i++) bytes += msgs[i].msg_len;
+    }
+    const int64_t cpu = nowNs(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+    return toLongArray(env, {packets, bytes, last - first, cpu});
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package android.net.datapath.benchmarktests
+
+import android.Manifest.permission.MANAGE_TEST_NETWORKS
+import android.net.ConnectivityManager
+import android.net.InetAddresses
+import android.net.IpPrefix
+import android.net.LinkAddress
+import android.net.LinkProperties
+import android.net.Network
+import android.net.NetworkCapabilities
+import android.net.NetworkRequest
+import android.net.TestNetworkInterface
+import android.net.TestNetworkManager
+import android.net.TestNetworkSpecifier
+import android.os.Binder
+import android.os.Build
+import android.os.Bundle
+import android.system.Os
+import android.system.OsConstants.AF_INET
+import android.system.OsConstants.AF_INET6
+import android.system.OsConstants.IPPROTO_ICMP
+import android.system.OsConstants.IPPROTO_UDP
+import android.system.OsConstants.POLLIN
+import android.system.OsConstants.SOCK_DGRAM
+import android.system.OsConstants.SOL_SOCKET
+import android.system.OsConstants.SO_RCVBUF
+import android.system.StructPollfd
+import android.util.Log
+import androidx.test.platform.app.InstrumentationRegistry
+import com.android.testutils.DevSdkIgnoreRule.IgnoreUpTo
+import com.android.testutils.DevSdkIgnoreRunner
+import com.android.testutils.RecorderCallback.CallbackEntry.Available
+import com.android.testutils.RecorderCallback.CallbackEntry.LinkPropertiesChanged
+import com.android.testutils.TestableNetworkCallback
+import com.android.testutils.runAsShell
+import java.io.FileDescriptor
+import java.net.Inet4Address
+import java.net.Inet6Address
+import java.net.InetAddress
+import java.net.InetSocketAddress
+import kotlin.concurrent.thread
+import kotlin.test.assertTrue
+import kotlin.test.fail
+import libcore.io.IoUtils
+import org.junit.After
+import org.junit.Before
+import org.junit.Test
+import org.junit.runner.RunWith
+
+private const val TAG = "DataPathBenchmarkTest"
+
+// Instrumentation arguments, e.g. "-e packetRates 10000,0 -e packetSizes 100,1280".
+// A rate of 0 injects as fast as possible.
+private const val ARG_PACKET_RATES = "packetRates"
+private const val ARG_PACKET_SIZES = "packetSizes"
+private const val ARG_PACKETS_PER_RUN = "packetsPerRun"
+private const val DEFAULT_PACKET_RATES = "10000,50000,0"
+private const val DEFAULT_PACKET_SIZES = "100,576,1280"
+private const val DEFAULT_PACKETS_PER_RUN = 20000L
+
+private const val MTU = 1500
+private const val RECEIVE_BUFFER_SIZE = 4 * 1024 * 1024
+private const val RECEIVE_IDLE_TIMEOUT_MS = 1000
+private const val REMOTE_PORT = 9999
+private const val DISCARD_PORT = 9
+
+/**
+ * End-to-end, network-free benchmark of the receive data path.
+ *
+ * Brings up an IPv6-only test network on a tun interface, with a NAT64 prefix in its link
+ * properties so that ConnectivityService starts clat on it. Packets built up front are injected
+ * into the tun fd from native code at configurable rates and sizes, and read from a socket on
+ * the other end of the path being measured:
+ *  - native IPv6 UDP: tc ingress and the cgroup ingress program.
+ *  - clat UDP: additionally translated by the clat ingress6 tc program.
+ *  - clat ICMP: ICMPv6 is not offloaded, so clatd translates it and writes it to the v4- tun.
+ *
+ * For each run, throughput, drop rate and CPU time per packet are reported as instrumentation
+ * status. CPU time is that of the injecting and receiving threads, which includes the softirq
+ * work the kernel does on their behalf, but not the time spent in clatd.
+ */
+@RunWith(DevSdkIgnoreRunner::class)
+@IgnoreUpTo(Build.VERSION_CODES.TIRAMISU)
+class DataPathBenchmarkTest {
+    private val LOCAL_V6ADDR = LinkAddress(InetAddresses.parseNumericAddress("2001:db8::1234"), 64)
+    private val REMOTE_V6ADDR = InetAddresses.parseNumericAddress("2001:db8:1::1") as Inet6Address
+    private val NAT64_PREFIX = IpPrefix("64:ff9b::/96")
+    private val REMOTE_V4ADDR = InetAddresses.parseNumericAddress("8.8.8.8") as Inet4Address
+    private val REMOTE_V4ADDR_NAT64 =
+        InetAddresses.parseNumericAddress("64:ff9b::808:808") as Inet6Address
+
+    private val inst = InstrumentationRegistry.getInstrumentation()
+    private val context = inst.context
+    private val cm = context.getSystemService(ConnectivityManager::class.java)!!
+    private val tnm = context.getSystemService(TestNetworkManager::class.java)!!
+    private val args = InstrumentationRegistry.getArguments()
+    private val packetRates = parseInts(args.getString(ARG_PACKET_RATES, DEFAULT_PACKET_RATES))
+    private val packetSizes = parseInts(args.getString(ARG_PACKET_SIZES, DEFAULT_PACKET_SIZES))
+    private val packetsPerRun =
+        args.getString(ARG_PACKETS_PER_RUN)?.toLong() ?: DEFAULT_PACKETS_PER_RUN
+
+    private val binder = Binder()
+    private lateinit var tunIface: TestNetworkInterface
+    private lateinit var tunFd: FileDescriptor
+    private lateinit var networkCallback: TestableNetworkCallback
+    private lateinit var network: Network
+    private lateinit var clatV4: Inet4Address
+    private lateinit var clatV6: Inet6Address
+
+    private fun parseInts(list: String) = list.split(',').map { it.trim().toInt() }
+
+    @Before
+    fun setUp() {
+        runAsShell(MANAGE_TEST_NETWORKS) {
+            tunIface = tnm.createTunInterface(listOf(LOCAL_V6ADDR))
+            tunFd = tunIface.fileDescriptor.fileDescriptor
+            val nr = NetworkRequest.Builder()
+                .clearCapabilities()
+                .addTransportType(NetworkCapabilities.TRANSPORT_TEST)
+                .setNetworkSpecifier(TestNetworkSpecifier(tunIface.interfaceName))
+                .build()
+            networkCallback = TestableNetworkCallback()
+            cm.requestNetwork(nr, networkCallback)
+            val lp = LinkProperties().apply {
+                interfaceName = tunIface.interfaceName
+                setLinkAddresses(listOf(LOCAL_V6ADDR))
+                // A NAT64 prefix from the network (as if from an RA) starts clat without DNS64.
+                nat64Prefix = NAT64_PREFIX
+            }
+            tnm.setupTestNetwork(lp, true /* isMetered */, binder)
+        }
+        network = networkCallback.expect<Available>().network
+        val lpChange = networkCallback.eventuallyExpect<LinkPropertiesChanged> {
+            it.lp.stackedLinks.getOrNull(0)?.linkAddresses?.getOrNull(0) != null
+        }
+        clatV4 = lpChange.lp.stackedLinks[0].linkAddresses[0].address as Inet4Address
+        clatV6 = discoverClatV6Address()
+        Log.i(TAG, "clat up on ${tunIface.interfaceName}: $clatV4 <-> $clatV6")
+    }
+
+    @After
+    fun tearDown() {
+        if (::networkCallback.isInitialized) cm.unregisterNetworkCallback(networkCallback)
+        if (::tunIface.isInitialized) tunIface.fileDescriptor.close()
+    }
+
+    // The clat IPv6 address isn't in the link properties; it is the source address of an IPv4
+    // packet translated on the way out.
+    private fun discoverClatV6Address(): Inet6Address {
+        val sock = Os.socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)
+        val buf = ByteArray(MTU)
+        try {
+            network.bindSocket(sock)
+            repeat(10) {
+                Os.sendto(sock, byteArrayOf(0), 0, 1, 0, REMOTE_V4ADDR, DISCARD_PORT)
+                val pollFd = StructPollfd().apply {
+                    fd = tunFd
+                    events = POLLIN.toShort()
+                }
+                while (Os.poll(arrayOf(pollFd), 200 /* timeoutMs */) > 0) {
+                    val len = Os.read(tunFd, buf, 0, buf.size)
+                    // Skip anything else the kernel sends, e.g. router solicitations or MLD.
+                    if (len < 48 || (buf[0].toInt() shr 4) != 6 || buf[6].toInt() != 17) continue
+                    val dst = InetAddress.getByAddress(buf.copyOfRange(24, 40))
+                    if (dst != REMOTE_V4ADDR_NAT64) continue
+                    return InetAddress.getByAddress(buf.copyOfRange(8, 24)) as Inet6Address
+                }
+            }
+        } finally {
+            IoUtils.closeQuietly(sock)
+        }
+        fail("No translated packet seen on ${tunIface.interfaceName}")
+    }
+
+    private fun openSocket(
+        family: Int,
+        protocol: Int,
+        addr: InetAddress
+    ): Pair<FileDescriptor, Int> {
+        val sock = Os.socket(family, SOCK_DGRAM, protocol)
+        network.bindSocket(sock)
+        Os.setsockoptInt(sock, SOL_SOCKET, SO_RCVBUF, RECEIVE_BUFFER_SIZE)
+        Os.bind(sock, addr, 0)
+        // For ping sockets, the port is the ICMP echo identifier.
+        return sock to (Os.getsockname(sock) as InetSocketAddress).port
+    }
+
+    private fun runScenario(
+        name: String,
+        family: Int,
+        protocol: Int,
+        bindAddr: InetAddress,
+        buildPacket: (port: Int, packetLen: Int) -> ByteArray
+    ) {
+        val (sock, port) = openSocket(family, protocol, bindAddr)
+        try {
+            for (size in packetSizes) {
+                val packet = buildPacket(port, size)
+                for (rate in packetRates) {
+                    measure("${name}_${size}B_${if (rate > 0) "${rate}pps" else "max"}",
+                            sock, packet, rate)
+                }
+            }
+        } finally {
+            IoUtils.closeQuietly(sock)
+        }
+    }
+
+    private fun measure(run: String, sock: FileDescriptor, packet: ByteArray, rate: Int) {
+        var rx: TrafficGenerator.ReceiveResult? = null
+        val receiver = thread(name = "$TAG-rx") {
+            rx = TrafficGenerator.receive(sock, packetsPerRun, RECEIVE_IDLE_TIMEOUT_MS)
+        }
+        val tx = TrafficGenerator.inject(tunFd, packet, packetsPerRun, rate)
+        receiver.join()
+        val received = rx!!
+
+        val sent = tx.written
+        val dropRate = if (sent == 0L) 1.0 else (1.0 - received.packets.toDouble() / sent)
+                .coerceAtLeast(0.0)
+        val elapsedNs = maxOf(tx.elapsedNs, received.elapsedNs)
+        val throughputMbps = if (elapsedNs == 0L) 0.0 else received.bytes * 8e3 / elapsedNs
+        val cpuNsPerPacket =
+            if (received.packets == 0L) 0.0
+            else (tx.cpuNs + received.cpuNs).toDouble() / received.packets
+        val results = Bundle().apply {
+            putLong("${run}_sent", sent)
+            putLong("${run}_injection_dropped", tx.dropped)
+            putLong("${run}_received", received.packets)
+            putDouble("${run}_injected_pps",
+                    if (tx.elapsedNs == 0L) 0.0 else sent * 1e9 / tx.elapsedNs)
+            putDouble("${run}_throughput_mbps", throughputMbps)
+            putDouble("${run}_drop_rate", dropRate)
+            putDouble("${run}_cpu_ns_per_packet", cpuNsPerPacket)
+        }
+        Log.i(TAG, "$run: $results")
+        inst.sendStatus(0, results)
+        assertTrue(received.packets > 0, "$run: no packet made it through")
+    }
+
+    @Test
+    fun testNativeIpv6Udp() = runScenario("ipv6_udp", AF_INET6, IPPROTO_UDP,
+            LOCAL_V6ADDR.address) { port, len ->
+        TrafficGenerator.buildUdp6(REMOTE_V6ADDR, LOCAL_V6ADDR.address as Inet6Address,
+                REMOTE_PORT, port, len)
+    }
+
+    @Test
+    fun testClatBpfUdp() = runScenario("clat_udp", AF_INET, IPPROTO_UDP, clatV4) { port, len ->
+        TrafficGenerator.buildUdp6(REMOTE_V4ADDR_NAT64, clatV6, REMOTE_PORT, port, len)
+    }
+
+    @Test
+    fun testClatdIcmp() = runScenario("clatd_icmp", AF_INET, IPPROTO_ICMP, clatV4) { id, len ->
+        TrafficGenerator.buildIcmp6EchoReply(REMOTE_V4ADDR_NAT64, clatV6, id, 1 /* seq */, len)
+    }
+}
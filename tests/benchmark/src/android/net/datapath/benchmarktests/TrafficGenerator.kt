@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package android.net.datapath.benchmarktests
+
+import android.os.ParcelFileDescriptor
+import java.io.FileDescriptor
+import java.net.Inet6Address
+import java.nio.ByteBuffer
+
+private const val IPV6_HEADER_LEN = 40
+private const val UDP_HEADER_LEN = 8
+private const val ICMPV6_ECHO_HEADER_LEN = 8
+private const val IPPROTO_UDP = 17
+private const val IPPROTO_ICMPV6 = 58
+private const val ICMPV6_ECHO_REPLY = 129
+private const val HOP_LIMIT = 64
+
+/**
+ * Native packet injection and reception for [DataPathBenchmarkTest], so that per-packet JNI and
+ * allocation costs don't dominate what is measured.
+ */
+object TrafficGenerator {
+    init {
+        System.loadLibrary("connectivitybenchmark_jni")
+    }
+
+    data class InjectResult(
+        val written: Long,
+        val dropped: Long,
+        val elapsedNs: Long,
+        val cpuNs: Long
+    )
+
+    data class ReceiveResult(
+        val packets: Long,
+        val bytes: Long,
+        val elapsedNs: Long,
+        val cpuNs: Long
+    )
+
+    /**
+     * Writes [packet] to a tun [fd] [count] times at [ratePps] packets per second, or as fast as
+     * possible if [ratePps] is 0.
+     */
+    fun inject(fd: FileDescriptor, packet: ByteArray, count: Long, ratePps: Int): InjectResult {
+        val r = withIntFd(fd) { nativeInject(it, packet, count, ratePps) }
+        return InjectResult(r[0], r[1], r[2], r[3])
+    }
+
+    /**
+     * Receives from socket [fd] until [expected] datagrams arrived or none did for
+     * [idleTimeoutMs].
+     */
+    fun receive(fd: FileDescriptor, expected: Long, idleTimeoutMs: Int): ReceiveResult {
+        val r = withIntFd(fd) { nativeReceive(it, expected, idleTimeoutMs) }
+        return ReceiveResult(r[0], r[1], r[2], r[3])
+    }
+
+    /** Builds an IPv6 UDP packet of [packetLen] bytes in total, with a valid checksum. */
+    fun buildUdp6(
+        src: Inet6Address,
+        dst: Inet6Address,
+        srcPort: Int,
+        dstPort: Int,
+        packetLen: Int
+    ): ByteArray {
+        val l4Len = packetLen - IPV6_HEADER_LEN
+        require(l4Len >= UDP_HEADER_LEN) { "Packet too short: $packetLen" }
+        val buf = ByteBuffer.allocate(packetLen)
+        putIpv6Header(buf, src, dst, IPPROTO_UDP, l4Len)
+        buf.putShort(srcPort.toShort())
+        buf.putShort(dstPort.toShort())
+        buf.putShort(l4Len.toShort())
+        buf.putShort(0) // checksum
+        fillPayload(buf)
+        val checksum = l4Checksum(buf.array(), src, dst, IPPROTO_UDP, l4Len)
+        // A computed UDP checksum of 0 is sent as all ones (RFC 768).
+        buf.putShort(IPV6_HEADER_LEN + 6, if (checksum == 0) 0xffff.toShort() else checksum)
+        return buf.array()
+    }
+
+    /** Builds an ICMPv6 echo reply of [packetLen] bytes in total, with a valid checksum. */
+    fun buildIcmp6EchoReply(
+        src: Inet6Address,
+        dst: Inet6Address,
+        id: Int,
+        seq: Int,
+        packetLen: Int
+    ): ByteArray {
+        val l4Len = packetLen - IPV6_HEADER_LEN
+        require(l4Len >= ICMPV6_ECHO_HEADER_LEN) { "Packet too short: $packetLen" }
+        val buf = ByteBuffer.allocate(packetLen)
+        putIpv6Header(buf, src, dst, IPPROTO_ICMPV6, l4Len)
+        buf.put(ICMPV6_ECHO_REPLY.toByte())
+        buf.put(0) // code
+        buf.putShort(0) // checksum
+        buf.putShort(id.toShort())
+        buf.putShort(seq.toShort())
+        fillPayload(buf)
+        buf.putShort(IPV6_HEADER_LEN + 2, l4Checksum(buf.array(), src, dst, IPPROTO_ICMPV6, l4Len))
+        return buf.array()
+    }
+
+    private fun putIpv6Header(
+        buf: ByteBuffer,
+        src: Inet6Address,
+        dst: Inet6Address,
+        nextHeader: Int,
+        payloadLen: Int
+    ) {
+        buf.putInt(0x60000000) // version 6, no traffic class or flow label
+        buf.putShort(payloadLen.toShort())
+        buf.put(nextHeader.toByte())
+        buf.put(HOP_LIMIT.toByte())
+        buf.put(src.address)
+        buf.put(dst.address)
+    }
+
+    private fun fillPayload(buf: ByteBuffer) {
+        var i = 0
+        while (buf.hasRemaining()) buf.put((i++).toByte())
+    }
+
+    // Internet checksum of the IPv6 pseudo-header and the L4 header and payload.
+    private fun l4Checksum(
+        packet: ByteArray,
+        src: Inet6Address,
+        dst: Inet6Address,
+        nextHeader: Int,
+        l4Len: Int
+    ): Short {
+        var sum = 0L
+        fun addWords(bytes: ByteArray, offset: Int, len: Int) {
+            var i = 0
+            while (i + 1 < len) {
+                sum += ((bytes[offset + i].toInt() and 0xff) shl 8) or
+                        (bytes[offset + i + 1].toInt() and 0xff)
+                i += 2
+            }
+            if (i < len) sum += (bytes[offset + i].toInt() and 0xff) shl 8
+        }
+        addWords(src.address, 0, 16)
+        addWords(dst.address, 0, 16)
+        sum += l4Len.toLong() + nextHeader
+        addWords(packet, IPV6_HEADER_LEN, l4Len)
+        while (sum shr 16 != 0L) sum = (sum and 0xffff) + (sum shr 16)
+        return sum.inv().toShort()
+    }
+
+    private inline fun <T> withIntFd(fd: FileDescriptor, block: (Int) -> T): T =
+        ParcelFileDescriptor.dup(fd).use { block(it.fd) }
+
+    @JvmStatic
+    private external fun nativeInject(
+        fd: Int,
+        packet: ByteArray,
+        count: Long,
+        ratePps: Int
+    ): LongArray
+
+    @JvmStatic
+    private external fun nativeReceive(fd: Int, expected: Long, idleTimeoutMs: Int): LongArray
+}
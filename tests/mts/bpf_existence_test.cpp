@@ -97,10 +97,11 @@ static const set<string> MAINLINE_FOR_T_PLUS = {
     NETD "map_netd_data_saver_enabled_map",
     NETD "map_netd_iface_index_name_map",
     NETD "map_netd_iface_stats_map",
+    NETD "map_netd_iface_stats_total_map",
     NETD "map_netd_ingress_discard_map",
     NETD "map_netd_stats_map_A",
     NETD "map_netd_stats_map_B",
-    NETD "map_netd_uid_counterset_map",
+    NETD "map_netd_stats_map_health_map",
     NETD "map_netd_uid_owner_map",
     NETD "map_netd_uid_permission_map",
     SHARED "prog_clatd_schedcls_egress4_clat_rawip",
@@ -32,6 +32,12 @@ typedef int (*UnblockPortForBind)(in_port_t);
 UnblockPortForBind unblockPortForBind;
 typedef int (*UnblockAllPortsForBind)();
 UnblockAllPortsForBind unblockAllPortsForBind;
+typedef int (*BlockPortsForBind)(const in_port_t*, size_t);
+BlockPortsForBind blockPortsForBind;
+BlockPortsForBind unblockPortsForBind;
+typedef int (*BlockPortRangeForBind)(in_port_t, in_port_t);
+BlockPortRangeForBind blockPortRangeForBind;
+BlockPortRangeForBind unblockPortRangeForBind;
 
 class ConnectivityNativeBinderTest : public ::testing::Test {
   public:
@@ -68,6 +74,15 @@ class ConnectivityNativeBinderTest : public ::testing::Test {
         unblockAllPortsForBind = reinterpret_cast<UnblockAllPortsForBind>(
                 dlsym(nativeLib, "AConnectivityNative_unblockAllPortsForBind"));
         ASSERT_NE(nullptr, unblockAllPortsForBind);
+        // The bulk APIs are only in newer versions of the library.
+        blockPortsForBind = reinterpret_cast<BlockPortsForBind>(
+                dlsym(nativeLib, "AConnectivityNative_blockPortsForBind"));
+        unblockPortsForBind = reinterpret_cast<BlockPortsForBind>(
+                dlsym(nativeLib, "AConnectivityNative_unblockPortsForBind"));
+        blockPortRangeForBind = reinterpret_cast<BlockPortRangeForBind>(
+                dlsym(nativeLib, "AConnectivityNative_blockPortRangeForBind"));
+        unblockPortRangeForBind = reinterpret_cast<BlockPortRangeForBind>(
+                dlsym(nativeLib, "AConnectivityNative_unblockPortRangeForBind"));
 
         // If there are already ports being blocked on device unblockAllPortsForBind() store
         // the currently blocked ports and add them back at the end of the test. Do this for
@@ -261,6 +276,69 @@ TEST_F(ConnectivityNativeBinderTest, UnblockAllPorts) {
     // If mActualBlockedPorts is not empty, ports will be added back in teardown.
 }
 
+TEST_F(ConnectivityNativeBinderTest, BlockPortsInBulk) {
+    if (!blockPortsForBind) GTEST_SKIP() << "Bulk port blocking is not supported";
+    int err;
+    in_port_t blockedPorts[6] = {1, 100, 5555, 5556, 5557, 65000};
+
+    if (mActualBlockedPortsCount > 0) {
+        err = unblockAllPortsForBind();
+        EXPECT_EQ(err, 0);
+    }
+
+    err = blockPortsForBind(blockedPorts, 6);
+    EXPECT_EQ(err, 0);
+    size_t actualBlockedPortsCount = 6;
+    in_port_t actualBlockedPorts[actualBlockedPortsCount];
+    err = getPortsBlockedForBind(actualBlockedPorts, &actualBlockedPortsCount);
+    EXPECT_EQ(err, 0);
+    EXPECT_EQ(actualBlockedPortsCount, 6);
+    for (int i = 0; i < actualBlockedPortsCount; i++) {
+        EXPECT_EQ(blockedPorts[i], actualBlockedPorts[i]);
+    }
+
+    err = unblockPortsForBind(blockedPorts, 6);
+    EXPECT_EQ(err, 0);
+    err = getPortsBlockedForBind(actualBlockedPorts, &actualBlockedPortsCount);
+    EXPECT_EQ(err, 0);
+    EXPECT_EQ(actualBlockedPortsCount, 0);
+}
+
+TEST_F(ConnectivityNativeBinderTest, BlockPortRange) {
+    if (!blockPortRangeForBind) GTEST_SKIP() << "Bulk port blocking is not supported";
+    int err;
+
+    if (mActualBlockedPortsCount > 0) {
+        err = unblockAllPortsForBind();
+        EXPECT_EQ(err, 0);
+    }
+
+    // Spans several words of the bitmap, with partial words at both ends.
+    err = blockPortRangeForBind(6000, 6199);
+    EXPECT_EQ(err, 0);
+    size_t actualBlockedPortsCount = 200;
+    in_port_t actualBlockedPorts[actualBlockedPortsCount];
+    err = getPortsBlockedForBind(actualBlockedPorts, &actualBlockedPortsCount);
+    EXPECT_EQ(err, 0);
+    EXPECT_EQ(actualBlockedPortsCount, 200);
+    for (int i = 0; i < actualBlockedPortsCount; i++) {
+        EXPECT_EQ(6000 + i, actualBlockedPorts[i]);
+    }
+
+    // Unblocking the middle leaves both ends blocked.
+    err = unblockPortRangeForBind(6001, 6198);
+    EXPECT_EQ(err, 0);
+    err = getPortsBlockedForBind(actualBlockedPorts, &actualBlockedPortsCount);
+    EXPECT_EQ(err, 0);
+    EXPECT_EQ(actualBlockedPortsCount, 2);
+    EXPECT_EQ(6000, actualBlockedPorts[0]);
+    EXPECT_EQ(6199, actualBlockedPorts[1]);
+
+    EXPECT_EQ(EINVAL, blockPortRangeForBind(7000, 6999));
+    err = unblockAllPortsForBind();
+    EXPECT_EQ(err, 0);
+}
+
 TEST_F(ConnectivityNativeBinderTest, CheckPermission) {
     int curUid = getuid();
     EXPECT_EQ(0, seteuid(FIRST_APPLICATION_UID + 2000)) << "seteuid failed: " << strerror(errno);
@@ -268,3 +346,13 @@ TEST_F(ConnectivityNativeBinderTest, CheckPermission) {
     EXPECT_EQ(EPERM, err);
     EXPECT_EQ(0, seteuid(curUid)) << "seteuid failed: " << strerror(errno);
 }
+
+TEST_F(ConnectivityNativeBinderTest, CheckPermissionForGetter) {
+    int curUid = getuid();
+    EXPECT_EQ(0, seteuid(FIRST_APPLICATION_UID + 2000)) << "seteuid failed: " << strerror(errno);
+    in_port_t blockedPorts[1];
+    size_t blockedPortsCount = 1;
+    int err = getPortsBlockedForBind(blockedPorts, &blockedPortsCount);
+    EXPECT_EQ(EPERM, err);
+    EXPECT_EQ(0, seteuid(curUid)) << "seteuid failed: " << strerror(errno);
+}
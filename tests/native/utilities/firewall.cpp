@@ -72,6 +72,7 @@ Result<void> Firewall::addRule(uint32_t uid, UidOwnerMatchType match, uint32_t i
         UidOwnerValue newMatch = {
                 .iif = iif ? iif : oldMatch.value().iif,
                 .rule = oldMatch.value().rule | match,
+                .counterSet = oldMatch.value().counterSet,
         };
         auto res = mUidOwnerMap.writeValue(uid, newMatch, BPF_ANY);
         if (!res.ok()) return Errorf("Failed to update rule: {}", res.error().message());
@@ -94,8 +95,10 @@ Result<void> Firewall::removeRule(uint32_t uid, UidOwnerMatchType match) {
     UidOwnerValue newMatch = {
             .iif = (match == IIF_MATCH) ? 0 : oldMatch.value().iif,
             .rule = oldMatch.value().rule & ~match,
+            .counterSet = oldMatch.value().counterSet,
     };
-    if (newMatch.rule == 0) {
+    // The entry also holds the uid's counter set, which is not ours to delete.
+    if (newMatch.rule == 0 && newMatch.counterSet == 0) {
         auto res = mUidOwnerMap.deleteValue(uid);
         if (!res.ok()) return Errorf("Failed to remove rule: {}", res.error().message());
     } else {
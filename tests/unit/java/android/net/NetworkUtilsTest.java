@@ -16,7 +16,10 @@
 
 package android.net;
 
+import static android.net.DnsResolver.CLASS_IN;
+import static android.net.DnsResolver.TYPE_A;
 import static android.system.OsConstants.AF_INET6;
+import static android.system.OsConstants.ETIMEDOUT;
 import static android.system.OsConstants.IPPROTO_ICMPV6;
 import static android.system.OsConstants.SOCK_DGRAM;
 import static android.system.OsConstants.SOL_SOCKET;
@@ -26,10 +29,15 @@ import static com.android.compatibility.common.util.PropertyUtil.getVsrApiLevel;
 
 import static junit.framework.Assert.assertEquals;
 
+import static org.junit.Assert.assertArrayEquals;
+import static org.junit.Assert.assertNotEquals;
+import static org.junit.Assert.assertThrows;
 import static org.junit.Assert.assertTrue;
+import static org.junit.Assert.fail;
 import static org.junit.Assume.assumeTrue;
 
 import android.os.Build;
+import android.os.SystemClock;
 import android.system.ErrnoException;
 import android.system.Os;
 import android.system.StructTimeval;
@@ -47,12 +55,21 @@ import java.io.FileDescriptor;
 import java.math.BigInteger;
 import java.nio.ByteBuffer;
 import java.nio.ByteOrder;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
 import java.util.TreeSet;
 
 @RunWith(DevSdkIgnoreRunner.class)
 @SmallTest
 @DevSdkIgnoreRule.IgnoreUpTo(Build.VERSION_CODES.R)
 public class NetworkUtilsTest {
+    // Queries sent to this network are cancelled before any reply could arrive.
+    private static final int TEST_NETID = 100;
+    // Can't even be sent: DNS labels are at most 63 characters long.
+    private static final String UNSENDABLE_NAME =
+            new String(new char[64]).replace('\0', 'a') + ".example.com";
+
     @Test
     public void testRoutedIPv4AddressCount() {
         final TreeSet<IpPrefix> set = new TreeSet<>(IpPrefix.lengthComparator());
@@ -187,4 +204,88 @@ public class NetworkUtilsTest {
         assumeTrue(getVsrApiLevel() > Build.VERSION_CODES.TIRAMISU);
         assertTrue(NetworkUtils.isKernel64Bit());
     }
+
+    @Test
+    public void testResNetworkQueryBatchRejectsNullName() throws ErrnoException {
+        final NetworkUtils.DnsBatchCallback callback = (indices, responses, errnos) ->
+                fail("No query should have been sent");
+        assertThrows(NullPointerException.class, () -> NetworkUtils.resNetworkQueryBatch(
+                TEST_NETID, new String[] {"www.android.com", null}, new int[] {TYPE_A, TYPE_A},
+                CLASS_IN, 0 /* flags */, 1000 /* timeoutMs */, callback));
+        assertThrows(IllegalArgumentException.class, () -> NetworkUtils.resNetworkQueryBatch(
+                TEST_NETID, new String[] {"www.android.com"}, new int[] {TYPE_A, TYPE_A},
+                CLASS_IN, 0 /* flags */, 1000 /* timeoutMs */, callback));
+    }
+
+    @Test
+    public void testResNetworkQueryBatchEmpty() throws ErrnoException {
+        NetworkUtils.resNetworkQueryBatch(TEST_NETID, new String[0], new int[0], CLASS_IN,
+                0 /* flags */, 1000 /* timeoutMs */,
+                (indices, responses, errnos) -> fail("Nothing to report for an empty batch"));
+    }
+
+    private static class BatchRecorder implements NetworkUtils.DnsBatchCallback {
+        final List<int[]> indices = new ArrayList<>();
+        final List<int[]> errnos = new ArrayList<>();
+
+        @Override
+        public void onResults(int[] indices, DnsResolver.DnsResponse[] responses, int[] errnos) {
+            assertEquals(indices.length, responses.length);
+            assertEquals(indices.length, errnos.length);
+            for (int i = 0; i < indices.length; i++) {
+                assertEquals(errnos[i] != 0, responses[i] == null);
+            }
+            // Completion order within a batch is unspecified.
+            final int[] sorted = indices.clone();
+            Arrays.sort(sorted);
+            this.indices.add(sorted);
+            this.errnos.add(errnos);
+        }
+    }
+
+    @Test
+    public void testResNetworkQueryBatchCancelsOnTimeout() throws ErrnoException {
+        final BatchRecorder recorder = new BatchRecorder();
+        NetworkUtils.resNetworkQueryBatch(TEST_NETID,
+                new String[] {"www.android.com", "www.google.com", "www.example.com"},
+                new int[] {TYPE_A, TYPE_A, TYPE_A}, CLASS_IN, 0 /* flags */,
+                0 /* timeoutMs */, recorder);
+
+        assertEquals(1, recorder.indices.size());
+        assertArrayEquals(new int[] {0, 1, 2}, recorder.indices.get(0));
+        assertArrayEquals(new int[] {ETIMEDOUT, ETIMEDOUT, ETIMEDOUT}, recorder.errnos.get(0));
+    }
+
+    @Test
+    public void testResNetworkQueryBatchReportsSendFailuresFirst() throws ErrnoException {
+        final BatchRecorder recorder = new BatchRecorder();
+        NetworkUtils.resNetworkQueryBatch(TEST_NETID,
+                new String[] {"www.android.com", UNSENDABLE_NAME, "www.google.com",
+                        UNSENDABLE_NAME},
+                new int[] {TYPE_A, TYPE_A, TYPE_A, TYPE_A}, CLASS_IN, 0 /* flags */,
+                0 /* timeoutMs */, recorder);
+
+        // One batch for the queries that could not be sent, then one for the cancelled ones.
+        assertEquals(2, recorder.indices.size());
+        assertArrayEquals(new int[] {1, 3}, recorder.indices.get(0));
+        for (int errno : recorder.errnos.get(0)) {
+            assertNotEquals(0, errno);
+            assertNotEquals(ETIMEDOUT, errno);
+        }
+        assertArrayEquals(new int[] {0, 2}, recorder.indices.get(1));
+        assertArrayEquals(new int[] {ETIMEDOUT, ETIMEDOUT}, recorder.errnos.get(1));
+    }
+
+    @Test
+    public void testResNetworkQueryBatchSendFailuresDontWait() throws ErrnoException {
+        final BatchRecorder recorder = new BatchRecorder();
+        final long start = SystemClock.elapsedRealtime();
+        NetworkUtils.resNetworkQueryBatch(TEST_NETID, new String[] {UNSENDABLE_NAME},
+                new int[] {TYPE_A}, CLASS_IN, 0 /* flags */, 60_000 /* timeoutMs */, recorder);
+
+        assertTrue(SystemClock.elapsedRealtime() - start < 10_000);
+        assertEquals(1, recorder.indices.size());
+        assertArrayEquals(new int[] {0}, recorder.indices.get(0));
+        assertNotEquals(0, recorder.errnos.get(0)[0]);
+    }
 }
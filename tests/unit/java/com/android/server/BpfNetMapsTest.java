@@ -365,6 +365,49 @@ public final class BpfNetMapsTest {
                 () -> mBpfNetMaps.removeNaughtyApp(TEST_UID));
     }
 
+    @Test
+    @IgnoreUpTo(Build.VERSION_CODES.S_V2)
+    public void testRulesKeepCounterSet() throws Exception {
+        final short counterSet = 1;
+        BpfNetMapsUtils.setUidCounterSet(mUidOwnerMap, TEST_UID, counterSet);
+        assertEquals(new UidOwnerValue(NO_IIF, NO_MATCH, counterSet),
+                mUidOwnerMap.getValue(new S32(TEST_UID)));
+
+        mBpfNetMaps.addNaughtyApp(TEST_UID);
+        assertEquals(new UidOwnerValue(NO_IIF, PENALTY_BOX_MATCH, counterSet),
+                mUidOwnerMap.getValue(new S32(TEST_UID)));
+
+        // Removing the last rule keeps the entry for its counter set...
+        mBpfNetMaps.removeNaughtyApp(TEST_UID);
+        assertEquals(new UidOwnerValue(NO_IIF, NO_MATCH, counterSet),
+                mUidOwnerMap.getValue(new S32(TEST_UID)));
+
+        // ...and resetting the counter set of a uid with rules keeps the rules.
+        mBpfNetMaps.addNaughtyApp(TEST_UID);
+        BpfNetMapsUtils.setUidCounterSet(mUidOwnerMap, TEST_UID, (short) 0);
+        checkUidOwnerValue(TEST_UID, NO_IIF, PENALTY_BOX_MATCH);
+
+        mBpfNetMaps.removeNaughtyApp(TEST_UID);
+        assertNull(mUidOwnerMap.getValue(new S32(TEST_UID)));
+    }
+
+    @Test
+    @IgnoreUpTo(Build.VERSION_CODES.S_V2)
+    public void testClearUidRulesKeepsCounterSet() throws Exception {
+        final int otherUid = TEST_UID + 1;
+        final short counterSet = 1;
+        mUidOwnerMap.updateEntry(new S32(TEST_UID),
+                new UidOwnerValue(TEST_IF_INDEX, IIF_MATCH | PENALTY_BOX_MATCH, counterSet));
+        mUidOwnerMap.updateEntry(new S32(otherUid),
+                new UidOwnerValue(NO_IIF, PENALTY_BOX_MATCH));
+
+        BpfNetMapsUtils.clearUidRules(mUidOwnerMap);
+
+        assertEquals(new UidOwnerValue(NO_IIF, NO_MATCH, counterSet),
+                mUidOwnerMap.getValue(new S32(TEST_UID)));
+        assertNull(mUidOwnerMap.getValue(new S32(otherUid)));
+    }
+
     @Test
     @IgnoreAfter(Build.VERSION_CODES.S_V2)
     public void testRemoveNaughtyAppBeforeT() {
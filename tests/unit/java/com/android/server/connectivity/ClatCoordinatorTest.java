@@ -33,11 +33,16 @@ import static com.android.testutils.MiscAsserts.assertThrows;
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertNotNull;
 import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertSame;
+import static org.junit.Assert.assertTrue;
 import static org.junit.Assert.fail;
+import static org.mockito.Mockito.any;
+import static org.mockito.Mockito.anyInt;
 import static org.mockito.Mockito.argThat;
 import static org.mockito.Mockito.clearInvocations;
 import static org.mockito.Mockito.eq;
 import static org.mockito.Mockito.inOrder;
+import static org.mockito.Mockito.mock;
 import static org.mockito.Mockito.never;
 import static org.mockito.Mockito.spy;
 import static org.mockito.Mockito.verify;
@@ -47,6 +52,9 @@ import android.net.INetd;
 import android.net.InetAddresses;
 import android.net.IpPrefix;
 import android.os.Build;
+import android.os.ConditionVariable;
+import android.os.Handler;
+import android.os.HandlerThread;
 import android.os.ParcelFileDescriptor;
 
 import androidx.test.filters.SmallTest;
@@ -61,6 +69,7 @@ import com.android.net.module.util.bpf.CookieTagMapKey;
 import com.android.net.module.util.bpf.CookieTagMapValue;
 import com.android.testutils.DevSdkIgnoreRule;
 import com.android.testutils.DevSdkIgnoreRunner;
+import com.android.testutils.HandlerUtils;
 import com.android.testutils.TestBpfMap;
 
 import org.junit.Before;
@@ -106,6 +115,7 @@ public class ClatCoordinatorTest {
     private static final Inet6Address INET6_LOCAL6 = (Inet6Address)
             InetAddresses.parseNumericAddress(XLAT_LOCAL_IPV6ADDR_STRING);
     private static final int CLATD_PID = 10483;
+    private static final long TIMEOUT_MS = 1000;
 
     private static final int TUN_FD = 534;
     private static final int RAW_SOCK_FD = 535;
@@ -117,6 +127,8 @@ public class ClatCoordinatorTest {
             new FileDescriptor()));
     private static final ParcelFileDescriptor PACKET_SOCK_PFD = spy(new ParcelFileDescriptor(
             new FileDescriptor()));
+    private static final ParcelFileDescriptor CONTROL_PFD = spy(new ParcelFileDescriptor(
+            new FileDescriptor()));
 
     private static final String EGRESS_PROG_PATH =
             "/sys/fs/bpf/net_shared/prog_clatd_schedcls_egress4_clat_rawip";
@@ -319,6 +331,22 @@ public class ClatCoordinatorTest {
             }
         }
 
+        /**
+         * Whether to prepare clat concurrently.
+         */
+        @Override
+        public boolean isClatPrepareEnabled() {
+            return false;
+        }
+
+        /**
+         * Whether to run clatd as a persistent clatd.
+         */
+        @Override
+        public boolean isPersistentClatdEnabled() {
+            return false;
+        }
+
         /**
          * Get socket cookie.
          */
@@ -489,6 +517,151 @@ public class ClatCoordinatorTest {
         inOrder.verifyNoMoreInteractions();
     }
 
+    @Test
+    public void testStartStopPreparedPersistentClatd() throws Exception {
+        final TestDependencies deps = spy(new TestDependencies() {
+            @Override
+            public boolean isClatPrepareEnabled() {
+                return true;
+            }
+
+            @Override
+            public boolean isPersistentClatdEnabled() {
+                return true;
+            }
+
+            @Override
+            public ClatCoordinator.ClatPreparation prepareClat(@NonNull String iface,
+                    @NonNull String tunIface, @NonNull String v4addr, int prefixlen,
+                    @NonNull String prefix64, int platSuffix, int mark) throws IOException {
+                return new ClatCoordinator.ClatPreparation(XLAT_LOCAL_IPV4ADDR_STRING,
+                        XLAT_LOCAL_IPV6ADDR_STRING, TUN_PFD, PACKET_SOCK_PFD, RAW_SOCK_PFD,
+                        ETHER_MTU);
+            }
+
+            @Override
+            public ClatCoordinator.PersistentClatd takeIdleClatd() {
+                return null;
+            }
+
+            @Override
+            public ClatCoordinator.PersistentClatd startPersistentClatd() throws IOException {
+                return new ClatCoordinator.PersistentClatd(CLATD_PID, CONTROL_PFD);
+            }
+
+            @Override
+            public void armClatd(@NonNull FileDescriptor control, @NonNull FileDescriptor tunfd,
+                    @NonNull FileDescriptor readsock6, @NonNull FileDescriptor writesock6,
+                    @NonNull String iface, @NonNull String pfx96, @NonNull String v4,
+                    @NonNull String v6) throws IOException {
+                // no-op
+            }
+
+            @Override
+            public void disarmClatd(@NonNull FileDescriptor control) throws IOException {
+                // no-op
+            }
+
+            @Override
+            public boolean offerIdleClatd(@NonNull ClatCoordinator.PersistentClatd clatd,
+                    @NonNull Runnable reap) {
+                return true;
+            }
+        });
+        final ClatCoordinator coordinator = new ClatCoordinator(deps);
+        final InOrder inOrder = inOrder(mNetd, deps);
+        clearInvocations(mNetd);
+
+        // [1] Start clatd.
+        assertEquals(XLAT_LOCAL_IPV6ADDR_STRING,
+                coordinator.clatStart(BASE_IFACE, NETID, NAT64_IP_PREFIX));
+        assertEquals(CLATD_PID, coordinator.getClatdTrackerForTesting().pid);
+
+        inOrder.verify(deps).prepareClat(eq(BASE_IFACE), eq(STACKED_IFACE),
+                eq(INIT_V4ADDR_STRING), eq(INIT_V4ADDR_PREFIX_LEN), eq(NAT64_PREFIX_STRING),
+                eq(GOOGLE_DNS_4), eq(MARK));
+        inOrder.verify(mNetd).interfaceSetEnableIPv6(eq(STACKED_IFACE), eq(false /* enable */));
+        inOrder.verify(mNetd).interfaceSetMtu(eq(STACKED_IFACE),
+                eq(1472 /* ETHER_MTU(1500) - MTU_DELTA(28) */));
+        inOrder.verify(mNetd).interfaceSetCfg(argThat(cfg ->
+                STACKED_IFACE.equals(cfg.ifName)
+                && XLAT_LOCAL_IPV4ADDR_STRING.equals(cfg.ipv4Addr)));
+        inOrder.verify(deps).startPersistentClatd();
+        inOrder.verify(deps).armClatd(
+                argThat(fd -> Objects.equals(CONTROL_PFD.getFileDescriptor(), fd)),
+                argThat(fd -> Objects.equals(TUN_PFD.getFileDescriptor(), fd)),
+                argThat(fd -> Objects.equals(PACKET_SOCK_PFD.getFileDescriptor(), fd)),
+                argThat(fd -> Objects.equals(RAW_SOCK_PFD.getFileDescriptor(), fd)),
+                eq(BASE_IFACE), eq(NAT64_PREFIX_STRING),
+                eq(XLAT_LOCAL_IPV4ADDR_STRING), eq(XLAT_LOCAL_IPV6ADDR_STRING));
+        verify(deps, never()).selectIpv4Address(any(), anyInt());
+        verify(deps, never()).startClatd(any(), any(), any(), any(), any(), any(), any());
+
+        // [2] Stopping disarms clatd and keeps it around instead of killing it.
+        coordinator.clatStop();
+        inOrder.verify(deps).disarmClatd(
+                argThat(fd -> Objects.equals(CONTROL_PFD.getFileDescriptor(), fd)));
+        inOrder.verify(deps).offerIdleClatd(argThat(clatd -> clatd.pid == CLATD_PID), any());
+        verify(deps, never()).stopClatd(anyInt());
+        verify(CONTROL_PFD, never()).close();
+        assertNull(coordinator.getClatdTrackerForTesting());
+    }
+
+    private ClatCoordinator.Dependencies makeIdleClatdDeps(@NonNull Handler handler) {
+        return new TestDependencies() {
+            @Override
+            public Handler getIdleClatdHandler() {
+                return handler;
+            }
+
+            @Override
+            public long getIdleClatdTimeoutMs() {
+                return 0;
+            }
+        };
+    }
+
+    @Test
+    public void testIdleClatdIsReaped() throws Exception {
+        final HandlerThread thread = new HandlerThread("ClatCoordinatorTest");
+        thread.start();
+        try {
+            final ClatCoordinator.Dependencies deps =
+                    makeIdleClatdDeps(new Handler(thread.getLooper()));
+            final Runnable reap = mock(Runnable.class);
+            assertTrue(deps.offerIdleClatd(
+                    new ClatCoordinator.PersistentClatd(CLATD_PID, CONTROL_PFD), reap));
+            HandlerUtils.waitForIdle(thread, TIMEOUT_MS);
+            verify(reap).run();
+            assertNull(deps.takeIdleClatd());
+        } finally {
+            thread.quitSafely();
+        }
+    }
+
+    @Test
+    public void testTakenIdleClatdIsNotReaped() throws Exception {
+        final HandlerThread thread = new HandlerThread("ClatCoordinatorTest");
+        thread.start();
+        try {
+            final Handler handler = new Handler(thread.getLooper());
+            final ClatCoordinator.Dependencies deps = makeIdleClatdDeps(handler);
+            // Hold the reaper back until the clatd has been taken.
+            final ConditionVariable taken = new ConditionVariable();
+            handler.post(taken::block);
+            final ClatCoordinator.PersistentClatd clatd =
+                    new ClatCoordinator.PersistentClatd(CLATD_PID, CONTROL_PFD);
+            final Runnable reap = mock(Runnable.class);
+            assertTrue(deps.offerIdleClatd(clatd, reap));
+            assertSame(clatd, deps.takeIdleClatd());
+            taken.open();
+            HandlerUtils.waitForIdle(thread, TIMEOUT_MS);
+            verify(reap, never()).run();
+        } finally {
+            thread.quitSafely();
+        }
+    }
+
     @Test
     public void testGetFwmark() throws Exception {
         assertEquals(0xf0064, ClatCoordinator.getFwmark(100));
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.server.connectivity;
+
+import static android.content.pm.PackageManager.PERMISSION_DENIED;
+import static android.content.pm.PackageManager.PERMISSION_GRANTED;
+
+import static org.junit.Assert.assertArrayEquals;
+import static org.junit.Assert.assertThrows;
+import static org.mockito.ArgumentMatchers.anyString;
+import static org.mockito.Mockito.doReturn;
+import static org.mockito.Mockito.inOrder;
+import static org.mockito.Mockito.verifyNoMoreInteractions;
+
+import android.content.Context;
+import android.os.Build;
+
+import androidx.test.filters.SmallTest;
+
+import com.android.net.module.util.BpfBitmap;
+import com.android.testutils.DevSdkIgnoreRule;
+import com.android.testutils.DevSdkIgnoreRunner;
+
+import org.junit.Before;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.mockito.InOrder;
+import org.mockito.Mock;
+import org.mockito.MockitoAnnotations;
+
+@RunWith(DevSdkIgnoreRunner.class)
+@SmallTest
+@DevSdkIgnoreRule.IgnoreUpTo(Build.VERSION_CODES.TIRAMISU)
+public class ConnectivityNativeServiceTest {
+    @Mock private Context mContext;
+    @Mock private BpfBitmap mBlockedPortsMap;
+
+    private ConnectivityNativeService mService;
+
+    @Before
+    public void setUp() {
+        MockitoAnnotations.initMocks(this);
+        doReturn(PERMISSION_GRANTED).when(mContext).checkCallingOrSelfPermission(anyString());
+        mService = new ConnectivityNativeService(mContext,
+                new ConnectivityNativeService.Dependencies() {
+                    @Override
+                    public BpfBitmap getBlockPortsMap() {
+                        return mBlockedPortsMap;
+                    }
+                });
+    }
+
+    @Test
+    public void testBlockPortRanges() throws Exception {
+        mService.blockPortRangesForBind(new int[] {0, 0, 100, 200, 65535, 65535});
+        mService.unblockPortRangesForBind(new int[] {150, 160});
+
+        final InOrder inOrder = inOrder(mBlockedPortsMap);
+        inOrder.verify(mBlockedPortsMap).setRange(0, 0, true);
+        inOrder.verify(mBlockedPortsMap).setRange(100, 200, true);
+        inOrder.verify(mBlockedPortsMap).setRange(65535, 65535, true);
+        inOrder.verify(mBlockedPortsMap).setRange(150, 160, false);
+        verifyNoMoreInteractions(mBlockedPortsMap);
+    }
+
+    @Test
+    public void testInvalidPortRangesChangeNothing() {
+        final int[][] invalidRanges = {
+                null,
+                {1},
+                {1, 2, 3},
+                {-1, 5},
+                {5, 65536},
+                {6, 5},
+                // Valid first range, so nothing must be changed before all are checked.
+                {1, 2, 6, 5},
+        };
+        for (int[] ranges : invalidRanges) {
+            assertThrows(IllegalArgumentException.class,
+                    () -> mService.blockPortRangesForBind(ranges));
+            assertThrows(IllegalArgumentException.class,
+                    () -> mService.unblockPortRangesForBind(ranges));
+        }
+        verifyNoMoreInteractions(mBlockedPortsMap);
+    }
+
+    @Test
+    public void testGetPortsBlockedForBind() throws Exception {
+        final int[] ports = {1, 100, 65535};
+        doReturn(ports).when(mBlockedPortsMap).getSetIndexes();
+        assertArrayEquals(ports, mService.getPortsBlockedForBind());
+    }
+
+    @Test
+    public void testRequiresNetworkStackPermission() {
+        doReturn(PERMISSION_DENIED).when(mContext).checkCallingOrSelfPermission(anyString());
+        assertThrows(SecurityException.class, () -> mService.getPortsBlockedForBind());
+        assertThrows(SecurityException.class,
+                () -> mService.blockPortRangesForBind(new int[] {1, 2}));
+        assertThrows(SecurityException.class,
+                () -> mService.unblockPortRangesForBind(new int[] {1, 2}));
+        verifyNoMoreInteractions(mBlockedPortsMap);
+    }
+}
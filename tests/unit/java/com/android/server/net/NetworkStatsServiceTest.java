@@ -56,6 +56,7 @@ import static android.net.NetworkTemplate.OEM_MANAGED_YES;
 import static android.net.TrafficStats.MB_IN_BYTES;
 import static android.net.TrafficStats.UID_REMOVED;
 import static android.net.TrafficStats.UID_TETHERING;
+import static android.net.TrafficStats.UNSUPPORTED;
 import static android.net.netstats.NetworkStatsDataMigrationUtils.PREFIX_UID;
 import static android.net.netstats.NetworkStatsDataMigrationUtils.PREFIX_UID_TAG;
 import static android.net.netstats.NetworkStatsDataMigrationUtils.PREFIX_XT;
@@ -66,6 +67,7 @@ import static android.text.format.DateUtils.WEEK_IN_MILLIS;
 
 import static com.android.dx.mockito.inline.extended.ExtendedMockito.doThrow;
 import static com.android.server.net.NetworkStatsEventLogger.POLL_REASON_RAT_CHANGED;
+import static com.android.server.net.NetworkStatsEventLogger.POLL_REASON_STATS_MAP_PRESSURE;
 import static com.android.server.net.NetworkStatsEventLogger.PollEvent.pollReasonNameOf;
 import static com.android.server.net.NetworkStatsService.ACTION_NETWORK_STATS_POLL;
 import static com.android.server.net.NetworkStatsService.NETSTATS_FASTDATAINPUT_FALLBACKS_COUNTER_NAME;
@@ -75,6 +77,7 @@ import static com.android.server.net.NetworkStatsService.NETSTATS_IMPORT_FALLBAC
 import static com.android.server.net.NetworkStatsService.NETSTATS_IMPORT_SUCCESSES_COUNTER_NAME;
 import static com.android.testutils.DevSdkIgnoreRuleKt.SC_V2;
 
+import static org.junit.Assert.assertArrayEquals;
 import static org.junit.Assert.assertEquals;
 import static org.junit.Assert.assertFalse;
 import static org.junit.Assert.assertNotNull;
@@ -118,6 +121,7 @@ import android.net.TelephonyNetworkSpecifier;
 import android.net.TestNetworkSpecifier;
 import android.net.TetherStatsParcel;
 import android.net.TetheringManager;
+import android.net.UidOwnerValue;
 import android.net.UnderlyingNetworkInfo;
 import android.net.netstats.provider.INetworkStatsProviderCallback;
 import android.net.wifi.WifiInfo;
@@ -150,7 +154,6 @@ import com.android.net.module.util.IBpfMap;
 import com.android.net.module.util.LocationPermissionChecker;
 import com.android.net.module.util.Struct;
 import com.android.net.module.util.Struct.S32;
-import com.android.net.module.util.Struct.U8;
 import com.android.net.module.util.bpf.CookieTagMapKey;
 import com.android.net.module.util.bpf.CookieTagMapValue;
 import com.android.server.BpfNetMaps;
@@ -186,6 +189,7 @@ import java.time.ZoneId;
 import java.time.ZoneOffset;
 import java.time.ZonedDateTime;
 import java.time.temporal.ChronoUnit;
+import java.util.ArrayList;
 import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
@@ -263,7 +267,8 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
     private HandlerThread mHandlerThread;
     @Mock
     private LocationPermissionChecker mLocationPermissionChecker;
-    private TestBpfMap<S32, U8> mUidCounterSetMap = spy(new TestBpfMap<>(S32.class, U8.class));
+    private TestBpfMap<S32, UidOwnerValue> mUidOwnerMap =
+            spy(new TestBpfMap<>(S32.class, UidOwnerValue.class));
     @Mock
     private BpfNetMaps mBpfNetMaps;
     @Mock
@@ -288,6 +293,12 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
     private Map<String, NetworkStatsCollection> mPlatformNetworkStatsCollection =
             new ArrayMap<String, NetworkStatsCollection>();
     private boolean mStoreFilesInApexData = false;
+    private boolean mShouldDrainStatsMap = false;
+    private int mCallingUid = Process.myUid();
+    // uid -> {rxBytes, rxPackets, txBytes, txPackets}, served by the uid stats natives.
+    private final Map<Integer, long[]> mNativeUidStats = new HashMap<>();
+    private final List<int[]> mNativeUidStatsQueries = new ArrayList<>();
+    private int mNativeAllUidStatsReads = 0;
     private int mImportLegacyTargetAttempts = 0;
     private @Mock PersistentInt mImportLegacyAttemptsCounter;
     private @Mock PersistentInt mImportLegacySuccessesCounter;
@@ -542,8 +553,8 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
         }
 
         @Override
-        public IBpfMap<S32, U8> getUidCounterSetMap() {
-            return mUidCounterSetMap;
+        public IBpfMap<S32, UidOwnerValue> getUidOwnerMap() {
+            return mUidOwnerMap;
         }
 
         @Override
@@ -591,6 +602,57 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
         public boolean supportEventLogger(@NonNull Context cts) {
             return true;
         }
+
+        @Override
+        public void dumpNativeLatencies(FileDescriptor fd) {
+            // The test JNI library does not register NetworkStatsService natives.
+        }
+
+        @Override
+        public boolean shouldDrainStatsMap() {
+            return mShouldDrainStatsMap;
+        }
+
+        @Override
+        public void dumpStatsMapHealth(FileDescriptor fd) {
+            // The test JNI library does not register NetworkStatsService natives.
+        }
+
+        @Override
+        public int getCallingUid() {
+            return mCallingUid;
+        }
+
+        @Override
+        public boolean getUidStatsBulk(int[] uids, long[] rxBytes, long[] rxPackets,
+                long[] txBytes, long[] txPackets) {
+            mNativeUidStatsQueries.add(uids.clone());
+            for (int i = 0; i < uids.length; i++) {
+                final long[] stats = mNativeUidStats.getOrDefault(uids[i], new long[4]);
+                rxBytes[i] = stats[0];
+                rxPackets[i] = stats[1];
+                txBytes[i] = stats[2];
+                txPackets[i] = stats[3];
+            }
+            return true;
+        }
+
+        @Override
+        public int getAllUidStats(int[] uids, long[] rxBytes, long[] rxPackets, long[] txBytes,
+                long[] txPackets) {
+            mNativeAllUidStatsReads++;
+            final int[] all = mNativeUidStats.keySet().stream().mapToInt(i -> i).sorted()
+                    .toArray();
+            for (int i = 0; i < Math.min(all.length, uids.length); i++) {
+                final long[] stats = mNativeUidStats.get(all[i]);
+                uids[i] = all[i];
+                rxBytes[i] = stats[0];
+                rxPackets[i] = stats[1];
+                txBytes[i] = stats[2];
+                txPackets[i] = stats[3];
+            }
+            return all.length;
+        }
     }
 
     @After
@@ -721,11 +783,11 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
                 .insertEntry(TEST_IFACE, UID_RED, SET_FOREGROUND, 0xFAAD, 256L, 2L, 128L, 1L, 0L)
                 .insertEntry(TEST_IFACE, UID_BLUE, SET_DEFAULT, TAG_NONE, 128L, 1L, 128L, 1L, 0L));
         mService.noteUidForeground(UID_RED, false);
-        verify(mUidCounterSetMap, never()).deleteEntry(any());
+        verify(mUidOwnerMap, never()).deleteEntry(any());
         mService.incrementOperationCount(UID_RED, 0xFAAD, 4);
         mService.noteUidForeground(UID_RED, true);
-        verify(mUidCounterSetMap).updateEntry(
-                eq(new S32(UID_RED)), eq(new U8((short) SET_FOREGROUND)));
+        verify(mUidOwnerMap).updateEntry(eq(new S32(UID_RED)),
+                eq(new UidOwnerValue(0, 0, (short) SET_FOREGROUND)));
         mService.incrementOperationCount(UID_RED, 0xFAAD, 6);
 
         forcePollAndWaitForIdle();
@@ -1424,8 +1486,8 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
                 .insertEntry(TEST_IFACE, UID_RED, SET_FOREGROUND, TAG_NONE, 32L, 2L, 32L, 2L, 0L)
                 .insertEntry(TEST_IFACE, UID_RED, SET_FOREGROUND, 0xFAAD, 1L, 1L, 1L, 1L, 0L));
         mService.noteUidForeground(UID_RED, true);
-        verify(mUidCounterSetMap).updateEntry(
-                eq(new S32(UID_RED)), eq(new U8((short) SET_FOREGROUND)));
+        verify(mUidOwnerMap).updateEntry(eq(new S32(UID_RED)),
+                eq(new UidOwnerValue(0, 0, (short) SET_FOREGROUND)));
         mService.incrementOperationCount(UID_RED, 0xFAAD, 1);
 
         forcePollAndWaitForIdle();
@@ -2042,11 +2104,11 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
                 .insertEntry(TEST_IFACE, UID_BLUE, SET_DEFAULT, TAG_NONE, 128L, 1L, 128L, 1L, 0L));
 
         mService.noteUidForeground(UID_RED, false);
-        verify(mUidCounterSetMap, never()).deleteEntry(any());
+        verify(mUidOwnerMap, never()).deleteEntry(any());
         mService.incrementOperationCount(UID_RED, 0xFAAD, 4);
         mService.noteUidForeground(UID_RED, true);
-        verify(mUidCounterSetMap).updateEntry(
-                eq(new S32(UID_RED)), eq(new U8((short) SET_FOREGROUND)));
+        verify(mUidOwnerMap).updateEntry(eq(new S32(UID_RED)),
+                eq(new UidOwnerValue(0, 0, (short) SET_FOREGROUND)));
         mService.incrementOperationCount(UID_RED, 0xFAAD, 6);
 
         forcePollAndWaitForIdle();
@@ -2662,13 +2724,13 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
 
         mAppUidStatsMap.insertEntry(new UidStatsMapKey(uid), new StatsMapValue(10, 10000, 6, 6000));
 
-        mUidCounterSetMap.insertEntry(new S32(uid), new U8((short) 1));
+        mUidOwnerMap.insertEntry(new S32(uid), new UidOwnerValue(0, 0, (short) 1));
 
         assertTrue(cookieTagMapContainsUid(uid));
         assertTrue(statsMapContainsUid(mStatsMapA, uid));
         assertTrue(statsMapContainsUid(mStatsMapB, uid));
         assertTrue(mAppUidStatsMap.containsKey(new UidStatsMapKey(uid)));
-        assertTrue(mUidCounterSetMap.containsKey(new S32(uid)));
+        assertTrue(mUidOwnerMap.containsKey(new S32(uid)));
     }
 
     @Test
@@ -2685,14 +2747,14 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
         assertFalse(statsMapContainsUid(mStatsMapA, UID_BLUE));
         assertFalse(statsMapContainsUid(mStatsMapB, UID_BLUE));
         assertFalse(mAppUidStatsMap.containsKey(new UidStatsMapKey(UID_BLUE)));
-        assertFalse(mUidCounterSetMap.containsKey(new S32(UID_BLUE)));
+        assertFalse(mUidOwnerMap.containsKey(new S32(UID_BLUE)));
 
         // assert that UID_RED related tag data is still in the maps.
         assertTrue(cookieTagMapContainsUid(UID_RED));
         assertTrue(statsMapContainsUid(mStatsMapA, UID_RED));
         assertTrue(statsMapContainsUid(mStatsMapB, UID_RED));
         assertTrue(mAppUidStatsMap.containsKey(new UidStatsMapKey(UID_RED)));
-        assertTrue(mUidCounterSetMap.containsKey(new S32(UID_RED)));
+        assertTrue(mUidOwnerMap.containsKey(new S32(UID_RED)));
     }
 
     private void assertDumpContains(final String dump, final String message) {
@@ -2753,7 +2815,7 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
         initBpfMapsWithTagData(UID_BLUE);
 
         final String dump = getDump();
-        assertDumpContains(dump, "mUidCounterSetMap: OK");
+        assertDumpContains(dump, "mUidOwnerMap: OK");
         assertDumpContains(dump, "uid=1002 set=1");
     }
 
@@ -2822,6 +2884,94 @@ public class NetworkStatsServiceTest extends NetworkStatsBaseTest {
         assertDumpContains(dump, pollReasonNameOf(POLL_REASON_RAT_CHANGED));
     }
 
+    @Test
+    public void testDrainStatsMapUnderPressure() {
+        final String pollCount = pollReasonNameOf(POLL_REASON_STATS_MAP_PRESSURE) + ": ";
+        mHandler.sendEmptyMessage(NetworkStatsService.MSG_CHECK_STATS_MAP_PRESSURE);
+        waitForIdle();
+        assertDumpContains(getDump(), pollCount + "0");
+
+        mShouldDrainStatsMap = true;
+        mHandler.sendEmptyMessage(NetworkStatsService.MSG_CHECK_STATS_MAP_PRESSURE);
+        waitForIdle();
+        assertDumpContains(getDump(), pollCount + "1");
+    }
+
+    @Test
+    public void testGetUidStatsBulkOnlyReadsCallerUid() {
+        mNativeUidStats.put(UID_RED, new long[] {100L, 1L, 200L, 2L});
+        mNativeUidStats.put(UID_BLUE, new long[] {300L, 3L, 400L, 4L});
+        mCallingUid = UID_RED;
+
+        final int[] uids = {UID_BLUE, UID_RED, UID_GREEN, UID_RED};
+        final long[] rxBytes = new long[4];
+        final long[] rxPackets = new long[4];
+        final long[] txBytes = new long[4];
+        final long[] txPackets = new long[4];
+        mService.getUidStatsBulk(uids, rxBytes, rxPackets, txBytes, txPackets);
+
+        assertArrayEquals(new long[] {UNSUPPORTED, 100L, UNSUPPORTED, 100L}, rxBytes);
+        assertArrayEquals(new long[] {UNSUPPORTED, 1L, UNSUPPORTED, 1L}, rxPackets);
+        assertArrayEquals(new long[] {UNSUPPORTED, 200L, UNSUPPORTED, 200L}, txBytes);
+        assertArrayEquals(new long[] {UNSUPPORTED, 2L, UNSUPPORTED, 2L}, txPackets);
+        assertEquals(1, mNativeUidStatsQueries.size());
+        assertArrayEquals(new int[] {UID_RED}, mNativeUidStatsQueries.get(0));
+
+        // Nothing is read at all if the caller asks only about other uids.
+        mNativeUidStatsQueries.clear();
+        mService.getUidStatsBulk(new int[] {UID_BLUE}, rxBytes, rxPackets, txBytes, txPackets);
+        assertEquals(UNSUPPORTED, rxBytes[0]);
+        assertEquals(UNSUPPORTED, txPackets[0]);
+        assertEquals(0, mNativeUidStatsQueries.size());
+    }
+
+    @Test
+    public void testGetUidStatsBulkSystemSeesAllUids() {
+        mNativeUidStats.put(UID_RED, new long[] {100L, 1L, 200L, 2L});
+        mNativeUidStats.put(UID_BLUE, new long[] {300L, 3L, 400L, 4L});
+        mCallingUid = Process.SYSTEM_UID;
+
+        final int[] uids = {UID_BLUE, UID_GREEN, UID_RED};
+        final long[] rxBytes = new long[3];
+        final long[] rxPackets = new long[3];
+        final long[] txBytes = new long[3];
+        final long[] txPackets = new long[3];
+        mService.getUidStatsBulk(uids, rxBytes, rxPackets, txBytes, txPackets);
+
+        assertArrayEquals(new long[] {300L, 0L, 100L}, rxBytes);
+        assertArrayEquals(new long[] {3L, 0L, 1L}, rxPackets);
+        assertArrayEquals(new long[] {400L, 0L, 200L}, txBytes);
+        assertArrayEquals(new long[] {4L, 0L, 2L}, txPackets);
+
+        assertThrows(IllegalArgumentException.class, () -> mService.getUidStatsBulk(uids,
+                rxBytes, rxPackets, txBytes, new long[2]));
+    }
+
+    @Test
+    public void testGetAllUidStats() {
+        mNativeUidStats.put(UID_RED, new long[] {100L, 1L, 200L, 2L});
+        mNativeUidStats.put(UID_BLUE, new long[] {300L, 3L, 400L, 4L});
+        final int[] uids = new int[1];
+        final long[] rxBytes = new long[1];
+        final long[] rxPackets = new long[1];
+        final long[] txBytes = new long[1];
+        final long[] txPackets = new long[1];
+
+        mCallingUid = UID_RED;
+        assertEquals(UNSUPPORTED,
+                mService.getAllUidStats(uids, rxBytes, rxPackets, txBytes, txPackets));
+        assertEquals(0, mNativeAllUidStatsReads);
+
+        // The system gets the total count even if the arrays only hold the first uids.
+        mCallingUid = Process.SYSTEM_UID;
+        assertEquals(2, mService.getAllUidStats(uids, rxBytes, rxPackets, txBytes, txPackets));
+        assertEquals(UID_RED, uids[0]);
+        assertEquals(100L, rxBytes[0]);
+        assertEquals(1L, rxPackets[0]);
+        assertEquals(200L, txBytes[0]);
+        assertEquals(2L, txPackets[0]);
+    }
+
     @Test
     public void testEnforcePackageNameMatchesUid() throws Exception {
         final String testMyPackageName = "test.package.myname";
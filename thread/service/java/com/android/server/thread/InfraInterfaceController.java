@@ -32,6 +32,10 @@ public class InfraInterfaceController {
      * Creates a socket on the infrastructure network interface for sending/receiving ICMPv6
      * Neighbor Discovery messages.
      *
+     * <p>A socket filter drops messages that didn't arrive with hop limit 255, have a non-zero
+     * code, or are Router Advertisements from a non link-local address, so that they don't wake up
+     * the Thread stack.
+     *
      * @param infraInterfaceName the infrastructure network interface name.
      * @return an ICMPv6 socket file descriptor on the Infrastructure network interface.
      * @throws IOException when fails to create the socket.
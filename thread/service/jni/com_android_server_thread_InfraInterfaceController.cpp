@@ -22,7 +22,9 @@
 #include <ifaddrs.h>
 #include <inttypes.h>
 #include <linux/if_arp.h>
+#include <linux/filter.h>
 #include <linux/ioctl.h>
+#include <linux/ipv6.h>
 #include <log/log.h>
 #include <net/if.h>
 #include <netdb.h>
@@ -36,6 +38,8 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <bpf/BpfClassic.h>
+
 #include "jni.h"
 #include "nativehelper/JNIHelp.h"
 #include "nativehelper/scoped_utf_chars.h"
@@ -59,6 +63,38 @@ com_android_server_thread_InfraInterfaceController_createIcmp6Socket(JNIEnv *env
     return -1;
   }
 
+  // Drop in the kernel what the Thread stack would drop anyway (RFC 4861 sections 6.1 and 7.1.2),
+  // so such packets don't wake it up: anything not sent with hop limit 255 has been routed, ND
+  // messages always have code 0, and Router Advertisements must come from a link-local address.
+  // Extension headers are not expected on ND messages and aren't parsed.
+  // Attached before anything else, so that no message is queued unfiltered once the socket is
+  // bound to the interface.
+  // clang-format off
+  struct sock_filter bpf_code[] = {
+      BPF_LOAD_IPV6_U8(hop_limit),
+      BPF2_REJECT_IF_NOT_EQUAL(255),
+      BPF_LOAD_IPV6_U8(nexthdr),
+      BPF2_REJECT_IF_NOT_EQUAL(IPPROTO_ICMPV6),
+      BPF_LOADX_CONSTANT_IPV6_HLEN,
+      BPF_LOAD_NETX_RELATIVE_ICMP_CODE,
+      BPF2_REJECT_IF_NOT_EQUAL(0),
+      BPF_LOAD_NETX_RELATIVE_ICMP_TYPE,
+      BPF_JUMP_IF_NOT_EQUAL(ND_ROUTER_ADVERT, 4),
+      BPF_LOAD_IPV6_BE16(saddr.s6_addr16[0]),
+      BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xffc0),
+      BPF2_REJECT_IF_NOT_EQUAL(0xfe80),
+      BPF_ACCEPT,
+  };
+  // clang-format on
+  struct sock_fprog bpf_prog = {sizeof(bpf_code) / sizeof(bpf_code[0]), bpf_code};
+
+  if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &bpf_prog, sizeof(bpf_prog)) != 0) {
+    jniThrowExceptionFmt(env, "java/io/IOException", "failed to setsockopt SO_ATTACH_FILTER (%s)",
+                         strerror(errno));
+    close(sock);
+    return -1;
+  }
+
   // Only accept Router Advertisements, Router Solicitations and Neighbor
   // Advertisements.
   ICMP6_FILTER_SETBLOCKALL(&filter);